@@ -6,6 +6,7 @@
 
 #include <avalanche/delegation.h>
 #include <avalanche/validation.h>
+#include <primitives/block.h>
 #include <random.h>
 #include <validation.h> // For ChainstateActive()
 
@@ -160,21 +161,54 @@ NodeId PeerManager::selectNode() {
     return NO_NODE;
 }
 
+void PeerManager::blockConnected(const CBlock &block) {
+    for (const CTransactionRef &tx : block.vtx) {
+        for (const CTxIn &txin : tx->vin) {
+            addPeerToRevalidate(txin.prevout);
+        }
+    }
+}
+
+void PeerManager::blockDisconnected(const CBlock &block) {
+    for (const CTransactionRef &tx : block.vtx) {
+        for (uint32_t i = 0; i < tx->vout.size(); i++) {
+            addPeerToRevalidate(COutPoint(tx->GetId(), i));
+        }
+    }
+}
+
+void PeerManager::addPeerToRevalidate(const COutPoint &utxo) {
+    auto it = utxos.find(utxo);
+    if (it != utxos.end()) {
+        peersToRevalidate.insert(it->second);
+    }
+}
+
 void PeerManager::updatedBlockTip() {
     std::vector<PeerId> invalidPeers;
 
     {
         LOCK(cs_main);
 
+        // The proofs were fully verified when the peers were created, and only
+        // their UTXOs can change with the tip.
         const CCoinsViewCache &coins = ::ChainstateActive().CoinsTip();
-        for (const auto &p : peers) {
+        for (const PeerId peerid : peersToRevalidate) {
+            auto it = peers.find(peerid);
+            if (it == peers.end()) {
+                // The peer was removed in the meantime.
+                continue;
+            }
+
             ProofValidationState state;
-            if (!p.proof.verify(state, coins)) {
-                invalidPeers.push_back(p.peerid);
+            if (!it->proof.verifyUTXOs(state, coins)) {
+                invalidPeers.push_back(peerid);
             }
         }
     }
 
+    peersToRevalidate.clear();
+
     for (const auto &pid : invalidPeers) {
         removePeer(pid);
     }
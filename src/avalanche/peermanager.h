@@ -20,8 +20,11 @@
 
 #include <chrono>
 #include <cstdint>
+#include <unordered_set>
 #include <vector>
 
+class CBlock;
+
 namespace avalanche {
 
 class Delegation;
@@ -103,6 +106,12 @@ class PeerManager {
 
     std::unordered_map<COutPoint, PeerId, SaltedOutpointHasher> utxos;
 
+    /**
+     * Peers whose proof has a stake which was spent by a connected block, or
+     * created by a disconnected block, since the last tip update.
+     */
+    std::unordered_set<PeerId> peersToRevalidate;
+
     using NodeSet = boost::multi_index_container<
         Node,
         boost::multi_index::indexed_by<
@@ -140,7 +149,15 @@ public:
     NodeId selectNode();
 
     /**
-     * Update the peer set when a nw block is connected.
+     * Track the peers whose proof may have been invalidated by a block being
+     * connected or disconnected.
+     */
+    void blockConnected(const CBlock &block);
+    void blockDisconnected(const CBlock &block);
+
+    /**
+     * Update the peer set when a nw block is connected. Only the peers tracked
+     * since the last update are checked.
      */
     void updatedBlockTip();
 
@@ -185,6 +202,7 @@ private:
     PeerSet::iterator fetchOrCreatePeer(const Proof &proof);
     bool addNodeToPeer(const PeerSet::iterator &it);
     bool removeNodeFromPeer(const PeerSet::iterator &it, uint32_t count = 1);
+    void addPeerToRevalidate(const COutPoint &utxo);
 };
 
 /**
@@ -20,11 +20,6 @@
 #include <chrono>
 #include <tuple>
 
-/**
- * Run the avalanche event loop every 10ms.
- */
-static constexpr std::chrono::milliseconds AVALANCHE_TIME_STEP{10};
-
 // Unfortunately, the lotusd codebase is full of global and we are kinda
 // forced into it here.
 std::unique_ptr<avalanche::Processor> g_avalanche;
@@ -149,6 +144,28 @@ class Processor::NotificationsHandler
 public:
     NotificationsHandler(Processor *p) : m_processor(p) {}
 
+    void transactionRemovedFromMempool(const CTransactionRef &tx) override {
+        m_processor->tx_vote_records.getWriteView()->erase(tx->GetId());
+    }
+
+    void blockConnected(const CBlock &block, int height) override {
+        {
+            // The transactions of the block left the mempool.
+            auto w = m_processor->tx_vote_records.getWriteView();
+            for (const CTransactionRef &tx : block.vtx) {
+                w->erase(tx->GetId());
+            }
+        }
+
+        LOCK(m_processor->cs_peerManager);
+        m_processor->peerManager->blockConnected(block);
+    }
+
+    void blockDisconnected(const CBlock &block, int height) override {
+        LOCK(m_processor->cs_peerManager);
+        m_processor->peerManager->blockDisconnected(block);
+    }
+
     void updatedBlockTip() override {
         LOCK(m_processor->cs_peerManager);
 
@@ -301,6 +318,35 @@ int Processor::getConfidence(const CBlockIndex *pindex) const {
     return it->second.getConfidence();
 }
 
+bool Processor::addTxToReconcile(const CTxMemPoolEntry &entry) {
+    // The transaction is in our mempool, so we start by accepting it.
+    return tx_vote_records.getWriteView()
+        ->insert({entry.GetTx().GetId(),
+                  CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()),
+                  entry.GetTime(), VoteRecord(true)})
+        .second;
+}
+
+bool Processor::isAccepted(const TxId &txid) const {
+    auto r = tx_vote_records.getReadView();
+    auto it = r->find(txid);
+    if (it == r.end()) {
+        return false;
+    }
+
+    return it->voteRecord.isAccepted();
+}
+
+int Processor::getConfidence(const TxId &txid) const {
+    auto r = tx_vote_records.getReadView();
+    auto it = r->find(txid);
+    if (it == r.end()) {
+        return -1;
+    }
+
+    return it->voteRecord.getConfidence();
+}
+
 namespace {
     /**
      * When using TCP, we need to sign all messages as the transport layer is
@@ -338,7 +384,8 @@ void Processor::sendResponse(CNode *pfrom, Response response) const {
 }
 
 bool Processor::registerVotes(NodeId nodeid, const Response &response,
-                              std::vector<BlockUpdate> &updates) {
+                              std::vector<BlockUpdate> &blockUpdates,
+                              std::vector<TxUpdate> &txUpdates) {
     {
         // Save the time at which we can query again.
         LOCK(cs_peerManager);
@@ -383,10 +430,17 @@ bool Processor::registerVotes(NodeId nodeid, const Response &response,
     }
 
     std::map<CBlockIndex *, Vote> responseIndex;
+    std::vector<Vote> txVotes;
 
     {
         LOCK(cs_main);
-        for (const auto &v : votes) {
+        for (size_t i = 0; i < size; i++) {
+            const Vote &v = votes[i];
+            if (invs[i].type == MSG_TX) {
+                txVotes.push_back(v);
+                continue;
+            }
+
             auto pindex = LookupBlockIndex(BlockHash(v.GetHash()));
             if (!pindex) {
                 // This should not happen, but just in case...
@@ -424,7 +478,7 @@ bool Processor::registerVotes(NodeId nodeid, const Response &response,
             if (!vr.hasFinalized()) {
                 // This item has note been finalized, so we have nothing more to
                 // do.
-                updates.emplace_back(
+                blockUpdates.emplace_back(
                     pindex, vr.isAccepted() ? BlockUpdate::Status::Accepted
                                             : BlockUpdate::Status::Rejected);
                 continue;
@@ -432,9 +486,45 @@ bool Processor::registerVotes(NodeId nodeid, const Response &response,
 
             // We just finalized a vote. If it is valid, then let the caller
             // know. Either way, remove the item from the map.
-            updates.emplace_back(pindex, vr.isAccepted()
-                                             ? BlockUpdate::Status::Finalized
-                                             : BlockUpdate::Status::Invalid);
+            blockUpdates.emplace_back(pindex,
+                                      vr.isAccepted()
+                                          ? BlockUpdate::Status::Finalized
+                                          : BlockUpdate::Status::Invalid);
+            w->erase(it);
+        }
+    }
+
+    if (txVotes.empty()) {
+        return true;
+    }
+
+    {
+        // Register votes on transactions.
+        auto w = tx_vote_records.getWriteView();
+        for (const Vote &v : txVotes) {
+            const TxId txid(v.GetHash());
+            auto it = w->find(txid);
+            if (it == w.end()) {
+                // We are not voting on that transaction anymore.
+                continue;
+            }
+
+            VoteRecord &vr = it->voteRecord;
+            if (!vr.registerVote(nodeid, v.GetError())) {
+                // This vote did not provide any extra information, move on.
+                continue;
+            }
+
+            if (!vr.hasFinalized()) {
+                txUpdates.emplace_back(txid, vr.isAccepted()
+                                                 ? TxUpdate::Status::Accepted
+                                                 : TxUpdate::Status::Rejected);
+                continue;
+            }
+
+            txUpdates.emplace_back(txid, vr.isAccepted()
+                                             ? TxUpdate::Status::Finalized
+                                             : TxUpdate::Status::Invalid);
             w->erase(it);
         }
     }
@@ -535,22 +625,41 @@ std::vector<CInv> Processor::getInvsForNextPoll(bool forPoll) {
         }
     }
 
-    auto r = vote_records.getReadView();
-    for (const std::pair<const CBlockIndex *const, VoteRecord> &p :
-         reverse_iterate(r)) {
-        // Check if we can run poll.
-        const bool shouldPoll =
-            forPoll ? p.second.registerPoll() : p.second.shouldPoll();
+    {
+        auto r = vote_records.getReadView();
+        for (const std::pair<const CBlockIndex *const, VoteRecord> &p :
+             reverse_iterate(r)) {
+            // Check if we can run poll.
+            const bool shouldPoll =
+                forPoll ? p.second.registerPoll() : p.second.shouldPoll();
+            if (!shouldPoll) {
+                continue;
+            }
+
+            // We don't have a decision, we need more votes.
+            invs.emplace_back(MSG_BLOCK, p.first->GetBlockHash());
+            if (invs.size() >= AVALANCHE_MAX_ELEMENT_POLL) {
+                // Make sure we do not produce more invs than specified by the
+                // protocol.
+                return invs;
+            }
+        }
+    }
+
+    // Fill the poll with the transactions of highest priority. The ones which
+    // are removed from the mempool are removed from tx_vote_records when we
+    // are notified of it, so there is no need to check them here.
+    auto r = tx_vote_records.getReadView();
+    for (const TxVoteItem &item : r->get<tx_poll_priority>()) {
+        const bool shouldPoll = forPoll ? item.voteRecord.registerPoll()
+                                        : item.voteRecord.shouldPoll();
         if (!shouldPoll) {
             continue;
         }
 
-        // We don't have a decision, we need more votes.
-        invs.emplace_back(MSG_BLOCK, p.first->GetBlockHash());
+        invs.emplace_back(MSG_TX, item.txid);
         if (invs.size() >= AVALANCHE_MAX_ELEMENT_POLL) {
-            // Make sure we do not produce more invs than specified by the
-            // protocol.
-            return invs;
+            break;
         }
     }
 
@@ -586,6 +695,15 @@ void Processor::clearTimedoutRequests() {
     // In flight request accounting.
     for (const auto &p : timedout_items) {
         const CInv &inv = p.first;
+        if (inv.type == MSG_TX) {
+            auto w = tx_vote_records.getWriteView();
+            auto it = w->find(TxId(inv.hash));
+            if (it != w.end()) {
+                it->voteRecord.clearInflightRequest(p.second);
+            }
+            continue;
+        }
+
         assert(inv.type == MSG_BLOCK);
 
         CBlockIndex *pindex;
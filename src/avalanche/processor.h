@@ -10,10 +10,13 @@
 #include <avalanche/protocol.h>
 #include <blockindexworkcomparator.h>
 #include <eventloop.h>
+#include <feerate.h>
 #include <interfaces/chain.h>
 #include <interfaces/handler.h>
 #include <key.h>
+#include <primitives/txid.h>
 #include <rwcollection.h>
+#include <txmempool.h> // For SaltedTxIdHasher
 
 #include <boost/multi_index/composite_key.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -24,6 +27,7 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -31,6 +35,7 @@ class ArgsManager;
 class Config;
 class CBlockIndex;
 class CScheduler;
+class CTxMemPoolEntry;
 class PeerManager;
 struct bilingual_str;
 
@@ -65,6 +70,11 @@ static constexpr std::chrono::milliseconds AVALANCHE_DEFAULT_QUERY_TIMEOUT{
  */
 static constexpr int AVALANCHE_MAX_INFLIGHT_POLL = 10;
 
+/**
+ * Run the avalanche event loop every 10ms.
+ */
+static constexpr std::chrono::milliseconds AVALANCHE_TIME_STEP{10};
+
 namespace avalanche {
 
 class Delegation;
@@ -189,6 +199,59 @@ public:
 using BlockVoteMap =
     std::map<const CBlockIndex *, VoteRecord, CBlockIndexWorkComparator>;
 
+class TxUpdate {
+public:
+    using Status = BlockUpdate::Status;
+
+private:
+    TxId txid;
+    Status status;
+
+public:
+    TxUpdate(const TxId &txidIn, Status statusIn)
+        : txid(txidIn), status(statusIn) {}
+
+    Status getStatus() const { return status; }
+    const TxId &getTxId() const { return txid; }
+};
+
+/**
+ * A transaction to run avalanche on, with the fee rate and the time at which
+ * it entered the mempool.
+ */
+struct TxVoteItem {
+    TxId txid;
+    CFeeRate feeRate;
+    std::chrono::seconds time;
+
+    /**
+     * We declare this as mutable so it can be modified in the multi_index.
+     * This is ok because we do not use this field to index in anyway.
+     */
+    mutable VoteRecord voteRecord;
+};
+
+struct tx_poll_priority {};
+
+using TxVoteSet = boost::multi_index_container<
+    TxVoteItem,
+    boost::multi_index::indexed_by<
+        // index by txid
+        boost::multi_index::hashed_unique<
+            boost::multi_index::member<TxVoteItem, TxId, &TxVoteItem::txid>,
+            SaltedTxIdHasher>,
+        // sorted by fee rate, highest first, then by time, oldest first
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<tx_poll_priority>,
+            boost::multi_index::composite_key<
+                TxVoteItem,
+                boost::multi_index::member<TxVoteItem, CFeeRate,
+                                           &TxVoteItem::feeRate>,
+                boost::multi_index::member<TxVoteItem, std::chrono::seconds,
+                                           &TxVoteItem::time>>,
+            boost::multi_index::composite_key_compare<
+                std::greater<CFeeRate>, std::less<std::chrono::seconds>>>>>;
+
 struct query_timeout {};
 
 namespace {
@@ -205,6 +268,12 @@ class Processor {
      */
     RWCollection<BlockVoteMap> vote_records;
 
+    /**
+     * Mempool transactions to run avalanche on. There can be many of them, so
+     * they are polled by priority.
+     */
+    RWCollection<TxVoteSet> tx_vote_records;
+
     /**
      * Keep track of peers and queries sent.
      */
@@ -284,10 +353,15 @@ public:
     bool isAccepted(const CBlockIndex *pindex) const;
     int getConfidence(const CBlockIndex *pindex) const;
 
+    bool addTxToReconcile(const CTxMemPoolEntry &entry);
+    bool isAccepted(const TxId &txid) const;
+    int getConfidence(const TxId &txid) const;
+
     // TDOD: Refactor the API to remove the dependency on avalanche/protocol.h
     void sendResponse(CNode *pfrom, Response response) const;
     bool registerVotes(NodeId nodeid, const Response &response,
-                       std::vector<BlockUpdate> &updates);
+                       std::vector<BlockUpdate> &blockUpdates,
+                       std::vector<TxUpdate> &txUpdates);
 
     bool addNode(NodeId nodeid, const Proof &proof,
                  const Delegation &delegation);
@@ -81,6 +81,11 @@ bool Proof::verify(ProofValidationState &state, const CCoinsView &view) const {
         return false;
     }
 
+    return verifyUTXOs(state, view);
+}
+
+bool Proof::verifyUTXOs(ProofValidationState &state,
+                        const CCoinsView &view) const {
     for (const SignedStake &ss : stakes) {
         const Stake &s = ss.getStake();
         const COutPoint &utxo = s.getUTXO();
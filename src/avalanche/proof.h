@@ -106,6 +106,13 @@ public:
 
     bool verify(ProofValidationState &state) const;
     bool verify(ProofValidationState &state, const CCoinsView &view) const;
+    /**
+     * Verify that the stakes are in the UTXO set. Unlike verify(), this
+     * doesn't check the signatures of the stakes, which don't depend on the
+     * UTXO set, so it is used to check again a proof which was already
+     * verified.
+     */
+    bool verifyUTXOs(ProofValidationState &state, const CCoinsView &view) const;
 };
 
 } // namespace avalanche
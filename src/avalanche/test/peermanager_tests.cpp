@@ -6,6 +6,7 @@
 #include <avalanche/peermanager.h>
 #include <avalanche/proofbuilder.h>
 #include <avalanche/test/util.h>
+#include <primitives/block.h>
 #include <script/standard.h>
 #include <validation.h>
 
@@ -438,4 +439,86 @@ BOOST_AUTO_TEST_CASE(proof_conflict) {
                       NO_PEER);
 }
 
+BOOST_AUTO_TEST_CASE(updated_block_tip) {
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script = GetScriptForDestination(PKHash(key.GetPubKey()));
+
+    const Amount v = 500 * COIN;
+    const int height = 1234;
+
+    // The stakes are the outputs of a transaction.
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(TxId(GetRandHash()), 0));
+    mtx.vout.resize(4, CTxOut(v, script));
+    const CTransactionRef tx = MakeTransactionRef(mtx);
+
+    {
+        LOCK(cs_main);
+        AddCoins(::ChainstateActive().CoinsTip(), *tx, height);
+    }
+
+    avalanche::PeerManager pm;
+    std::vector<PeerId> peerids;
+    for (uint32_t i = 0; i < tx->vout.size(); i++) {
+        ProofBuilder pb(0, 0, CPubKey());
+        pb.addUTXO(COutPoint(tx->GetId(), i), v, height, false, key);
+        peerids.push_back(pm.getPeerId(pb.build()));
+        BOOST_CHECK(peerids.back() != NO_PEER);
+    }
+
+    const auto hasPeer = [&](PeerId peerid) {
+        for (const Peer &p : pm.getPeers()) {
+            if (p.peerid == peerid) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    const auto spendCoin = [&](uint32_t i) {
+        LOCK(cs_main);
+        ::ChainstateActive().CoinsTip().SpendCoin(COutPoint(tx->GetId(), i));
+    };
+
+    const auto buildBlockSpending = [&](uint32_t i) {
+        CMutableTransaction spend;
+        spend.vin.emplace_back(COutPoint(TxId(GetRandHash()), 0));
+        spend.vin.emplace_back(COutPoint(tx->GetId(), i));
+        CBlock block;
+        block.vtx.push_back(MakeTransactionRef(spend));
+        return block;
+    };
+
+    // Spending a stake in a block removes its peer.
+    spendCoin(0);
+    pm.blockConnected(buildBlockSpending(0));
+    pm.updatedBlockTip();
+    BOOST_CHECK(!hasPeer(peerids[0]));
+    BOOST_CHECK(hasPeer(peerids[1]));
+
+    // Only the peers whose stakes are spent by the blocks connected since the
+    // last update are checked.
+    spendCoin(1);
+    pm.blockConnected(buildBlockSpending(2));
+    pm.updatedBlockTip();
+    BOOST_CHECK(hasPeer(peerids[1]));
+    BOOST_CHECK(hasPeer(peerids[2]));
+    pm.blockConnected(buildBlockSpending(1));
+    pm.updatedBlockTip();
+    BOOST_CHECK(!hasPeer(peerids[1]));
+    BOOST_CHECK(hasPeer(peerids[2]));
+
+    // Disconnecting the block which created a stake removes its peer, unless
+    // the stake is still in the UTXO set.
+    spendCoin(2);
+    CBlock block;
+    block.vtx.push_back(tx);
+    pm.blockDisconnected(block);
+    pm.updatedBlockTip();
+    BOOST_CHECK(!hasPeer(peerids[2]));
+    BOOST_CHECK(hasPeer(peerids[3]));
+    BOOST_CHECK(pm.verify());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
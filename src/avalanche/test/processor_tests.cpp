@@ -10,11 +10,14 @@
 #include <chain.h>
 #include <config.h>
 #include <net_processing.h> // For ::PeerManager
+#include <script/script.h>
+#include <txmempool.h>
 #include <util/time.h>
 #include <util/translation.h> // For bilingual_str
 // D6970 moved LookupBlockIndex from chain.h to validation.h TODO: remove this
 // when LookupBlockIndex is refactored out of validation
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -163,6 +166,13 @@ struct AvalancheTestingSetup : public TestChain100Setup {
     }
 
     uint64_t getRound() const { return AvalancheTest::getRound(*m_processor); }
+
+    std::vector<TxUpdate> txUpdates;
+    bool registerVotes(NodeId nodeid, const Response &response,
+                       std::vector<BlockUpdate> &blockUpdates) {
+        return m_processor->registerVotes(nodeid, response, blockUpdates,
+                                          txUpdates);
+    }
 };
 } // namespace
 
@@ -331,7 +341,7 @@ BOOST_AUTO_TEST_CASE(block_register) {
     auto registerNewVote = [&](const Response &resp) {
         runEventLoop();
         auto nodeid = avanodes[nextNodeIndex++ % avanodes.size()]->GetId();
-        BOOST_CHECK(m_processor->registerVotes(nodeid, resp, updates));
+        BOOST_CHECK(registerVotes(nodeid, resp, updates));
     };
 
     // Let's vote for this block a few times.
@@ -490,8 +500,8 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
 
     uint64_t round = getRound();
     runEventLoop();
-    BOOST_CHECK(m_processor->registerVotes(
-        avanodes[0]->GetId(), {round, 0, {Vote(0, blockHashA)}}, updates));
+    BOOST_CHECK(registerVotes(avanodes[0]->GetId(),
+                              {round, 0, {Vote(0, blockHashA)}}, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Start voting on block B after one vote.
@@ -510,7 +520,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     for (int i = 0; i < 4; i++) {
         NodeId nodeid = getSuitableNodeToQuery();
         runEventLoop();
-        BOOST_CHECK(m_processor->registerVotes(nodeid, next(resp), updates));
+        BOOST_CHECK(registerVotes(nodeid, next(resp), updates));
         BOOST_CHECK_EQUAL(updates.size(), 0);
     }
 
@@ -518,7 +528,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     for (int i = 0; i < AVALANCHE_FINALIZATION_SCORE; i++) {
         NodeId nodeid = getSuitableNodeToQuery();
         runEventLoop();
-        BOOST_CHECK(m_processor->registerVotes(nodeid, next(resp), updates));
+        BOOST_CHECK(registerVotes(nodeid, next(resp), updates));
         BOOST_CHECK_EQUAL(updates.size(), 0);
     }
 
@@ -532,7 +542,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     BOOST_CHECK(firstNodeid != secondNodeid);
 
     // Next vote will finalize block A.
-    BOOST_CHECK(m_processor->registerVotes(firstNodeid, next(resp), updates));
+    BOOST_CHECK(registerVotes(firstNodeid, next(resp), updates));
     BOOST_CHECK_EQUAL(updates.size(), 1);
     BOOST_CHECK(updates[0].getBlockIndex() == pindexA);
     BOOST_CHECK_EQUAL(updates[0].getStatus(), BlockUpdate::Status::Finalized);
@@ -545,7 +555,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     BOOST_CHECK(invs[0].hash == blockHashB);
 
     // Next vote will finalize block B.
-    BOOST_CHECK(m_processor->registerVotes(secondNodeid, resp, updates));
+    BOOST_CHECK(registerVotes(secondNodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 1);
     BOOST_CHECK(updates[0].getBlockIndex() == pindexB);
     BOOST_CHECK_EQUAL(updates[0].getStatus(), BlockUpdate::Status::Finalized);
@@ -595,7 +605,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
 
     // Respond to the request.
     Response resp = {round, 0, {Vote(0, blockHash)}};
-    BOOST_CHECK(m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Now that avanode fullfilled his request, it is added back to the list of
@@ -603,7 +613,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
     // Sending a response when not polled fails.
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, next(resp), updates));
+    BOOST_CHECK(!registerVotes(avanodeid, next(resp), updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Trigger a poll on avanode.
@@ -615,21 +625,21 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     // 1. Too many results.
     resp = {round, 0, {Vote(0, blockHash), Vote(0, blockHash)}};
     runEventLoop();
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
     // 2. Not enough results.
     resp = {getRound(), 0, {}};
     runEventLoop();
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
     // 3. Do not match the poll.
     resp = {getRound(), 0, {Vote()}};
     runEventLoop();
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
@@ -638,22 +648,22 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     runEventLoop();
 
     resp = {queryRound + 1, 0, {Vote()}};
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     resp = {queryRound - 1, 0, {Vote()}};
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // 5. Making request for invalid nodes do not work. Request is not
     // discarded.
     resp = {queryRound, 0, {Vote(0, blockHash)}};
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid + 1234, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid + 1234, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Proper response gets processed and avanode is available again.
     resp = {queryRound, 0, {Vote(0, blockHash)}};
-    BOOST_CHECK(m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
@@ -669,14 +679,14 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
 
     resp = {getRound(), 0, {Vote(0, blockHash), Vote(0, blockHash2)}};
     runEventLoop();
-    BOOST_CHECK(!m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
     // But they are accepted in order.
     resp = {getRound(), 0, {Vote(0, blockHash2), Vote(0, blockHash)}};
     runEventLoop();
-    BOOST_CHECK(m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 
@@ -684,7 +694,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     pindex2->nStatus = pindex2->nStatus.withFailed();
     resp = {getRound(), 0, {Vote(0, blockHash)}};
     runEventLoop();
-    BOOST_CHECK(m_processor->registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(registerVotes(avanodeid, resp, updates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(getSuitableNodeToQuery(), avanodeid);
 }
@@ -721,7 +731,7 @@ BOOST_AUTO_TEST_CASE(poll_inflight_timeout, *boost::unit_test::timeout(60)) {
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
         runEventLoop();
 
-        bool ret = m_processor->registerVotes(avanodeid, next(resp), updates);
+        bool ret = registerVotes(avanodeid, next(resp), updates);
         if (std::chrono::steady_clock::now() > start + queryTimeDuration) {
             // We waited for too long, bail. Because we can't know for sure when
             // previous steps ran, ret is not deterministic and we do not check
@@ -737,8 +747,7 @@ BOOST_AUTO_TEST_CASE(poll_inflight_timeout, *boost::unit_test::timeout(60)) {
         runEventLoop();
         std::this_thread::sleep_for(queryTimeDuration);
         runEventLoop();
-        BOOST_CHECK(
-            !m_processor->registerVotes(avanodeid, next(resp), updates));
+        BOOST_CHECK(!registerVotes(avanodeid, next(resp), updates));
     }
 }
 
@@ -790,7 +799,7 @@ BOOST_AUTO_TEST_CASE(poll_inflight_count) {
     // Send one response, now we can poll again.
     auto it = node_round_map.begin();
     Response resp = {it->second, 0, {Vote(0, blockHash)}};
-    BOOST_CHECK(m_processor->registerVotes(it->first, resp, updates));
+    BOOST_CHECK(registerVotes(it->first, resp, updates));
     node_round_map.erase(it);
 
     invs = getInvsForNextPoll();
@@ -826,8 +835,7 @@ BOOST_AUTO_TEST_CASE(quorum_diversity) {
     // Check that all nodes can vote.
     for (size_t i = 0; i < avanodes.size(); i++) {
         runEventLoop();
-        BOOST_CHECK(m_processor->registerVotes(avanodes[i]->GetId(), next(resp),
-                                               updates));
+        BOOST_CHECK(registerVotes(avanodes[i]->GetId(), next(resp), updates));
     }
 
     // Generate a query for every single node.
@@ -856,16 +864,165 @@ BOOST_AUTO_TEST_CASE(quorum_diversity) {
             continue;
         }
 
-        BOOST_CHECK(m_processor->registerVotes(
-            nodeid, {r, 0, {Vote(0, blockHash)}}, updates));
+        BOOST_CHECK(
+            registerVotes(nodeid, {r, 0, {Vote(0, blockHash)}}, updates));
         BOOST_CHECK_EQUAL(m_processor->getConfidence(pindex), confidence);
     }
 
-    BOOST_CHECK(m_processor->registerVotes(
-        firstNodeId, {round, 0, {Vote(0, blockHash)}}, updates));
+    BOOST_CHECK(
+        registerVotes(firstNodeId, {round, 0, {Vote(0, blockHash)}}, updates));
     BOOST_CHECK_EQUAL(m_processor->getConfidence(pindex), confidence + 1);
 }
 
+namespace {
+CTxMemPoolEntry BuildTxEntry(Amount fee, int64_t time) {
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(TxId(GetRandHash()), 0));
+    mtx.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+    return TestMemPoolEntryHelper().Fee(fee).Time(time).FromTx(mtx);
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(tx_register) {
+    std::vector<BlockUpdate> updates;
+
+    // Create nodes that supports avalanche.
+    auto avanodes = ConnectNodes();
+
+    const CTxMemPoolEntry entry = BuildTxEntry(1000 * SATOSHI, GetTime());
+    const TxId txid = entry.GetTx().GetId();
+
+    // Querying for random transaction returns false.
+    BOOST_CHECK(!m_processor->isAccepted(txid));
+    BOOST_CHECK_EQUAL(m_processor->getConfidence(txid), -1);
+
+    // Add a new transaction. Check it is added to the polls.
+    BOOST_CHECK(m_processor->addTxToReconcile(entry));
+    BOOST_CHECK(!m_processor->addTxToReconcile(entry));
+    auto invs = getInvsForNextPoll();
+    BOOST_CHECK_EQUAL(invs.size(), 1);
+    BOOST_CHECK_EQUAL(invs[0].type, MSG_TX);
+    BOOST_CHECK(invs[0].hash == txid);
+
+    // Transactions from the mempool start accepted.
+    BOOST_CHECK(m_processor->isAccepted(txid));
+    BOOST_CHECK_EQUAL(m_processor->getConfidence(txid), 0);
+
+    int nextNodeIndex = 0;
+    auto registerNewVote = [&](const Response &resp) {
+        runEventLoop();
+        auto nodeid = avanodes[nextNodeIndex++ % avanodes.size()]->GetId();
+        BOOST_CHECK(registerVotes(nodeid, resp, updates));
+        BOOST_CHECK_EQUAL(updates.size(), 0);
+    };
+
+    // Vote for this transaction until it is about to be finalized.
+    Response resp{getRound(), 0, {Vote(0, txid)}};
+    for (int i = 0; i < AVALANCHE_FINALIZATION_SCORE + 5; i++) {
+        registerNewVote(next(resp));
+        BOOST_CHECK(m_processor->isAccepted(txid));
+        BOOST_CHECK_EQUAL(txUpdates.size(), 0);
+    }
+    BOOST_CHECK_EQUAL(m_processor->getConfidence(txid),
+                      AVALANCHE_FINALIZATION_SCORE - 1);
+
+    // Now finalize the decision.
+    registerNewVote(next(resp));
+    BOOST_CHECK_EQUAL(txUpdates.size(), 1);
+    BOOST_CHECK(txUpdates[0].getTxId() == txid);
+    BOOST_CHECK_EQUAL(txUpdates[0].getStatus(), TxUpdate::Status::Finalized);
+    txUpdates = {};
+
+    // Once the decision is finalized, there is no poll for it.
+    BOOST_CHECK_EQUAL(getInvsForNextPoll().size(), 0);
+    BOOST_CHECK_EQUAL(m_processor->getConfidence(txid), -1);
+
+    // Now let's undo this and finalize rejection.
+    BOOST_CHECK(m_processor->addTxToReconcile(entry));
+    resp = {getRound(), 0, {Vote(1, txid)}};
+    for (int i = 0; i < 6; i++) {
+        registerNewVote(next(resp));
+        BOOST_CHECK(m_processor->isAccepted(txid));
+        BOOST_CHECK_EQUAL(txUpdates.size(), 0);
+    }
+
+    // Now the state will flip.
+    registerNewVote(next(resp));
+    BOOST_CHECK(!m_processor->isAccepted(txid));
+    BOOST_CHECK_EQUAL(txUpdates.size(), 1);
+    BOOST_CHECK(txUpdates[0].getTxId() == txid);
+    BOOST_CHECK_EQUAL(txUpdates[0].getStatus(), TxUpdate::Status::Rejected);
+    txUpdates = {};
+
+    for (int i = 1; i < AVALANCHE_FINALIZATION_SCORE; i++) {
+        registerNewVote(next(resp));
+        BOOST_CHECK(!m_processor->isAccepted(txid));
+        BOOST_CHECK_EQUAL(txUpdates.size(), 0);
+    }
+
+    registerNewVote(next(resp));
+    BOOST_CHECK_EQUAL(txUpdates.size(), 1);
+    BOOST_CHECK(txUpdates[0].getTxId() == txid);
+    BOOST_CHECK_EQUAL(txUpdates[0].getStatus(), TxUpdate::Status::Invalid);
+    txUpdates = {};
+    BOOST_CHECK_EQUAL(getInvsForNextPoll().size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(tx_poll_priority) {
+    const int64_t now = GetTime();
+
+    // Transactions are polled by fee rate, then by age.
+    const CTxMemPoolEntry low = BuildTxEntry(100 * SATOSHI, now);
+    const CTxMemPoolEntry high = BuildTxEntry(10000 * SATOSHI, now);
+    const CTxMemPoolEntry mid_new = BuildTxEntry(1000 * SATOSHI, now);
+    const CTxMemPoolEntry mid_old = BuildTxEntry(1000 * SATOSHI, now - 60);
+    for (const CTxMemPoolEntry *entry : {&low, &high, &mid_new, &mid_old}) {
+        BOOST_CHECK(m_processor->addTxToReconcile(*entry));
+    }
+
+    // Blocks are polled first.
+    CBlock block = CreateAndProcessBlock({}, CScript());
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(block.GetHash());
+    }
+    BOOST_CHECK(m_processor->addBlockToReconcile(pindex));
+
+    auto invs = getInvsForNextPoll();
+    BOOST_CHECK_EQUAL(invs.size(), 5);
+    BOOST_CHECK_EQUAL(invs[0].type, MSG_BLOCK);
+    BOOST_CHECK(invs[0].hash == block.GetHash());
+    const std::vector<const CTxMemPoolEntry *> expected{&high, &mid_old,
+                                                        &mid_new, &low};
+    for (size_t i = 0; i < expected.size(); i++) {
+        BOOST_CHECK_EQUAL(invs[i + 1].type, MSG_TX);
+        BOOST_CHECK(invs[i + 1].hash == expected[i]->GetTx().GetId());
+    }
+
+    // The polls are limited in size, the transactions of lowest priority are
+    // left out.
+    for (size_t i = 0; i < AVALANCHE_MAX_ELEMENT_POLL; i++) {
+        BOOST_CHECK(m_processor->addTxToReconcile(
+            BuildTxEntry(2000 * SATOSHI, now)));
+    }
+    invs = getInvsForNextPoll();
+    BOOST_CHECK_EQUAL(invs.size(), AVALANCHE_MAX_ELEMENT_POLL);
+    BOOST_CHECK(invs[1].hash == high.GetTx().GetId());
+    for (const CInv &inv : invs) {
+        BOOST_CHECK(inv.hash != mid_old.GetTx().GetId());
+    }
+
+    // Transactions which leave the mempool are not polled anymore.
+    GetMainSignals().TransactionRemovedFromMempool(high.GetSharedTx());
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(m_processor->getConfidence(high.GetTx().GetId()), -1);
+    invs = getInvsForNextPoll();
+    for (const CInv &inv : invs) {
+        BOOST_CHECK(inv.hash != high.GetTx().GetId());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(event_loop) {
     CScheduler s;
 
@@ -920,8 +1077,7 @@ BOOST_AUTO_TEST_CASE(event_loop) {
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
 
     std::vector<BlockUpdate> updates;
-    m_processor->registerVotes(nodeid, {queryRound, 100, {Vote(0, blockHash)}},
-                               updates);
+    registerVotes(nodeid, {queryRound, 100, {Vote(0, blockHash)}}, updates);
     for (int i = 0; i < 10000; i++) {
         // We make sure that we do not get a request before queryTime.
         UninterruptibleSleep(std::chrono::milliseconds(1));
@@ -72,6 +72,7 @@ void BanMan::ClearBanned() {
         LOCK(m_cs_banned);
         m_discouraged.reset();
         m_banned.clear();
+        m_banned_index.Clear();
         m_is_dirty = true;
     }
     // store banlist to disk
@@ -89,15 +90,7 @@ bool BanMan::IsDiscouraged(const CNetAddr &net_addr) {
 bool BanMan::IsBanned(const CNetAddr &net_addr) {
     auto current_time = GetTime();
     LOCK(m_cs_banned);
-    for (const auto &it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
-
-        if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
-            return true;
-        }
-    }
-    return false;
+    return m_banned_index.Match(net_addr, current_time);
 }
 
 bool BanMan::IsBanned(const CSubNet &sub_net) {
@@ -141,6 +134,7 @@ void BanMan::Ban(const CSubNet &sub_net, int64_t ban_time_offset,
         LOCK(m_cs_banned);
         if (m_banned[sub_net].nBanUntil < ban_entry.nBanUntil) {
             m_banned[sub_net] = ban_entry;
+            m_banned_index.Insert(sub_net, ban_entry.nBanUntil);
             m_is_dirty = true;
         } else {
             return;
@@ -165,6 +159,7 @@ bool BanMan::Unban(const CSubNet &sub_net) {
         if (m_banned.erase(sub_net) == 0) {
             return false;
         }
+        m_banned_index.Erase(sub_net);
         m_is_dirty = true;
     }
     if (m_client_interface) {
@@ -187,6 +182,10 @@ void BanMan::GetBanned(banmap_t &banmap) {
 void BanMan::SetBanned(const banmap_t &banmap) {
     LOCK(m_cs_banned);
     m_banned = banmap;
+    m_banned_index.Clear();
+    for (const auto &it : m_banned) {
+        m_banned_index.Insert(it.first, it.second.nBanUntil);
+    }
     m_is_dirty = true;
 }
 
@@ -201,6 +200,7 @@ void BanMan::SweepBanned() {
             CBanEntry ban_entry = (*it).second;
             if (!sub_net.IsValid() || now > ban_entry.nBanUntil) {
                 m_banned.erase(it++);
+                m_banned_index.Erase(sub_net);
                 m_is_dirty = true;
                 notify_ui = true;
                 LogPrint(
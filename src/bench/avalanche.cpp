@@ -0,0 +1,87 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <avalanche/processor.h>
+#include <avalanche/protocol.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <interfaces/chain.h>
+#include <random.h>
+#include <script/script.h>
+#include <txmempool.h>
+#include <util/translation.h>
+
+#include <test/util/setup_common.h>
+
+#include <cassert>
+#include <vector>
+
+namespace avalanche {
+namespace {
+    struct AvalancheTest {
+        static std::vector<CInv> getInvsForNextPoll(Processor &p) {
+            return p.getInvsForNextPoll();
+        }
+
+        static void registerQuery(Processor &p, NodeId nodeid, uint64_t round,
+                                  std::vector<CInv> invs) {
+            p.queries.getWriteView()->insert(
+                {nodeid, round,
+                 std::chrono::steady_clock::now() + std::chrono::hours(1),
+                 std::move(invs)});
+        }
+    };
+} // namespace
+} // namespace avalanche
+
+using namespace avalanche;
+
+// Poll the transactions of a large mempool and register the votes, until they
+// are finalized.
+static void AvalancheTxVoting(benchmark::Bench &bench) {
+    TestingSetup test_setup{};
+    test_setup.m_node.chain =
+        interfaces::MakeChain(test_setup.m_node, Params());
+
+    bilingual_str error;
+    std::unique_ptr<Processor> processor =
+        Processor::MakeProcessor(*test_setup.m_node.args,
+                                 *test_setup.m_node.chain, nullptr, nullptr,
+                                 error);
+    assert(processor);
+
+    FastRandomContext rng(true);
+    for (size_t i = 0; i < 20000; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(TxId(rng.rand256()), 0));
+        mtx.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+        processor->addTxToReconcile(
+            TestMemPoolEntryHelper()
+                .Fee(int64_t(rng.randrange(10000)) * SATOSHI)
+                .Time(rng.randrange(600))
+                .FromTx(mtx));
+    }
+
+    NodeId nodeid = 0;
+    uint64_t round = 0;
+    std::vector<BlockUpdate> blockUpdates;
+    std::vector<TxUpdate> txUpdates;
+    bench.batch(AVALANCHE_MAX_ELEMENT_POLL).unit("vote").run([&] {
+        std::vector<CInv> invs = AvalancheTest::getInvsForNextPoll(*processor);
+        std::vector<Vote> votes;
+        for (const CInv &inv : invs) {
+            votes.emplace_back(0, inv.hash);
+        }
+
+        // Each vote comes from a different node, so it is counted.
+        AvalancheTest::registerQuery(*processor, nodeid, round,
+                                     std::move(invs));
+        processor->registerVotes(nodeid, Response(round, 0, std::move(votes)),
+                                 blockUpdates, txUpdates);
+        nodeid++;
+        round++;
+    });
+}
+
+BENCHMARK(AvalancheTxVoting);
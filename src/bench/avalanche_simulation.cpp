@@ -0,0 +1,437 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <avalanche/delegationbuilder.h>
+#include <avalanche/processor.h>
+#include <avalanche/proofbuilder.h>
+#include <avalanche/protocol.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <interfaces/chain.h>
+#include <key.h>
+#include <net.h>
+#include <random.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <util/translation.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace avalanche {
+namespace {
+    struct AvalancheTest {
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        static NodeId getSuitableNodeToQuery(Processor &p) {
+            return p.getSuitableNodeToQuery();
+        }
+
+        static std::vector<CInv> getInvsForNextPoll(Processor &p) {
+            return p.getInvsForNextPoll();
+        }
+
+        /**
+         * Register a query as if it was sent to nodeid, and returns its round.
+         * The simulator decides when it times out, so it never expires on its
+         * own.
+         */
+        static uint64_t registerQuery(Processor &p, NodeId nodeid,
+                                      std::vector<CInv> invs) {
+            const uint64_t round = p.round++;
+            p.queries.getWriteView()->insert(
+                {nodeid, round, TimePoint::max(), std::move(invs)});
+            setNodeAvailable(p, nodeid, false);
+            return round;
+        }
+
+        static void expireQuery(Processor &p, NodeId nodeid, uint64_t round) {
+            {
+                auto w = p.queries.getWriteView();
+                auto it = w->find(std::make_tuple(nodeid, round));
+                assert(it != w.end());
+                w->modify(it, [](auto &query) { query.timeout = TimePoint(); });
+            }
+            p.clearTimedoutRequests();
+        }
+
+        /**
+         * The processor uses the real clock for the time at which a node can
+         * be queried again, so the simulator keeps the node unavailable until
+         * it decides otherwise.
+         */
+        static void setNodeAvailable(Processor &p, NodeId nodeid,
+                                     bool available) {
+            LOCK(p.cs_peerManager);
+            p.peerManager->updateNextRequestTime(
+                nodeid, available ? TimePoint() : TimePoint::max());
+        }
+    };
+} // namespace
+} // namespace avalanche
+
+using namespace avalanche;
+
+namespace {
+
+struct SimulationConfig {
+    size_t nodes = 16;
+    size_t items = 200;
+    //! Time between the arrival of two items.
+    std::chrono::milliseconds itemInterval{10};
+    //! The stake of the i-th node is proportional to 1 / (i + 1)^stakeSkew,
+    //! so 0 means every node has the same stake.
+    double stakeSkew = 0;
+    //! One way latency of a message is latency + rand(jitter).
+    std::chrono::milliseconds latency{50};
+    std::chrono::milliseconds jitter{20};
+    //! Probability for each message to be lost.
+    double loss = 0;
+    std::chrono::milliseconds timeStep = AVALANCHE_TIME_STEP;
+    std::chrono::milliseconds queryTimeout = AVALANCHE_DEFAULT_QUERY_TIMEOUT;
+    std::chrono::milliseconds cooldown{AVALANCHE_DEFAULT_COOLDOWN};
+    //! Give up on the items which are not finalized after that time.
+    std::chrono::milliseconds maxDuration{2 * 60 * 1000};
+    uint64_t seed = 0;
+};
+
+struct SimulationResult {
+    //! Time from arrival to finalization of each item on each node, in ms.
+    std::vector<int64_t> latencies;
+    //! Number of polls for each item on each node, until it is finalized.
+    std::vector<uint32_t> polls;
+    //! Polls and responses sent over all the links.
+    uint64_t messages = 0;
+    uint64_t lostMessages = 0;
+    uint64_t timeouts = 0;
+    std::chrono::milliseconds duration{0};
+};
+
+/**
+ * Runs N avalanche processors polling each other over simulated links, in
+ * virtual time.
+ *
+ * Every processor is given the same mempool transactions, which all the nodes
+ * vote to accept, and the simulator measures how long each of them takes to
+ * finalize each transaction. Polls are taken from the processors the way
+ * their event loop does, once per time step, but the messages are delivered
+ * by the simulator, with the configured latency and loss, and it also decides
+ * when the queries time out and the queried nodes are available again.
+ */
+class Simulation {
+    const SimulationConfig config;
+    FastRandomContext rng;
+
+    std::vector<std::unique_ptr<Processor>> processors;
+    std::map<TxId, size_t> itemIndex;
+
+    //! Events to process, by virtual time in ms and insertion order.
+    std::map<std::pair<int64_t, uint64_t>, std::function<void()>> events;
+    uint64_t eventSequence = 0;
+    int64_t now = 0;
+
+    //! The queries in flight, by processor, queried node and round.
+    std::set<std::tuple<size_t, NodeId, uint64_t>> inflight;
+    //! Items finalized by each processor.
+    std::vector<std::vector<bool>> finalized;
+    std::vector<std::vector<uint32_t>> polls;
+    size_t remaining = 0;
+
+    SimulationResult result;
+
+    void schedule(int64_t delay, std::function<void()> event) {
+        events.emplace(std::make_pair(now + delay, eventSequence++),
+                       std::move(event));
+    }
+
+    //! Return the latency of a message, or -1 if it is lost.
+    int64_t getLatency() {
+        result.messages++;
+        if (config.loss > 0 && rng.randrange(1000000) < config.loss * 1000000) {
+            result.lostMessages++;
+            return -1;
+        }
+
+        int64_t latency = config.latency.count();
+        if (config.jitter.count() > 0) {
+            latency += rng.randrange(config.jitter.count() + 1);
+        }
+        return latency;
+    }
+
+    void setupNodes(const NodeContext &node) {
+        std::vector<Proof> proofs;
+        for (size_t i = 0; i < config.nodes; i++) {
+            CKey masterKey;
+            masterKey.MakeNewKey(true);
+            CKey key;
+            key.MakeNewKey(true);
+
+            const int64_t score = 10000 / std::pow(i + 1, config.stakeSkew);
+            const Amount amount = std::max<int64_t>(1, score) * COIN;
+            const COutPoint utxo(TxId(rng.rand256()), 0);
+            const int height = 1;
+            {
+                LOCK(cs_main);
+                ::ChainstateActive().CoinsTip().AddCoin(
+                    utxo,
+                    Coin(CTxOut(amount,
+                                GetScriptForDestination(
+                                    PKHash(key.GetPubKey()))),
+                         height, false),
+                    false);
+            }
+
+            ProofBuilder pb(0, std::numeric_limits<uint32_t>::max(),
+                            masterKey.GetPubKey());
+            pb.addUTXO(utxo, amount, height, false, std::move(key));
+            proofs.push_back(pb.build());
+
+            bilingual_str error;
+            processors.push_back(Processor::MakeProcessor(
+                *node.args, *node.chain, nullptr, nullptr, error));
+            assert(processors.back());
+        }
+
+        for (size_t i = 0; i < config.nodes; i++) {
+            for (size_t j = 0; j < config.nodes; j++) {
+                if (i == j) {
+                    continue;
+                }
+
+                bool added = processors[i]->addNode(
+                    j, proofs[j], DelegationBuilder(proofs[j]).build());
+                assert(added);
+            }
+        }
+    }
+
+    void tick(size_t i) {
+        if (remaining == 0 || now >= config.maxDuration.count()) {
+            return;
+        }
+        schedule(config.timeStep.count(), [this, i] { tick(i); });
+
+        Processor &processor = *processors[i];
+        const NodeId nodeid = AvalancheTest::getSuitableNodeToQuery(processor);
+        if (nodeid == NO_NODE) {
+            return;
+        }
+
+        std::vector<CInv> invs = AvalancheTest::getInvsForNextPoll(processor);
+        if (invs.empty()) {
+            return;
+        }
+
+        for (const CInv &inv : invs) {
+            polls[i][itemIndex.at(TxId(inv.hash))]++;
+        }
+
+        // All the nodes know the items and vote to accept them.
+        std::vector<Vote> votes;
+        for (const CInv &inv : invs) {
+            votes.emplace_back(0, inv.hash);
+        }
+
+        const uint64_t round =
+            AvalancheTest::registerQuery(processor, nodeid, std::move(invs));
+        inflight.emplace(i, nodeid, round);
+        schedule(config.queryTimeout.count(),
+                 [this, i, nodeid, round] { timeout(i, nodeid, round); });
+
+        const int64_t pollLatency = getLatency();
+        if (pollLatency < 0) {
+            return;
+        }
+
+        const int64_t responseLatency = getLatency();
+        if (responseLatency < 0) {
+            return;
+        }
+
+        Response response(round, config.cooldown.count(), std::move(votes));
+        schedule(pollLatency + responseLatency,
+                 [this, i, nodeid, response = std::move(response)] {
+                     receiveResponse(i, nodeid, response);
+                 });
+    }
+
+    void receiveResponse(size_t i, NodeId nodeid, const Response &response) {
+        // Responses arriving after the timeout are dropped by the network
+        // layer.
+        if (inflight.erase(std::make_tuple(i, nodeid, response.getRound())) ==
+            0) {
+            return;
+        }
+
+        std::vector<BlockUpdate> blockUpdates;
+        std::vector<TxUpdate> txUpdates;
+        bool registered =
+            processors[i]->registerVotes(nodeid, response, blockUpdates,
+                                         txUpdates);
+        assert(registered);
+        AvalancheTest::setNodeAvailable(*processors[i], nodeid, false);
+        schedule(config.cooldown.count(), [this, i, nodeid] {
+            AvalancheTest::setNodeAvailable(*processors[i], nodeid, true);
+        });
+
+        for (const TxUpdate &update : txUpdates) {
+            assert(update.getStatus() != TxUpdate::Status::Invalid &&
+                   update.getStatus() != TxUpdate::Status::Rejected);
+            if (update.getStatus() != TxUpdate::Status::Finalized) {
+                continue;
+            }
+
+            const size_t item = itemIndex.at(update.getTxId());
+            assert(!finalized[i][item]);
+            finalized[i][item] = true;
+            remaining--;
+            result.duration = std::chrono::milliseconds(now);
+            result.latencies.push_back(now -
+                                       item * config.itemInterval.count());
+            result.polls.push_back(polls[i][item]);
+        }
+    }
+
+    void timeout(size_t i, NodeId nodeid, uint64_t round) {
+        if (inflight.erase(std::make_tuple(i, nodeid, round)) == 0) {
+            return;
+        }
+
+        result.timeouts++;
+        AvalancheTest::expireQuery(*processors[i], nodeid, round);
+        AvalancheTest::setNodeAvailable(*processors[i], nodeid, true);
+    }
+
+public:
+    Simulation(const NodeContext &node, const SimulationConfig &configIn)
+        : config(configIn),
+          rng(ArithToUint256(arith_uint256(configIn.seed))) {
+        setupNodes(node);
+
+        finalized.assign(config.nodes, std::vector<bool>(config.items));
+        polls.assign(config.nodes, std::vector<uint32_t>(config.items));
+        remaining = config.nodes * config.items;
+
+        for (size_t k = 0; k < config.items; k++) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(COutPoint(TxId(rng.rand256()), 0));
+            mtx.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+            const CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+            itemIndex.emplace(tx->GetId(), k);
+
+            // Items arriving later have a lower priority, so they are polled
+            // after the older ones.
+            const CTxMemPoolEntry entry = TestMemPoolEntryHelper()
+                                              .Fee(1000 * SATOSHI)
+                                              .Time(config.items - k)
+                                              .FromTx(tx);
+            schedule(k * config.itemInterval.count(),
+                     [this, entry] {
+                         for (auto &processor : processors) {
+                             processor->addTxToReconcile(entry);
+                         }
+                     });
+        }
+
+        // Start the event loops at different times, as on a real network.
+        for (size_t i = 0; i < config.nodes; i++) {
+            now = rng.randrange(config.timeStep.count());
+            schedule(0, [this, i] { tick(i); });
+        }
+        now = 0;
+    }
+
+    SimulationResult run() {
+        while (!events.empty()) {
+            auto it = events.begin();
+            now = it->first.first;
+            std::function<void()> event = std::move(it->second);
+            events.erase(it);
+            event();
+        }
+
+        return result;
+    }
+};
+
+template <typename T> T Percentile(std::vector<T> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min<size_t>(values.size() - 1, p * values.size())];
+}
+
+void RunSimulation(benchmark::Bench &bench, const SimulationConfig &config) {
+    TestingSetup test_setup{};
+    test_setup.m_node.chain =
+        interfaces::MakeChain(test_setup.m_node, Params());
+
+    SimulationResult result;
+    bench.epochs(1).epochIterations(1).run([&] {
+        result = Simulation(test_setup.m_node, config).run();
+    });
+
+    const size_t finalized = result.latencies.size();
+    const size_t expected = config.nodes * config.items;
+    tfm::format(std::cout,
+                "%s: %d nodes, %d items, finalized %d/%d after %dms of "
+                "simulated time\n",
+                bench.name(), config.nodes, config.items, finalized, expected,
+                result.duration.count());
+    tfm::format(std::cout,
+                "  finalization latency p50 %dms, p90 %dms, p99 %dms, max "
+                "%dms\n",
+                Percentile(result.latencies, 0.5),
+                Percentile(result.latencies, 0.9),
+                Percentile(result.latencies, 0.99),
+                Percentile(result.latencies, 1));
+    tfm::format(std::cout, "  polls per item p50 %d, p90 %d, p99 %d\n",
+                Percentile(result.polls, 0.5), Percentile(result.polls, 0.9),
+                Percentile(result.polls, 0.99));
+    tfm::format(std::cout,
+                "  %.1f messages per finalized item, %d lost, %d timeouts\n",
+                finalized ? double(result.messages) / finalized : 0.,
+                result.lostMessages, result.timeouts);
+}
+
+} // namespace
+
+static void AvalancheSimulation(benchmark::Bench &bench) {
+    RunSimulation(bench, SimulationConfig());
+}
+
+static void AvalancheSimulationSkewedStake(benchmark::Bench &bench) {
+    SimulationConfig config;
+    config.stakeSkew = 1;
+    RunSimulation(bench, config);
+}
+
+static void AvalancheSimulationLossy(benchmark::Bench &bench) {
+    SimulationConfig config;
+    config.loss = 0.05;
+    config.latency = std::chrono::milliseconds{150};
+    config.jitter = std::chrono::milliseconds{100};
+    RunSimulation(bench, config);
+}
+
+BENCHMARK(AvalancheSimulation);
+BENCHMARK(AvalancheSimulationSkewedStake);
+BENCHMARK(AvalancheSimulationLossy);
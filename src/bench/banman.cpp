@@ -0,0 +1,53 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrdb.h>
+#include <banman.h>
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <netaddress.h>
+#include <random.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <test/util/setup_common.h>
+
+#include <vector>
+
+static CNetAddr RandomIPv4(FastRandomContext &rng) {
+    in_addr addr;
+    addr.s_addr = rng.rand32();
+    return CNetAddr(addr);
+}
+
+// Check addresses against a ban list of 100k subnets, as loaded from an abuse
+// feed: mostly single addresses, and some /24 and /16 subnets.
+static void BanManIsBanned(benchmark::Bench &bench) {
+    BasicTestingSetup test_setup{};
+    FastRandomContext rng(true);
+
+    banmap_t banmap;
+    CBanEntry ban_entry(GetTime());
+    ban_entry.nBanUntil = GetTime() + 24 * 60 * 60;
+    for (size_t i = 0; i < 100000; i++) {
+        const uint64_t kind = rng.randrange(10);
+        const uint8_t prefix_len = kind == 0 ? 16 : kind < 3 ? 24 : 32;
+        banmap[CSubNet(RandomIPv4(rng), prefix_len)] = ban_entry;
+    }
+    const fs::path ban_file = GetDataDir() / "banlist.dat";
+    CBanDB(ban_file, Params()).Write(banmap);
+    BanMan banman(ban_file, Params(), nullptr, DEFAULT_MISBEHAVING_BANTIME);
+
+    std::vector<CNetAddr> addrs;
+    for (size_t i = 0; i < 1000; i++) {
+        addrs.push_back(RandomIPv4(rng));
+    }
+    bench.batch(addrs.size()).unit("addr").minEpochIterations(10).run([&] {
+        for (const CNetAddr &addr : addrs) {
+            banman.IsBanned(addr);
+        }
+    });
+}
+
+BENCHMARK(BanManIsBanned);
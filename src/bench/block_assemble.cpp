@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <miner.h>
 #include <script/standard.h>
 #include <test/util/mining.h>
 #include <test/util/setup_common.h>
@@ -14,6 +15,14 @@
 
 #include <vector>
 
+// The miner reward is the second output of the coinbase, the first one being
+// unspendable.
+static CTxIn MinerReward(const Config &config, const TestingSetup &test_setup,
+                         const CScript &scriptPubKey) {
+    const CTxIn coinbase = MineBlock(config, test_setup.m_node, scriptPubKey);
+    return CTxIn(COutPoint(coinbase.prevout.GetTxId(), 1));
+}
+
 static void AssembleBlock(benchmark::Bench &bench) {
     const Config &config = GetConfig();
     TestingSetup test_setup{
@@ -39,7 +48,7 @@ static void AssembleBlock(benchmark::Bench &bench) {
     std::array<CTransactionRef, NUM_BLOCKS - COINBASE_MATURITY + 1> txs;
     for (size_t b = 0; b < NUM_BLOCKS; ++b) {
         CMutableTransaction tx;
-        tx.vin.push_back(MineBlock(config, test_setup.m_node, SCRIPT_PUB));
+        tx.vin.push_back(MinerReward(config, test_setup, SCRIPT_PUB));
         tx.vin.back().scriptSig = scriptSig;
         tx.vout.emplace_back(1337 * SATOSHI, SCRIPT_PUB);
         if (NUM_BLOCKS - b >= COINBASE_MATURITY) {
@@ -64,4 +73,111 @@ static void AssembleBlock(benchmark::Bench &bench) {
     bench.run([&] { PrepareBlock(config, test_setup.m_node, SCRIPT_PUB); });
 }
 
+
+// Fill the mempool with numTxs transactions, then measure how long it takes to
+// produce a new block template each time a transaction enters the mempool,
+// either from scratch or by updating the previous selection.
+static void AssembleBlockTemplate(benchmark::Bench &bench, size_t numTxs,
+                                  bool incremental) {
+    const Config &config = GetConfig();
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */
+        {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+    CTxMemPool &mempool = *test_setup.m_node.mempool;
+
+    const CScript redeemScript = CScript() << OP_DROP << OP_TRUE;
+    const CScript SCRIPT_PUB =
+        CScript() << OP_HASH160 << ToByteVector(CScriptID(redeemScript))
+                  << OP_EQUAL;
+    const CScript scriptSig = CScript() << std::vector<uint8_t>(100, 0xff)
+                                        << ToByteVector(redeemScript);
+
+    const auto accept = [&](const CTransactionRef &tx) {
+        // Required for ::AcceptToMemoryPool.
+        LOCK(::cs_main);
+        TxValidationState vstate;
+        bool ret{::AcceptToMemoryPool(config, mempool, vstate, tx,
+                                      false /* bypass_limits */,
+                                      /* nAbsurdFee */ Amount::zero())};
+        assert(ret);
+    };
+
+    // Split mature coinbases into enough outputs for the mempool, plus one
+    // transaction per iteration.
+    bench.epochs(5).epochIterations(20);
+    const size_t numNewTxs = bench.epochs() * bench.epochIterations();
+    constexpr size_t OUTPUTS_PER_TX{500};
+    const size_t numFanouts = (numTxs + numNewTxs) / OUTPUTS_PER_TX + 1;
+
+    std::vector<CTxIn> rewards;
+    for (size_t b = 0; b < COINBASE_MATURITY + numFanouts; ++b) {
+        rewards.push_back(MinerReward(config, test_setup, SCRIPT_PUB));
+    }
+
+    std::vector<CTxIn> coins;
+    for (size_t f = 0; f < numFanouts; ++f) {
+        CMutableTransaction tx;
+        tx.vin.push_back(rewards.at(f));
+        tx.vin.back().scriptSig = scriptSig;
+        tx.vout.resize(OUTPUTS_PER_TX, CTxOut(100000 * SATOSHI, SCRIPT_PUB));
+        const CTransactionRef fanout = MakeTransactionRef(tx);
+        accept(fanout);
+        for (size_t i = 0; i < OUTPUTS_PER_TX; ++i) {
+            coins.emplace_back(COutPoint(fanout->GetId(), i));
+        }
+    }
+    MineBlock(config, test_setup.m_node, SCRIPT_PUB);
+    assert(mempool.size() == 0);
+
+    // Spend the outputs with various fees, so the selection has some ordering
+    // to do.
+    std::vector<CTransactionRef> txs;
+    for (size_t n = 0; n < numTxs + numNewTxs; ++n) {
+        CMutableTransaction tx;
+        tx.vin.push_back(coins.at(n));
+        tx.vin.back().scriptSig = scriptSig;
+        tx.vout.emplace_back((99000 - 100 * int64_t(n % 97)) * SATOSHI,
+                             SCRIPT_PUB);
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    for (size_t n = 0; n < numTxs; ++n) {
+        accept(txs.at(n));
+    }
+
+    BlockTemplateSelection selection;
+    BlockAssembler(config, mempool).CreateNewBlock(SCRIPT_PUB, &selection);
+
+    size_t next = numTxs;
+    bench.run([&] {
+        accept(txs.at(next++));
+        BlockAssembler(config, mempool)
+            .CreateNewBlock(SCRIPT_PUB, incremental ? &selection : nullptr);
+    });
+}
+
+static void AssembleBlockTemplate500(benchmark::Bench &bench) {
+    AssembleBlockTemplate(bench, 500, false);
+}
+
+static void AssembleBlockTemplate5000(benchmark::Bench &bench) {
+    AssembleBlockTemplate(bench, 5000, false);
+}
+
+static void AssembleBlockTemplateIncremental500(benchmark::Bench &bench) {
+    AssembleBlockTemplate(bench, 500, true);
+}
+
+static void AssembleBlockTemplateIncremental5000(benchmark::Bench &bench) {
+    AssembleBlockTemplate(bench, 5000, true);
+}
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockTemplate500);
+BENCHMARK(AssembleBlockTemplate5000);
+BENCHMARK(AssembleBlockTemplateIncremental500);
+BENCHMARK(AssembleBlockTemplateIncremental5000);
@@ -0,0 +1,90 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <config.h>
+#include <graphene.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+//! Number of transactions in the mempool of the receiver.
+static constexpr size_t MEMPOOL_TXS = 200000;
+//! Number of transactions in the block.
+static constexpr size_t BLOCK_TXS = 5000;
+
+static CTransactionRef MakeTransaction(FastRandomContext &rng) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(TxId(rng.rand256()), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000 * SATOSHI;
+    return MakeTransactionRef(std::move(tx));
+}
+
+// Reconstruct a block from a large mempool holding all but one of its
+// transactions, so the whole mempool is scanned.
+template <typename Encoding, typename PartialBlock>
+static void ReconstructBlock(benchmark::Bench &bench) {
+    BasicTestingSetup test_setup{CBaseChainParams::REGTEST};
+    FastRandomContext rng(true);
+
+    CBlock block;
+    block.nBits = 0x207fffff;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42 * SATOSHI;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < MEMPOOL_TXS; i++) {
+            const CTransactionRef tx = MakeTransaction(rng);
+            if (i < BLOCK_TXS) {
+                block.vtx.push_back(tx);
+            }
+            if (i > 0) {
+                pool.addUnchecked(entry.FromTx(tx));
+            }
+        }
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    Encoding encoding;
+    if constexpr (std::is_same_v<Encoding, CGrapheneBlock>) {
+        encoding = CGrapheneBlock(block, pool.size());
+    } else {
+        encoding = CBlockHeaderAndShortTxIDs(block);
+    }
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
+    bench.unit("block").run([&] {
+        PartialBlock partialBlock(GetConfig(), &pool);
+        const ReadStatus status = partialBlock.InitData(encoding, extra_txn);
+        assert(status == READ_STATUS_OK);
+    });
+}
+
+static void CompactBlockReconstruction(benchmark::Bench &bench) {
+    ReconstructBlock<CBlockHeaderAndShortTxIDs, PartiallyDownloadedBlock>(
+        bench);
+}
+
+static void GrapheneBlockReconstruction(benchmark::Bench &bench) {
+    ReconstructBlock<CGrapheneBlock, PartiallyDownloadedGrapheneBlock>(bench);
+}
+
+BENCHMARK(CompactBlockReconstruction);
+BENCHMARK(GrapheneBlockReconstruction);
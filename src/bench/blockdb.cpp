@@ -0,0 +1,99 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <blockdb.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <flatfile.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/script.h>
+#include <streams.h>
+#include <util/system.h>
+
+#include <test/util/setup_common.h>
+
+#include <cassert>
+#include <vector>
+
+/**
+ * Build a block of pay to pubkey hash transactions. Hashes, keys and
+ * signatures are random, so only the structure of the block compresses, like
+ * on the real chain.
+ */
+static CBlock MakeBlock(size_t nTx) {
+    FastRandomContext rng(true);
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + i % 3);
+        for (CTxIn &in : tx.vin) {
+            in.prevout = COutPoint(TxId(rng.rand256()), rng.randrange(4));
+            in.scriptSig = CScript() << rng.randbytes(65) << rng.randbytes(33);
+        }
+        tx.vout.resize(2);
+        for (CTxOut &out : tx.vout) {
+            out.nValue = int64_t(rng.randrange(1000000000)) * SATOSHI;
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160
+                                         << rng.randbytes(20) << OP_EQUALVERIFY
+                                         << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// Read a block record back from a flat file, the way ReadBlockFromDisk does,
+// with the block stored either raw or compressed.
+
+static void ReadBlockRecord(benchmark::Bench &bench, bool compress) {
+    BasicTestingSetup test_setup{};
+    FlatFileSeq seq(GetDataDir(), "blk", BLOCKFILE_CHUNK_SIZE);
+
+    const CBlock blockIn = MakeBlock(2000);
+    std::vector<uint8_t> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << blockIn;
+    const uint32_t nSize = EncodeDiskRecord(data, compress);
+    assert(bool(nSize & DISK_RECORD_COMPRESSED_FLAG) == compress);
+
+    FlatFilePos pos(0, 0);
+    {
+        CAutoFile fileout(seq.Open(pos), SER_DISK, CLIENT_VERSION);
+        fileout << Params().DiskMagic() << nSize;
+        pos.nPos = ftell(fileout.Get());
+        fileout.write(reinterpret_cast<const char *>(data.data()),
+                      data.size());
+    }
+
+    bench.unit("block").run([&] {
+        uint32_t nReadSize;
+        CAutoFile filein(OpenDiskRecord(seq, pos, nReadSize), SER_DISK,
+                         CLIENT_VERSION);
+        assert(nReadSize == nSize);
+
+        CBlock block;
+        if (nReadSize & DISK_RECORD_COMPRESSED_FLAG) {
+            CDataStream stream(SER_DISK, CLIENT_VERSION);
+            bool decoded = ReadCompressedDiskRecord(filein, nReadSize, stream);
+            assert(decoded);
+            stream >> block;
+        } else {
+            filein >> block;
+        }
+        assert(block.vtx.size() == blockIn.vtx.size());
+    });
+}
+
+static void ReadBlockRecordRaw(benchmark::Bench &bench) {
+    ReadBlockRecord(bench, false);
+}
+
+static void ReadBlockRecordCompressed(benchmark::Bench &bench) {
+    ReadBlockRecord(bench, true);
+}
+
+BENCHMARK(ReadBlockRecordRaw);
+BENCHMARK(ReadBlockRecordCompressed);
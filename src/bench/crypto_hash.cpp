@@ -66,6 +66,21 @@ static void SipHash_32b(benchmark::Bench &bench) {
     });
 }
 
+static void SipHash_32b_Batch(benchmark::Bench &bench) {
+    std::vector<uint256> vals(64);
+    std::vector<const uint256 *> val_ptrs;
+    for (uint256 &val : vals) {
+        val_ptrs.push_back(&val);
+    }
+    std::vector<uint64_t> hashes(vals.size());
+    uint64_t k1 = 0;
+    bench.batch(vals.size()).unit("hash").run([&] {
+        SipHashUint256Batch(0, ++k1, val_ptrs.data(), hashes.data(),
+                            vals.size());
+        std::memcpy(vals[0].begin(), &hashes[0], sizeof(hashes[0]));
+    });
+}
+
 static void FastRandom_32bit(benchmark::Bench &bench) {
     FastRandomContext rng(true);
     bench.run([&] { rng.rand32(); });
@@ -83,6 +98,7 @@ BENCHMARK(SHA3_256_1M);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(SipHash_32b_Batch);
 BENCHMARK(SHA256D64_1024);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
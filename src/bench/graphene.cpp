@@ -0,0 +1,137 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/merkle.h>
+#include <graphene.h>
+#include <pow/pow.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+
+//! Number of transactions in the relayed block.
+static constexpr size_t BLOCK_TXS = 10000;
+//! Number of transactions of the receiver's mempool not in the block.
+static constexpr size_t OTHER_MEMPOOL_TXS = 10000;
+//! Bandwidth of the simulated link between the peers, in bits per second.
+static constexpr uint64_t LINK_BANDWIDTH = 20000000;
+
+static CTransactionRef MakeTransaction(FastRandomContext &rng) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(TxId(rng.rand256()), rng.randrange(4));
+    tx.vin[0].scriptSig = CScript() << rng.randbytes(65) << rng.randbytes(33);
+    tx.vout.resize(2);
+    for (CTxOut &out : tx.vout) {
+        out.nValue = int64_t(1 + rng.randrange(1000000000)) * SATOSHI;
+        out.scriptPubKey = CScript() << OP_DUP << OP_HASH160
+                                     << rng.randbytes(20) << OP_EQUALVERIFY
+                                     << OP_CHECKSIG;
+    }
+    return MakeTransactionRef(std::move(tx));
+}
+
+static CBlock MakeBlock(FastRandomContext &rng) {
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << rng.randbytes(8);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42 * SATOSHI;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    for (size_t i = 0; i < BLOCK_TXS; i++) {
+        block.vtx.push_back(MakeTransaction(rng));
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    block.hashPrevBlock = BlockHash(rng.rand256());
+    block.nBits = 0x207fffff;
+    block.nHeaderVersion = 1;
+    block.hashExtendedMetadata = SerializeHash(std::vector<uint8_t>());
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.SetSize(::GetSerializeSize(block));
+
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        ++block.nNonce;
+    }
+    return block;
+}
+
+// Wait for as long as sending the message over the simulated link takes.
+static void SimulateTransfer(const CDataStream &msg) {
+    const auto end = std::chrono::steady_clock::now() +
+                     std::chrono::nanoseconds(msg.size() * 8 * 1000000000 /
+                                              LINK_BANDWIDTH);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Propagate a large block to a peer which has all of its transactions in a
+// mempool twice as large: encode it, send it over the simulated link, and
+// reconstruct it on the other side.
+template <typename Encoding, typename PartialBlock>
+static void PropagateBlock(benchmark::Bench &bench) {
+    BasicTestingSetup test_setup{CBaseChainParams::REGTEST};
+    FastRandomContext rng(true);
+    const CBlock block = MakeBlock(rng);
+
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            pool.addUnchecked(entry.FromTx(block.vtx[i]));
+        }
+        for (size_t i = 0; i < OTHER_MEMPOOL_TXS; i++) {
+            pool.addUnchecked(entry.FromTx(MakeTransaction(rng)));
+        }
+    }
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
+
+    bench.unit("block").run([&] {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        if constexpr (std::is_same_v<Encoding, CGrapheneBlock>) {
+            stream << CGrapheneBlock(block, pool.size());
+        } else {
+            stream << CBlockHeaderAndShortTxIDs(block);
+        }
+        SimulateTransfer(stream);
+
+        Encoding encoding;
+        stream >> encoding;
+        PartialBlock partialBlock(GetConfig(), &pool);
+        ReadStatus status = partialBlock.InitData(encoding, extra_txn);
+        assert(status == READ_STATUS_OK);
+        CBlock block2;
+        status = partialBlock.FillBlock(block2, {});
+        assert(status == READ_STATUS_OK);
+        assert(block2.GetHash() == block.GetHash());
+    });
+}
+
+static void CompactBlockPropagation(benchmark::Bench &bench) {
+    PropagateBlock<CBlockHeaderAndShortTxIDs, PartiallyDownloadedBlock>(bench);
+}
+
+static void GrapheneBlockPropagation(benchmark::Bench &bench) {
+    PropagateBlock<CGrapheneBlock, PartiallyDownloadedGrapheneBlock>(bench);
+}
+
+BENCHMARK(CompactBlockPropagation);
+BENCHMARK(GrapheneBlockPropagation);
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <config.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <primitives/block.h>
+#include <protocol.h>
+#include <random.h>
+#include <script/script.h>
+
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+
+#include <vector>
+
+static CBlock MakeBlock(size_t nTx) {
+    FastRandomContext rng(true);
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + i % 3);
+        for (CTxIn &in : tx.vin) {
+            in.prevout = COutPoint(TxId(rng.rand256()), rng.randrange(4));
+            in.scriptSig = CScript() << rng.randbytes(65) << rng.randbytes(33);
+        }
+        tx.vout.resize(2);
+        for (CTxOut &out : tx.vout) {
+            out.nValue = int64_t(rng.randrange(1000000000)) * SATOSHI;
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160
+                                         << rng.randbytes(20) << OP_EQUALVERIFY
+                                         << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// Queue a new block for 100 peers, either serializing it for each of them or
+// sharing a single serialized message.
+static void RelayBlock(benchmark::Bench &bench, bool shared) {
+    BasicTestingSetup test_setup{};
+    const CBlock block = MakeBlock(1000);
+
+    ConnmanTestMsg connman(GetConfig(), 0x1337, 0x1337);
+    std::vector<CNode *> nodes;
+    for (NodeId id = 0; id < 100; id++) {
+        nodes.push_back(new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET,
+                                  CAddress(), 0, 0, 0, CAddress(), "",
+                                  ConnectionType::INBOUND));
+        connman.AddTestNode(*nodes.back());
+    }
+
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    bench.unit("block").run([&] {
+        if (shared) {
+            const CSharedNetMsg msg =
+                connman.MakeSharedMsg(msgMaker.Make(NetMsgType::BLOCK, block));
+            for (CNode *node : nodes) {
+                connman.PushMessage(node, msg);
+            }
+        } else {
+            for (CNode *node : nodes) {
+                connman.PushMessage(node,
+                                    msgMaker.Make(NetMsgType::BLOCK, block));
+            }
+        }
+
+        for (CNode *node : nodes) {
+            connman.ClearSendQueue(*node);
+        }
+    });
+
+    connman.ClearTestNodes();
+}
+
+static void RelayBlockSerializedPerPeer(benchmark::Bench &bench) {
+    RelayBlock(bench, false);
+}
+
+static void RelayBlockShared(benchmark::Bench &bench) {
+    RelayBlock(bench, true);
+}
+
+BENCHMARK(RelayBlockSerializedPerPeer);
+BENCHMARK(RelayBlockShared);
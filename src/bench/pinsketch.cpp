@@ -0,0 +1,42 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <pinsketch.h>
+#include <random.h>
+
+#include <vector>
+
+// Decode a difference of 30 transactions, about what a reconciliation every
+// few seconds sees on a busy network.
+static void PinSketchDecode(benchmark::Bench &bench) {
+    FastRandomContext rng(true);
+    PinSketch sketch(32);
+    for (int i = 0; i < 30; i++) {
+        sketch.Add(rng.rand32() | 1);
+    }
+    std::vector<uint32_t> elements;
+    bench.run([&] {
+        bool decoded = sketch.Decode(elements);
+        assert(decoded);
+    });
+}
+
+// Sketch a set of 1000 transactions.
+static void PinSketchAdd(benchmark::Bench &bench) {
+    FastRandomContext rng(true);
+    std::vector<uint32_t> elements(1000);
+    for (uint32_t &element : elements) {
+        element = rng.rand32() | 1;
+    }
+    bench.run([&] {
+        PinSketch sketch(32);
+        for (const uint32_t element : elements) {
+            sketch.Add(element);
+        }
+    });
+}
+
+BENCHMARK(PinSketchDecode);
+BENCHMARK(PinSketchAdd);
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <config.h>
+#include <net.h>
+#include <protocol.h>
+#include <random.h>
+#include <util/time.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// The wire bytes of a mix of messages a busy node typically receives.
+static std::vector<uint8_t> MakeMessageStream() {
+    FastRandomContext rng(true);
+    std::vector<uint8_t> stream;
+    auto add = [&](const std::string &type, size_t size) {
+        CSerializedNetMsg msg;
+        msg.m_type = type;
+        msg.data = rng.randbytes(size);
+        std::vector<uint8_t> header;
+        V1TransportSerializer().prepareForTransport(GetConfig(), msg, header);
+        stream.insert(stream.end(), header.begin(), header.end());
+        stream.insert(stream.end(), msg.data.begin(), msg.data.end());
+    };
+
+    for (int i = 0; i < 100; i++) {
+        add(NetMsgType::INV, 1 + 36 * (1 + rng.randrange(20)));
+        add(NetMsgType::TX, 200 + rng.randrange(800));
+        add(NetMsgType::TX, 200 + rng.randrange(300));
+        add(NetMsgType::GETDATA, 1 + 36 * (1 + rng.randrange(5)));
+        if (i % 10 == 0) {
+            add(NetMsgType::PING, 8);
+            add(NetMsgType::ADDR, 1 + 30 * (1 + rng.randrange(10)));
+            add(NetMsgType::HEADERS, 1 + 81 * (1 + rng.randrange(20)));
+        }
+    }
+    return stream;
+}
+
+// Deserialize the messages from socket sized reads, giving back their buffers
+// after "processing" them or not.
+static void RecvMessages(benchmark::Bench &bench, bool recycle) {
+    BasicTestingSetup test_setup{};
+    const Config &config = GetConfig();
+    const std::vector<uint8_t> stream = MakeMessageStream();
+    V1TransportDeserializer deserializer(config.GetChainParams().NetMagic(),
+                                         SER_NETWORK, INIT_PROTO_VERSION);
+
+    bench.unit("byte").batch(stream.size()).run([&] {
+        for (size_t pos = 0; pos < stream.size();) {
+            // Same read size as the socket handler
+            const uint32_t size =
+                std::min<size_t>(stream.size() - pos, 0x10000);
+            const char *data = (const char *)stream.data() + pos;
+            pos += size;
+            for (uint32_t read = 0; read < size;) {
+                const int ret =
+                    deserializer.Read(config, data + read, size - read);
+                assert(ret > 0);
+                read += ret;
+                if (deserializer.Complete()) {
+                    CNetMessage msg = deserializer.GetMessage(
+                        config, std::chrono::microseconds(GetTimeMicros()));
+                    if (recycle) {
+                        g_recv_buffer_pool.Put(std::move(msg.m_recv));
+                    }
+                }
+            }
+        }
+    });
+}
+
+static void RecvMessagesPooled(benchmark::Bench &bench) {
+    RecvMessages(bench, true);
+}
+
+static void RecvMessagesUnpooled(benchmark::Bench &bench) {
+    RecvMessages(bench, false);
+}
+
+BENCHMARK(RecvMessagesPooled);
+BENCHMARK(RecvMessagesUnpooled);
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <mempoolsnapshot.h>
 #include <rpc/blockchain.h>
 #include <txmempool.h>
 
@@ -35,4 +36,33 @@ static void RpcMempool(benchmark::Bench &bench) {
     bench.run([&] { (void)MempoolToJSON(pool, /*verbose*/ true); });
 }
 
+// Publish a snapshot after a change, which is what a reader polling a busy
+// mempool pays for while holding the mempool lock.
+static void MempoolSnapshotUpdate(benchmark::Bench &bench) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+
+    std::vector<TxId> txids;
+    for (int i = 0; i < 10000; ++i) {
+        CMutableTransaction tx = CMutableTransaction();
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = i * COIN;
+        const CTransactionRef tx_r{MakeTransactionRef(tx)};
+        AddTx(tx_r, /* fee */ i * COIN, pool);
+        txids.push_back(tx_r->GetId());
+    }
+
+    (void)pool.GetSnapshot();
+
+    size_t i = 0;
+    bench.run([&] {
+        pool.PrioritiseTransaction(txids[i++ % txids.size()], SATOSHI);
+        (void)pool.GetSnapshot();
+    });
+}
+
 BENCHMARK(RpcMempool);
+BENCHMARK(MempoolSnapshotUpdate);
@@ -0,0 +1,64 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <config.h>
+#include <net.h>
+#include <netbase.h>
+#include <util/system.h>
+
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <cassert>
+
+// Wait for socket events with many idle peers and a few active ones, which is
+// what the socket handler thread does on every iteration.
+static void SocketEventsLoopbackPeers(benchmark::Bench &bench, size_t nPeers) {
+    BasicTestingSetup test_setup{};
+
+    // Each peer needs a socket for both ends of the connection.
+    const int nAvailable = RaiseFileDescriptorLimit(2 * nPeers + 100);
+    nPeers = std::min<size_t>(nPeers, std::max(0, nAvailable - 100) / 2);
+
+    ConnmanTestMsg connman(GetConfig(), 0x1337, 0x1337);
+    std::vector<std::pair<SOCKET, SOCKET>> sockets;
+    assert(CreateLoopbackConnections(nPeers, sockets));
+
+    NodeId id = 0;
+    for (const auto &pair : sockets) {
+        connman.AddTestNode(*new CNode(id++, NODE_NETWORK, 0, pair.second,
+                                       CAddress(), 0, 0, 0, CAddress(), "",
+                                       ConnectionType::INBOUND));
+    }
+
+    // One peer in a hundred has data waiting. It is never read, so the
+    // socket stays readable.
+    const char byte = 0;
+    for (size_t i = 0; i < sockets.size(); i += 100) {
+        assert(send(sockets[i].first, &byte, 1, 0) == 1);
+    }
+
+    bench.minEpochIterations(10).run([&] {
+        std::set<SOCKET> recv_set, send_set, error_set;
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+    });
+
+    connman.ClearTestNodes();
+    for (auto &pair : sockets) {
+        CloseSocket(pair.first);
+    }
+}
+
+static void SocketEventsLoopbackPeers100(benchmark::Bench &bench) {
+    SocketEventsLoopbackPeers(bench, 100);
+}
+
+static void SocketEventsLoopbackPeers2000(benchmark::Bench &bench) {
+    SocketEventsLoopbackPeers(bench, 2000);
+}
+
+BENCHMARK(SocketEventsLoopbackPeers100);
+BENCHMARK(SocketEventsLoopbackPeers2000);
@@ -0,0 +1,30 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <txinventory.h>
+
+// Same workload as the RollingBloom bench, for comparison with the filter
+// KnownTxInventory replaced.
+static void KnownTxInventoryInsert(benchmark::Bench &bench) {
+    KnownTxInventory known;
+    uint256 data;
+    uint32_t count = 0;
+    bench.run([&] {
+        count++;
+        data.begin()[0] = count;
+        data.begin()[1] = count >> 8;
+        data.begin()[2] = count >> 16;
+        data.begin()[3] = count >> 24;
+        known.insert(TxId(data));
+
+        data.begin()[0] = count >> 24;
+        data.begin()[1] = count >> 16;
+        data.begin()[2] = count >> 8;
+        data.begin()[3] = count;
+        known.contains(TxId(data));
+    });
+}
+
+BENCHMARK(KnownTxInventoryInsert);
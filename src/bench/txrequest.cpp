@@ -0,0 +1,59 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <primitives/txid.h>
+#include <random.h>
+#include <txrequest.h>
+
+#include <cassert>
+#include <chrono>
+#include <vector>
+
+// Go through the whole life of numTxs transactions announced by numPeers
+// peers each: the announcements, the requests to the best peers, and the
+// responses.
+static void TxRequestAnnounce(benchmark::Bench &bench, int numPeers,
+                              int numTxs) {
+    FastRandomContext rng(true);
+    std::vector<TxId> txids;
+    for (int i = 0; i < numTxs; i++) {
+        txids.emplace_back(rng.rand256());
+    }
+
+    TxRequestTracker tracker;
+    std::chrono::microseconds now{1000000000};
+    bench.unit("announcement")
+        .batch(numPeers * numTxs)
+        .run([&] {
+            for (int peer = 0; peer < numPeers; peer++) {
+                for (const TxId &txid : txids) {
+                    tracker.ReceivedInv(peer, txid, peer % 8 == 0,
+                                        now + std::chrono::seconds{2});
+                }
+            }
+            now += std::chrono::seconds{2};
+
+            for (int peer = 0; peer < numPeers; peer++) {
+                for (const TxId &txid : tracker.GetRequestable(peer, now)) {
+                    tracker.RequestedTx(peer, txid,
+                                        now + std::chrono::seconds{60});
+                    tracker.ReceivedResponse(peer, txid);
+                    tracker.ForgetTxId(txid);
+                }
+            }
+            assert(tracker.Size() == 0);
+        });
+}
+
+static void TxRequestAnnounce1000Peers(benchmark::Bench &bench) {
+    TxRequestAnnounce(bench, 1000, 100);
+}
+
+static void TxRequestAnnounce10000Txs(benchmark::Bench &bench) {
+    TxRequestAnnounce(bench, 10, 10000);
+}
+
+BENCHMARK(TxRequestAnnounce1000Peers);
+BENCHMARK(TxRequestAnnounce10000Txs);
@@ -0,0 +1,127 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <policy/policy.h>
+#include <primitives/transaction.h>
+#include <script/interpreter.h>
+#include <script/sign.h>
+#include <script/signingprovider.h>
+#include <script/standard.h>
+#include <txverifyqueue.h>
+
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+static const size_t NUM_TXS = 200;
+static const size_t NUM_INPUTS = 2;
+
+struct SignedTx {
+    CTransactionRef tx;
+    std::vector<CTxOut> spent;
+    PrecomputedTransactionData txdata;
+};
+
+static bool VerifyTx(const SignedTx &stx) {
+    const CTransaction &tx = *stx.tx;
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        ScriptExecutionMetrics metrics = {};
+        if (!VerifyScript(tx.vin[i].scriptSig, stx.spent[i].scriptPubKey,
+                          STANDARD_SCRIPT_VERIFY_FLAGS,
+                          TransactionSignatureChecker(
+                              &tx, i, stx.spent[i].nValue, stx.txdata),
+                          metrics)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Verify the scripts of a burst of relayed transactions, either on the
+// calling thread or on a TxVerifyQueue, which is what the message handler
+// hands over to the verification threads.
+static void TxVerify(benchmark::Bench &bench, int threads) {
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+
+    CKey key;
+    key.MakeNewKey(true);
+    FillableSigningProvider keystore;
+    keystore.AddKey(key);
+    const CScript scriptPubKey =
+        GetScriptForDestination(PKHash(key.GetPubKey()));
+
+    std::vector<SignedTx> txs(NUM_TXS);
+    for (size_t n = 0; n < NUM_TXS; n++) {
+        CMutableTransaction funding;
+        funding.vin.emplace_back(COutPoint(TxId(), uint32_t(n)));
+        funding.vout.resize(NUM_INPUTS, CTxOut(COIN, scriptPubKey));
+        const CTransaction fundingTx(funding);
+
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            tx.vin.emplace_back(COutPoint(fundingTx.GetId(), i));
+        }
+        tx.vout.emplace_back(int64_t(NUM_INPUTS) * COIN - 1000 * SATOSHI,
+                             scriptPubKey);
+        for (size_t i = 0; i < NUM_INPUTS; i++) {
+            bool ret = SignSignature(keystore, fundingTx, tx, i,
+                                     SigHashType().withForkId());
+            assert(ret);
+        }
+
+        SignedTx &stx = txs[n];
+        stx.tx = MakeTransactionRef(tx);
+        stx.spent = fundingTx.vout;
+        stx.txdata = PrecomputedTransactionData(
+            *stx.tx, std::vector<CTxOut>(stx.spent));
+        assert(VerifyTx(stx));
+    }
+
+    TxVerifyQueue queue(NUM_TXS);
+    queue.Start(threads);
+
+    bench.batch(NUM_TXS).unit("tx").run([&] {
+        std::atomic<size_t> verified{0};
+        for (const SignedTx &stx : txs) {
+            const bool queued = threads > 0 && queue.Enqueue([&]() {
+                                    bool ret = VerifyTx(stx);
+                                    assert(ret);
+                                    verified++;
+                                });
+            if (!queued) {
+                bool ret = VerifyTx(stx);
+                assert(ret);
+                verified++;
+            }
+        }
+
+        while (verified < NUM_TXS) {
+            std::this_thread::yield();
+        }
+    });
+
+    queue.Stop();
+    ECC_Stop();
+}
+
+static void TxVerifyInline(benchmark::Bench &bench) {
+    TxVerify(bench, 0);
+}
+
+static void TxVerifyQueue2Threads(benchmark::Bench &bench) {
+    TxVerify(bench, 2);
+}
+
+static void TxVerifyQueue4Threads(benchmark::Bench &bench) {
+    TxVerify(bench, 4);
+}
+
+BENCHMARK(TxVerifyInline);
+BENCHMARK(TxVerifyQueue2Threads);
+BENCHMARK(TxVerifyQueue4Threads);
@@ -2,13 +2,17 @@
 
 #include <blockindex.h>
 #include <clientversion.h>
+#include <crypto/common.h>
 #include <pow/pow.h>
 #include <primitives/block.h>
 #include <streams.h>
+#include <util/lzcodec.h>
 #include <util/system.h>
 
 extern RecursiveMutex cs_main;
 
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+
 FlatFileSeq BlockFileSeq() {
     return FlatFileSeq(GetBlocksDir(), "blk", BLOCKFILE_CHUNK_SIZE);
 }
@@ -30,12 +34,87 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos) {
     return BlockFileSeq().FileName(pos);
 }
 
+uint32_t EncodeDiskRecord(std::vector<uint8_t> &data, bool compress) {
+    const uint32_t nRawSize = data.size();
+    if (!compress) {
+        return nRawSize;
+    }
+
+    std::vector<uint8_t> compressed = LZCompress(data);
+    if (compressed.size() + sizeof(nRawSize) >= data.size()) {
+        // Not worth it, store the record raw.
+        return nRawSize;
+    }
+
+    data.resize(sizeof(nRawSize));
+    WriteLE32(data.data(), nRawSize);
+    data.insert(data.end(), compressed.begin(), compressed.end());
+    return data.size() | DISK_RECORD_COMPRESSED_FLAG;
+}
+
+bool DecodeDiskRecord(Span<const uint8_t> frame, CDataStream &stream) {
+    if (frame.size() < sizeof(uint32_t)) {
+        return false;
+    }
+
+    const uint32_t nRawSize = ReadLE32(frame.data());
+    const Span<const uint8_t> compressed = frame.subspan(sizeof(nRawSize));
+    // Each compressed byte expands into at most 255 bytes, so don't trust a
+    // corrupted size to allocate an arbitrary amount of memory.
+    if (nRawSize > compressed.size() * 255) {
+        return false;
+    }
+
+    std::vector<uint8_t> raw;
+    if (!LZDecompress(compressed, nRawSize, raw)) {
+        return false;
+    }
+
+    stream.clear();
+    stream.write(reinterpret_cast<const char *>(raw.data()), raw.size());
+    return true;
+}
+
+FILE *OpenDiskRecord(FlatFileSeq seq, const FlatFilePos &pos,
+                     uint32_t &nSize) {
+    if (pos.nPos < sizeof(nSize)) {
+        error("%s: No record header before %s", __func__, pos.ToString());
+        return nullptr;
+    }
+
+    CAutoFile file(seq.Open(FlatFilePos(pos.nFile, pos.nPos - sizeof(nSize)),
+                            true),
+                   SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return nullptr;
+    }
+
+    try {
+        file >> nSize;
+    } catch (const std::exception &e) {
+        error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(),
+              pos.ToString());
+        return nullptr;
+    }
+
+    return file.release();
+}
+
+bool ReadCompressedDiskRecord(CAutoFile &file, uint32_t nSize,
+                              CDataStream &stream) {
+    std::vector<uint8_t> frame(nSize & ~DISK_RECORD_COMPRESSED_FLAG);
+    file.read(reinterpret_cast<char *>(frame.data()), frame.size());
+    return DecodeDiskRecord(frame, stream);
+}
+
 bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params) {
     block.SetNull();
 
     // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    uint32_t nSize;
+    CAutoFile filein(OpenDiskRecord(BlockFileSeq(), pos, nSize), SER_DISK,
+                     CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
                      pos.ToString());
@@ -43,7 +122,16 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
 
     // Read block
     try {
-        filein >> block;
+        if (nSize & DISK_RECORD_COMPRESSED_FLAG) {
+            CDataStream stream(SER_DISK, CLIENT_VERSION);
+            if (!ReadCompressedDiskRecord(filein, nSize, stream)) {
+                return error("%s: Corrupted compressed block at %s", __func__,
+                             pos.ToString());
+            }
+            stream >> block;
+        } else {
+            filein >> block;
+        }
     } catch (const std::exception &e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__,
                      e.what(), pos.ToString());
@@ -6,19 +6,40 @@
 #define BITCOIN_BLOCKDB_H
 
 #include <flatfile.h>
+#include <span.h>
+
+#include <cstdint>
+#include <vector>
 
 namespace Consensus {
 struct Params;
 }
 
+class CAutoFile;
 class CBlock;
 class CBlockIndex;
+class CDataStream;
 
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static constexpr unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
+/** Default for -blockcompression */
+static constexpr bool DEFAULT_BLOCK_COMPRESSION = false;
+
+/**
+ * Records in blk?????.dat and rev?????.dat files are stored as
+ * <disk magic><size><payload>. When this bit of <size> is set, the payload is a
+ * compressed frame made of the uncompressed size followed by the compressed
+ * serialization. Readers look at the size field preceding a FlatFilePos, so raw
+ * and compressed records can be mixed within the same file.
+ */
+static constexpr uint32_t DISK_RECORD_COMPRESSED_FLAG = 0x80000000;
+
+/** True if new block and undo records are written compressed. */
+extern bool fBlockCompression;
+
 FlatFileSeq BlockFileSeq();
 FlatFileSeq UndoFileSeq();
 FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
@@ -33,6 +54,31 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos);
  */
 FILE *OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 
+/**
+ * Prepare the serialization of a record for writing to disk. If compress is
+ * true and compression saves space, data is replaced by a compressed frame.
+ * Returns the size field to write in the record header.
+ */
+uint32_t EncodeDiskRecord(std::vector<uint8_t> &data, bool compress);
+
+/**
+ * Decompress the payload of a compressed record into stream.
+ */
+bool DecodeDiskRecord(Span<const uint8_t> frame, CDataStream &stream);
+
+/**
+ * Open the record whose payload starts at pos. The size field of the record
+ * header is returned in nSize and the file is positioned on the payload.
+ */
+FILE *OpenDiskRecord(FlatFileSeq seq, const FlatFilePos &pos, uint32_t &nSize);
+
+/**
+ * Read the payload of a compressed record from file and decompress it into
+ * stream.
+ */
+bool ReadCompressedDiskRecord(CAutoFile &file, uint32_t nSize,
+                              CDataStream &stream);
+
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params);
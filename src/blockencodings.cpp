@@ -16,6 +16,7 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
@@ -49,6 +50,15 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const TxHash &txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256 *const *txhashes,
+                                            uint64_t *out,
+                                            size_t count) const {
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, out, count);
+    for (size_t i = 0; i < count; i++) {
+        out[i] &= 0xffffffffffffL;
+    }
+}
+
 ReadStatus PartiallyDownloadedBlock::InitData(
     const CBlockHeaderAndShortTxIDs &cmpctblock,
     const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
@@ -129,11 +139,38 @@ ReadStatus PartiallyDownloadedBlock::InitData(
         return READ_STATUS_FAILED;
     }
 
+    // Most of the mempool isn't in the block, so look the short ids up in a
+    // bitmap of the block's short ids before looking them up in the map.
+    size_t bitmap_size = 64;
+    while (bitmap_size < 8 * shorttxids.size()) {
+        bitmap_size *= 2;
+    }
+    std::vector<bool> shortid_bitmap(bitmap_size);
+    for (const uint64_t shortid : cmpctblock.shorttxids) {
+        shortid_bitmap[shortid & (bitmap_size - 1)] = true;
+    }
+
     std::vector<bool> have_txn(txns_available.size());
     {
         LOCK(pool->cs);
+        // The short ids of the mempool are computed in batches, which is
+        // faster than one at a time.
+        static constexpr size_t BATCH_SIZE = 64;
+        const uint256 *txhashes[BATCH_SIZE];
+        uint64_t batch_shortids[BATCH_SIZE];
         for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-            uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
+            if (i % BATCH_SIZE == 0) {
+                const size_t count =
+                    std::min(BATCH_SIZE, pool->vTxHashes.size() - i);
+                for (size_t j = 0; j < count; j++) {
+                    txhashes[j] = &pool->vTxHashes[i + j].first;
+                }
+                cmpctblock.GetShortIDs(txhashes, batch_shortids, count);
+            }
+            const uint64_t shortid = batch_shortids[i % BATCH_SIZE];
+            if (!shortid_bitmap[shortid & (bitmap_size - 1)]) {
+                continue;
+            }
             std::unordered_map<uint64_t, uint32_t>::iterator idit =
                 shorttxids.find(shortid);
             if (idit != shorttxids.end()) {
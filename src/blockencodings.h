@@ -115,6 +115,9 @@ public:
     explicit CBlockHeaderAndShortTxIDs(const CBlock &block);
 
     uint64_t GetShortID(const TxHash &txhash) const;
+    //! Compute the short ids of count transactions at once, in out.
+    void GetShortIDs(const uint256 *const *txhashes, uint64_t *out,
+                     size_t count) const;
 
     size_t BlockTxCount() const {
         return shorttxids.size() + prefilledtxn.size();
@@ -92,6 +92,9 @@ typedef char *sockopt_arg_type;
 // https://github.com/bitcoin/bitcoin/pull/14336#issuecomment-437384408
 #if defined(__linux__)
 #define USE_POLL
+// epoll keeps the set of watched sockets in the kernel, so it doesn't have to
+// be rebuilt on every iteration of the socket handler.
+#define USE_EPOLL
 #endif
 
 static bool inline IsSelectableSocket(const SOCKET &s) {
@@ -4,6 +4,15 @@
 
 #include <crypto/siphash.h>
 
+#include <compat/cpuid.h>
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace siphash_avx2 {
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         uint64_t *out);
+}
+#endif
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND                                                               \
@@ -175,3 +184,50 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+typedef void (*SipHashUint256_4wayFn)(uint64_t k0, uint64_t k1,
+                                      const uint256 *const *vals,
+                                      uint64_t *out);
+
+void SipHashUint256_4wayGeneric(uint64_t k0, uint64_t k1,
+                                const uint256 *const *vals, uint64_t *out) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = SipHashUint256(k0, k1, *vals[i]);
+    }
+}
+
+SipHashUint256_4wayFn SelectSipHashUint256_4way() {
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) &&     \
+    !defined(BUILD_BITCOIN_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        // Check whether the OS has enabled AVX registers.
+        uint32_t a, d;
+        __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        const bool have_avx2 = (ebx >> 5) & 1;
+        if ((a & 6) == 6 && have_avx2) {
+            return siphash_avx2::SipHashUint256_4way;
+        }
+    }
+#endif
+    return SipHashUint256_4wayGeneric;
+}
+} // namespace
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         uint64_t *out, size_t count) {
+    static const SipHashUint256_4wayFn hash_4way = SelectSipHashUint256_4way();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        hash_4way(k0, k1, vals + i, out + i);
+    }
+    for (; i < count; i++) {
+        out[i] = SipHashUint256(k0, k1, *vals[i]);
+    }
+}
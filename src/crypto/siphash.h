@@ -7,6 +7,7 @@
 
 #include <uint256.h>
 
+#include <cstddef>
 #include <cstdint>
 
 /** SipHash-2-4 */
@@ -47,4 +48,12 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256 &val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
                              uint32_t extra);
 
+/**
+ * Compute SipHashUint256 of count values with the same key, in out. This is
+ * faster than hashing the values one at a time, as they are hashed 4 at once
+ * with AVX2 when the CPU supports it.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         uint64_t *out, size_t count);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// This is a 4-way AVX2 implementation of SipHashUint256, one 64-bit lane per
+// value.
+
+#ifdef ENABLE_AVX2
+
+#include <cstdint>
+#include <immintrin.h>
+
+#include <uint256.h>
+
+namespace siphash_avx2 {
+namespace {
+
+    __m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+    __m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+    __m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+    __m256i inline RotL(__m256i x, int n) {
+        return _mm256_or_si256(_mm256_slli_epi64(x, n),
+                               _mm256_srli_epi64(x, 64 - n));
+    }
+    /** Rotations by 16 and 32 bits are byte shuffles. */
+    __m256i inline RotL16(__m256i x) {
+        return _mm256_shuffle_epi8(
+            x, _mm256_setr_epi8(6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11,
+                                12, 13, 6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9,
+                                10, 11, 12, 13));
+    }
+    __m256i inline RotL32(__m256i x) { return _mm256_shuffle_epi32(x, 0xb1); }
+
+    inline void __attribute__((always_inline))
+    SipRound(__m256i &v0, __m256i &v1, __m256i &v2, __m256i &v3) {
+        v0 = Add(v0, v1);
+        v1 = Xor(RotL(v1, 13), v0);
+        v0 = RotL32(v0);
+        v2 = Add(v2, v3);
+        v3 = Xor(RotL16(v3), v2);
+        v0 = Add(v0, v3);
+        v3 = Xor(RotL(v3, 21), v0);
+        v2 = Add(v2, v1);
+        v1 = Xor(RotL(v1, 17), v2);
+        v2 = RotL32(v2);
+    }
+
+    __m256i inline Read4(const uint256 *const *vals, int pos) {
+        return _mm256_setr_epi64x(vals[0]->GetUint64(pos),
+                                  vals[1]->GetUint64(pos),
+                                  vals[2]->GetUint64(pos),
+                                  vals[3]->GetUint64(pos));
+    }
+
+} // namespace
+
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         uint64_t *out) {
+    __m256i v0 = K(0x736f6d6570736575ULL ^ k0);
+    __m256i v1 = K(0x646f72616e646f6dULL ^ k1);
+    __m256i v2 = K(0x6c7967656e657261ULL ^ k0);
+    __m256i v3 = K(0x7465646279746573ULL ^ k1);
+
+    for (int pos = 0; pos < 4; pos++) {
+        const __m256i d = Read4(vals, pos);
+        v3 = Xor(v3, d);
+        SipRound(v0, v1, v2, v3);
+        SipRound(v0, v1, v2, v3);
+        v0 = Xor(v0, d);
+    }
+    v3 = Xor(v3, K(uint64_t(4) << 59));
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 = Xor(v0, K(uint64_t(4) << 59));
+    v2 = Xor(v2, K(0xFF));
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        Xor(Xor(v0, v1), Xor(v2, v3)));
+}
+
+} // namespace siphash_avx2
+
+#endif
@@ -0,0 +1,356 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <graphene.h>
+
+#include <bloom.h>
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <crypto/sha256.h>
+#include <crypto/siphash.h>
+#include <logging.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+//! The serialized size of an IBLT cell.
+constexpr size_t IBLT_CELL_SIZE = 16;
+
+/**
+ * Larger mempool sizes sent by the receiver are capped, which only makes the
+ * filter more accurate than needed.
+ */
+constexpr uint64_t MAX_RECEIVER_MEMPOOL_TXS = 1 << 24;
+
+/**
+ * The number of entries to make room for in the IBLT: the expected number of
+ * false positives of the filter with some margin, as the actual number varies,
+ * and a few transactions the receiver may miss.
+ */
+size_t GetIBLTEntries(uint64_t expected_false_positives, size_t nTxs) {
+    return expected_false_positives +
+           2 * size_t(std::sqrt(double(expected_false_positives))) +
+           nTxs / 128 + 4;
+}
+
+void GetShortTxIDKeys(const CBlockHeader &header, uint64_t nonce,
+                      uint64_t &k0, uint64_t &k1) {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((uint8_t *)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    k0 = shorttxidhash.GetUint64(0);
+    k1 = shorttxidhash.GetUint64(1);
+}
+
+} // namespace
+
+ShortIdFilter::ShortIdFilter(size_t nElements, double nFPRate)
+    : vData(GetSize(nElements, nFPRate)), nHashFuncs(0) {
+    if (!vData.empty()) {
+        const double bits_per_element =
+            vData.size() * 8 / double(std::max<size_t>(nElements, 1));
+        nHashFuncs = std::clamp<uint32_t>(
+            std::lround(bits_per_element * M_LN2), 1, MAX_HASH_FUNCS);
+    }
+}
+
+size_t ShortIdFilter::GetSize(size_t nElements, double nFPRate) {
+    if (nFPRate >= 1 || nElements == 0) {
+        return 0;
+    }
+    const double bits =
+        -1 / (M_LN2 * M_LN2) * nElements * std::log(std::max(nFPRate, 1e-9));
+    return std::max<size_t>(std::ceil(bits / 8), 1);
+}
+
+void ShortIdFilter::insert(uint64_t shortid) {
+    if (vData.empty()) {
+        return;
+    }
+    // Double hashing, with both halves of the short id.
+    const uint32_t h1 = shortid;
+    const uint32_t h2 = shortid >> 32;
+    for (uint32_t i = 0; i < nHashFuncs; i++) {
+        const uint32_t bit = (h1 + i * h2) % (vData.size() * 8);
+        vData[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+bool ShortIdFilter::contains(uint64_t shortid) const {
+    if (vData.empty()) {
+        return true;
+    }
+    const uint32_t h1 = shortid;
+    const uint32_t h2 = shortid >> 32;
+    for (uint32_t i = 0; i < nHashFuncs; i++) {
+        const uint32_t bit = (h1 + i * h2) % (vData.size() * 8);
+        if (!(vData[bit >> 3] & (1 << (bit & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShortIdFilter::IsWithinSizeConstraints() const {
+    return nHashFuncs <= MAX_HASH_FUNCS;
+}
+
+CGrapheneBlock::CGrapheneBlock(const CBlock &block,
+                               uint64_t nReceiverMempoolTxs)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+      nBlockTxs(block.vtx.size()), coinbase(block.vtx[0]), header(block),
+      vMetadata(block.vMetadata) {
+    FillShortTxIDSelector();
+
+    // The receiver is expected to have the transactions of the block in its
+    // mempool, and the filter must rule out the other ones. Pick the number
+    // of false positives, listed from the IBLT, which makes the filter and the
+    // IBLT the smallest.
+    const size_t nTxs = block.vtx.size() - 1;
+    const uint64_t nOtherTxs =
+        std::min(nReceiverMempoolTxs, MAX_RECEIVER_MEMPOOL_TXS) -
+        std::min<uint64_t>(nReceiverMempoolTxs, nTxs);
+    uint64_t best_false_positives = nOtherTxs;
+    size_t best_size =
+        IBLT::CellsFor(GetIBLTEntries(nOtherTxs, nTxs)) * IBLT_CELL_SIZE;
+    for (uint64_t false_positives = 1; false_positives < nOtherTxs;
+         false_positives += false_positives / 8 + 1) {
+        const size_t size =
+            ShortIdFilter::GetSize(nTxs, double(false_positives) / nOtherTxs) +
+            IBLT::CellsFor(GetIBLTEntries(false_positives, nTxs)) *
+                IBLT_CELL_SIZE;
+        if (size < best_size) {
+            best_size = size;
+            best_false_positives = false_positives;
+        }
+    }
+
+    if (best_false_positives < nOtherTxs) {
+        filter = ShortIdFilter(nTxs, double(best_false_positives) / nOtherTxs);
+    }
+    iblt = IBLT(GetIBLTEntries(best_false_positives, nTxs));
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const uint64_t shortid = GetShortID(block.vtx[i]->GetHash());
+        filter.insert(shortid);
+        iblt.Insert(shortid);
+    }
+}
+
+void CGrapheneBlock::FillShortTxIDSelector() const {
+    GetShortTxIDKeys(header, nonce, shorttxidk0, shorttxidk1);
+}
+
+uint64_t CGrapheneBlock::GetShortID(const TxHash &txhash) const {
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash);
+}
+
+void CGrapheneBlock::GetShortIDs(const uint256 *const *txhashes, uint64_t *out,
+                                 size_t count) const {
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, out, count);
+}
+
+BlockTransactions
+GetGrapheneBlockTransactions(const CBlock &block,
+                             const GrapheneBlockTransactionsRequest &req) {
+    uint64_t k0, k1;
+    GetShortTxIDKeys(block, req.nonce, k0, k1);
+    std::unordered_map<uint64_t, CTransactionRef> shorttxids(block.vtx.size());
+    for (const CTransactionRef &tx : block.vtx) {
+        shorttxids.emplace(SipHashUint256(k0, k1, tx->GetHash()), tx);
+    }
+
+    BlockTransactions resp;
+    resp.blockhash = req.blockhash;
+    for (const uint64_t shortid : req.shorttxids) {
+        auto it = shorttxids.find(shortid);
+        if (it != shorttxids.end()) {
+            resp.txn.push_back(it->second);
+        }
+    }
+    return resp;
+}
+
+ReadStatus PartiallyDownloadedGrapheneBlock::InitData(
+    const CGrapheneBlock &grapheneblock,
+    const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
+    if (grapheneblock.header.IsNull() || grapheneblock.coinbase->IsNull() ||
+        grapheneblock.nBlockTxs == 0) {
+        return READ_STATUS_INVALID;
+    }
+    if (grapheneblock.nBlockTxs >
+        config->GetMaxBlockSize() / MIN_TRANSACTION_SIZE) {
+        return READ_STATUS_INVALID;
+    }
+    if (!grapheneblock.filter.IsWithinSizeConstraints() ||
+        !grapheneblock.iblt.IsValid()) {
+        return READ_STATUS_INVALID;
+    }
+
+    assert(header.IsNull() && txns_available.empty());
+    header = grapheneblock.header;
+    vMetadata = grapheneblock.vMetadata;
+    nonce = grapheneblock.nonce;
+    shorttxidk0 = grapheneblock.shorttxidk0;
+    shorttxidk1 = grapheneblock.shorttxidk1;
+
+    // Erase the transactions which pass the filter from the IBLT, leaving the
+    // false positives and the transactions we miss.
+    std::unordered_map<uint64_t, CTransactionRef> candidates;
+    IBLT iblt = grapheneblock.iblt;
+    {
+        LOCK(pool->cs);
+        // The short ids of the mempool are computed in batches, which is
+        // faster than one at a time.
+        static constexpr size_t BATCH_SIZE = 64;
+        const uint256 *txhashes[BATCH_SIZE];
+        uint64_t batch_shortids[BATCH_SIZE];
+        for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
+            if (i % BATCH_SIZE == 0) {
+                const size_t count =
+                    std::min(BATCH_SIZE, pool->vTxHashes.size() - i);
+                for (size_t j = 0; j < count; j++) {
+                    txhashes[j] = &pool->vTxHashes[i + j].first;
+                }
+                grapheneblock.GetShortIDs(txhashes, batch_shortids, count);
+            }
+            const uint64_t shortid = batch_shortids[i % BATCH_SIZE];
+            if (!grapheneblock.filter.contains(shortid)) {
+                continue;
+            }
+            if (!candidates
+                     .emplace(shortid,
+                              pool->vTxHashes[i].second->GetSharedTx())
+                     .second) {
+                // Short ID collision
+                return READ_STATUS_FAILED;
+            }
+            iblt.Erase(shortid);
+        }
+    }
+
+    for (const auto &extra_txn : extra_txns) {
+        const uint64_t shortid = grapheneblock.GetShortID(extra_txn.first);
+        if (!grapheneblock.filter.contains(shortid)) {
+            continue;
+        }
+        auto it = candidates.find(shortid);
+        if (it != candidates.end()) {
+            // Don't count transactions both in the mempool and the extra pool
+            // as a collision.
+            if (it->second->GetHash() != extra_txn.first) {
+                return READ_STATUS_FAILED;
+            }
+            continue;
+        }
+        candidates.emplace(shortid, extra_txn.second);
+        iblt.Erase(shortid);
+    }
+
+    std::vector<uint64_t> in_block, false_positives;
+    if (!iblt.ListEntries(in_block, false_positives)) {
+        return READ_STATUS_FAILED;
+    }
+    for (const uint64_t shortid : false_positives) {
+        if (!candidates.erase(shortid)) {
+            return READ_STATUS_FAILED;
+        }
+    }
+    for (const uint64_t shortid : in_block) {
+        if (candidates.count(shortid)) {
+            return READ_STATUS_FAILED;
+        }
+    }
+    if (1 + candidates.size() + in_block.size() != grapheneblock.nBlockTxs) {
+        return READ_STATUS_FAILED;
+    }
+
+    txns_available.reserve(grapheneblock.nBlockTxs);
+    txns_available.push_back(grapheneblock.coinbase);
+    for (auto &candidate : candidates) {
+        txns_available.push_back(std::move(candidate.second));
+    }
+    missing_shorttxids = std::move(in_block);
+
+    LogPrint(BCLog::CMPCTBLOCK,
+             "Initialized PartiallyDownloadedGrapheneBlock for block %s using "
+             "a grblk of size %lu\n",
+             grapheneblock.header.GetHash().ToString(),
+             GetSerializeSize(grapheneblock, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+GrapheneBlockTransactionsRequest
+PartiallyDownloadedGrapheneBlock::GetMissingTransactionsRequest() const {
+    assert(!header.IsNull());
+    GrapheneBlockTransactionsRequest req;
+    req.blockhash = header.GetHash();
+    req.nonce = nonce;
+    req.shorttxids = missing_shorttxids;
+    return req;
+}
+
+ReadStatus PartiallyDownloadedGrapheneBlock::FillBlock(
+    CBlock &block, const std::vector<CTransactionRef> &vtx_missing) {
+    assert(!header.IsNull());
+    if (vtx_missing.size() != missing_shorttxids.size()) {
+        return READ_STATUS_INVALID;
+    }
+    std::unordered_set<uint64_t> missing(missing_shorttxids.begin(),
+                                         missing_shorttxids.end());
+    for (const CTransactionRef &tx : vtx_missing) {
+        if (!missing.erase(
+                SipHashUint256(shorttxidk0, shorttxidk1, tx->GetHash()))) {
+            return READ_STATUS_INVALID;
+        }
+    }
+
+    const BlockHash hash = header.GetHash();
+    block = header;
+    block.vMetadata = std::move(vMetadata);
+    block.vtx = std::move(txns_available);
+    block.vtx.insert(block.vtx.end(), vtx_missing.begin(), vtx_missing.end());
+    // The transactions after the coinbase follow the canonical ordering.
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    // Make sure we can't call FillBlock again.
+    header.SetNull();
+    txns_available.clear();
+
+    BlockValidationState state;
+    if (!CheckBlock(block, state, config->GetChainParams().GetConsensus(),
+                    BlockValidationOptions(*config))) {
+        if (state.GetResult() == BlockValidationResult::BLOCK_MUTATED) {
+            // Possible Short ID collision.
+            return READ_STATUS_FAILED;
+        }
+        LogPrintf("ERROR: PartiallyDownloadedGrapheneBlock::FillBlock failed: "
+                  "%s\n",
+                  state.ToString());
+        return READ_STATUS_CHECKBLOCK_FAILED;
+    }
+
+    LogPrint(BCLog::CMPCTBLOCK,
+             "Successfully reconstructed graphene block %s with %lu txn from "
+             "mempool (incl extra pool) and %lu txn requested\n",
+             hash.ToString(), block.vtx.size() - 1 - vtx_missing.size(),
+             vtx_missing.size());
+
+    return READ_STATUS_OK;
+}
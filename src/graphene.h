@@ -0,0 +1,181 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_GRAPHENE_H
+#define BITCOIN_GRAPHENE_H
+
+#include <blockencodings.h>
+#include <iblt.h>
+#include <primitives/block.h>
+
+/** Default for -graphene. */
+static const bool DEFAULT_GRAPHENE = false;
+
+/**
+ * Graphene block relay encodes the set of transactions of a block with a bloom
+ * filter and an IBLT, in much less space than a short id per transaction when
+ * the receiver has most of them in its mempool.
+ *
+ * The receiver sends the size of its mempool in a getgrblk message. The
+ * sender replies with a grblk message holding a CGrapheneBlock: the header,
+ * the coinbase and a bloom filter and an IBLT of the short ids of the other
+ * transactions. The receiver passes its mempool through the bloom filter, and
+ * erases the short ids of the transactions which match from the IBLT. This
+ * leaves the false positives of the filter and the transactions it misses in
+ * the IBLT, which the sender sizes so that they can be listed. The receiver
+ * asks for the transactions it misses by short id with a getgrblktx message,
+ * which the sender answers with a blocktxn message.
+ *
+ * No ordering information is sent, as the transactions of a block follow the
+ * canonical ordering. If the IBLT can't be listed, the receiver falls back to
+ * compact block relay, and getblocktxn.
+ */
+
+/** A graphene block request: a getgrblk message. */
+class GrapheneBlockRequest {
+public:
+    BlockHash blockhash;
+    //! The number of transactions in the mempool of the receiver.
+    uint64_t nMempoolTxs;
+
+    SERIALIZE_METHODS(GrapheneBlockRequest, obj) {
+        READWRITE(obj.blockhash, obj.nMempoolTxs);
+    }
+};
+
+/**
+ * A request for the transactions of a graphene block missing from the
+ * receiver: a getgrblktx message.
+ */
+class GrapheneBlockTransactionsRequest {
+public:
+    BlockHash blockhash;
+    //! The nonce of the graphene block, which keys the short ids.
+    uint64_t nonce;
+    std::vector<uint64_t> shorttxids;
+
+    SERIALIZE_METHODS(GrapheneBlockTransactionsRequest, obj) {
+        READWRITE(obj.blockhash, obj.nonce, obj.shorttxids);
+    }
+};
+
+/**
+ * A bloom filter of short transaction ids. The short ids already are keyed
+ * hashes, so the bits to set are taken from the short id itself. A filter
+ * without data matches everything.
+ */
+class ShortIdFilter {
+private:
+    std::vector<uint8_t> vData;
+    uint8_t nHashFuncs;
+
+public:
+    //! A filter matching everything.
+    ShortIdFilter() : nHashFuncs(0) {}
+    //! Create a filter with the given false positive rate for the given
+    //! number of elements, or matching everything if the rate is 1 or more.
+    ShortIdFilter(size_t nElements, double nFPRate);
+
+    //! The size of a filter, in bytes.
+    static size_t GetSize(size_t nElements, double nFPRate);
+
+    void insert(uint64_t shortid);
+    bool contains(uint64_t shortid) const;
+
+    bool IsWithinSizeConstraints() const;
+
+    SERIALIZE_METHODS(ShortIdFilter, obj) {
+        READWRITE(obj.vData, obj.nHashFuncs);
+    }
+};
+
+class CGrapheneBlock {
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedGrapheneBlock;
+
+protected:
+    uint64_t nBlockTxs;
+    CTransactionRef coinbase;
+    ShortIdFilter filter;
+    IBLT iblt;
+
+public:
+    CBlockHeader header;
+    std::vector<CBlockMetadataField> vMetadata;
+
+    // Dummy for deserialization
+    CGrapheneBlock() {}
+
+    /**
+     * Encode a block for a receiver with the given number of transactions in
+     * its mempool.
+     */
+    CGrapheneBlock(const CBlock &block, uint64_t nReceiverMempoolTxs);
+
+    uint64_t GetNonce() const { return nonce; }
+    uint64_t GetShortID(const TxHash &txhash) const;
+    //! Compute the short ids of count transactions at once, in out.
+    void GetShortIDs(const uint256 *const *txhashes, uint64_t *out,
+                     size_t count) const;
+    size_t BlockTxCount() const { return nBlockTxs; }
+
+    SERIALIZE_METHODS(CGrapheneBlock, obj) {
+        READWRITE(obj.header, obj.vMetadata, obj.nonce,
+                  COMPACTSIZE(obj.nBlockTxs),
+                  Using<TransactionCompression>(obj.coinbase), obj.filter,
+                  obj.iblt);
+        if (ser_action.ForRead()) {
+            obj.FillShortTxIDSelector();
+        }
+    }
+};
+
+/**
+ * Map the short ids of the requested transactions of a block to these
+ * transactions, for a getgrblktx message. Short ids not in the block are
+ * ignored.
+ */
+BlockTransactions
+GetGrapheneBlockTransactions(const CBlock &block,
+                             const GrapheneBlockTransactionsRequest &req);
+
+class PartiallyDownloadedGrapheneBlock {
+protected:
+    //! The transactions we have, coinbase first, in no particular order.
+    std::vector<CTransactionRef> txns_available;
+    std::vector<CBlockMetadataField> vMetadata;
+    std::vector<uint64_t> missing_shorttxids;
+    uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+    const CTxMemPool *pool;
+    const Config *config;
+
+public:
+    CBlockHeader header;
+    PartiallyDownloadedGrapheneBlock(const Config &configIn,
+                                     CTxMemPool *poolIn)
+        : pool(poolIn), config(&configIn) {}
+
+    // extra_txn is a list of extra transactions to look at, in <txhash,
+    // reference> form.
+    ReadStatus
+    InitData(const CGrapheneBlock &grapheneblock,
+             const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txn);
+    //! The transactions to request with getgrblktx, after InitData.
+    GrapheneBlockTransactionsRequest GetMissingTransactionsRequest() const;
+    /**
+     * Complete the block with the requested transactions, in any order.
+     * Returns READ_STATUS_FAILED if the block doesn't match its header, in
+     * which case it should be requested in full.
+     */
+    ReadStatus FillBlock(CBlock &block,
+                         const std::vector<CTransactionRef> &vtx_missing);
+};
+
+#endif // BITCOIN_GRAPHENE_H
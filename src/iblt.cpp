@@ -0,0 +1,107 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+//! The finalizer of SplitMix64, a cheap mix of the bits of a 64 bits value.
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+} // namespace
+
+size_t IBLT::CellsFor(size_t entries) {
+    // Large tables list their entries with a high probability from 1.3 cells
+    // per entry. Small ones need a larger margin, as a few keys sharing their
+    // cells are enough to prevent the listing.
+    const size_t cells = entries + entries / 2 + 4 * NUM_HASHES +
+                         2 * size_t(std::sqrt(double(entries)));
+    return (cells + NUM_HASHES - 1) / NUM_HASHES * NUM_HASHES;
+}
+
+size_t IBLT::GetCell(uint64_t key, size_t i) const {
+    const size_t sub_table_size = m_cells.size() / NUM_HASHES;
+    return i * sub_table_size +
+           Mix(key ^ (0x9e3779b97f4a7c15 * (i + 1))) % sub_table_size;
+}
+
+uint32_t IBLT::CheckSum(uint64_t key) {
+    return Mix(key) >> 32;
+}
+
+void IBLT::Update(uint64_t key, int32_t delta) {
+    assert(IsValid());
+    const uint32_t check_sum = CheckSum(key);
+    for (size_t i = 0; i < NUM_HASHES; i++) {
+        Cell &cell = m_cells[GetCell(key, i)];
+        cell.count += delta;
+        cell.key_sum ^= key;
+        cell.check_sum ^= check_sum;
+    }
+}
+
+bool IBLT::ListEntries(std::vector<uint64_t> &inserted,
+                       std::vector<uint64_t> &erased) const {
+    if (!IsValid()) {
+        return false;
+    }
+
+    IBLT table(*this);
+    const size_t sub_table_size = m_cells.size() / NUM_HASHES;
+    // A cell holding a single key, which can be taken out of the table.
+    auto is_pure = [&](size_t index) {
+        const Cell &cell = table.m_cells[index];
+        return (cell.count == 1 || cell.count == -1) &&
+               cell.check_sum == CheckSum(cell.key_sum) &&
+               table.GetCell(cell.key_sum, index / sub_table_size) == index;
+    };
+
+    std::vector<size_t> pure_cells;
+    for (size_t index = 0; index < table.m_cells.size(); index++) {
+        if (is_pure(index)) {
+            pure_cells.push_back(index);
+        }
+    }
+
+    // Every key taken out empties at least one cell, so a well formed table
+    // can't list more keys than it has cells.
+    size_t listed = 0;
+    while (!pure_cells.empty() && listed <= m_cells.size()) {
+        const size_t index = pure_cells.back();
+        pure_cells.pop_back();
+        if (!is_pure(index)) {
+            // Already taken out through another cell.
+            continue;
+        }
+
+        const uint64_t key = table.m_cells[index].key_sum;
+        const int32_t count = table.m_cells[index].count;
+        (count > 0 ? inserted : erased).push_back(key);
+        listed++;
+        table.Update(key, -count);
+        for (size_t i = 0; i < NUM_HASHES; i++) {
+            const size_t cell = table.GetCell(key, i);
+            if (is_pure(cell)) {
+                pure_cells.push_back(cell);
+            }
+        }
+    }
+
+    for (const Cell &cell : table.m_cells) {
+        if (!cell.IsEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
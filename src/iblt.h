@@ -0,0 +1,89 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_IBLT_H
+#define BITCOIN_IBLT_H
+
+#include <serialize.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * An invertible bloom lookup table (IBLT) of 64 bits keys, as used to find the
+ * difference between two sets.
+ *
+ * Every key is added to NUM_HASHES cells, one in each of NUM_HASHES equal
+ * sub-tables. A cell holds the number of keys added to it, and the xor of the
+ * keys and of a checksum of the keys. Keys can be erased as well as inserted,
+ * even keys which were never inserted: inserting the keys of a set, then
+ * erasing the keys of another one leaves the symmetric difference of the two
+ * sets in the table. That difference can be listed whatever the size of the
+ * sets, as long as the table has enough cells for it (see CellsFor).
+ */
+class IBLT {
+public:
+    //! The number of cells a key is added to.
+    static constexpr size_t NUM_HASHES = 4;
+
+    //! An empty table, which can't hold any key.
+    IBLT() {}
+    //! An empty table able to list up to the given number of entries.
+    explicit IBLT(size_t entries) : m_cells(CellsFor(entries)) {}
+
+    /**
+     * The number of cells for a table to list up to the given number of
+     * entries. Listing fails less than 1% of the time for tables filled up
+     * to that number, and much more rarely below.
+     */
+    static size_t CellsFor(size_t entries);
+
+    size_t GetCells() const { return m_cells.size(); }
+    //! Whether keys can be added to the table. Deserialized tables must be
+    //! checked first.
+    bool IsValid() const {
+        return !m_cells.empty() && m_cells.size() % NUM_HASHES == 0;
+    }
+
+    void Insert(uint64_t key) { Update(key, 1); }
+    void Erase(uint64_t key) { Update(key, -1); }
+
+    /**
+     * List the keys in the table.
+     *
+     * @param[out] inserted The keys inserted more than erased.
+     * @param[out] erased The keys erased more than inserted.
+     * @return False if the table holds too many keys to list them all, in
+     *         which case the output vectors hold a part of them.
+     */
+    bool ListEntries(std::vector<uint64_t> &inserted,
+                     std::vector<uint64_t> &erased) const;
+
+    SERIALIZE_METHODS(IBLT, obj) { READWRITE(obj.m_cells); }
+
+private:
+    struct Cell {
+        int32_t count{0};
+        uint64_t key_sum{0};
+        uint32_t check_sum{0};
+
+        bool IsEmpty() const {
+            return count == 0 && key_sum == 0 && check_sum == 0;
+        }
+
+        SERIALIZE_METHODS(Cell, obj) {
+            READWRITE(obj.count, obj.key_sum, obj.check_sum);
+        }
+    };
+
+    std::vector<Cell> m_cells;
+
+    void Update(uint64_t key, int32_t delta);
+    //! The cell of a key in the i-th sub-table.
+    size_t GetCell(uint64_t key, size_t i) const;
+    static uint32_t CheckSum(uint64_t key);
+};
+
+#endif // BITCOIN_IBLT_H
@@ -24,6 +24,7 @@
 #include <consensus/validation.h>
 #include <flatfile.h>
 #include <fs.h>
+#include <graphene.h>
 #include <hash.h>
 #include <httprpc.h>
 #include <httpserver.h>
@@ -43,6 +44,7 @@
 #include <policy/policy.h>
 #include <policy/settings.h>
 #include <rpc/blockchain.h>
+#include <rpc/blocktemplatecache.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -56,6 +58,7 @@
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <util/asmap.h>
 #include <util/check.h>
 #include <util/moneystr.h>
@@ -231,6 +234,9 @@ void Shutdown(NodeContext &node) {
         LOCK2(::cs_main, ::g_cs_orphans);
         node.connman->StopNodes();
     }
+    if (node.peerman) {
+        node.peerman->StopTxVerification();
+    }
 
     StopTorControl();
 
@@ -432,6 +438,14 @@ void SetupServerArgs(NodeContext &node) {
             defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(),
             testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()),
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-blockcompression",
+        strprintf("Compress newly written block and undo files. Blocks "
+                  "already on disk are not rewritten and stay readable "
+                  "either way, but compressed files cannot be read by older "
+                  "versions (default: %u)",
+                  DEFAULT_BLOCK_COMPRESSION),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>",
                    "Specify directory to hold blocks subdirectory for *.dat "
                    "files (default: <datadir>)",
@@ -597,6 +611,14 @@ void SetupServerArgs(NodeContext &node) {
                              "getrawtransaction rpc call (default: %d)",
                              DEFAULT_TXINDEX),
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-txverifythreads=<n>",
+        strprintf("Set the number of threads verifying the scripts of relayed "
+                  "transactions before they are accepted to the mempool (0 to "
+                  "%d, 0 = verify them on the message handler thread, "
+                  "default: %d)",
+                  MAX_TXVERIFY_THREADS, DEFAULT_TXVERIFY_THREADS),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg(
         "-blockfilterindex=<type>",
         strprintf("Maintain an index of compact filters by block "
@@ -667,6 +689,12 @@ void SetupServerArgs(NodeContext &node) {
                    "If set, only use the specified DNS seed when "
                    "querying for peer addresses via DNS lookup.",
                    ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-graphene",
+        strprintf("Relay blocks with graphene to and from the peers supporting "
+                  "it, instead of compact blocks (experimental, default: %d)",
+                  DEFAULT_GRAPHENE),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg(
         "-listen",
         "Accept connections from outside (default: 1 if no -proxy or -connect)",
@@ -701,6 +729,12 @@ void SetupServerArgs(NodeContext &node) {
                   "backward by this amount. (default: %u seconds)",
                   DEFAULT_MAX_TIME_ADJUSTMENT),
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-msghandlerthreads=<n>",
+        strprintf("Set the number of threads processing peer messages. Each "
+                  "peer is handled by a single thread (1 to %d, default: %d)",
+                  MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-onion=<ip:port>",
                    strprintf("Use separate SOCKS5 proxy to reach peers via Tor "
                              "hidden services (default: %s)",
@@ -769,6 +803,13 @@ void SetupServerArgs(NodeContext &node) {
                    "Tor control port password (default: empty)",
                    ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE,
                    OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-txreconciliation",
+        strprintf("Relay transactions by set reconciliation with the peers "
+                  "supporting it, instead of announcing every transaction to "
+                  "them (experimental, default: %d)",
+                  DEFAULT_TXRECONCILIATION),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     argsman.AddArg("-upnp",
@@ -1118,6 +1159,14 @@ void SetupServerArgs(NodeContext &node) {
                   CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE_PER_KB)),
         ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
+    argsman.AddArg(
+        "-blocktemplaterefreshfee=<amt>",
+        strprintf("Fees (in %s) which have to enter the mempool before "
+                  "getblocktemplate builds a new template for the same "
+                  "block (default: %s)",
+                  CURRENCY_UNIT,
+                  FormatMoney(DEFAULT_BLOCK_TEMPLATE_REFRESH_FEE)),
+        ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockversion=<n>",
                    "Override block version to test forking scenarios",
                    ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY,
@@ -1960,6 +2009,9 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
         fPruneMode = true;
     }
 
+    fBlockCompression =
+        args.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+
     nConnectTimeout = args.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -2006,6 +2058,14 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
                                           args.GetArg("-blockmintxfee", "")));
         }
     }
+    if (args.IsArgSet("-blocktemplaterefreshfee")) {
+        Amount n = Amount::zero();
+        if (!ParseMoney(args.GetArg("-blocktemplaterefreshfee", ""), n)) {
+            return InitError(
+                AmountErrMsg("blocktemplaterefreshfee",
+                             args.GetArg("-blocktemplaterefreshfee", "")));
+        }
+    }
 
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions.
@@ -2052,6 +2112,14 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
     }
 
+    if (args.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_TXRECON);
+    }
+
+    if (args.GetBoolArg("-graphene", DEFAULT_GRAPHENE)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_GRAPHENE);
+    }
+
     nMaxTipAge = args.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     return true;
@@ -2294,6 +2362,16 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                                        chainman, *node.mempool));
     RegisterValidationInterface(node.peerman.get());
 
+    int tx_verify_threads =
+        args.GetArg("-txverifythreads", DEFAULT_TXVERIFY_THREADS);
+    tx_verify_threads =
+        std::max(std::min(tx_verify_threads, MAX_TXVERIFY_THREADS), 0);
+    LogPrintf("Relayed transaction verification uses %d threads\n",
+              tx_verify_threads);
+    if (tx_verify_threads >= 1) {
+        node.peerman->StartTxVerification(tx_verify_threads);
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string &cmt : args.GetArgs("-uacomment")) {
@@ -2926,6 +3004,11 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     connOptions.nReceiveFloodSize =
         1000 * args.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
     connOptions.m_added_nodes = args.GetArgs("-addnode");
+    connOptions.m_msghandler_threads = std::max(
+        std::min(int(args.GetArg("-msghandlerthreads",
+                                 DEFAULT_MSGHANDLER_THREADS)),
+                 MAX_MSGHANDLER_THREADS),
+        1);
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
@@ -0,0 +1,67 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempoolsnapshot.h>
+
+#include <txmempool.h>
+
+#include <algorithm>
+
+MempoolSnapshotEntry::MempoolSnapshotEntry(const CTxMemPoolEntry &entry,
+                                           std::vector<TxId> dependsIn,
+                                           std::vector<TxId> spentByIn,
+                                           bool unbroadcastIn)
+    : tx(entry.GetSharedTx()), fee(entry.GetFee()),
+      modifiedFee(entry.GetModifiedFee()), txSize(entry.GetTxSize()),
+      time(entry.GetTime()), height(entry.GetHeight()),
+      countWithDescendants(entry.GetCountWithDescendants()),
+      sizeWithDescendants(entry.GetSizeWithDescendants()),
+      modFeesWithDescendants(entry.GetModFeesWithDescendants()),
+      countWithAncestors(entry.GetCountWithAncestors()),
+      sizeWithAncestors(entry.GetSizeWithAncestors()),
+      modFeesWithAncestors(entry.GetModFeesWithAncestors()),
+      depends(std::move(dependsIn)), spentBy(std::move(spentByIn)),
+      unbroadcast(unbroadcastIn) {}
+
+const MempoolSnapshotEntry *MempoolSnapshot::find(const TxId &txid) const {
+    const auto &bucket = buckets[GetBucketIndex(txid)];
+    if (!bucket) {
+        return nullptr;
+    }
+
+    auto it = std::lower_bound(
+        bucket->entries.begin(), bucket->entries.end(), txid,
+        [](const RCUPtr<const MempoolSnapshotEntry> &entry, const TxId &id) {
+            return entry->GetId() < id;
+        });
+    if (it == bucket->entries.end() || (*it)->GetId() != txid) {
+        return nullptr;
+    }
+
+    return it->get();
+}
+
+std::vector<const MempoolSnapshotEntry *>
+MempoolSnapshot::GetSortedDepthAndScore() const {
+    std::vector<const MempoolSnapshotEntry *> entries;
+    entries.reserve(count);
+    ForEachEntry(
+        [&](const MempoolSnapshotEntry &entry) { entries.push_back(&entry); });
+
+    // This mirrors DepthAndScoreComparator and CompareTxMemPoolEntryByScore.
+    std::sort(entries.begin(), entries.end(),
+              [](const MempoolSnapshotEntry *a, const MempoolSnapshotEntry *b) {
+                  if (a->countWithAncestors != b->countWithAncestors) {
+                      return a->countWithAncestors < b->countWithAncestors;
+                  }
+
+                  double f1 = b->txSize * (a->fee / SATOSHI);
+                  double f2 = a->txSize * (b->fee / SATOSHI);
+                  if (f1 == f2) {
+                      return b->GetId() < a->GetId();
+                  }
+                  return f1 > f2;
+              });
+    return entries;
+}
@@ -0,0 +1,137 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMPOOLSNAPSHOT_H
+#define BITCOIN_MEMPOOLSNAPSHOT_H
+
+#include <amount.h>
+#include <primitives/transaction.h>
+#include <primitives/txid.h>
+#include <rcu.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class CTxMemPoolEntry;
+
+/**
+ * An immutable copy of a mempool entry, along with its in-mempool parents and
+ * children, as it was when the snapshot was published.
+ */
+class MempoolSnapshotEntry {
+public:
+    const CTransactionRef tx;
+    const Amount fee;
+    const Amount modifiedFee;
+    const size_t txSize;
+    const std::chrono::seconds time;
+    const unsigned int height;
+    const uint64_t countWithDescendants;
+    const uint64_t sizeWithDescendants;
+    const Amount modFeesWithDescendants;
+    const uint64_t countWithAncestors;
+    const uint64_t sizeWithAncestors;
+    const Amount modFeesWithAncestors;
+    //! In-mempool transactions spent by this one, sorted by txid.
+    const std::vector<TxId> depends;
+    //! In-mempool transactions spending this one, sorted by txid.
+    const std::vector<TxId> spentBy;
+    const bool unbroadcast;
+
+    MempoolSnapshotEntry(const CTxMemPoolEntry &entry,
+                         std::vector<TxId> dependsIn,
+                         std::vector<TxId> spentByIn, bool unbroadcastIn);
+
+    TxId GetId() const { return tx->GetId(); }
+
+    IMPLEMENT_RCU_REFCOUNT(uint32_t);
+};
+
+/**
+ * A consistent, immutable view of the mempool which can be traversed without
+ * holding the mempool lock.
+ *
+ * Entries are spread over a fixed number of buckets, sorted by txid within
+ * each bucket. When the mempool changes, the next snapshot shares every bucket
+ * that wasn't modified with the previous one, so publishing a new snapshot
+ * costs in proportion to the changes rather than to the size of the mempool.
+ * Snapshots are reference counted using RCU, so that readers never need to
+ * synchronize with the publisher.
+ */
+class MempoolSnapshot {
+public:
+    static constexpr size_t NUM_BUCKETS = 1024;
+
+    class Bucket {
+    public:
+        const std::vector<RCUPtr<const MempoolSnapshotEntry>> entries;
+
+        explicit Bucket(std::vector<RCUPtr<const MempoolSnapshotEntry>> e)
+            : entries(std::move(e)) {}
+
+        IMPLEMENT_RCU_REFCOUNT(uint32_t);
+    };
+
+    using BucketArray = std::array<RCUPtr<const Bucket>, NUM_BUCKETS>;
+
+private:
+    const BucketArray buckets;
+    const size_t count;
+    const uint64_t totalTxSize;
+    const size_t usage;
+    const size_t unbroadcastCount;
+    const bool loaded;
+
+public:
+    MempoolSnapshot(BucketArray bucketsIn, size_t countIn,
+                    uint64_t totalTxSizeIn, size_t usageIn,
+                    size_t unbroadcastCountIn, bool loadedIn)
+        : buckets(std::move(bucketsIn)), count(countIn),
+          totalTxSize(totalTxSizeIn), usage(usageIn),
+          unbroadcastCount(unbroadcastCountIn), loaded(loadedIn) {}
+
+    static size_t GetBucketIndex(const TxId &txid) {
+        return txid.GetUint64(0) % NUM_BUCKETS;
+    }
+
+    const BucketArray &GetBuckets() const { return buckets; }
+
+    /** Number of transactions in the snapshot. */
+    size_t size() const { return count; }
+    /** Sum of the sizes of all the transactions. */
+    uint64_t GetTotalTxSize() const { return totalTxSize; }
+    /** Dynamic memory usage of the mempool when the snapshot was taken. */
+    size_t DynamicMemoryUsage() const { return usage; }
+    size_t GetUnbroadcastCount() const { return unbroadcastCount; }
+    bool IsLoaded() const { return loaded; }
+
+    /** Returns the entry for this txid, or nullptr if there is none. */
+    const MempoolSnapshotEntry *find(const TxId &txid) const;
+
+    /** Calls f on every entry, in no particular order. */
+    template <typename F> void ForEachEntry(F f) const {
+        for (const auto &bucket : buckets) {
+            if (!bucket) {
+                continue;
+            }
+
+            for (const auto &entry : bucket->entries) {
+                f(*entry);
+            }
+        }
+    }
+
+    /**
+     * Returns all the entries sorted by number of in-mempool ancestors, then
+     * by fee rate, which is the order used by CTxMemPool::queryHashes.
+     */
+    std::vector<const MempoolSnapshotEntry *> GetSortedDepthAndScore() const;
+
+    IMPLEMENT_RCU_REFCOUNT(uint32_t);
+};
+
+#endif // BITCOIN_MEMPOOLSNAPSHOT_H
@@ -120,13 +120,15 @@ void BlockAssembler::resetBlock() {
     // These counters do not include coinbase tx.
     nBlockTx = 0;
     nFees = Amount::zero();
+    minPackageFeeRate = CFeeRate(MAX_MONEY);
 }
 
 std::optional<int64_t> BlockAssembler::m_last_block_num_txs{std::nullopt};
 std::optional<int64_t> BlockAssembler::m_last_block_size{std::nullopt};
 
 std::unique_ptr<CBlockTemplate>
-BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
+BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
+                               BlockTemplateSelection *selection) {
     int64_t nTimeStart = GetTimeMicros();
 
     resetBlock();
@@ -176,7 +178,22 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    const bool fUpdated =
+        selection && updatePackageTxs(*selection, nPackagesSelected);
+    if (!fUpdated) {
+        resetBlock();
+        nPackagesSelected = 0;
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+        if (selection) {
+            saveSelection(*selection, m_mempool.GetJournalSequence());
+        }
+    }
+
+    pblocktemplate->entries.reserve(inBlock.size() + 1);
+    for (CTxMemPool::txiter it : inBlock) {
+        pblocktemplate->entries.emplace_back(it->GetSharedTx(), it->GetFee(),
+                                             it->GetSigOpCount());
+    }
 
     // We make sure transaction are canonically ordered.
     std::sort(
@@ -251,11 +268,11 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     int64_t nTime2 = GetTimeMicros();
 
     LogPrint(BCLog::BENCH,
-             "CreateNewBlock() packages: %.2fms (%d packages, %d updated "
+             "CreateNewBlock() packages: %.2fms (%d %spackages, %d updated "
              "descendants), validity: %.2fms (total %.2fms)\n",
              0.001 * (nTime1 - nTimeStart), nPackagesSelected,
-             nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
-             0.001 * (nTime2 - nTimeStart));
+             fUpdated ? "new " : "", nDescendantsUpdated,
+             0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -314,8 +331,6 @@ bool BlockAssembler::TestPackageTransactions(
 }
 
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
-    pblocktemplate->entries.emplace_back(iter->GetSharedTx(), iter->GetFee(),
-                                         iter->GetSigOpCount());
     nBlockSize += iter->GetTxSize();
     ++nBlockTx;
     nBlockSigOps += iter->GetSigOpCount();
@@ -549,12 +564,153 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
         }
 
         ++nPackagesSelected;
+        minPackageFeeRate = std::min(minPackageFeeRate,
+                                     CFeeRate(packageFees, packageSize));
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
 }
 
+/**
+ * updatePackageTxs picks up where a previous selection left off. As long as
+ * the tip and the selected transactions are unchanged, the packages of the
+ * transactions which entered the mempool since are appended in the order they
+ * arrived, which gives the same template addPackageTxs would as long as the
+ * block is not full. Once it is, a new package which pays more than the worst
+ * selected one means the selection has to be rebuilt.
+ * @param[in,out] selection         The previous selection
+ * @param[out] nPackagesSelected    How many packages were selected
+ */
+bool BlockAssembler::updatePackageTxs(BlockTemplateSelection &selection,
+                                      int &nPackagesSelected) {
+    if (selection.mempool != &m_mempool ||
+        selection.hashPrevBlock != pblock->hashPrevBlock ||
+        selection.nMaxGeneratedBlockSize != nMaxGeneratedBlockSize ||
+        selection.nMaxGeneratedBlockSigChecks != nMaxGeneratedBlockSigChecks ||
+        selection.blockMinFeeRate != blockMinFeeRate) {
+        return false;
+    }
+
+    uint64_t journalSequence = selection.journalSequence;
+    std::vector<MempoolJournalEntry> changes;
+    if (!m_mempool.GetJournalEntriesSince(journalSequence, changes)) {
+        return false;
+    }
+
+    std::vector<TxId> added;
+    for (const MempoolJournalEntry &change : changes) {
+        switch (change.type) {
+            case MempoolJournalEntry::Type::ADDED:
+                added.push_back(change.txid);
+                break;
+            case MempoolJournalEntry::Type::REMOVED:
+                if (selection.selectedTxIds.count(change.txid)) {
+                    return false;
+                }
+                break;
+            case MempoolJournalEntry::Type::UPDATED:
+                // The feerates the selection was based on changed.
+                return false;
+        }
+    }
+
+    for (const TxId &txid : selection.selectedTxIds) {
+        auto iter = m_mempool.GetIter(txid);
+        if (!iter) {
+            return false;
+        }
+        inBlock.insert(*iter);
+    }
+    nBlockSize = selection.nBlockSize;
+    nBlockTx = selection.nBlockTx;
+    nBlockSigOps = selection.nBlockSigOps;
+    nFees = selection.nFees;
+    minPackageFeeRate = selection.minPackageFeeRate;
+
+    for (const TxId &txid : added) {
+        auto iter = m_mempool.GetIter(txid);
+        if (!iter || inBlock.count(*iter)) {
+            continue;
+        }
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        m_mempool.CalculateMemPoolAncestors(**iter, ancestors, nNoLimit,
+                                            nNoLimit, nNoLimit, nNoLimit, dummy,
+                                            false);
+
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(*iter);
+
+        uint64_t packageSize = 0;
+        Amount packageFees = Amount::zero();
+        int64_t packageSigOps = 0;
+        for (CTxMemPool::txiter it : ancestors) {
+            packageSize += it->GetTxSize();
+            packageFees += it->GetModifiedFee();
+            packageSigOps += it->GetSigOpCount();
+        }
+
+        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+            continue;
+        }
+
+        if (!TestPackage(packageSize, packageSigOps)) {
+            if (CFeeRate(packageFees, packageSize) > minPackageFeeRate) {
+                // This package should have displaced some of the selected
+                // ones.
+                return false;
+            }
+            continue;
+        }
+
+        if (!TestPackageTransactions(ancestors)) {
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+        for (auto &entry : sortedEntries) {
+            AddToBlock(entry);
+            selection.selectedTxIds.insert(entry->GetTx().GetId());
+        }
+
+        ++nPackagesSelected;
+        minPackageFeeRate =
+            std::min(minPackageFeeRate, CFeeRate(packageFees, packageSize));
+    }
+
+    selection.nBlockSize = nBlockSize;
+    selection.nBlockTx = nBlockTx;
+    selection.nBlockSigOps = nBlockSigOps;
+    selection.nFees = nFees;
+    selection.minPackageFeeRate = minPackageFeeRate;
+    selection.journalSequence = journalSequence;
+    return true;
+}
+
+void BlockAssembler::saveSelection(BlockTemplateSelection &selection,
+                                   uint64_t journalSequence) const {
+    selection.mempool = &m_mempool;
+    selection.hashPrevBlock = pblock->hashPrevBlock;
+    selection.nMaxGeneratedBlockSize = nMaxGeneratedBlockSize;
+    selection.nMaxGeneratedBlockSigChecks = nMaxGeneratedBlockSigChecks;
+    selection.blockMinFeeRate = blockMinFeeRate;
+    selection.journalSequence = journalSequence;
+
+    selection.selectedTxIds.clear();
+    for (CTxMemPool::txiter it : inBlock) {
+        selection.selectedTxIds.insert(it->GetTx().GetId());
+    }
+    selection.nBlockSize = nBlockSize;
+    selection.nBlockTx = nBlockTx;
+    selection.nBlockSigOps = nBlockSigOps;
+    selection.nFees = nFees;
+    selection.minPackageFeeRate = minPackageFeeRate;
+}
+
 static const std::vector<uint8_t>
 getExcessiveBlockSizeSig(uint64_t nExcessiveBlockSize) {
     std::string cbmsg = "/EB" + getSubVersionEB(nExcessiveBlockSize) + "/";
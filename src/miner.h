@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <set>
 
 class CBlockIndex;
 class CChainParams;
@@ -134,6 +135,38 @@ struct update_for_parent_inclusion {
     CTxMemPool::txiter iter;
 };
 
+/**
+ * The transactions selected for the last block template, kept by the caller
+ * across calls to BlockAssembler::CreateNewBlock. The selection is brought up
+ * to date using the mempool journal rather than rebuilt from the whole
+ * mempool, unless the changes could affect the transactions already selected.
+ */
+class BlockTemplateSelection {
+private:
+    friend class BlockAssembler;
+
+    // What the selection was made against
+    const CTxMemPool *mempool{nullptr};
+    BlockHash hashPrevBlock;
+    uint64_t nMaxGeneratedBlockSize{0};
+    uint64_t nMaxGeneratedBlockSigChecks{0};
+    CFeeRate blockMinFeeRate;
+    uint64_t journalSequence{0};
+
+    // The selected transactions and the state of the block they make
+    std::set<TxId> selectedTxIds;
+    uint64_t nBlockSize{0};
+    uint64_t nBlockTx{0};
+    uint64_t nBlockSigOps{0};
+    Amount nFees{Amount::zero()};
+    // Lowest feerate of the packages that were selected
+    CFeeRate minPackageFeeRate;
+
+public:
+    //! Forget the selection, so the next template is built from scratch.
+    void Reset() { mempool = nullptr; }
+};
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler {
 private:
@@ -153,6 +186,7 @@ private:
     uint64_t nBlockSigOps;
     Amount nFees;
     CTxMemPool::setEntries inBlock;
+    CFeeRate minPackageFeeRate;
 
     // Chain context for the block
     int nHeight;
@@ -176,9 +210,14 @@ public:
     BlockAssembler(const CChainParams &params, const CTxMemPool &mempool,
                    const Options &options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /**
+     * Construct a new block template with coinbase to scriptPubKeyIn. If a
+     * selection is given, the transactions it holds are reused when possible
+     * and it is updated to match the new template.
+     */
     std::unique_ptr<CBlockTemplate>
-    CreateNewBlock(const CScript &scriptPubKeyIn);
+    CreateNewBlock(const CScript &scriptPubKeyIn,
+                   BlockTemplateSelection *selection = nullptr);
 
     uint64_t GetMaxGeneratedBlockSize() const { return nMaxGeneratedBlockSize; }
 
@@ -200,6 +239,17 @@ private:
      */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
         EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /**
+     * Restore the block's state from a previous selection and add the
+     * packages of the transactions which entered the mempool since. Returns
+     * false if the selection has to be rebuilt from scratch.
+     */
+    bool updatePackageTxs(BlockTemplateSelection &selection,
+                          int &nPackagesSelected)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Save the block's state into selection */
+    void saveSelection(BlockTemplateSelection &selection,
+                       uint64_t journalSequence) const;
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -27,9 +27,12 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
-#ifdef USE_POLL
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#elif defined(USE_POLL)
 #include <poll.h>
 #endif
 
@@ -93,10 +96,23 @@ enum BindFlags {
     BF_REPORT_ERROR = (1U << 1),
 };
 
+#ifndef WIN32
+/** Maximum number of queued buffers handed to a single sendmsg() call. */
+static const size_t MAX_SEND_IOVECS = 64;
+#endif
+
 // The set of sockets cannot be modified while waiting
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifdef USE_EPOLL
+/**
+ * Maximum number of socket events returned per epoll_wait() call. Sockets are
+ * level triggered, so any event left over is reported by the next call.
+ */
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 // SHA256("netgroup")[0:8]
@@ -114,6 +130,8 @@ bool g_relay_txes = !DEFAULT_BLOCKSONLY;
 RecursiveMutex cs_mapLocalHost;
 std::map<CNetAddr, LocalServiceInfo> mapLocalHost GUARDED_BY(cs_mapLocalHost);
 static bool vfLimited[NET_MAX] GUARDED_BY(cs_mapLocalHost) = {};
+RecvBufferPool g_recv_buffer_pool;
+TxAnnouncementQueue g_tx_announcements;
 
 void CConnman::AddAddrFetch(const std::string &strDest) {
     LOCK(m_addr_fetches_mutex);
@@ -582,6 +600,14 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap) {
     } else {
         stats.minFeeFilter = Amount::zero();
     }
+    if (m_tx_relay != nullptr) {
+        LOCK(m_tx_relay->cs_tx_inventory);
+        stats.m_tx_relay_usage =
+            sizeof(TxRelay) +
+            m_tx_relay->m_inventory_known.DynamicMemoryUsage();
+    } else {
+        stats.m_tx_relay_usage = 0;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer. Merely reporting
@@ -679,6 +705,8 @@ int V1TransportDeserializer::readHeader(const Config &config, const char *pch,
 
     // switch state to reading message data
     in_data = true;
+    vRecv = g_recv_buffer_pool.Get(hdr.nMessageSize, vRecv.GetType(),
+                                   vRecv.GetVersion());
 
     return nCopy;
 }
@@ -687,14 +715,18 @@ int V1TransportDeserializer::readData(const char *pch, uint32_t nBytes) {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Allocate up to 256 KiB ahead, or double the buffer, but never more
+        // than the total message size.
+        vRecv.reserve(std::min<size_t>(
+            hdr.nMessageSize,
+            std::max<size_t>(2 * vRecv.capacity(),
+                             nDataPos + nCopy + 256 * 1024)));
     }
 
     hasher.Write({(const uint8_t *)pch, nCopy});
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Append without zero-filling the buffer first.
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -753,6 +785,64 @@ V1TransportDeserializer::GetMessage(const Config &config,
     return msg;
 }
 
+CDataStream RecvBufferPool::Get(size_t size, int nType, int nVersion) {
+    if (size == 0) {
+        return CDataStream(nType, nVersion);
+    }
+
+    int size_class = MIN_SIZE_CLASS;
+    while (size_class < MAX_SIZE_CLASS && (size_t(1) << size_class) < size) {
+        size_class++;
+    }
+
+    {
+        LOCK(cs_pool);
+        std::vector<CDataStream> &buffers =
+            m_buffers[size_class - MIN_SIZE_CLASS];
+        if (!buffers.empty()) {
+            CDataStream stream = std::move(buffers.back());
+            buffers.pop_back();
+            stream.SetType(nType);
+            stream.SetVersion(nVersion);
+            return stream;
+        }
+    }
+
+    CDataStream stream(nType, nVersion);
+    stream.reserve(size_t(1) << size_class);
+    return stream;
+}
+
+void RecvBufferPool::Put(CDataStream &&stream) {
+    stream.clear();
+    const size_t capacity = stream.capacity();
+    // Leave the buffers of large messages, like blocks, to the allocator.
+    if (capacity < (size_t(1) << MIN_SIZE_CLASS) ||
+        capacity > (size_t(1) << MAX_SIZE_CLASS)) {
+        return;
+    }
+
+    int size_class = MAX_SIZE_CLASS;
+    while ((size_t(1) << size_class) > capacity) {
+        size_class--;
+    }
+
+    LOCK(cs_pool);
+    std::vector<CDataStream> &buffers = m_buffers[size_class - MIN_SIZE_CLASS];
+    if (buffers.size() < (SIZE_CLASS_BUDGET >> size_class)) {
+        buffers.push_back(std::move(stream));
+    }
+}
+
+size_t RecvBufferPool::Count() const {
+    LOCK(cs_pool);
+    size_t count = 0;
+    for (const std::vector<CDataStream> &buffers : m_buffers) {
+        count += buffers.size();
+    }
+    return count;
+}
+
 void V1TransportSerializer::prepareForTransport(const Config &config,
                                                 CSerializedNetMsg &msg,
                                                 std::vector<uint8_t> &header) {
@@ -769,13 +859,45 @@ void V1TransportSerializer::prepareForTransport(const Config &config,
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
 }
 
+/**
+ * Send as much of the queued buffers as the socket accepts, starting at offset
+ * in the first one. Returns the number of bytes sent, like send().
+ */
+static int SendBuffers(SOCKET hSocket, const std::deque<SendBuffer> &buffers,
+                       size_t offset) {
+#ifndef WIN32
+    // Gather the header and payload of several messages into a single call,
+    // without copying them.
+    struct iovec iov[MAX_SEND_IOVECS];
+    size_t count = 0;
+    for (const SendBuffer &buffer : buffers) {
+        if (count == MAX_SEND_IOVECS) {
+            break;
+        }
+        iov[count].iov_base = const_cast<uint8_t *>(buffer->data()) + offset;
+        iov[count].iov_len = buffer->size() - offset;
+        offset = 0;
+        count++;
+    }
+
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    const SendBuffer &buffer = buffers.front();
+    return send(hSocket,
+                reinterpret_cast<const char *>(buffer->data()) + offset,
+                buffer->size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const
     EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend) {
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
+    while (!pnode->vSendMsg.empty()) {
+        assert(pnode->vSendMsg.front()->size() > pnode->nSendOffset);
         int nBytes = 0;
 
         {
@@ -784,11 +906,8 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 break;
             }
 
-            nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendBuffers(pnode->hSocket, pnode->vSendMsg,
+                                 pnode->nSendOffset);
         }
 
         if (nBytes == 0) {
@@ -811,22 +930,31 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
+
+        // Drop the buffers which were fully sent.
+        size_t nRemaining = nBytes;
+        while (nRemaining > 0) {
+            const size_t nBufferSize = pnode->vSendMsg.front()->size();
+            const size_t nLeft = nBufferSize - pnode->nSendOffset;
+            if (nRemaining < nLeft) {
+                pnode->nSendOffset += nRemaining;
+                break;
+            }
+
+            nRemaining -= nLeft;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= nBufferSize;
+            pnode->vSendMsg.pop_front();
+        }
+        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+
+        if (pnode->nSendOffset != 0) {
             // could not send full message; stop sending more
             break;
         }
-
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
-        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
     }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
-                          pnode->vSendMsg.begin() + nMsgCount);
-
     if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
@@ -1327,7 +1455,124 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set,
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
-#ifdef USE_POLL
+#ifdef USE_EPOLL
+void CConnman::EpollRegister(SOCKET hSocket, NodeId id, uint32_t events) {
+    auto it = m_epoll_registrations.find(hSocket);
+    const bool registered =
+        it != m_epoll_registrations.end() && it->second.node == id;
+    if (registered && it->second.events == events) {
+        it->second.generation = m_epoll_generation;
+        return;
+    }
+
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = hSocket;
+    // Closing a socket removes it from the epoll set, and its descriptor may
+    // since have been reused by another one, so the registration we remember
+    // can be out of date. Fall back on the operation the kernel expects.
+    int op = registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(m_epoll_fd, op, hSocket, &event) != 0) {
+        op = errno == ENOENT ? EPOLL_CTL_ADD
+                             : errno == EEXIST ? EPOLL_CTL_MOD : -1;
+        if (op == -1 || epoll_ctl(m_epoll_fd, op, hSocket, &event) != 0) {
+            LogPrint(BCLog::NET, "epoll_ctl error for socket %d: %s\n",
+                     hSocket, NetworkErrorString(errno));
+            m_epoll_registrations.erase(hSocket);
+            return;
+        }
+    }
+
+    m_epoll_registrations[hSocket] = {id, events, m_epoll_generation};
+}
+
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set,
+                            std::set<SOCKET> &send_set,
+                            std::set<SOCKET> &error_set) {
+    if (m_epoll_fd == -1) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(
+                std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+            return;
+        }
+    }
+
+    // Same selection as GenerateSelectSet, but only the sockets whose
+    // interest changed are updated in the kernel. Errors and hang ups are
+    // always reported by epoll.
+    m_epoll_generation++;
+    for (const ListenSocket &hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET) {
+            EpollRegister(hListenSocket.socket, -1, EPOLLIN);
+        }
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode *pnode : vNodes) {
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET) {
+                continue;
+            }
+
+            uint32_t events = 0;
+            if (select_send) {
+                events = EPOLLOUT;
+            } else if (select_recv) {
+                events = EPOLLIN;
+            }
+            EpollRegister(pnode->hSocket, pnode->GetId(), events);
+        }
+    }
+
+    // Sockets which were not seen have been closed, and the kernel already
+    // forgot about them.
+    for (auto it = m_epoll_registrations.begin();
+         it != m_epoll_registrations.end();) {
+        if (it->second.generation != m_epoll_generation) {
+            it = m_epoll_registrations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_epoll_registrations.empty()) {
+        interruptNet.sleep_for(
+            std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS,
+                             SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) {
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET hSocket = events[i].data.fd;
+        if (events[i].events & EPOLLIN) {
+            recv_set.insert(hSocket);
+        }
+        if (events[i].events & EPOLLOUT) {
+            send_set.insert(hSocket);
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            error_set.insert(hSocket);
+        }
+    }
+}
+#elif defined(USE_POLL)
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set,
                             std::set<SOCKET> &send_set,
                             std::set<SOCKET> &error_set) {
@@ -1608,9 +1853,9 @@ void CConnman::ThreadSocketHandler() {
 void CConnman::WakeMessageHandler() {
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        nMsgProcWake++;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 #ifdef USE_UPNP
@@ -2277,14 +2522,19 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     }
 }
 
-void CConnman::ThreadMessageHandler() {
+void CConnman::ThreadMessageHandler(int worker) {
+    uint64_t nWake = WITH_LOCK(mutexMsgProc, return nMsgProcWake);
     while (!flagInterruptMsgProc) {
+        // Each peer is handled by a single thread, so its messages are
+        // processed in order. Peers waiting on validation only hold up the
+        // other peers of the same thread.
         std::vector<CNode *> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy) {
-                pnode->AddRef();
+            for (CNode *pnode : vNodes) {
+                if (pnode->GetId() % m_msghandler_threads == worker) {
+                    vNodesCopy.push_back(pnode->AddRef());
+                }
             }
         }
 
@@ -2326,10 +2576,12 @@ void CConnman::ThreadMessageHandler() {
             condMsgProc.wait_until(lock,
                                    std::chrono::steady_clock::now() +
                                        std::chrono::milliseconds(100),
-                                   [this]() EXCLUSIVE_LOCKS_REQUIRED(
-                                       mutexMsgProc) { return fMsgProcWake; });
+                                   [&]() EXCLUSIVE_LOCKS_REQUIRED(
+                                       mutexMsgProc) {
+                                       return nMsgProcWake != nWake;
+                                   });
         }
-        fMsgProcWake = false;
+        nWake = nMsgProcWake;
     }
 }
 
@@ -2600,11 +2852,6 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
-    }
-
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(
         &TraceThread<std::function<void()>>, "net",
@@ -2645,10 +2892,13 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     }
 
     // Process messages
-    threadMessageHandler =
-        std::thread(&TraceThread<std::function<void()>>, "msghand",
-                    std::function<void()>(
-                        std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < m_msghandler_threads; i++) {
+        threadMessageHandlers.emplace_back([this, i] {
+            const std::string name =
+                i == 0 ? "msghand" : strprintf("msghand.%d", i);
+            TraceThread(name.c_str(), [this, i] { ThreadMessageHandler(i); });
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(
@@ -2698,9 +2948,10 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::StopThreads() {
-    if (threadMessageHandler.joinable()) {
-        threadMessageHandler.join();
+    for (std::thread &thread : threadMessageHandlers) {
+        thread.join();
     }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
@@ -2745,6 +2996,10 @@ void CConnman::StopNodes() {
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef USE_EPOLL
+    // The sockets are closed, their descriptors can be reused on restart.
+    m_epoll_registrations.clear();
+#endif
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2762,6 +3017,11 @@ void CConnman::DeleteNode(CNode *pnode) {
 CConnman::~CConnman() {
     Interrupt();
     Stop();
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+    }
+#endif
 }
 
 void CConnman::SetServices(const CService &addr, ServiceFlags nServices) {
@@ -2986,6 +3246,13 @@ unsigned int CConnman::GetReceiveFloodSize() const {
     return nReceiveFloodSize;
 }
 
+CNode::TxRelay::TxRelay()
+    : m_next_announcement(g_tx_announcements.AddReader()) {}
+
+CNode::TxRelay::~TxRelay() {
+    g_tx_announcements.RemoveReader(m_next_announcement);
+}
+
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
              int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress &addrIn,
              uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn,
@@ -3041,7 +3308,43 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
     // make sure we use the appropriate network transport format
     std::vector<uint8_t> serializedHeader;
     pnode->m_serializer->prepareForTransport(*config, msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
+
+    PushSendBuffers(
+        pnode, msg.m_type,
+        std::make_shared<const std::vector<uint8_t>>(
+            std::move(serializedHeader)),
+        nMessageSize
+            ? std::make_shared<const std::vector<uint8_t>>(std::move(msg.data))
+            : nullptr);
+}
+
+void CConnman::PushMessage(CNode *pnode, const CSharedNetMsg &msg) {
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
+             SanitizeString(msg.m_type), msg.data ? msg.data->size() : 0,
+             pnode->GetId());
+
+    PushSendBuffers(pnode, msg.m_type, msg.header, msg.data);
+}
+
+CSharedNetMsg CConnman::MakeSharedMsg(CSerializedNetMsg &&msg) const {
+    std::vector<uint8_t> serializedHeader;
+    V1TransportSerializer().prepareForTransport(*config, msg,
+                                                serializedHeader);
+
+    CSharedNetMsg shared;
+    shared.header = std::make_shared<const std::vector<uint8_t>>(
+        std::move(serializedHeader));
+    if (!msg.data.empty()) {
+        shared.data =
+            std::make_shared<const std::vector<uint8_t>>(std::move(msg.data));
+    }
+    shared.m_type = std::move(msg.m_type);
+    return shared;
+}
+
+void CConnman::PushSendBuffers(CNode *pnode, const std::string &msg_type,
+                               SendBuffer header, SendBuffer data) {
+    size_t nTotalSize = header->size() + (data ? data->size() : 0);
 
     size_t nBytesSent = 0;
     {
@@ -3049,15 +3352,15 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         bool optimisticSend(pnode->vSendMsg.empty());
 
         // log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[msg_type] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::move(header));
+        if (data) {
+            pnode->vSendMsg.push_back(std::move(data));
         }
 
         // If write queue empty, attempt "optimistic write"
@@ -24,15 +24,18 @@
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
+#include <txinventory.h>
 #include <uint256.h>
 #include <validation.h> // For cs_main
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <memory>
 #include <thread>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -94,6 +97,14 @@ static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 
+/**
+ * Default for -msghandlerthreads, number of threads processing the messages
+ * of peers. The messages of a given peer are always processed by the same
+ * thread, in order.
+ */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+static const int MAX_MSGHANDLER_THREADS = 16;
+
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
@@ -127,6 +138,20 @@ struct CSerializedNetMsg {
     std::string m_type;
 };
 
+/** An immutable buffer, which can be queued for several peers at once. */
+using SendBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+/**
+ * A serialized message, along with its transport header, which can be sent to
+ * many peers while only being serialized and checksummed once. See
+ * CConnman::MakeSharedMsg.
+ */
+struct CSharedNetMsg {
+    SendBuffer header;
+    SendBuffer data;
+    std::string m_type;
+};
+
 /**
  * Different types of connections to a peer. This enum encapsulates the
  * information we have available at the time of opening or accepting the
@@ -197,6 +222,7 @@ public:
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
         std::vector<bool> m_asmap;
+        int m_msghandler_threads = DEFAULT_MSGHANDLER_THREADS;
     };
 
     void Init(const Options &connOptions) {
@@ -223,6 +249,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msghandler_threads = connOptions.m_msghandler_threads;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -261,6 +288,13 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
 
     void PushMessage(CNode *pnode, CSerializedNetMsg &&msg);
+    void PushMessage(CNode *pnode, const CSharedNetMsg &msg);
+
+    /**
+     * Frame a message so it can be pushed to several peers. All peers use the
+     * v1 transport, so they can share the same header.
+     */
+    CSharedNetMsg MakeSharedMsg(CSerializedNetMsg &&msg) const;
 
     template <typename Callable> void ForEachNode(Callable &&func) {
         LOCK(cs_vNodes);
@@ -410,7 +444,7 @@ private:
     void AddAddrFetch(const std::string &strDest);
     void ProcessAddrFetch();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int worker);
     void AcceptConnection(const ListenSocket &hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -420,6 +454,9 @@ private:
                            std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set,
                       std::set<SOCKET> &error_set);
+#ifdef USE_EPOLL
+    void EpollRegister(SOCKET hSocket, NodeId id, uint32_t events);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -442,6 +479,8 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    void PushSendBuffers(CNode *pnode, const std::string &msg_type,
+                         SendBuffer header, SendBuffer data);
     void DumpAddresses();
 
     // Network stats
@@ -530,8 +569,11 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /**
+     * Counter for waking the message processor threads, each of which waits
+     * for it to change.
+     */
+    uint64_t nMsgProcWake GUARDED_BY(mutexMsgProc){0};
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -539,11 +581,30 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    struct EpollRegistration {
+        //! Node owning the socket, or -1 for a listening socket
+        NodeId node;
+        //! Events the socket is registered for
+        uint32_t events;
+        //! Last SocketEvents() call which saw the socket
+        uint64_t generation;
+    };
+
+    // Used only by SocketHandler thread
+    int m_epoll_fd{-1};
+    uint64_t m_epoll_generation{0};
+    std::unordered_map<SOCKET, EpollRegistration> m_epoll_registrations;
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
+
+    /** Number of threads processing messages, peers are spread across them */
+    int m_msghandler_threads{DEFAULT_MSGHANDLER_THREADS};
 
     /**
      * flag for deciding to connect to an extra outbound peer, in excess of
@@ -670,6 +731,8 @@ struct CNodeStats {
     int64_t m_ping_wait_usec;
     int64_t m_min_ping_usec;
     Amount minFeeFilter;
+    // Memory used to relay transactions to this peer
+    size_t m_tx_relay_usage;
     // Our address, as reported by the peer
     std::string addrLocal;
     // Address of this peer
@@ -704,6 +767,41 @@ public:
     void SetVersion(int nVersionIn) { m_recv.SetVersion(nVersionIn); }
 };
 
+/**
+ * Pool of buffers for received message payloads, grouped by power-of-two size
+ * classes. Reusing the buffer of a processed message spares busy nodes an
+ * allocation, and the zeroing free of CSerializeData, for each message.
+ */
+class RecvBufferPool {
+public:
+    //! Smallest and largest pooled buffer sizes, as powers of two
+    static constexpr int MIN_SIZE_CLASS = 8;
+    static constexpr int MAX_SIZE_CLASS = 18;
+    //! Bytes worth of buffers kept in each size class
+    static constexpr size_t SIZE_CLASS_BUDGET = 512 * 1024;
+
+    /**
+     * Get an empty stream with room for size bytes, or for the largest size
+     * class for bigger payloads.
+     */
+    CDataStream Get(size_t size, int nType, int nVersion)
+        LOCKS_EXCLUDED(cs_pool);
+    /** Give back the stream of a message once it has been processed. */
+    void Put(CDataStream &&stream) LOCKS_EXCLUDED(cs_pool);
+    /** Number of pooled buffers. */
+    size_t Count() const LOCKS_EXCLUDED(cs_pool);
+
+private:
+    mutable Mutex cs_pool;
+    std::array<std::vector<CDataStream>, MAX_SIZE_CLASS - MIN_SIZE_CLASS + 1>
+        m_buffers GUARDED_BY(cs_pool);
+};
+
+extern RecvBufferPool g_recv_buffer_pool;
+
+/** The transactions to announce to all the peers we relay transactions to. */
+extern TxAnnouncementQueue g_tx_announcements;
+
 /**
  * The TransportDeserializer takes care of holding and deserializing the
  * network receive buffer. It can deserialize the network buffer into a
@@ -825,7 +923,7 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset{0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<uint8_t>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<SendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     Mutex cs_vSend;
     Mutex cs_hSocket;
     Mutex cs_vRecv;
@@ -946,8 +1044,12 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    std::unique_ptr<CRollingBloomFilter> m_addr_known = nullptr;
+    // Addresses are pushed to a peer by the threads processing the messages
+    // of other peers.
+    Mutex cs_addrSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrSend);
+    std::unique_ptr<CRollingBloomFilter>
+        m_addr_known PT_GUARDED_BY(cs_addrSend) = nullptr;
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds
@@ -962,6 +1064,9 @@ public:
     Mutex cs_inventory;
 
     struct TxRelay {
+        TxRelay();
+        ~TxRelay();
+
         mutable RecursiveMutex cs_filter;
         // We use fRelayTxes for two purposes -
         // a) it allows us to not relay tx invs before receiving the peer's
@@ -973,12 +1078,10 @@ public:
             GUARDED_BY(cs_filter){nullptr};
 
         mutable RecursiveMutex cs_tx_inventory;
-        CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){
-            50000, 0.000001};
-        // Set of transaction ids we still have to announce.
-        // They are sorted by the mempool before relay, so the order is not
-        // important.
-        std::set<TxId> setInventoryTxToSend GUARDED_BY(cs_tx_inventory);
+        KnownTxInventory m_inventory_known GUARDED_BY(cs_tx_inventory);
+        // Our position in g_tx_announcements: the transactions from there on
+        // still have to be announced.
+        uint64_t m_next_announcement GUARDED_BY(cs_tx_inventory);
         // Used for BIP35 mempool sending
         bool fSendMempool GUARDED_BY(cs_tx_inventory){false};
         // Last time a "MEMPOOL" request was serviced.
@@ -1118,6 +1221,7 @@ public:
     void Release() { nRefCount--; }
 
     void AddAddressKnown(const CAddress &_addr) {
+        LOCK(cs_addrSend);
         assert(m_addr_known);
         m_addr_known->insert(_addr.GetKey());
     }
@@ -1132,6 +1236,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         assert(m_addr_known);
         if (_addr.IsValid() && !m_addr_known->contains(_addr.GetKey()) &&
             addr_format_supported) {
@@ -1147,17 +1252,7 @@ public:
     void AddKnownTx(const TxId &txid) {
         if (m_tx_relay != nullptr) {
             LOCK(m_tx_relay->cs_tx_inventory);
-            m_tx_relay->filterInventoryKnown.insert(txid);
-        }
-    }
-
-    void PushTxInventory(const TxId &txid) {
-        if (m_tx_relay == nullptr) {
-            return;
-        }
-        LOCK(m_tx_relay->cs_tx_inventory);
-        if (!m_tx_relay->filterInventoryKnown.contains(txid)) {
-            m_tx_relay->setInventoryTxToSend.insert(txid);
+            m_tx_relay->m_inventory_known.insert(txid);
         }
     }
 
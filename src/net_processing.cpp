@@ -18,6 +18,7 @@
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <graphene.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
 #include <merkleblock.h>
@@ -38,6 +39,7 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <deque>
 #include <memory>
 #include <typeinfo>
 
@@ -102,34 +104,37 @@ static const unsigned int MAX_INV_SZ = 50000;
 static_assert(MAX_PROTOCOL_MESSAGE_LENGTH > MAX_INV_SZ * sizeof(CInv),
               "Max protocol message length must be greater than largest "
               "possible INV message");
-/** Maximum number of in-flight transactions from a peer */
-static constexpr int32_t MAX_PEER_TX_IN_FLIGHT = 100;
-/** Maximum number of announced transactions from a peer */
+/**
+ * Maximum number of in-flight transaction requests from a peer. It is not a
+ * hard limit, but the threshold at which point the OVERLOADED_PEER_TX_DELAY
+ * kicks in.
+ */
+static constexpr int32_t MAX_PEER_TX_REQUEST_IN_FLIGHT = 100;
+/**
+ * Maximum number of transactions to consider for requesting, per peer. It
+ * provides a reasonable DoS limit to per-peer memory usage spent on
+ * announcements, while covering peers continuously sending INVs at the
+ * maximum rate for several minutes.
+ */
 static constexpr int32_t MAX_PEER_TX_ANNOUNCEMENTS = 2 * MAX_INV_SZ;
-/** How many microseconds to delay requesting transactions from inbound peers */
-static constexpr std::chrono::microseconds INBOUND_PEER_TX_DELAY{
-    std::chrono::seconds{2}};
 /**
- * How long to wait (in microseconds) before downloading a transaction from an
- * additional peer.
+ * How many microseconds to delay requesting transactions from non-preferred
+ * (inbound) peers.
  */
-static constexpr std::chrono::microseconds GETDATA_TX_INTERVAL{
-    std::chrono::seconds{60}};
+static constexpr std::chrono::microseconds NONPREF_PEER_TX_DELAY{
+    std::chrono::seconds{2}};
 /**
- * Maximum delay (in microseconds) for transaction requests to avoid biasing
- * some peers over others.
+ * How many microseconds to delay requesting transactions from overloaded
+ * peers (see MAX_PEER_TX_REQUEST_IN_FLIGHT).
  */
-static constexpr std::chrono::microseconds MAX_GETDATA_RANDOM_DELAY{
+static constexpr std::chrono::microseconds OVERLOADED_PEER_TX_DELAY{
     std::chrono::seconds{2}};
 /**
- * How long to wait (in microseconds) before expiring an in-flight getdata
- * request to a peer.
+ * How long to wait (in microseconds) before downloading a transaction from an
+ * additional peer.
  */
-static constexpr std::chrono::microseconds TX_EXPIRY_INTERVAL{
-    GETDATA_TX_INTERVAL * 10};
-static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
-              "To preserve security, MAX_GETDATA_RANDOM_DELAY should not "
-              "exceed INBOUND_PEER_DELAY");
+static constexpr std::chrono::microseconds GETDATA_TX_INTERVAL{
+    std::chrono::seconds{60}};
 /**
  * Limit to avoid sending big packets. Not used in processing incoming GETDATA
  * for compatibility.
@@ -311,6 +316,8 @@ struct QueuedBlock {
     bool fValidatedHeaders;
     //! Optional, used for CMPCTBLOCK downloads
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+    //! Optional, used for GRBLK downloads
+    std::unique_ptr<PartiallyDownloadedGrapheneBlock> partialGrapheneBlock;
 };
 std::map<BlockHash, std::pair<NodeId, std::list<QueuedBlock>::iterator>>
     mapBlocksInFlight GUARDED_BY(cs_main);
@@ -447,70 +454,6 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
-    /*
-     * State associated with transaction download.
-     *
-     * Tx download algorithm:
-     *
-     *   When inv comes in, queue up (process_time, txid) inside the peer's
-     *   CNodeState (m_tx_process_time) as long as m_tx_announced for the peer
-     *   isn't too big (MAX_PEER_TX_ANNOUNCEMENTS).
-     *
-     *   The process_time for a transaction is set to nNow for outbound peers,
-     *   nNow + 2 seconds for inbound peers. This is the time at which we'll
-     *   consider trying to request the transaction from the peer in
-     *   SendMessages(). The delay for inbound peers is to allow outbound peers
-     *   a chance to announce before we request from inbound peers, to prevent
-     *   an adversary from using inbound connections to blind us to a
-     *   transaction (InvBlock).
-     *
-     *   When we call SendMessages() for a given peer,
-     *   we will loop over the transactions in m_tx_process_time, looking
-     *   at the transactions whose process_time <= nNow. We'll request each
-     *   such transaction that we don't have already and that hasn't been
-     *   requested from another peer recently, up until we hit the
-     *   MAX_PEER_TX_IN_FLIGHT limit for the peer. Then we'll update
-     *   g_already_asked_for for each requested txid, storing the time of the
-     *   GETDATA request. We use g_already_asked_for to coordinate transaction
-     *   requests amongst our peers.
-     *
-     *   For transactions that we still need but we have already recently
-     *   requested from some other peer, we'll reinsert (process_time, txid)
-     *   back into the peer's m_tx_process_time at the point in the future at
-     *   which the most recent GETDATA request would time out (ie
-     *   GETDATA_TX_INTERVAL + the request time stored in g_already_asked_for).
-     *   We add an additional delay for inbound peers, again to prefer
-     *   attempting download from outbound peers first.
-     *   We also add an extra small random delay up to 2 seconds
-     *   to avoid biasing some peers over others. (e.g., due to fixed ordering
-     *   of peer processing in ThreadMessageHandler).
-     *
-     *   When we receive a transaction from a peer, we remove the txid from the
-     *   peer's m_tx_in_flight set and from their recently announced set
-     *   (m_tx_announced).  We also clear g_already_asked_for for that entry, so
-     *   that if somehow the transaction is not accepted but also not added to
-     *   the reject filter, then we will eventually redownload from other
-     *   peers.
-     */
-    struct TxDownloadState {
-        /**
-         * Track when to attempt download of announced transactions (process
-         * time in micros -> txid)
-         */
-        std::multimap<std::chrono::microseconds, TxId> m_tx_process_time;
-
-        //! Store all the transactions a peer has recently announced
-        std::set<TxId> m_tx_announced;
-
-        //! Store transactions which were requested by us, with timestamp
-        std::map<TxId, std::chrono::microseconds> m_tx_in_flight;
-
-        //! Periodically check for stuck getdata requests
-        std::chrono::microseconds m_check_expiry_timer{0};
-    };
-
-    TxDownloadState m_tx_download;
-
     struct AvalancheState {
         std::chrono::time_point<std::chrono::steady_clock> last_poll;
     };
@@ -553,11 +496,6 @@ struct CNodeState {
     }
 };
 
-// Keeps track of the time (in microseconds) when transactions were requested
-// last time
-limitedmap<TxId, std::chrono::microseconds>
-    g_already_asked_for GUARDED_BY(cs_main)(MAX_INV_SZ);
-
 /** Map maintaining per-node state. */
 static std::map<NodeId, CNodeState> mapNodeState GUARDED_BY(cs_main);
 
@@ -570,6 +508,18 @@ static CNodeState *State(NodeId pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return &it->second;
 }
 
+/**
+ * A transaction received from a peer, waiting for its acceptance to the
+ * mempool.
+ */
+struct PendingTx {
+    const CTransactionRef tx;
+    /** Whether the scripts have been verified, successfully or not */
+    std::atomic<bool> verified{false};
+
+    explicit PendingTx(CTransactionRef txIn) : tx(std::move(txIn)) {}
+};
+
 /**
  * Data structure for an individual peer. This struct is not protected by
  * cs_main since it does not contain validation-critical data.
@@ -593,6 +543,25 @@ struct Peer {
      * (unless it has the noban permission). */
     bool m_should_discourage GUARDED_BY(m_misbehavior_mutex){false};
 
+    /** Protects the transactions pending acceptance to the mempool */
+    Mutex m_pending_txs_mutex;
+    /**
+     * Transactions received from this peer which are waiting for their
+     * scripts to be verified, in the order they were received. They are
+     * accepted to the mempool in that order, and other messages from the peer
+     * are not processed until they all have been.
+     */
+    std::deque<std::shared_ptr<PendingTx>>
+        m_pending_txs GUARDED_BY(m_pending_txs_mutex);
+
+    /** Whether transactions are relayed to this peer by reconciliation */
+    std::atomic<bool> m_txreconciliation{false};
+    /**
+     * Estimate of the bytes saved by the reconciliation with this peer: the
+     * size of the invs it avoided, minus the size of the messages it sent.
+     */
+    std::atomic<int64_t> m_txrecon_bytes_saved{0};
+
     Peer(NodeId id) : m_id(id) {}
 };
 
@@ -617,6 +586,48 @@ static PeerRef GetPeerRef(NodeId id) {
     return it != g_peer_map.end() ? it->second : nullptr;
 }
 
+/** The size of an entry of an inv message. */
+static constexpr int64_t INV_ENTRY_SIZE = 4 + 32;
+static_assert(MAX_RECON_SET_SIZE <= MAX_INV_SZ,
+              "A reconciliation set must fit in a single inv message");
+
+/**
+ * Send a transaction reconciliation message, and deduct its size from the
+ * bytes the reconciliation saved.
+ */
+static void PushTxReconciliationMessage(CConnman &connman, CNode &node,
+                                        Peer &peer, CSerializedNetMsg &&msg) {
+    peer.m_txrecon_bytes_saved -=
+        msg.data.size() + CMessageHeader::HEADER_SIZE;
+    connman.PushMessage(&node, std::move(msg));
+}
+
+/**
+ * Announce the transactions a reconciliation found the peer misses, unless it
+ * announced them to us in the meantime.
+ */
+static void AnnounceReconciledTxs(CConnman &connman, CNode &node, Peer &peer,
+                                  const CNetMsgMaker &msg_maker,
+                                  const std::vector<TxId> &txids) {
+    if (node.m_tx_relay == nullptr) {
+        return;
+    }
+    std::vector<CInv> invs;
+    {
+        LOCK(node.m_tx_relay->cs_tx_inventory);
+        for (const TxId &txid : txids) {
+            if (!node.m_tx_relay->m_inventory_known.contains(txid)) {
+                node.m_tx_relay->m_inventory_known.insert(txid);
+                invs.emplace_back(MSG_TX, txid);
+            }
+        }
+    }
+    if (!invs.empty()) {
+        PushTxReconciliationMessage(connman, node, peer,
+                                    msg_maker.Make(NetMsgType::INV, invs));
+    }
+}
+
 static void UpdatePreferredDownload(const CNode &node, CNodeState *state)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     nPreferredDownload -= state->fPreferredDownload;
@@ -799,6 +810,12 @@ static void UpdateBlockAvailability(NodeId nodeid, const BlockHash &hash)
     }
 }
 
+/** Whether we relay blocks with graphene with a peer. */
+static bool CanRelayGraphene(const CNode &node) {
+    return (node.GetLocalServices() & NODE_GRAPHENE) &&
+           (node.nServices & NODE_GRAPHENE);
+}
+
 /**
  * When a peer sends us a valid block, instruct it to announce blocks to us
  * using CMPCTBLOCK if possible by adding its nodeid to the end of
@@ -827,6 +844,11 @@ static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid,
     }
     connman.ForNode(nodeid, [&connman](CNode *pfrom) {
         AssertLockHeld(cs_main);
+        if (CanRelayGraphene(*pfrom)) {
+            // Graphene blocks depend on the size of our mempool, so we request
+            // them after the header is announced.
+            return true;
+        }
         uint64_t nCMPCTBLOCKVersion = 1;
         if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
             // As per BIP152, we only get 3 of our peers to announce
@@ -989,79 +1011,43 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
     }
 }
 
-void EraseTxRequest(const TxId &txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    g_already_asked_for.erase(txid);
-}
-
-std::chrono::microseconds GetTxRequestTime(const TxId &txid)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    auto it = g_already_asked_for.find(txid);
-    if (it != g_already_asked_for.end()) {
-        return it->second;
-    }
-    return {};
-}
-
-void UpdateTxRequestTime(const TxId &txid,
-                         std::chrono::microseconds request_time)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    auto it = g_already_asked_for.find(txid);
-    if (it == g_already_asked_for.end()) {
-        g_already_asked_for.insert(std::make_pair(txid, request_time));
-    } else {
-        g_already_asked_for.update(it, request_time);
-    }
-}
-
-std::chrono::microseconds
-CalculateTxGetDataTime(const TxId &txid, std::chrono::microseconds current_time,
-                       bool use_inbound_delay)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    std::chrono::microseconds process_time;
-    const auto last_request_time = GetTxRequestTime(txid);
-    // First time requesting this tx
-    if (last_request_time.count() == 0) {
-        process_time = current_time;
-    } else {
-        // Randomize the delay to avoid biasing some peers over others (such as
-        // due to fixed ordering of peer processing in ThreadMessageHandler)
-        process_time = last_request_time + GETDATA_TX_INTERVAL +
-                       GetRandMicros(MAX_GETDATA_RANDOM_DELAY);
-    }
-
-    // We delay processing announcements from inbound peers
-    if (use_inbound_delay) {
-        process_time += INBOUND_PEER_TX_DELAY;
-    }
-
-    return process_time;
-}
+} // namespace
 
-void RequestTx(CNodeState *state, const TxId &txid,
-               std::chrono::microseconds current_time)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    CNodeState::TxDownloadState &peer_download_state = state->m_tx_download;
-    if (peer_download_state.m_tx_announced.size() >=
-            MAX_PEER_TX_ANNOUNCEMENTS ||
-        peer_download_state.m_tx_process_time.size() >=
-            MAX_PEER_TX_ANNOUNCEMENTS ||
-        peer_download_state.m_tx_announced.count(txid)) {
-        // Too many queued announcements from this peer, or we already have
-        // this announcement
+void PeerManager::AddTxAnnouncement(const CNode &node, const TxId &txid,
+                                    std::chrono::microseconds current_time) {
+    // For m_txrequest
+    AssertLockHeld(::cs_main);
+    NodeId nodeid = node.GetId();
+    if (!node.HasPermission(PF_RELAY) &&
+        m_txrequest.Count(nodeid) >= MAX_PEER_TX_ANNOUNCEMENTS) {
+        // Too many queued announcements from this peer
         return;
     }
-    peer_download_state.m_tx_announced.insert(txid);
-
-    // Calculate the time to try requesting this transaction. Use
-    // fPreferredDownload as a proxy for outbound peers.
-    const auto process_time =
-        CalculateTxGetDataTime(txid, current_time, !state->fPreferredDownload);
-
-    peer_download_state.m_tx_process_time.emplace(process_time, txid);
+    const CNodeState *state = State(nodeid);
+
+    // Decide the TxRequestTracker parameters for this announcement:
+    // - "preferred": if fPreferredDownload is set (= outbound, or PF_NOBAN
+    //   permission)
+    // - "reqtime": current time plus delays for:
+    //   - NONPREF_PEER_TX_DELAY for announcements from non-preferred
+    //     connections
+    //   - OVERLOADED_PEER_TX_DELAY for announcements from peers which have at
+    //     least MAX_PEER_TX_REQUEST_IN_FLIGHT requests in flight (and don't
+    //     have PF_RELAY).
+    auto delay = std::chrono::microseconds{0};
+    const bool preferred = state->fPreferredDownload;
+    if (!preferred) {
+        delay += NONPREF_PEER_TX_DELAY;
+    }
+    const bool overloaded =
+        !node.HasPermission(PF_RELAY) &&
+        m_txrequest.CountInFlight(nodeid) >= MAX_PEER_TX_REQUEST_IN_FLIGHT;
+    if (overloaded) {
+        delay += OVERLOADED_PEER_TX_DELAY;
+    }
+    m_txrequest.ReceivedInv(nodeid, txid, preferred, current_time + delay);
 }
 
-} // namespace
-
 // This function is used for testing the stale tip eviction logic, see
 // denialofservice_tests.cpp
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds) {
@@ -1100,7 +1086,7 @@ void PeerManager::ReattemptInitialBroadcast(CScheduler &scheduler) const {
     for (const TxId &txid : unbroadcast_txids) {
         // Sanity check: all unbroadcast txns should exist in the mempool
         if (m_mempool.exists(txid)) {
-            RelayTransaction(txid, m_connman);
+            RelayTransaction(txid);
         } else {
             m_mempool.RemoveUnbroadcastTx(txid, true);
         }
@@ -1143,6 +1129,10 @@ void PeerManager::FinalizeNode(const Config &config, NodeId nodeid,
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    m_txrequest.DisconnectedPeer(nodeid);
+    if (m_txreconciliation) {
+        m_txreconciliation->ForgetPeer(nodeid);
+    }
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -1158,6 +1148,7 @@ void PeerManager::FinalizeNode(const Config &config, NodeId nodeid,
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
+        assert(m_txrequest.Size() == 0);
     }
     LogPrint(BCLog::NET, "Cleared nodestate for peer=%d\n", nodeid);
 }
@@ -1188,6 +1179,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     }
     stats.m_misbehavior_score =
         WITH_LOCK(peer->m_misbehavior_mutex, return peer->m_misbehavior_score);
+    stats.m_txreconciliation = peer->m_txreconciliation;
+    stats.m_txrecon_bytes_saved = peer->m_txrecon_bytes_saved;
 
     return true;
 }
@@ -1503,6 +1496,10 @@ PeerManager::PeerManager(const CChainParams &chainparams, CConnman &connman,
     g_recent_confirmed_transactions.reset(
         new CRollingBloomFilter(24000, 0.000001));
 
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+        m_txreconciliation = std::make_unique<TxReconciliationTracker>();
+    }
+
     const Consensus::Params &consensusParams = chainparams.GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
@@ -1574,6 +1571,12 @@ void PeerManager::BlockConnected(const std::shared_ptr<const CBlock> &pblock,
             g_recent_confirmed_transactions->insert(ptx->GetId());
         }
     }
+    {
+        LOCK(cs_main);
+        for (const CTransactionRef &ptx : pblock->vtx) {
+            m_txrequest.ForgetTxId(ptx->GetId());
+        }
+    }
 }
 
 void PeerManager::BlockDisconnected(const std::shared_ptr<const CBlock> &block,
@@ -1598,6 +1601,38 @@ static std::shared_ptr<const CBlock>
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
     most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+// The serialized messages for the above, shared by all the peers they are sent
+// to. The block message is only built once a peer asks for the block.
+static CSharedNetMsg
+    most_recent_block_msg GUARDED_BY(cs_most_recent_block);
+static CSharedNetMsg
+    most_recent_compact_block_msg GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Return the block message for the most recent block, serializing it the
+ * first time it is sent.
+ */
+static CSharedNetMsg
+GetMostRecentBlockMsg(const CConnman &connman,
+                      const std::shared_ptr<const CBlock> &pblock) {
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block == pblock && most_recent_block_msg.header) {
+            return most_recent_block_msg;
+        }
+    }
+
+    // Serialize without holding the lock, a concurrent request may end up
+    // doing the same but the result is identical.
+    CSharedNetMsg msg = connman.MakeSharedMsg(
+        CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, *pblock));
+
+    LOCK(cs_most_recent_block);
+    if (most_recent_block == pblock) {
+        most_recent_block_msg = msg;
+    }
+    return msg;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1608,6 +1643,9 @@ void PeerManager::NewPoWValidBlock(
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
         std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    // Serialized once, whichever number of peers it is announced to.
+    const CSharedNetMsg cmpctblock_msg = m_connman.MakeSharedMsg(
+        msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
 
     LOCK(cs_main);
 
@@ -1624,13 +1662,14 @@ void PeerManager::NewPoWValidBlock(
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_block_msg = CSharedNetMsg();
+        most_recent_compact_block_msg = cmpctblock_msg;
     }
 
-    m_connman.ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    m_connman.ForEachNode([this, &cmpctblock_msg, pindex,
                            &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION ||
             pnode->fDisconnect) {
             return;
@@ -1644,8 +1683,7 @@ void PeerManager::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerManager::NewPoWValidBlock", hashBlock.ToString(),
                      pnode->GetId());
-            m_connman.PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            m_connman.PushMessage(pnode, cmpctblock_msg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1769,9 +1807,8 @@ static bool AlreadyHaveBlock(const BlockHash &block_hash)
     return LookupBlockIndex(block_hash) != nullptr;
 }
 
-void RelayTransaction(const TxId &txid, const CConnman &connman) {
-    connman.ForEachNode(
-        [&txid](CNode *pnode) { pnode->PushTxInventory(txid); });
+void RelayTransaction(const TxId &txid) {
+    g_tx_announcements.Push(txid);
 }
 
 static void RelayAddress(const CAddress &addr, bool fReachable,
@@ -1828,10 +1865,12 @@ static void ProcessGetBlockData(const Config &config, CNode &pfrom,
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    CSharedNetMsg a_recent_compact_block_msg;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_msg = most_recent_compact_block_msg;
     }
 
     bool need_activate_chain = false;
@@ -1923,8 +1962,14 @@ static void ProcessGetBlockData(const Config &config, CNode &pfrom,
             pblock = pblockRead;
         }
         if (inv.IsMsgBlk()) {
-            connman.PushMessage(&pfrom,
-                                msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            if (pblock == a_recent_block) {
+                // Many peers are likely to ask for it, share the message.
+                connman.PushMessage(&pfrom,
+                                    GetMostRecentBlockMsg(connman, pblock));
+            } else {
+                connman.PushMessage(&pfrom,
+                                    msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            }
         } else if (inv.IsMsgFilteredBlk()) {
             bool sendMerkleBlock = false;
             CMerkleBlock merkleBlock;
@@ -1967,10 +2012,17 @@ static void ProcessGetBlockData(const Config &config, CNode &pfrom,
             if (CanDirectFetch(consensusParams) &&
                 pindex->nHeight >=
                     ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
-                connman.PushMessage(
-                    &pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
+                if (a_recent_compact_block &&
+                    a_recent_compact_block->header.GetHash() ==
+                        pindex->GetBlockHash()) {
+                    connman.PushMessage(&pfrom, a_recent_compact_block_msg);
+                } else {
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+                    connman.PushMessage(
+                        &pfrom, msgMaker.Make(nSendFlags,
+                                              NetMsgType::CMPCTBLOCK,
+                                              cmpctblock));
+                }
             } else {
                 connman.PushMessage(
                     &pfrom,
@@ -2085,7 +2137,7 @@ static void ProcessGetData(const Config &config, CNode &pfrom,
                     // parent.
                     if (WITH_LOCK(
                             pfrom.m_tx_relay->cs_tx_inventory,
-                            return !pfrom.m_tx_relay->filterInventoryKnown
+                            return !pfrom.m_tx_relay->m_inventory_known
                                         .contains(txin.prevout.GetTxId()))) {
                         LOCK(cs_main);
                         State(pfrom.GetId())
@@ -2148,6 +2200,44 @@ void PeerManager::SendBlockTransactions(CNode &pfrom, const CBlock &block,
         &pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+std::shared_ptr<const CBlock>
+PeerManager::GetGrapheneRequestedBlock(CNode &pfrom,
+                                       const BlockHash &blockhash) {
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block_hash == blockhash) {
+            return most_recent_block;
+        }
+        // Unlock cs_most_recent_block to avoid cs_main lock inversion
+    }
+
+    LOCK(cs_main);
+
+    const CBlockIndex *pindex = LookupBlockIndex(blockhash);
+    if (!pindex || !pindex->nStatus.hasData()) {
+        LogPrint(BCLog::NET,
+                 "Peer %d sent us a graphene request for a block we don't "
+                 "have\n",
+                 pfrom.GetId());
+        return nullptr;
+    }
+
+    if (pindex->nHeight < ::ChainActive().Height() - MAX_BLOCKTXN_DEPTH) {
+        // As for getblocktxn, don't read old blocks from disk for a small
+        // response.
+        LogPrint(BCLog::NET,
+                 "Peer %d sent us a graphene request for a block > %i deep\n",
+                 pfrom.GetId(), MAX_BLOCKTXN_DEPTH);
+        pfrom.vRecvGetData.push_back(CInv(MSG_BLOCK, blockhash));
+        return nullptr;
+    }
+
+    auto block = std::make_shared<CBlock>();
+    bool ret = ReadBlockFromDisk(*block, pindex, m_chainparams.GetConsensus());
+    assert(ret);
+    return block;
+}
+
 void PeerManager::ProcessHeadersMessage(
     const Config &config, CNode &pfrom,
     const std::vector<CBlockHeader> &headers, bool via_compact_block) {
@@ -2317,14 +2407,24 @@ void PeerManager::ProcessHeadersMessage(
                              pindexLast->GetBlockHash().ToString(),
                              pindexLast->nHeight);
                 }
-                if (vGetData.size() > 0) {
-                    if (nodestate->fSupportsDesiredCmpctVersion &&
-                        vGetData.size() == 1 && mapBlocksInFlight.size() == 1 &&
-                        pindexLast->pprev->IsValid(BlockValidity::CHAIN)) {
+                if (vGetData.size() == 1 && mapBlocksInFlight.size() == 1 &&
+                    pindexLast->pprev->IsValid(BlockValidity::CHAIN)) {
+                    if (CanRelayGraphene(pfrom)) {
+                        // Download using a graphene block, which is even
+                        // smaller than a compact block.
+                        GrapheneBlockRequest req;
+                        req.blockhash = BlockHash(vGetData[0].hash);
+                        req.nMempoolTxs = m_mempool.size();
+                        m_connman.PushMessage(
+                            &pfrom, msgMaker.Make(NetMsgType::GETGRBLK, req));
+                        vGetData.clear();
+                    } else if (nodestate->fSupportsDesiredCmpctVersion) {
                         // In any case, we want to download using a compact
                         // block, not a regular one.
                         vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
                     }
+                }
+                if (vGetData.size() > 0) {
                     m_connman.PushMessage(
                         &pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetData));
                 }
@@ -2414,7 +2514,7 @@ void PeerManager::ProcessOrphanTx(const Config &config,
                                Amount::zero() /* nAbsurdFee */)) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
                      orphanTxId.ToString());
-            RelayTransaction(orphanTxId, m_connman);
+            RelayTransaction(orphanTxId);
             for (size_t i = 0; i < orphanTx.vout.size(); i++) {
                 auto it_by_prev =
                     mapOrphanTransactionsByPrev.find(COutPoint(orphanTxId, i));
@@ -2449,6 +2549,176 @@ void PeerManager::ProcessOrphanTx(const Config &config,
     }
 }
 
+void PeerManager::ProcessTransaction(const Config &config, CNode &pfrom,
+                                     const CTransactionRef &ptx) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+
+    const CTransaction &tx = *ptx;
+    const TxId &txid = tx.GetId();
+
+    // Whatever the outcome, the transaction ends up in the mempool, the orphan
+    // pool or recentRejects, so there is no need to request it anymore.
+    m_txrequest.ForgetTxId(txid);
+
+    TxValidationState state;
+
+    if (!AlreadyHaveTx(txid, m_mempool) &&
+        AcceptToMemoryPool(config, m_mempool, state, ptx,
+                           false /* bypass_limits */,
+                           Amount::zero() /* nAbsurdFee */)) {
+        m_mempool.check(&::ChainstateActive().CoinsTip());
+        RelayTransaction(tx.GetId());
+        for (size_t i = 0; i < tx.vout.size(); i++) {
+            auto it_by_prev =
+                mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto &elem : it_by_prev->second) {
+                    pfrom.orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        pfrom.nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL,
+                 "AcceptToMemoryPool: peer=%d: accepted %s "
+                 "(poolsz %u txn, %u kB)\n",
+                 pfrom.GetId(), tx.GetId().ToString(), m_mempool.size(),
+                 m_mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this
+        // one
+        ProcessOrphanTx(config, pfrom.orphan_work_set);
+    } else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+        // It may be the case that the orphans parents have all been
+        // rejected.
+        bool fRejectedParents = false;
+        for (const CTxIn &txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.GetTxId())) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            const auto current_time = GetTime<std::chrono::microseconds>();
+
+            for (const CTxIn &txin : tx.vin) {
+                // FIXME: MSG_TX should use a TxHash, not a TxId.
+                const TxId _txid = txin.prevout.GetTxId();
+                pfrom.AddKnownTx(_txid);
+                if (!AlreadyHaveTx(_txid, m_mempool)) {
+                    AddTxAnnouncement(pfrom, _txid, current_time);
+                }
+            }
+            AddOrphanTx(ptx, pfrom.GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow
+            // unbounded (see CVE-2012-3789)
+            unsigned int nMaxOrphanTx = (unsigned int)std::max(
+                int64_t(0), gArgs.GetArg("-maxorphantx",
+                                         DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL,
+                         "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL,
+                     "not keeping orphan with rejected parents %s\n",
+                     tx.GetId().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetId());
+        }
+    } else {
+        assert(recentRejects);
+        recentRejects->insert(tx.GetId());
+
+        if (RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom.HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from whitelisted peers,
+            // even if they were already in the mempool or rejected from it
+            // due to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that might result in being
+            // disconnected (or banned).
+            if (state.IsInvalid() && TxRelayMayResultInDisconnect(state)) {
+                LogPrintf("Not relaying invalid transaction %s from "
+                          "whitelisted peer=%d (%s)\n",
+                          tx.GetId().ToString(), pfrom.GetId(),
+                          state.ToString());
+            } else {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
+                          tx.GetId().ToString(), pfrom.GetId());
+                RelayTransaction(tx.GetId());
+            }
+        }
+    }
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    if (state.IsInvalid()) {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n",
+                 tx.GetHash().ToString(), pfrom.GetId(), state.ToString());
+        MaybePunishNodeForTx(pfrom.GetId(), state);
+    }
+}
+
+bool PeerManager::ProcessPendingTransactions(const Config &config,
+                                             CNode &pfrom) {
+    PeerRef peer = GetPeerRef(pfrom.GetId());
+    if (!peer) {
+        return false;
+    }
+
+    while (true) {
+        std::shared_ptr<PendingTx> pending;
+        {
+            LOCK(peer->m_pending_txs_mutex);
+            if (peer->m_pending_txs.empty()) {
+                return false;
+            }
+            if (!peer->m_pending_txs.front()->verified) {
+                return true;
+            }
+
+            pending = std::move(peer->m_pending_txs.front());
+            peer->m_pending_txs.pop_front();
+        }
+
+        LOCK2(cs_main, g_cs_orphans);
+        ProcessTransaction(config, pfrom, pending->tx);
+    }
+}
+
+void PeerManager::StartTxVerification(int num_threads) {
+    m_tx_verify_queue.Start(num_threads);
+}
+
+void PeerManager::StopTxVerification() {
+    m_tx_verify_queue.Stop();
+}
+
 /**
  * Validation logic for compact filters request handling.
  *
@@ -2814,6 +3084,18 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         // Signal ADDRv2 support (BIP155).
         m_connman.PushMessage(&pfrom, msg_maker.Make(NetMsgType::SENDADDRV2));
 
+        // Signal transaction reconciliation support, if the peer supports it
+        // too and wants transactions from us.
+        if (m_txreconciliation && (nServices & NODE_TXRECON) &&
+            pfrom.m_tx_relay != nullptr && fRelay) {
+            const uint64_t salt =
+                m_txreconciliation->PreRegisterPeer(pfrom.GetId());
+            m_connman.PushMessage(&pfrom,
+                                  msg_maker.Make(NetMsgType::SENDRECON,
+                                                 TXRECONCILIATION_VERSION,
+                                                 salt));
+        }
+
         pfrom.nServices = nServices;
         pfrom.SetAddrLocal(addrMe);
         {
@@ -3047,6 +3329,99 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         return;
     }
 
+    if (msg_type == NetMsgType::SENDRECON) {
+        uint32_t version;
+        uint64_t remote_salt;
+        vRecv >> version >> remote_salt;
+        // Ignore the message if we didn't send ours.
+        if (!m_txreconciliation || version < TXRECONCILIATION_VERSION ||
+            !m_txreconciliation->RegisterPeer(
+                pfrom.GetId(), !pfrom.IsInboundConn(), remote_salt)) {
+            return;
+        }
+        PeerRef peer = GetPeerRef(pfrom.GetId());
+        if (peer) {
+            peer->m_txreconciliation = true;
+        }
+        LogPrint(BCLog::NET,
+                 "relaying transactions to peer=%d by reconciliation%s\n",
+                 pfrom.GetId(),
+                 m_txreconciliation->IsFloodPeer(pfrom.GetId())
+                     ? " (flooding to it)"
+                     : "");
+        return;
+    }
+
+    if (msg_type == NetMsgType::REQRECON) {
+        uint32_t set_size;
+        uint16_t q;
+        vRecv >> set_size >> q;
+        PeerRef peer = GetPeerRef(pfrom.GetId());
+        if (!m_txreconciliation || !peer) {
+            return;
+        }
+        std::optional<std::vector<uint8_t>> skdata =
+            m_txreconciliation->HandleReconciliationRequest(pfrom.GetId(),
+                                                            set_size, q);
+        if (!skdata) {
+            LogPrint(BCLog::NET, "unexpected reqrecon from peer=%d\n",
+                     pfrom.GetId());
+            return;
+        }
+        PushTxReconciliationMessage(
+            m_connman, pfrom, *peer,
+            msgMaker.Make(NetMsgType::SKETCH, *skdata));
+        return;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        std::vector<uint8_t> skdata;
+        vRecv >> skdata;
+        PeerRef peer = GetPeerRef(pfrom.GetId());
+        if (!m_txreconciliation || !peer) {
+            return;
+        }
+        std::vector<uint32_t> ask_shortids;
+        std::vector<TxId> announce;
+        std::optional<bool> decoded = m_txreconciliation->HandleSketch(
+            pfrom.GetId(), skdata, ask_shortids, announce);
+        if (!decoded) {
+            LogPrint(BCLog::NET, "unexpected sketch from peer=%d\n",
+                     pfrom.GetId());
+            return;
+        }
+        LogPrint(BCLog::NET,
+                 "reconciliation with peer=%d %s, announcing %u "
+                 "transactions, asking for %u\n",
+                 pfrom.GetId(), *decoded ? "succeeded" : "failed",
+                 announce.size(), ask_shortids.size());
+        PushTxReconciliationMessage(
+            m_connman, pfrom, *peer,
+            msgMaker.Make(NetMsgType::RECONCILDIFF, uint8_t(*decoded),
+                           ask_shortids));
+        AnnounceReconciledTxs(m_connman, pfrom, *peer, msgMaker, announce);
+        return;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        uint8_t success;
+        std::vector<uint32_t> ask_shortids;
+        vRecv >> success >> ask_shortids;
+        PeerRef peer = GetPeerRef(pfrom.GetId());
+        if (!m_txreconciliation || !peer) {
+            return;
+        }
+        std::vector<TxId> announce;
+        if (!m_txreconciliation->HandleReconciliationDifference(
+                pfrom.GetId(), success, ask_shortids, announce)) {
+            LogPrint(BCLog::NET, "unexpected reconcildiff from peer=%d\n",
+                     pfrom.GetId());
+            return;
+        }
+        AnnounceReconciledTxs(m_connman, pfrom, *peer, msgMaker, announce);
+        return;
+    }
+
     if (msg_type == NetMsgType::SENDHEADERS) {
         LOCK(cs_main);
         State(pfrom.GetId())->fPreferHeaders = true;
@@ -3138,7 +3513,7 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
                     return;
                 } else if (!fAlreadyHave && !m_chainman.ActiveChainstate()
                                                  .IsInitialBlockDownload()) {
-                    RequestTx(State(pfrom.GetId()), txid, current_time);
+                    AddTxAnnouncement(pfrom, txid, current_time);
                 }
             } else {
                 LogPrint(BCLog::NET,
@@ -3326,6 +3701,50 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         return;
     }
 
+    if (msg_type == NetMsgType::GETGRBLK) {
+        GrapheneBlockRequest req;
+        vRecv >> req;
+
+        if (!(pfrom.GetLocalServices() & NODE_GRAPHENE)) {
+            LogPrint(BCLog::NET,
+                     "Unexpected getgrblk message received from peer %d\n",
+                     pfrom.GetId());
+            return;
+        }
+
+        std::shared_ptr<const CBlock> block =
+            GetGrapheneRequestedBlock(pfrom, req.blockhash);
+        if (block) {
+            m_connman.PushMessage(
+                &pfrom,
+                msgMaker.Make(NetMsgType::GRBLK,
+                              CGrapheneBlock(*block, req.nMempoolTxs)));
+        }
+        return;
+    }
+
+    if (msg_type == NetMsgType::GETGRBLKTX) {
+        GrapheneBlockTransactionsRequest req;
+        vRecv >> req;
+
+        if (!(pfrom.GetLocalServices() & NODE_GRAPHENE)) {
+            LogPrint(BCLog::NET,
+                     "Unexpected getgrblktx message received from peer %d\n",
+                     pfrom.GetId());
+            return;
+        }
+
+        std::shared_ptr<const CBlock> block =
+            GetGrapheneRequestedBlock(pfrom, req.blockhash);
+        if (block) {
+            m_connman.PushMessage(
+                &pfrom,
+                msgMaker.Make(NetMsgType::BLOCKTXN,
+                              GetGrapheneBlockTransactions(*block, req)));
+        }
+        return;
+    }
+
     if (msg_type == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         BlockHash hashStop;
@@ -3421,139 +3840,36 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
 
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction &tx = *ptx;
-        const TxId &txid = tx.GetId();
+        const TxId &txid = ptx->GetId();
         pfrom.AddKnownTx(txid);
 
         LOCK2(cs_main, g_cs_orphans);
 
-        TxValidationState state;
-
-        CNodeState *nodestate = State(pfrom.GetId());
-        nodestate->m_tx_download.m_tx_announced.erase(txid);
-        nodestate->m_tx_download.m_tx_in_flight.erase(txid);
-        EraseTxRequest(txid);
-
-        if (!AlreadyHaveTx(txid, m_mempool) &&
-            AcceptToMemoryPool(config, m_mempool, state, ptx,
-                               false /* bypass_limits */,
-                               Amount::zero() /* nAbsurdFee */)) {
-            m_mempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetId(), m_connman);
-            for (size_t i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev =
-                    mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto &elem : it_by_prev->second) {
-                        pfrom.orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom.nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL,
-                     "AcceptToMemoryPool: peer=%d: accepted %s "
-                     "(poolsz %u txn, %u kB)\n",
-                     pfrom.GetId(), tx.GetId().ToString(), m_mempool.size(),
-                     m_mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this
-            // one
-            ProcessOrphanTx(config, pfrom.orphan_work_set);
-        } else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
-            // It may be the case that the orphans parents have all been
-            // rejected.
-            bool fRejectedParents = false;
-            for (const CTxIn &txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.GetTxId())) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const CTxIn &txin : tx.vin) {
-                    // FIXME: MSG_TX should use a TxHash, not a TxId.
-                    const TxId _txid = txin.prevout.GetTxId();
-                    pfrom.AddKnownTx(_txid);
-                    if (!AlreadyHaveTx(_txid, m_mempool)) {
-                        RequestTx(State(pfrom.GetId()), _txid, current_time);
-                    }
-                }
-                AddOrphanTx(ptx, pfrom.GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow
-                // unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max(
-                    int64_t(0), gArgs.GetArg("-maxorphantx",
-                                             DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL,
-                             "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL,
-                         "not keeping orphan with rejected parents %s\n",
-                         tx.GetId().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetId());
-            }
-        } else {
-            assert(recentRejects);
-            recentRejects->insert(tx.GetId());
-
-            if (RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
+        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
+
+        PeerRef peer = GetPeerRef(pfrom.GetId());
+        if (peer && m_tx_verify_queue.IsRunning()) {
+            // Verify the scripts on a worker thread. The transaction is then
+            // accepted to the mempool by ProcessPendingTransactions, after the
+            // ones received before it from this peer. If it cannot be queued,
+            // it is verified when it is accepted.
+            auto pending = std::make_shared<PendingTx>(ptx);
+            if (AlreadyHaveTx(txid, m_mempool) ||
+                !m_tx_verify_queue.Enqueue([this, &config, pending]() {
+                    PreVerifyTransactionScripts(config, m_mempool,
+                                                *pending->tx);
+                    pending->verified = true;
+                    m_connman.WakeMessageHandler();
+                })) {
+                pending->verified = true;
             }
 
-            if (pfrom.HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from whitelisted peers,
-                // even if they were already in the mempool or rejected from it
-                // due to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that might result in being
-                // disconnected (or banned).
-                if (state.IsInvalid() && TxRelayMayResultInDisconnect(state)) {
-                    LogPrintf("Not relaying invalid transaction %s from "
-                              "whitelisted peer=%d (%s)\n",
-                              tx.GetId().ToString(), pfrom.GetId(),
-                              state.ToString());
-                } else {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
-                              tx.GetId().ToString(), pfrom.GetId());
-                    RelayTransaction(tx.GetId(), m_connman);
-                }
-            }
+            LOCK(peer->m_pending_txs_mutex);
+            peer->m_pending_txs.push_back(std::move(pending));
+            return;
         }
 
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid()) {
-            LogPrint(BCLog::MEMPOOLREJ,
-                     "%s from peer=%d was not accepted: %s\n",
-                     tx.GetHash().ToString(), pfrom.GetId(), state.ToString());
-            MaybePunishNodeForTx(pfrom.GetId(), state);
-        }
+        ProcessTransaction(config, pfrom, ptx);
         return;
     }
 
@@ -3828,6 +4144,84 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         return;
     }
 
+    if (msg_type == NetMsgType::GRBLK) {
+        // Ignore grblk received while importing
+        if (fImporting || fReindex) {
+            LogPrint(BCLog::NET,
+                     "Unexpected grblk message received from peer %d\n",
+                     pfrom.GetId());
+            return;
+        }
+
+        CGrapheneBlock grapheneblock;
+        vRecv >> grapheneblock;
+
+        // As for cmpctblock, jump to the BLOCKTXN handling code with a dummy
+        // message if we have all the transactions.
+        bool fProcessBLOCKTXN = false;
+        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+
+        {
+            LOCK2(cs_main, g_cs_orphans);
+
+            // We only accept graphene blocks we requested, after their header.
+            const BlockHash hash = grapheneblock.header.GetHash();
+            std::map<BlockHash,
+                     std::pair<NodeId, std::list<QueuedBlock>::iterator>>::
+                iterator it = mapBlocksInFlight.find(hash);
+            if (it == mapBlocksInFlight.end() ||
+                it->second.first != pfrom.GetId() ||
+                it->second.second->partialBlock ||
+                it->second.second->partialGrapheneBlock) {
+                LogPrint(BCLog::NET,
+                         "Peer %d sent us a graphene block we weren't "
+                         "expecting\n",
+                         pfrom.GetId());
+                return;
+            }
+
+            std::unique_ptr<PartiallyDownloadedGrapheneBlock> &partialBlock =
+                it->second.second->partialGrapheneBlock;
+            partialBlock.reset(
+                new PartiallyDownloadedGrapheneBlock(config, &m_mempool));
+            ReadStatus status =
+                partialBlock->InitData(grapheneblock, vExtraTxnForCompact);
+            if (status == READ_STATUS_INVALID) {
+                // Reset in-flight state in case of whitelist
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom, 100, "invalid graphene block");
+                return;
+            } else if (status == READ_STATUS_FAILED) {
+                // The IBLT couldn't be decoded, the block is still in flight
+                // so fall back to a compact block.
+                partialBlock.reset();
+                std::vector<CInv> vInv(1);
+                vInv[0] = CInv(MSG_CMPCT_BLOCK, hash);
+                m_connman.PushMessage(
+                    &pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                return;
+            }
+
+            GrapheneBlockTransactionsRequest req =
+                partialBlock->GetMissingTransactionsRequest();
+            if (req.shorttxids.empty()) {
+                BlockTransactions txn;
+                txn.blockhash = hash;
+                blockTxnMsg << txn;
+                fProcessBLOCKTXN = true;
+            } else {
+                m_connman.PushMessage(
+                    &pfrom, msgMaker.Make(NetMsgType::GETGRBLKTX, req));
+            }
+        } // cs_main
+
+        if (fProcessBLOCKTXN) {
+            return ProcessMessage(config, pfrom, NetMsgType::BLOCKTXN,
+                                  blockTxnMsg, time_received, interruptMsgProc);
+        }
+        return;
+    }
+
     if (msg_type == NetMsgType::BLOCKTXN) {
         // Ignore blocktxn received while importing
         if (fImporting || fReindex) {
@@ -3849,7 +4243,8 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
                      std::pair<NodeId, std::list<QueuedBlock>::iterator>>::
                 iterator it = mapBlocksInFlight.find(resp.blockhash);
             if (it == mapBlocksInFlight.end() ||
-                !it->second.second->partialBlock ||
+                !(it->second.second->partialBlock ||
+                  it->second.second->partialGrapheneBlock) ||
                 it->second.first != pfrom.GetId()) {
                 LogPrint(BCLog::NET,
                          "Peer %d sent us block transactions for block "
@@ -3858,9 +4253,17 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
                 return;
             }
 
-            PartiallyDownloadedBlock &partialBlock =
-                *it->second.second->partialBlock;
-            ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
+            ReadStatus status;
+            if (it->second.second->partialGrapheneBlock) {
+                status = it->second.second->partialGrapheneBlock->FillBlock(
+                    *pblock, resp.txn);
+                // The graphene block can't be filled again, and a block
+                // failing to reconstruct is requested in full.
+                it->second.second->partialGrapheneBlock.reset();
+            } else {
+                status = it->second.second->partialBlock->FillBlock(*pblock,
+                                                                    resp.txn);
+            }
             if (status == READ_STATUS_INVALID) {
                 // Reset in-flight state in case of whitelist.
                 MarkBlockAsReceived(resp.blockhash);
@@ -4066,6 +4469,26 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
                     votes.emplace_back(e, inv.hash);
                 };
 
+                if (inv.type == MSG_TX) {
+                    const TxId txid(inv.hash);
+
+                    // Transaction in the mempool.
+                    if (m_mempool.exists(txid)) {
+                        insertVote(0);
+                        continue;
+                    }
+
+                    // Recently rejected transaction.
+                    if (recentRejects->contains(txid)) {
+                        insertVote(1);
+                        continue;
+                    }
+
+                    // Unknown transaction.
+                    insertVote(-1);
+                    continue;
+                }
+
                 // Not a block.
                 if (inv.type != MSG_BLOCK) {
                     insertVote(-1);
@@ -4146,10 +4569,42 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         }
 
         std::vector<avalanche::BlockUpdate> updates;
-        if (!g_avalanche->registerVotes(pfrom.GetId(), response, updates)) {
+        std::vector<avalanche::TxUpdate> txUpdates;
+        if (!g_avalanche->registerVotes(pfrom.GetId(), response, updates,
+                                        txUpdates)) {
             return;
         }
 
+        if (txUpdates.size()) {
+            LOCK2(cs_main, m_mempool.cs);
+            for (const avalanche::TxUpdate &u : txUpdates) {
+                const TxId &txid = u.getTxId();
+                switch (u.getStatus()) {
+                    case avalanche::TxUpdate::Status::Invalid: {
+                        LogPrint(BCLog::MEMPOOL,
+                                 "Avalanche rejected %s, removing it from the "
+                                 "mempool\n",
+                                 txid.ToString());
+                        CTransactionRef tx = m_mempool.get(txid);
+                        if (tx) {
+                            m_mempool.removeRecursive(
+                                *tx, MemPoolRemovalReason::AVALANCHE);
+                        }
+                        // Don't request it again.
+                        recentRejects->insert(txid);
+                    } break;
+                    case avalanche::TxUpdate::Status::Finalized: {
+                        LogPrint(BCLog::MEMPOOL, "Avalanche finalized %s\n",
+                                 txid.ToString());
+                        m_mempool.SetAvalancheFinalized(txid);
+                    } break;
+                    case avalanche::TxUpdate::Status::Rejected:
+                    case avalanche::TxUpdate::Status::Accepted:
+                        break;
+                }
+            }
+        }
+
         if (updates.size()) {
             for (avalanche::BlockUpdate &u : updates) {
                 CBlockIndex *pindex = u.getBlockIndex();
@@ -4216,7 +4671,7 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
         }
         pfrom.fSentAddr = true;
 
-        pfrom.vAddrToSend.clear();
+        WITH_LOCK(pfrom.cs_addrSend, pfrom.vAddrToSend.clear());
         std::vector<CAddress> vAddr = m_connman.GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -4439,28 +4894,18 @@ void PeerManager::ProcessMessage(const Config &config, CNode &pfrom,
     }
 
     if (msg_type == NetMsgType::NOTFOUND) {
-        // Remove the NOTFOUND transactions from the peer
-        LOCK(cs_main);
-        CNodeState *state = State(pfrom.GetId());
         std::vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() <=
-            MAX_PEER_TX_IN_FLIGHT + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            MAX_PEER_TX_ANNOUNCEMENTS + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            LOCK(::cs_main);
             for (CInv &inv : vInv) {
                 if (inv.IsMsgTx()) {
-                    const TxId txid(inv.hash);
-                    // If we receive a NOTFOUND message for a txid we requested,
-                    // erase it from our data structures for this peer.
-                    auto in_flight_it =
-                        state->m_tx_download.m_tx_in_flight.find(txid);
-                    if (in_flight_it ==
-                        state->m_tx_download.m_tx_in_flight.end()) {
-                        // Skip any further work if this is a spurious NOTFOUND
-                        // message.
-                        continue;
-                    }
-                    state->m_tx_download.m_tx_in_flight.erase(in_flight_it);
-                    state->m_tx_download.m_tx_announced.erase(txid);
+                    // If we receive a NOTFOUND message for a tx we requested,
+                    // mark the announcement for it as completed in
+                    // TxRequestTracker.
+                    m_txrequest.ReceivedResponse(pfrom.GetId(),
+                                                 TxId(inv.hash));
                 }
             }
         }
@@ -4545,6 +4990,8 @@ bool PeerManager::ProcessMessages(const Config &config, CNode *pfrom,
         ProcessOrphanTx(config, pfrom->orphan_work_set);
     }
 
+    const bool fPendingTxs = ProcessPendingTransactions(config, *pfrom);
+
     if (pfrom->fDisconnect) {
         return false;
     }
@@ -4569,6 +5016,13 @@ bool PeerManager::ProcessMessages(const Config &config, CNode *pfrom,
         if (pfrom->vProcessMsg.empty()) {
             return false;
         }
+        // Transactions are accepted in the order they were received, so only
+        // more transactions are processed while some are being verified. The
+        // verification threads wake us up when they are done.
+        if (fPendingTxs &&
+            pfrom->vProcessMsg.front().m_command != NetMsgType::TX) {
+            return false;
+        }
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg,
                     pfrom->vProcessMsg.begin());
@@ -4628,6 +5082,10 @@ bool PeerManager::ProcessMessages(const Config &config, CNode *pfrom,
             return false;
         }
 
+        // Accept the transactions which are already verified, including one
+        // which couldn't be queued for verification.
+        ProcessPendingTransactions(config, *pfrom);
+
         if (!pfrom->vRecvGetData.empty()) {
             fMoreWork = true;
         }
@@ -4640,6 +5098,8 @@ bool PeerManager::ProcessMessages(const Config &config, CNode *pfrom,
                  __func__, SanitizeString(msg_type), nMessageSize);
     }
 
+    g_recv_buffer_pool.Put(std::move(vRecv));
+
     return fMoreWork;
 }
 
@@ -4836,23 +5296,6 @@ void PeerManager::CheckForStaleTipAndEvictPeers(
     m_stale_tip_check_time = time_in_seconds + STALE_CHECK_INTERVAL;
 }
 
-namespace {
-class CompareInvMempoolOrder {
-    CTxMemPool *mp;
-
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool) { mp = _mempool; }
-
-    bool operator()(std::set<TxId>::iterator a, std::set<TxId>::iterator b) {
-        /**
-         * As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later.
-         */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-} // namespace
-
 bool PeerManager::SendMessages(const Config &config, CNode *pto,
                                std::atomic<bool> &interruptMsgProc) {
     const Consensus::Params &consensusParams =
@@ -4928,6 +5371,7 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
         if (pto->IsAddrRelayPeer() && pto->m_next_addr_send < current_time) {
             pto->m_next_addr_send =
                 PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             assert(pto->m_addr_known);
@@ -5101,12 +5545,8 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash ==
                             pBestIndex->GetBlockHash()) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(
-                                *most_recent_block);
                             m_connman.PushMessage(
-                                pto, msgMaker.Make(nSendFlags,
-                                                   NetMsgType::CMPCTBLOCK,
-                                                   cmpctblock));
+                                pto, most_recent_compact_block_msg);
                             fGotBlockFromCache = true;
                         }
                     }
@@ -5226,7 +5666,10 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
                 if (fSendTrickle) {
                     LOCK(pto->m_tx_relay->cs_filter);
                     if (!pto->m_tx_relay->fRelayTxes) {
-                        pto->m_tx_relay->setInventoryTxToSend.clear();
+                        const uint64_t end = g_tx_announcements.End();
+                        g_tx_announcements.Advance(
+                            pto->m_tx_relay->m_next_announcement, end);
+                        pto->m_tx_relay->m_next_announcement = end;
                     }
                 }
 
@@ -5244,7 +5687,6 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
 
                     for (const auto &txinfo : vtxinfo) {
                         const TxId &txid = txinfo.tx->GetId();
-                        pto->m_tx_relay->setInventoryTxToSend.erase(txid);
                         // Don't send transactions that peers will not put into
                         // their mempool
                         if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
@@ -5255,7 +5697,7 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
                                 *txinfo.tx)) {
                             continue;
                         }
-                        pto->m_tx_relay->filterInventoryKnown.insert(txid);
+                        pto->m_tx_relay->m_inventory_known.insert(txid);
                         // Responses to MEMPOOL requests bypass the
                         // m_recently_announced_invs filter.
                         addInvAndMaybeFlush(MSG_TX, txid);
@@ -5266,89 +5708,110 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
 
                 // Determine transactions to relay
                 if (fSendTrickle) {
-                    // Produce a vector with all candidates for sending
-                    std::vector<std::set<TxId>::iterator> vInvTx;
-                    vInvTx.reserve(
-                        pto->m_tx_relay->setInventoryTxToSend.size());
-                    for (std::set<TxId>::iterator it =
-                             pto->m_tx_relay->setInventoryTxToSend.begin();
-                         it != pto->m_tx_relay->setInventoryTxToSend.end();
-                         it++) {
-                        vInvTx.push_back(it);
-                    }
                     CFeeRate filterrate;
                     {
                         LOCK(pto->m_tx_relay->cs_feeFilter);
                         filterrate = CFeeRate(pto->m_tx_relay->minFeeFilter);
                     }
-                    // Topologically and fee-rate sort the inventory we send for
-                    // privacy and priority reasons. A heap is used so that not
-                    // all items need sorting if only a few are being sent.
-                    CompareInvMempoolOrder compareInvMempoolOrder(&m_mempool);
-                    std::make_heap(vInvTx.begin(), vInvTx.end(),
-                                   compareInvMempoolOrder);
+                    // Go through the transactions relayed since the last
+                    // trickle. They are in the order they were relayed, so
+                    // the parents are announced before their children.
                     // No reason to drain out at many times the network's
                     // capacity, especially since we have many peers and some
                     // will draw much shorter delays.
+                    const unsigned int nMaxRelayedTransactions =
+                        INVENTORY_BROADCAST_MAX_PER_MB *
+                        config.GetMaxBlockSize() / 1000000;
                     unsigned int nRelayedTransactions = 0;
+                    // The transactions for the peers we reconcile with go to
+                    // their reconciliation set instead of an inv.
+                    const bool reconcile =
+                        m_txreconciliation &&
+                        m_txreconciliation->IsPeerRegistered(pto->GetId()) &&
+                        !m_txreconciliation->IsFloodPeer(pto->GetId());
+                    int64_t reconciled = 0;
+                    uint64_t pos = pto->m_tx_relay->m_next_announcement;
+                    std::vector<TxId> vInvTx;
                     LOCK(pto->m_tx_relay->cs_filter);
-                    while (!vInvTx.empty() &&
-                           nRelayedTransactions <
-                               INVENTORY_BROADCAST_MAX_PER_MB *
-                                   config.GetMaxBlockSize() / 1000000) {
-                        // Fetch the top element from the heap
-                        std::pop_heap(vInvTx.begin(), vInvTx.end(),
-                                      compareInvMempoolOrder);
-                        std::set<TxId>::iterator it = vInvTx.back();
-                        vInvTx.pop_back();
-                        const TxId txid = *it;
-                        // Remove it from the to-be-sent set
-                        pto->m_tx_relay->setInventoryTxToSend.erase(it);
-                        // Check if not in the filter already
-                        if (pto->m_tx_relay->filterInventoryKnown.contains(
-                                txid)) {
-                            continue;
-                        }
-                        // Not in the mempool anymore? don't bother sending it.
-                        auto txinfo = m_mempool.info(txid);
-                        if (!txinfo.tx) {
-                            continue;
-                        }
-                        // Peer told you to not send transactions at that
-                        // feerate? Don't bother sending it.
-                        if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
-                            continue;
-                        }
-                        if (pto->m_tx_relay->pfilter &&
-                            !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(
-                                *txinfo.tx)) {
-                            continue;
+                    while (nRelayedTransactions < nMaxRelayedTransactions) {
+                        vInvTx.clear();
+                        g_tx_announcements.Read(pos, nMaxRelayedTransactions,
+                                                vInvTx);
+                        if (vInvTx.empty()) {
+                            break;
                         }
-                        // Send
-                        State(pto->GetId())
-                            ->m_recently_announced_invs.insert(txid);
-                        addInvAndMaybeFlush(MSG_TX, txid);
-                        nRelayedTransactions++;
-                        {
-                            // Expire old relay messages
-                            while (!vRelayExpiration.empty() &&
-                                   vRelayExpiration.front().first < nNow) {
-                                mapRelay.erase(vRelayExpiration.front().second);
-                                vRelayExpiration.pop_front();
+                        for (const TxId &txid : vInvTx) {
+                            if (nRelayedTransactions >=
+                                nMaxRelayedTransactions) {
+                                break;
                             }
-
-                            auto ret = mapRelay.insert(
-                                std::make_pair(txid, std::move(txinfo.tx)));
-                            if (ret.second) {
-                                vRelayExpiration.push_back(std::make_pair(
-                                    nNow +
-                                        std::chrono::microseconds{
-                                            RELAY_TX_CACHE_TIME}
-                                            .count(),
-                                    ret.first));
+                            ++pos;
+                            // Check if the peer doesn't know it already
+                            if (pto->m_tx_relay->m_inventory_known.contains(
+                                    txid)) {
+                                continue;
+                            }
+                            // Not in the mempool anymore? don't bother
+                            // sending it.
+                            auto txinfo = m_mempool.info(txid);
+                            if (!txinfo.tx) {
+                                continue;
+                            }
+                            // Peer told you to not send transactions at that
+                            // feerate? Don't bother sending it.
+                            if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
+                                continue;
+                            }
+                            if (pto->m_tx_relay->pfilter &&
+                                !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(
+                                    *txinfo.tx)) {
+                                continue;
+                            }
+                            // Send
+                            State(pto->GetId())
+                                ->m_recently_announced_invs.insert(txid);
+                            if (reconcile && m_txreconciliation->AddToSet(
+                                                 pto->GetId(), txid)) {
+                                // The peer isn't known to have it until the
+                                // reconciliation.
+                                reconciled++;
+                            } else {
+                                addInvAndMaybeFlush(MSG_TX, txid);
+                                pto->m_tx_relay->m_inventory_known.insert(
+                                    txid);
+                            }
+                            nRelayedTransactions++;
+                            {
+                                // Expire old relay messages
+                                while (!vRelayExpiration.empty() &&
+                                       vRelayExpiration.front().first < nNow) {
+                                    mapRelay.erase(
+                                        vRelayExpiration.front().second);
+                                    vRelayExpiration.pop_front();
+                                }
+
+                                auto ret = mapRelay.insert(
+                                    std::make_pair(txid, std::move(txinfo.tx)));
+                                if (ret.second) {
+                                    vRelayExpiration.push_back(std::make_pair(
+                                        nNow +
+                                            std::chrono::microseconds{
+                                                RELAY_TX_CACHE_TIME}
+                                                .count(),
+                                        ret.first));
+                                }
                             }
                         }
-                        pto->m_tx_relay->filterInventoryKnown.insert(txid);
+                    }
+                    g_tx_announcements.Advance(
+                        pto->m_tx_relay->m_next_announcement, pos);
+                    pto->m_tx_relay->m_next_announcement = pos;
+                    if (reconciled > 0) {
+                        PeerRef peer = GetPeerRef(pto->GetId());
+                        if (peer) {
+                            peer->m_txrecon_bytes_saved +=
+                                reconciled * INV_ENTRY_SIZE;
+                        }
                     }
                 }
             }
@@ -5476,70 +5939,30 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
         //
         // Message: getdata (transactions)
         //
-
-        // For robustness, expire old requests after a long timeout, so that we
-        // can resume downloading transactions from a peer even if they were
-        // unresponsive in the past. Eventually we should consider disconnecting
-        // peers, but this is conservative.
-        if (state.m_tx_download.m_check_expiry_timer <= current_time) {
-            for (auto it = state.m_tx_download.m_tx_in_flight.begin();
-                 it != state.m_tx_download.m_tx_in_flight.end();) {
-                if (it->second <= current_time - TX_EXPIRY_INTERVAL) {
-                    LogPrint(BCLog::NET,
-                             "timeout of inflight tx %s from peer=%d\n",
-                             it->first.ToString(), pto->GetId());
-                    state.m_tx_download.m_tx_announced.erase(it->first);
-                    state.m_tx_download.m_tx_in_flight.erase(it++);
-                } else {
-                    ++it;
-                }
-            }
-            // On average, we do this check every TX_EXPIRY_INTERVAL. Randomize
-            // so that we're not doing this for all peers at the same time.
-            state.m_tx_download.m_check_expiry_timer =
-                current_time + TX_EXPIRY_INTERVAL / 2 +
-                GetRandMicros(TX_EXPIRY_INTERVAL);
-        }
-
-        auto &tx_process_time = state.m_tx_download.m_tx_process_time;
-        while (!tx_process_time.empty() &&
-               tx_process_time.begin()->first <= current_time &&
-               state.m_tx_download.m_tx_in_flight.size() <
-                   MAX_PEER_TX_IN_FLIGHT) {
-            const TxId txid = tx_process_time.begin()->second;
-            // Erase this entry from tx_process_time (it may be added back for
-            // processing at a later time, see below)
-            tx_process_time.erase(tx_process_time.begin());
-            CInv inv(MSG_TX, txid);
+        std::vector<std::pair<NodeId, TxId>> expired;
+        auto requestable =
+            m_txrequest.GetRequestable(pto->GetId(), current_time, &expired);
+        for (const auto &entry : expired) {
+            LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n",
+                     entry.second.ToString(), entry.first);
+        }
+        for (const TxId &txid : requestable) {
             if (!AlreadyHaveTx(txid, m_mempool)) {
-                // If this transaction was last requested more than 1 minute
-                // ago, then request.
-                const auto last_request_time = GetTxRequestTime(txid);
-                if (last_request_time <= current_time - GETDATA_TX_INTERVAL) {
-                    LogPrint(BCLog::NET, "Requesting %s peer=%d\n",
-                             inv.ToString(), pto->GetId());
-                    vGetData.push_back(inv);
-                    if (vGetData.size() >= MAX_GETDATA_SZ) {
-                        m_connman.PushMessage(
-                            pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
-                        vGetData.clear();
-                    }
-                    UpdateTxRequestTime(txid, current_time);
-                    state.m_tx_download.m_tx_in_flight.emplace(txid,
-                                                               current_time);
-                } else {
-                    // This transaction is in flight from someone else; queue
-                    // up processing to happen after the download times out
-                    // (with a slight delay for inbound peers, to prefer
-                    // requests to outbound peers).
-                    const auto next_process_time = CalculateTxGetDataTime(
-                        txid, current_time, !state.fPreferredDownload);
-                    tx_process_time.emplace(next_process_time, txid);
+                LogPrint(BCLog::NET, "Requesting tx %s peer=%d\n",
+                         txid.ToString(), pto->GetId());
+                vGetData.emplace_back(MSG_TX, txid);
+                if (vGetData.size() >= MAX_GETDATA_SZ) {
+                    m_connman.PushMessage(
+                        pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+                    vGetData.clear();
                 }
+                m_txrequest.RequestedTx(pto->GetId(), txid,
+                                        current_time + GETDATA_TX_INTERVAL);
             } else {
                 // We have already seen this transaction, no need to download.
-                state.m_tx_download.m_tx_announced.erase(txid);
-                state.m_tx_download.m_tx_in_flight.erase(txid);
+                // This is just a belt-and-suspenders, as this should already
+                // be called whenever a transaction becomes AlreadyHaveTx().
+                m_txrequest.ForgetTxId(txid);
             }
         }
 
@@ -5606,6 +6029,22 @@ bool PeerManager::SendMessages(const Config &config, CNode *pto,
                     timeNow + GetRandInt(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
             }
         }
+
+        //
+        // Message: reqrecon
+        //
+        if (m_txreconciliation) {
+            if (auto request = m_txreconciliation->MaybeRequestReconciliation(
+                    pto->GetId(), current_time)) {
+                PeerRef peer = GetPeerRef(pto->GetId());
+                if (peer) {
+                    PushTxReconciliationMessage(
+                        m_connman, *pto, *peer,
+                        msgMaker.Make(NetMsgType::REQRECON, request->set_size,
+                                      request->q));
+                }
+            }
+        }
     } // release cs_main
     return true;
 }
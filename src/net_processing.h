@@ -9,6 +9,9 @@
 #include <consensus/params.h>
 #include <net.h>
 #include <sync.h>
+#include <txreconciliation.h>
+#include <txrequest.h>
+#include <txverifyqueue.h>
 #include <validationinterface.h>
 
 extern RecursiveMutex cs_main;
@@ -33,6 +36,18 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
  */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/**
+ * Default for -txverifythreads, number of threads verifying the scripts of
+ * relayed transactions ahead of their acceptance to the mempool.
+ */
+static const int DEFAULT_TXVERIFY_THREADS = 2;
+static const int MAX_TXVERIFY_THREADS = 16;
+/**
+ * Maximum number of relayed transactions waiting for a verification thread.
+ * When the queue is full, transactions are verified on the message handler
+ * thread instead.
+ */
+static const size_t MAX_TXVERIFY_QUEUE_SIZE = 1000;
 /** Threshold for marking a node to be discouraged, e.g. disconnected and added
  * to the discouragement filter. */
 static const int DISCOURAGEMENT_THRESHOLD{100};
@@ -135,6 +150,16 @@ public:
      */
     void ReattemptInitialBroadcast(CScheduler &scheduler) const;
 
+    /**
+     * Start verifying the scripts of relayed transactions on a pool of worker
+     * threads. Transactions are still accepted to the mempool one at a time,
+     * in the order they were received from each peer, once their scripts have
+     * been verified.
+     */
+    void StartTxVerification(int num_threads);
+    /** Stop the transaction verification threads and wait for them. */
+    void StopTxVerification();
+
 private:
     // overloaded variant of above to operate on CNode*s
     void Misbehaving(const CNode &node, int howmuch,
@@ -180,6 +205,20 @@ private:
 
     void ProcessOrphanTx(const Config &config, std::set<TxId> &orphan_work_set)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /**
+     * Try to accept a transaction received from a peer to the mempool, and
+     * handle the orphans, rejects and relay that follow.
+     */
+    void ProcessTransaction(const Config &config, CNode &pfrom,
+                            const CTransactionRef &ptx)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /**
+     * Process the transactions received from a peer whose scripts have been
+     * verified, in the order they were received.
+     *
+     * @return True if some transactions are still being verified
+     */
+    bool ProcessPendingTransactions(const Config &config, CNode &pfrom);
     /** Process a single headers message from a peer. */
     void ProcessHeadersMessage(const Config &config, CNode &pfrom,
                                const std::vector<CBlockHeader> &headers,
@@ -187,6 +226,21 @@ private:
 
     void SendBlockTransactions(CNode &pfrom, const CBlock &block,
                                const BlockTransactionsRequest &req);
+    /**
+     * Get the block of a getgrblk or getgrblktx request, if it is recent
+     * enough. Older blocks are queued to be sent in full instead.
+     */
+    std::shared_ptr<const CBlock>
+    GetGrapheneRequestedBlock(CNode &pfrom, const BlockHash &blockhash);
+
+    /**
+     * Register with TxRequestTracker that an INV has been received from a
+     * peer. The announcement parameters are decided in PeerManager and then
+     * passed to TxRequestTracker.
+     */
+    void AddTxAnnouncement(const CNode &node, const TxId &txid,
+                           std::chrono::microseconds current_time)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     const CChainParams &m_chainparams;
     CConnman &m_connman;
@@ -200,6 +254,17 @@ private:
 
     //! Next time to check for stale tip
     int64_t m_stale_tip_check_time;
+
+    //! Schedules the download of the transactions announced by peers.
+    TxRequestTracker m_txrequest GUARDED_BY(::cs_main);
+
+    //! Relays transactions by set reconciliation with the peers supporting
+    //! it. Only set with -txreconciliation.
+    std::unique_ptr<TxReconciliationTracker> m_txreconciliation;
+
+    //! Verifies the scripts of relayed transactions. Declared last so that the
+    //! worker threads are stopped before anything they use is destroyed.
+    TxVerifyQueue m_tx_verify_queue{MAX_TXVERIFY_QUEUE_SIZE};
 };
 
 struct CNodeStateStats {
@@ -207,12 +272,14 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    bool m_txreconciliation = false;
+    int64_t m_txrecon_bytes_saved = 0;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
 /** Relay transaction to every node */
-void RelayTransaction(const TxId &txid, const CConnman &connman);
+void RelayTransaction(const TxId &txid);
 
 #endif // BITCOIN_NET_PROCESSING_H
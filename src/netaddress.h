@@ -254,6 +254,7 @@ public:
     }
 
     friend class CSubNet;
+    friend class SubNetTrie;
 
 private:
     /**
@@ -483,6 +484,8 @@ public:
     }
     friend bool operator<(const CSubNet &a, const CSubNet &b);
 
+    friend class SubNetTrie;
+
     SERIALIZE_METHODS(CSubNet, obj) {
         READWRITE(obj.network);
         if (obj.network.IsIPv4()) {
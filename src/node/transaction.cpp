@@ -92,7 +92,7 @@ TransactionError BroadcastTransaction(NodeContext &node, const Config &config,
         // best-effort of initial broadcast
         node.mempool->AddUnbroadcastTx(txid);
 
-        RelayTransaction(txid, *node.connman);
+        RelayTransaction(txid);
     }
 
     return TransactionError::OK;
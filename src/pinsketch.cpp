@@ -0,0 +1,279 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+// Arithmetic in GF(2^32), with the elements represented as polynomials over
+// GF(2) modulo x^32 + x^7 + x^3 + x^2 + 1.
+
+uint32_t Mul(uint32_t a, uint32_t b) {
+    // Carry-less multiplication, 4 bits of b at a time.
+    uint64_t multiples[16];
+    multiples[0] = 0;
+    multiples[1] = a;
+    for (int i = 2; i < 16; i += 2) {
+        multiples[i] = multiples[i / 2] << 1;
+        multiples[i + 1] = multiples[i] ^ a;
+    }
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4) {
+        r = (r << 4) ^ multiples[(b >> i) & 15];
+    }
+    // The low part of the modulus has degree 7, so two folds reduce any
+    // product.
+    uint64_t high = r >> 32;
+    r = (r & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    high = r >> 32;
+    r = (r & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    return uint32_t(r);
+}
+
+uint32_t Inv(uint32_t a) {
+    assert(a != 0);
+    // a^(2^32 - 2) is the inverse of a.
+    uint32_t result = 1;
+    uint32_t power = a;
+    for (uint32_t exponent = 0xfffffffe; exponent != 0; exponent >>= 1) {
+        if (exponent & 1) {
+            result = Mul(result, power);
+        }
+        power = Mul(power, power);
+    }
+    return result;
+}
+
+// Polynomials over GF(2^32), lowest degree coefficient first, without
+// trailing zero coefficients. The zero polynomial is empty.
+using Poly = std::vector<uint32_t>;
+
+void Trim(Poly &a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
+
+void Add(Poly &a, const Poly &b) {
+    if (a.size() < b.size()) {
+        a.resize(b.size(), 0);
+    }
+    for (size_t i = 0; i < b.size(); ++i) {
+        a[i] ^= b[i];
+    }
+    Trim(a);
+}
+
+//! Divide a by the non-zero polynomial b. a is replaced by the remainder, and
+//! the quotient is returned if quotient is not nullptr.
+void DivMod(Poly &a, const Poly &b, Poly *quotient = nullptr) {
+    assert(!b.empty());
+    const size_t deg_b = b.size() - 1;
+    const uint32_t inv_lead = b.back() == 1 ? 1 : Inv(b.back());
+    if (quotient) {
+        quotient->assign(a.size() >= b.size() ? a.size() - deg_b : 0, 0);
+    }
+    while (a.size() > deg_b) {
+        const uint32_t factor = Mul(a.back(), inv_lead);
+        const size_t shift = a.size() - b.size();
+        if (quotient) {
+            (*quotient)[shift] = factor;
+        }
+        for (size_t i = 0; i < deg_b; ++i) {
+            a[shift + i] ^= Mul(factor, b[i]);
+        }
+        a.pop_back();
+        Trim(a);
+    }
+}
+
+void MakeMonic(Poly &a) {
+    const uint32_t inv_lead = Inv(a.back());
+    for (uint32_t &coef : a) {
+        coef = Mul(coef, inv_lead);
+    }
+}
+
+//! The monic greatest common divisor of a and b, which must not both be zero.
+Poly Gcd(Poly a, Poly b) {
+    while (!b.empty()) {
+        DivMod(a, b);
+        std::swap(a, b);
+    }
+    MakeMonic(a);
+    return a;
+}
+
+//! a^2 modulo mod. Squaring is linear in characteristic 2, so this only
+//! squares the coefficients before the reduction.
+Poly SquareMod(const Poly &a, const Poly &mod) {
+    Poly square(a.empty() ? 0 : 2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        square[2 * i] = Mul(a[i], a[i]);
+    }
+    DivMod(square, mod);
+    return square;
+}
+
+//! Tr(factor * z) modulo mod, where Tr(y) = y + y^2 + y^4 + ... + y^(2^31)
+//! maps GF(2^32) to GF(2).
+Poly TraceMod(uint32_t factor, const Poly &mod) {
+    Poly power{0, factor};
+    DivMod(power, mod);
+    Poly trace = power;
+    for (int i = 1; i < 32; ++i) {
+        power = SquareMod(power, mod);
+        Add(trace, power);
+    }
+    return trace;
+}
+
+//! Whether the monic polynomial poly is a product of distinct linear factors,
+//! that is whether it divides z^(2^32) - z.
+bool HasDistinctRoots(const Poly &poly) {
+    Poly z{0, 1};
+    DivMod(z, poly);
+    Poly power = z;
+    for (int i = 0; i < 32; ++i) {
+        power = SquareMod(power, poly);
+    }
+    return power == z;
+}
+
+/**
+ * Find the roots of a monic polynomial with distinct roots, using the
+ * Berlekamp trace algorithm: for any two distinct roots, one of the
+ * Tr(2^i * z) takes a different value on them, so that its gcd with the
+ * polynomial splits them apart. The basis elements before first_basis are
+ * known not to split poly.
+ */
+bool FindRoots(const Poly &poly, int first_basis,
+               std::vector<uint32_t> &roots) {
+    if (poly.size() == 2) {
+        // z + c, whose root is c in characteristic 2.
+        roots.push_back(poly[0]);
+        return true;
+    }
+    for (int i = first_basis; i < 32; ++i) {
+        const Poly factor = Gcd(poly, TraceMod(uint32_t(1) << i, poly));
+        if (factor.size() > 1 && factor.size() < poly.size()) {
+            Poly remainder = poly;
+            Poly cofactor;
+            DivMod(remainder, factor, &cofactor);
+            return FindRoots(factor, i + 1, roots) &&
+                   FindRoots(cofactor, i + 1, roots);
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element) {
+    assert(element != 0);
+    const uint32_t square = Mul(element, element);
+    uint32_t power = element;
+    for (uint32_t &sum : m_sums) {
+        sum ^= power;
+        power = Mul(power, square);
+    }
+}
+
+void PinSketch::Merge(const PinSketch &other) {
+    m_sums.resize(std::min(m_sums.size(), other.m_sums.size()));
+    for (size_t i = 0; i < m_sums.size(); ++i) {
+        m_sums[i] ^= other.m_sums[i];
+    }
+}
+
+std::vector<uint8_t> PinSketch::Serialize() const {
+    std::vector<uint8_t> data;
+    data.reserve(4 * m_sums.size());
+    for (const uint32_t sum : m_sums) {
+        for (int i = 0; i < 4; ++i) {
+            data.push_back(sum >> (8 * i));
+        }
+    }
+    return data;
+}
+
+PinSketch PinSketch::Deserialize(const std::vector<uint8_t> &data) {
+    if (data.size() % 4 != 0) {
+        return PinSketch(0);
+    }
+    PinSketch sketch(data.size() / 4);
+    for (size_t i = 0; i < data.size(); ++i) {
+        sketch.m_sums[i / 4] |= uint32_t(data[i]) << (8 * (i % 4));
+    }
+    return sketch;
+}
+
+bool PinSketch::Decode(std::vector<uint32_t> &elements) const {
+    elements.clear();
+
+    // All the power sums S_1 ... S_2c, the even ones being S_2k = S_k^2.
+    const size_t capacity = m_sums.size();
+    std::vector<uint32_t> sums(2 * capacity);
+    for (size_t j = 0; j < sums.size(); ++j) {
+        sums[j] = j % 2 == 0 ? m_sums[j / 2] : Mul(sums[j / 2], sums[j / 2]);
+    }
+
+    // The Berlekamp-Massey algorithm finds the shortest linear recurrence
+    // followed by the power sums. Its connection polynomial is the product of
+    // the (1 - x * z) for the elements x.
+    Poly connection{1};
+    Poly previous{1};
+    size_t length = 0;
+    size_t shift = 1;
+    uint32_t previous_discrepancy = 1;
+    for (size_t n = 0; n < sums.size(); ++n) {
+        uint32_t discrepancy = sums[n];
+        for (size_t i = 1; i <= length && i < connection.size(); ++i) {
+            discrepancy ^= Mul(connection[i], sums[n - i]);
+        }
+        if (discrepancy == 0) {
+            ++shift;
+            continue;
+        }
+        const uint32_t factor = Mul(discrepancy, Inv(previous_discrepancy));
+        const Poly saved = connection;
+        if (connection.size() < previous.size() + shift) {
+            connection.resize(previous.size() + shift, 0);
+        }
+        for (size_t i = 0; i < previous.size(); ++i) {
+            connection[i + shift] ^= Mul(factor, previous[i]);
+        }
+        if (2 * length <= n) {
+            length = n + 1 - length;
+            previous = saved;
+            previous_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            ++shift;
+        }
+    }
+    Trim(connection);
+
+    // A recurrence of the full length, or one with a zero root, means the
+    // sketch holds more elements than it can recover.
+    if (length >= capacity || connection.size() != length + 1) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    // The elements are the roots of the reversed connection polynomial, which
+    // is monic as the connection polynomial has a constant term of 1.
+    const Poly locator(connection.rbegin(), connection.rend());
+    if (!HasDistinctRoots(locator) || !FindRoots(locator, 0, elements) ||
+        elements.size() != length) {
+        elements.clear();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PINSKETCH_H
+#define BITCOIN_PINSKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A PinSketch of a set of non-zero 32 bits elements, as used for set
+ * reconciliation.
+ *
+ * A sketch of capacity c holds the odd power sums x, x^3, ..., x^(2c-1) of its
+ * elements, in GF(2^32). Adding an element twice removes it, so merging the
+ * sketches of two sets (a xor of their power sums) gives the sketch of their
+ * symmetric difference. Up to c - 1 elements can be recovered from a sketch,
+ * whatever the size of the sets it was computed from.
+ *
+ * The serialized form of a sketch is its c power sums, as 4 bytes little
+ * endian each.
+ *
+ * When a sketch holds more elements than it can recover, the power sums look
+ * random, and the shortest recurrence they follow has the full length. So a
+ * sketch is only decoded when it holds fewer elements than its capacity, and
+ * the spare power sums make a wrong result as unlikely as 2^-64. Without them,
+ * an overfull sketch of capacity 1 would always decode to a single bogus
+ * element.
+ */
+class PinSketch {
+public:
+    //! Construct an empty sketch of the given capacity.
+    explicit PinSketch(size_t capacity) : m_sums(capacity, 0) {}
+
+    size_t GetCapacity() const { return m_sums.size(); }
+
+    //! Add an element, or remove it if it was already added. Must not be zero.
+    void Add(uint32_t element);
+
+    //! Add all the elements of another sketch. If the capacities differ, the
+    //! result has the smaller one.
+    void Merge(const PinSketch &other);
+
+    std::vector<uint8_t> Serialize() const;
+    //! Build a sketch from its serialized form. Returns a sketch of capacity
+    //! zero if the size of data isn't a multiple of 4.
+    static PinSketch Deserialize(const std::vector<uint8_t> &data);
+
+    /**
+     * Recover the elements of the sketch.
+     *
+     * @param[out] elements The elements, in no particular order.
+     * @return False if the sketch holds as many elements as its capacity or
+     *         more, in which case elements is left empty.
+     */
+    bool Decode(std::vector<uint32_t> &elements) const;
+
+private:
+    std::vector<uint32_t> m_sums;
+};
+
+#endif // BITCOIN_PINSKETCH_H
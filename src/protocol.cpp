@@ -51,6 +51,13 @@ const char *GETCFHEADERS = "getcfheaders";
 const char *CFHEADERS = "cfheaders";
 const char *GETCFCHECKPT = "getcfcheckpt";
 const char *CFCHECKPT = "cfcheckpt";
+const char *SENDRECON = "sendrecon";
+const char *REQRECON = "reqrecon";
+const char *SKETCH = "sketch";
+const char *RECONCILDIFF = "reconcildiff";
+const char *GETGRBLK = "getgrblk";
+const char *GRBLK = "grblk";
+const char *GETGRBLKTX = "getgrblktx";
 const char *AVAHELLO = "avahello";
 const char *AVAPOLL = "avapoll";
 const char *AVARESPONSE = "avaresponse";
@@ -59,7 +66,8 @@ const char *AVAPROOF = "avaproof";
 bool IsBlockLike(const std::string &strCommand) {
     return strCommand == NetMsgType::BLOCK ||
            strCommand == NetMsgType::CMPCTBLOCK ||
-           strCommand == NetMsgType::BLOCKTXN;
+           strCommand == NetMsgType::BLOCKTXN ||
+           strCommand == NetMsgType::GRBLK;
 }
 }; // namespace NetMsgType
 
@@ -79,6 +87,9 @@ static const std::string allNetMessageTypes[] = {
     NetMsgType::CMPCTBLOCK,  NetMsgType::GETBLOCKTXN,  NetMsgType::BLOCKTXN,
     NetMsgType::GETCFILTERS, NetMsgType::CFILTER,      NetMsgType::GETCFHEADERS,
     NetMsgType::CFHEADERS,   NetMsgType::GETCFCHECKPT, NetMsgType::CFCHECKPT,
+    NetMsgType::SENDRECON,   NetMsgType::REQRECON,     NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF, NetMsgType::GETGRBLK,     NetMsgType::GRBLK,
+    NetMsgType::GETGRBLKTX,
 };
 static const std::vector<std::string>
     allNetMessageTypesVec(allNetMessageTypes,
@@ -270,6 +281,10 @@ static std::string serviceFlagToStr(const size_t bit) {
             return "COMPACT_FILTERS";
         case NODE_AVALANCHE:
             return "AVALANCHE";
+        case NODE_TXRECON:
+            return "TXRECON";
+        case NODE_GRAPHENE:
+            return "GRAPHENE";
         default:
             std::ostringstream stream;
             stream.imbue(std::locale::classic());
@@ -296,6 +296,46 @@ extern const char *GETCFCHECKPT;
  * evenly spaced filter headers for blocks on the requested chain.
  */
 extern const char *CFCHECKPT;
+/**
+ * Signals support for transaction reconciliation, and contains the version of
+ * the protocol and a salt for the short ids. Only sent to peers with the
+ * service bit NODE_TXRECON, right after the verack message.
+ */
+extern const char *SENDRECON;
+/**
+ * Requests a reconciliation. Contains the size of the set of transactions
+ * to reconcile of the sender, and the coefficient q used to estimate the
+ * difference of the sets. Peer should respond with a "sketch" message.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a sketch of the set of transactions to reconcile of the sender.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Ends a reconciliation. Contains whether the difference of the sets was
+ * decoded, and the short ids of the transactions the sender misses. Sent in
+ * response to a "sketch" message.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Contains a GrapheneBlockRequest, with the size of the mempool of the
+ * sender. Only sent to peers with the service bit NODE_GRAPHENE.
+ * Peer should respond with a "grblk" message.
+ */
+extern const char *GETGRBLK;
+/**
+ * Contains a CGrapheneBlock: a header, and a bloom filter and an IBLT of the
+ * transactions of the block. Sent in response to a "getgrblk" message.
+ */
+extern const char *GRBLK;
+/**
+ * Contains a GrapheneBlockTransactionsRequest, with the short ids of the
+ * transactions of a graphene block the sender misses.
+ * Peer should respond with a "blocktxn" message.
+ */
+extern const char *GETGRBLKTX;
 /**
  * Contains a delegation and a signature.
  */
@@ -377,6 +417,14 @@ enum ServiceFlags : uint64_t {
     // NODE_AVALANCHE means the node supports Bitcoin Cash's avalanche
     // preconsensus mechanism.
     NODE_AVALANCHE = (1 << 24),
+
+    // NODE_TXRECON means the node supports relaying transactions by set
+    // reconciliation, see txreconciliation.h.
+    NODE_TXRECON = (1 << 25),
+
+    // NODE_GRAPHENE means the node can relay blocks with graphene, see
+    // graphene.h.
+    NODE_GRAPHENE = (1 << 26),
 };
 
 /**
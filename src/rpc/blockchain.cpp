@@ -17,6 +17,7 @@
 #include <core_io.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <mempoolsnapshot.h>
 #include <network.h>
 #include <node/coinstats.h>
 #include <node/context.h>
@@ -536,35 +537,29 @@ static std::vector<RPCResult> MempoolEntryDescription() {
     };
 }
 
-static void entryToJSON(const CTxMemPool &pool, UniValue &info,
-                        const CTxMemPoolEntry &e)
-    EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
-    AssertLockHeld(pool.cs);
-
+static void entryToJSON(UniValue &info, const MempoolSnapshotEntry &e) {
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modifiedFee));
+    fees.pushKV("ancestor", ValueFromAmount(e.modFeesWithAncestors));
+    fees.pushKV("descendant", ValueFromAmount(e.modFeesWithDescendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants() / SATOSHI);
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors() / SATOSHI);
-    const CTransaction &tx = e.GetTx();
+    info.pushKV("size", (int)e.txSize);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modifiedFee));
+    info.pushKV("time", count_seconds(e.time));
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.countWithDescendants);
+    info.pushKV("descendantsize", e.sizeWithDescendants);
+    info.pushKV("descendantfees", e.modFeesWithDescendants / SATOSHI);
+    info.pushKV("ancestorcount", e.countWithAncestors);
+    info.pushKV("ancestorsize", e.sizeWithAncestors);
+    info.pushKV("ancestorfees", e.modFeesWithAncestors / SATOSHI);
+
     std::set<std::string> setDepends;
-    for (const CTxIn &txin : tx.vin) {
-        if (pool.exists(txin.prevout.GetTxId())) {
-            setDepends.insert(txin.prevout.GetTxId().ToString());
-        }
+    for (const TxId &dep : e.depends) {
+        setDepends.insert(dep.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -575,37 +570,35 @@ static void entryToJSON(const CTxMemPool &pool, UniValue &info,
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter &it = pool.mapTx.find(tx.GetId());
-    const CTxMemPool::setEntries &setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetId().ToString());
+    for (const TxId &child : e.spentBy) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
-    info.pushKV("unbroadcast", pool.IsUnbroadcastTx(tx.GetId()));
+    info.pushKV("unbroadcast", e.unbroadcast);
 }
 
 UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose) {
+    // The snapshot is traversed without holding pool.cs, so that building the
+    // result doesn't stall transaction acceptance.
+    RCUPtr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
+
     if (verbose) {
-        LOCK(pool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry &e : pool.mapTx) {
-            const uint256 &txid = e.GetTx().GetId();
+        snapshot->ForEachEntry([&](const MempoolSnapshotEntry &e) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+            entryToJSON(info, e);
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(txid.ToString(), info);
-        }
+            o.__pushKV(e.GetId().ToString(), info);
+        });
         return o;
     } else {
-        std::vector<uint256> vtxids;
-        pool.queryHashes(vtxids);
-
         UniValue a(UniValue::VARR);
-        for (const uint256 &txid : vtxids) {
-            a.push_back(txid.ToString());
+        for (const MempoolSnapshotEntry *e :
+             snapshot->GetSortedDepthAndScore()) {
+            a.push_back(e->GetId().ToString());
         }
 
         return a;
@@ -689,35 +682,47 @@ static UniValue getmempoolancestors(const Config &config,
     TxId txid(ParseHashV(request.params[0], "parameter 1"));
 
     const CTxMemPool &mempool = EnsureMemPool(request.context);
-    LOCK(mempool.cs);
+    std::vector<TxId> ancestors;
+    RCUPtr<const MempoolSnapshot> snapshot;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(txid);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                           "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(txid);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "Transaction not in mempool");
+        }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit,
-                                      noLimit, noLimit, dummy, false);
+        CTxMemPool::setEntries setAncestors;
+        uint64_t noLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit,
+                                          noLimit, noLimit, dummy, false);
+        for (CTxMemPool::txiter ancestorIt : setAncestors) {
+            ancestors.push_back(ancestorIt->GetTx().GetId());
+        }
+
+        if (fVerbose) {
+            // Consistent with the ancestors as we still hold the lock.
+            snapshot = mempool.GetSnapshot();
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetId().ToString());
+        for (const TxId &ancestor : ancestors) {
+            o.push_back(ancestor.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const TxId &_txid = e.GetTx().GetId();
+        for (const TxId &ancestor : ancestors) {
+            const MempoolSnapshotEntry *e = snapshot->find(ancestor);
+            assert(e);
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_txid.ToString(), info);
+            entryToJSON(info, *e);
+            o.pushKV(ancestor.ToString(), info);
         }
         return o;
     }
@@ -764,34 +769,46 @@ static UniValue getmempooldescendants(const Config &config,
     TxId txid(ParseHashV(request.params[0], "parameter 1"));
 
     const CTxMemPool &mempool = EnsureMemPool(request.context);
-    LOCK(mempool.cs);
+    std::vector<TxId> descendants;
+    RCUPtr<const MempoolSnapshot> snapshot;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(txid);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                           "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(txid);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "Transaction not in mempool");
+        }
+
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        // CTxMemPool::CalculateDescendants will include the given tx
+        setDescendants.erase(it);
+        for (CTxMemPool::txiter descendantIt : setDescendants) {
+            descendants.push_back(descendantIt->GetTx().GetId());
+        }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+        if (fVerbose) {
+            // Consistent with the descendants as we still hold the lock.
+            snapshot = mempool.GetSnapshot();
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetId().ToString());
+        for (const TxId &descendant : descendants) {
+            o.push_back(descendant.ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const TxId &_txid = e.GetTx().GetId();
+        for (const TxId &descendant : descendants) {
+            const MempoolSnapshotEntry *e = snapshot->find(descendant);
+            assert(e);
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_txid.ToString(), info);
+            entryToJSON(info, *e);
+            o.pushKV(descendant.ToString(), info);
         }
         return o;
     }
@@ -815,17 +832,16 @@ static UniValue getmempoolentry(const Config &config,
     TxId txid(ParseHashV(request.params[0], "parameter 1"));
 
     const CTxMemPool &mempool = EnsureMemPool(request.context);
-    LOCK(mempool.cs);
+    RCUPtr<const MempoolSnapshot> snapshot = mempool.GetSnapshot();
 
-    CTxMemPool::txiter it = mempool.mapTx.find(txid);
-    if (it == mempool.mapTx.end()) {
+    const MempoolSnapshotEntry *e = snapshot->find(txid);
+    if (!e) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
                            "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(mempool, info, e);
+    entryToJSON(info, *e);
     return info;
 }
 
@@ -1653,13 +1669,13 @@ static UniValue getchaintips(const Config &config,
 }
 
 UniValue MempoolInfoToJSON(const CTxMemPool &pool) {
-    // Make sure this call is atomic in the pool.
-    LOCK(pool.cs);
+    // The snapshot makes this call atomic in the pool.
+    RCUPtr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
     UniValue ret(UniValue::VOBJ);
-    ret.pushKV("loaded", pool.IsLoaded());
-    ret.pushKV("size", (int64_t)pool.size());
-    ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
+    ret.pushKV("loaded", snapshot->IsLoaded());
+    ret.pushKV("size", (int64_t)snapshot->size());
+    ret.pushKV("bytes", (int64_t)snapshot->GetTotalTxSize());
+    ret.pushKV("usage", (int64_t)snapshot->DynamicMemoryUsage());
     size_t maxmempool =
         gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t)maxmempool);
@@ -1668,7 +1684,7 @@ UniValue MempoolInfoToJSON(const CTxMemPool &pool) {
         ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee)
                             .GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
-    ret.pushKV("unbroadcastcount", uint64_t{pool.GetUnbroadcastTxs().size()});
+    ret.pushKV("unbroadcastcount", uint64_t{snapshot->GetUnbroadcastCount()});
     return ret;
 }
 
@@ -0,0 +1,97 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/blocktemplatecache.h>
+
+#include <chain.h>
+#include <core_io.h>
+#include <primitives/transaction.h>
+#include <rpc/protocol.h>
+#include <rpc/request.h>
+#include <script/script.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+std::shared_ptr<const CachedBlockTemplate>
+BlockTemplateCache::Get(const Config &config, const CTxMemPool &mempool) {
+    AssertLockHeld(cs_main);
+    LOCK(cs_cache);
+    if (m_template && IsFresh(*m_template, mempool)) {
+        return m_template;
+    }
+
+    // Drop the template now, so future calls make a new one despite any
+    // failures from here on.
+    m_template.reset();
+
+    auto cached = std::make_shared<CachedBlockTemplate>();
+
+    // Store the mempool state before CreateNewBlock, to avoid races
+    cached->pindexPrev = ::ChainActive().Tip();
+    cached->nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    cached->mempoolFees = mempool.GetTotalFee();
+    cached->nTime = GetTime();
+
+    // scriptDummy is just for testing block validity and is not part of the
+    // returned template.
+    CScript scriptDummy = CScript() << OP_RETURN;
+    cached->blocktemplate = BlockAssembler(config, mempool)
+                                .CreateNewBlock(scriptDummy, &m_selection);
+    if (!cached->blocktemplate) {
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    }
+
+    const CBlockTemplate &blocktemplate = *cached->blocktemplate;
+    UniValue transactions(UniValue::VARR);
+    transactions.reserve(blocktemplate.block.vtx.size());
+    for (size_t i = 0; i < blocktemplate.block.vtx.size(); i++) {
+        const CTransaction &tx = *blocktemplate.block.vtx[i];
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        UniValue entry(UniValue::VOBJ);
+        entry.reserve(5);
+        entry.__pushKV("data", EncodeHexTx(tx));
+        entry.__pushKV("txid", tx.GetId().GetHex());
+        entry.__pushKV("hash", tx.GetHash().GetHex());
+        entry.__pushKV("fee", blocktemplate.entries[i].fees / SATOSHI);
+        entry.__pushKV("sigops", blocktemplate.entries[i].sigOpCount);
+
+        transactions.push_back(entry);
+    }
+    cached->transactions = std::move(transactions);
+
+    m_template = std::move(cached);
+    return m_template;
+}
+
+void BlockTemplateCache::Clear() {
+    LOCK(cs_cache);
+    m_template.reset();
+    m_selection.Reset();
+}
+
+bool BlockTemplateCache::IsFresh(const CachedBlockTemplate &cached,
+                                 const CTxMemPool &mempool) const {
+    AssertLockHeld(cs_main);
+    if (cached.pindexPrev != ::ChainActive().Tip()) {
+        return false;
+    }
+
+    if (mempool.GetTransactionsUpdated() == cached.nTransactionsUpdated) {
+        return true;
+    }
+
+    const int64_t age = GetTime() - cached.nTime;
+    if (age >= BLOCK_TEMPLATE_MAX_AGE) {
+        return false;
+    }
+
+    // Don't bother for transactions which pay little, the template will catch
+    // up with them eventually.
+    return age < BLOCK_TEMPLATE_MIN_AGE ||
+           mempool.GetTotalFee() - cached.mempoolFees < refreshFee;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_BLOCKTEMPLATECACHE_H
+#define BITCOIN_RPC_BLOCKTEMPLATECACHE_H
+
+#include <amount.h>
+#include <miner.h>
+#include <sync.h>
+
+#include <univalue.h>
+
+#include <cstdint>
+#include <memory>
+
+class CBlockIndex;
+class Config;
+class CTxMemPool;
+
+extern RecursiveMutex cs_main;
+
+/**
+ * Default for -blocktemplaterefreshfee, the fees which have to enter the
+ * mempool before a new block template is built for the same tip.
+ */
+static const Amount DEFAULT_BLOCK_TEMPLATE_REFRESH_FEE = 10000 * SATOSHI;
+/** Minimum age of a block template before it is refreshed for fees. */
+static const int64_t BLOCK_TEMPLATE_MIN_AGE = 1;
+/** Age past which a block template is refreshed for any mempool change. */
+static const int64_t BLOCK_TEMPLATE_MAX_AGE = 30;
+
+/**
+ * A block template, along with the parts of the getblocktemplate response
+ * which only depend on it. It is immutable, so it can be shared by all the
+ * callers which are served the same template.
+ */
+struct CachedBlockTemplate {
+    std::unique_ptr<const CBlockTemplate> blocktemplate;
+    //! The tip the template builds on
+    const CBlockIndex *pindexPrev;
+    //! Mempool state the template was built from
+    unsigned int nTransactionsUpdated;
+    Amount mempoolFees;
+    //! When the template was built
+    int64_t nTime;
+    //! The non-coinbase transactions, as returned by getblocktemplate
+    UniValue transactions;
+};
+
+/**
+ * Cache of the block template served by getblocktemplate. A new template is
+ * built when the tip changes, when the fees which entered the mempool since
+ * the last one exceed a threshold, or when the last one is too old.
+ */
+class BlockTemplateCache {
+public:
+    explicit BlockTemplateCache(Amount refreshFeeIn)
+        : refreshFee(refreshFeeIn) {}
+
+    /** Return a template for the next block, building it if needed. */
+    std::shared_ptr<const CachedBlockTemplate> Get(const Config &config,
+                                                   const CTxMemPool &mempool)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main) LOCKS_EXCLUDED(cs_cache);
+
+    /** Drop the cached template, so the next call builds a new one. */
+    void Clear() LOCKS_EXCLUDED(cs_cache);
+
+private:
+    bool IsFresh(const CachedBlockTemplate &cached,
+                 const CTxMemPool &mempool) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    const Amount refreshFee;
+
+    Mutex cs_cache;
+    std::shared_ptr<const CachedBlockTemplate> m_template GUARDED_BY(cs_cache);
+    BlockTemplateSelection m_selection GUARDED_BY(cs_cache);
+};
+
+#endif // BITCOIN_RPC_BLOCKTEMPLATECACHE_H
@@ -23,6 +23,7 @@
 #include <policy/policy.h>
 #include <pow/pow.h>
 #include <rpc/blockchain.h>
+#include <rpc/blocktemplatecache.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
@@ -30,6 +31,7 @@
 #include <shutdown.h>
 #include <txmempool.h>
 #include <univalue.h>
+#include <util/moneystr.h>
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -522,6 +524,19 @@ static UniValue getmininginfo(const Config &config,
     return obj;
 }
 
+static BlockTemplateCache &GetBlockTemplateCache() {
+    static BlockTemplateCache cache([] {
+        Amount refreshFee = Amount::zero();
+        if (gArgs.IsArgSet("-blocktemplaterefreshfee") &&
+            ParseMoney(gArgs.GetArg("-blocktemplaterefreshfee", ""),
+                       refreshFee)) {
+            return refreshFee;
+        }
+        return DEFAULT_BLOCK_TEMPLATE_REFRESH_FEE;
+    }());
+    return cache;
+}
+
 // NOTE: Unlike wallet RPC (which use BCH values), mining RPCs follow GBT (BIP
 // 22) in using satoshi amounts
 static UniValue prioritisetransaction(const Config &config,
@@ -563,6 +578,9 @@ static UniValue prioritisetransaction(const Config &config,
     }
 
     EnsureMemPool(request.context).PrioritiseTransaction(txid, nAmount);
+    // Don't wait for the fee threshold, the caller wants to see the new
+    // priority in the next template.
+    GetBlockTemplateCache().Clear();
     return true;
 }
 
@@ -877,41 +895,18 @@ static UniValue getblocktemplate(const Config &config,
     }
 
     // Update block
-    static CBlockIndex *pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != ::ChainActive().Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-         GetTime() - nStart > 5)) {
-        // Clear pindexPrev so future calls make a new block, despite any
-        // failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex *pindexPrevNew = ::ChainActive().Tip();
-        nStart = GetTime();
-
-        // Create new block. scriptDummy is just for testing block validity and
-        // is not part of the returned template.
-        CScript scriptDummy = CScript() << OP_RETURN;
-        pblocktemplate =
-            BlockAssembler(config, mempool).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate) {
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-        }
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
-
+    std::shared_ptr<const CachedBlockTemplate> cached =
+        GetBlockTemplateCache().Get(config, mempool);
+    nTransactionsUpdatedLast = cached->nTransactionsUpdated;
+    const CBlockIndex *pindexPrev = cached->pindexPrev;
     CHECK_NONFATAL(pindexPrev);
-    // pointer for convenience
-    CBlock *pblock = &pblocktemplate->block;
 
-    // Update nTime (can update nBits on testnet)
-    UpdateTime(pblock, chainparams, pindexPrev);
-    pblock->nNonce = 0;
+    // The template is shared with other callers, so only update a copy of its
+    // header. Update nTime (can update nBits on testnet)
+    CBlockHeader header = cached->blocktemplate->block.GetBlockHeader();
+    UpdateTime(&header, chainparams, pindexPrev);
+    // pointer for convenience
+    const CBlockHeader *pblock = &header;
 
     UniValue aCaps(UniValue::VARR);
     aCaps.push_back("proposal");
@@ -919,38 +914,11 @@ static UniValue getblocktemplate(const Config &config,
     const Consensus::Params &consensusParams = chainparams.GetConsensus();
     // CreateNewBlock stores the total fees times -1 in entries[0].fees
     Amount amountFeeReward =
-        GetBlockRewardFromFees(-1 * pblocktemplate->entries[0].fees);
+        GetBlockRewardFromFees(-1 * cached->blocktemplate->entries[0].fees);
     // UpdateTime can update nBits, so we recompute the subsidy
     Amount coinbasevalue =
         amountFeeReward + GetBlockSubsidy(pblock->nBits, consensusParams);
 
-    UniValue transactions(UniValue::VARR);
-    transactions.reserve(pblock->vtx.size());
-    int index_in_template = 0;
-    for (const auto &it : pblock->vtx) {
-        const CTransaction &tx = *it;
-        const TxId txId = tx.GetId();
-
-        if (tx.IsCoinBase()) {
-            index_in_template++;
-            continue;
-        }
-
-        UniValue entry(UniValue::VOBJ);
-        entry.reserve(5);
-        entry.__pushKV("data", EncodeHexTx(tx));
-        entry.__pushKV("txid", txId.GetHex());
-        entry.__pushKV("hash", tx.GetHash().GetHex());
-        entry.__pushKV("fee", pblocktemplate->entries[index_in_template].fees /
-                                  SATOSHI);
-        int64_t nTxSigOps =
-            pblocktemplate->entries[index_in_template].sigOpCount;
-        entry.__pushKV("sigops", nTxSigOps);
-
-        transactions.push_back(entry);
-        index_in_template++;
-    }
-
     UniValue aux(UniValue::VOBJ);
 
     UniValue requiredOutputsList(UniValue::VARR);
@@ -987,11 +955,11 @@ static UniValue getblocktemplate(const Config &config,
     result.pushKV("epochblockhash", pblock->hashEpochBlock.GetHex());
     result.pushKV("extendedmetadatahash",
                   pblock->hashExtendedMetadata.GetHex());
-    result.pushKV("transactions", transactions);
+    result.pushKV("transactions", cached->transactions);
     result.pushKV("coinbaseaux", aux);
     result.pushKV("coinbasetxn", coinbasetxn);
     result.pushKV("coinbasevalue", int64_t(coinbasevalue / SATOSHI));
-    result.pushKV("longpollid", ::ChainActive().Tip()->GetBlockHash().GetHex() +
+    result.pushKV("longpollid", pindexPrev->GetBlockHash().GetHex() +
                                     ToString(nTransactionsUpdatedLast));
     result.pushKV("target", hashTarget.GetHex());
     result.pushKV("mintime", int64_t(pindexPrev->GetMedianTimePast()) + 1);
@@ -165,10 +165,20 @@ static UniValue getpeerinfo(const Config &config,
                           "The heights of blocks we're currently asking from "
                           "this peer"},
                      }},
+                    {RPCResult::Type::BOOL, "txreconciliation",
+                     "Whether transactions are relayed to this peer by set "
+                     "reconciliation"},
+                    {RPCResult::Type::NUM, "txrecon_bytes_saved",
+                     "An estimate of the bytes the transaction "
+                     "reconciliation saved on the announcements to this "
+                     "peer, compared to announcing every transaction"},
                     {RPCResult::Type::BOOL, "whitelisted",
                      "Whether the peer is whitelisted"},
                     {RPCResult::Type::NUM, "minfeefilter",
                      "The minimum fee rate for transactions this peer accepts"},
+                    {RPCResult::Type::NUM, "txrelayusage",
+                     "The memory used to relay transactions to this peer, in "
+                     "bytes"},
                     {RPCResult::Type::OBJ_DYN,
                      "bytessent_per_msg",
                      "",
@@ -264,6 +274,9 @@ static UniValue getpeerinfo(const Config &config,
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("txreconciliation", statestats.m_txreconciliation);
+            obj.pushKV("txrecon_bytes_saved",
+                       statestats.m_txrecon_bytes_saved);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -273,6 +286,7 @@ static UniValue getpeerinfo(const Config &config,
         }
         obj.pushKV("permissions", permissions);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
+        obj.pushKV("txrelayusage", uint64_t(stats.m_tx_relay_usage));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const auto &i : stats.mapSendBytesPerMsgCmd) {
@@ -0,0 +1,207 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <subnettrie.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+using Key = std::array<uint8_t, ADDR_IPV6_SIZE>;
+
+bool GetBit(const Key &key, size_t bit) {
+    return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/**
+ * Return the number of leading bits a and b have in common, up to max_len,
+ * knowing that the first from bits are the same.
+ */
+size_t CommonPrefixLength(const Key &a, const Key &b, size_t from,
+                          size_t max_len) {
+    size_t len = from;
+    while (len < max_len) {
+        if (len % 8 == 0 && len + 8 <= max_len && a[len / 8] == b[len / 8]) {
+            len += 8;
+        } else if (GetBit(a, len) == GetBit(b, len)) {
+            len++;
+        } else {
+            break;
+        }
+    }
+    return len;
+}
+
+/**
+ * @returns The length of the prefix of a subnet's netmask, or -1 if the
+ *          netmask isn't a prefix.
+ */
+int GetPrefixLength(const uint8_t *netmask, size_t size) {
+    int len = 0;
+    for (size_t i = 0; i < size; i++) {
+        int bits = 0;
+        while (bits < 8 && (netmask[i] << bits) & 0x80) {
+            bits++;
+        }
+        if (uint8_t(netmask[i] << bits) != 0 ||
+            (bits > 0 && size_t(len) != 8 * i)) {
+            return -1;
+        }
+        len += bits;
+    }
+    return len;
+}
+
+} // namespace
+
+SubNetTrie::Key SubNetTrie::GetKey(const CNetAddr &addr) {
+    Key key{};
+    assert(addr.m_addr.size() <= key.size());
+    std::copy(addr.m_addr.begin(), addr.m_addr.end(), key.begin());
+    return key;
+}
+
+void SubNetTrie::Insert(const CSubNet &subnet, int64_t ban_until) {
+    // Invalid subnets don't match any address.
+    if (!subnet.IsValid()) {
+        return;
+    }
+
+    const int prefix_len = GetPrefixLength(subnet.netmask,
+                                           subnet.network.m_addr.size());
+    if (prefix_len < 0) {
+        m_other[subnet] = ban_until;
+        return;
+    }
+
+    const Key key = GetKey(subnet.network);
+    std::unique_ptr<Node> *slot = &m_roots[subnet.network.m_net];
+    size_t checked_len = 0;
+    while (true) {
+        if (!*slot) {
+            *slot = std::make_unique<Node>();
+            (*slot)->key = key;
+            (*slot)->prefix_len = prefix_len;
+        }
+
+        Node *node = slot->get();
+        const size_t common_len = CommonPrefixLength(
+            node->key, key, checked_len,
+            std::min(node->prefix_len, size_t(prefix_len)));
+        if (common_len < node->prefix_len) {
+            // The subnet branches off within the prefix of this node: insert
+            // a node with the common prefix above it.
+            auto parent = std::make_unique<Node>();
+            parent->key = key;
+            parent->prefix_len = common_len;
+            parent->children[GetBit(node->key, common_len)] = std::move(*slot);
+            *slot = std::move(parent);
+            node = slot->get();
+        }
+
+        if (node->prefix_len == size_t(prefix_len)) {
+            if (!node->is_subnet) {
+                node->is_subnet = true;
+                m_size++;
+            }
+            node->ban_until = ban_until;
+            return;
+        }
+
+        checked_len = node->prefix_len;
+        slot = &node->children[GetBit(key, node->prefix_len)];
+    }
+}
+
+bool SubNetTrie::EraseFrom(std::unique_ptr<Node> &slot, const Key &key,
+                           size_t prefix_len, size_t checked_len) {
+    Node *node = slot.get();
+    if (!node || node->prefix_len > prefix_len ||
+        CommonPrefixLength(node->key, key, checked_len, node->prefix_len) <
+            node->prefix_len) {
+        return false;
+    }
+
+    if (node->prefix_len == prefix_len) {
+        if (!node->is_subnet) {
+            return false;
+        }
+        node->is_subnet = false;
+    } else if (!EraseFrom(node->children[GetBit(key, node->prefix_len)], key,
+                          prefix_len, node->prefix_len)) {
+        return false;
+    }
+
+    // Remove the nodes which no longer separate two branches.
+    if (!node->is_subnet && !(node->children[0] && node->children[1])) {
+        // Move the child out first, as it is owned by the node being reset.
+        std::unique_ptr<Node> child = std::move(
+            node->children[0] ? node->children[0] : node->children[1]);
+        slot = std::move(child);
+    }
+    return true;
+}
+
+bool SubNetTrie::Erase(const CSubNet &subnet) {
+    if (!subnet.IsValid()) {
+        return false;
+    }
+
+    const int prefix_len = GetPrefixLength(subnet.netmask,
+                                           subnet.network.m_addr.size());
+    if (prefix_len < 0) {
+        return m_other.erase(subnet) > 0;
+    }
+
+    auto it = m_roots.find(subnet.network.m_net);
+    if (it == m_roots.end() ||
+        !EraseFrom(it->second, GetKey(subnet.network), prefix_len, 0)) {
+        return false;
+    }
+    if (!it->second) {
+        m_roots.erase(it);
+    }
+    m_size--;
+    return true;
+}
+
+void SubNetTrie::Clear() {
+    m_roots.clear();
+    m_size = 0;
+    m_other.clear();
+}
+
+bool SubNetTrie::Match(const CNetAddr &addr, int64_t time) const {
+    if (!addr.IsValid()) {
+        return false;
+    }
+
+    auto it = m_roots.find(addr.m_net);
+    if (it != m_roots.end()) {
+        const Key key = GetKey(addr);
+        const size_t addr_len = 8 * addr.m_addr.size();
+        size_t checked_len = 0;
+        const Node *node = it->second.get();
+        while (node && node->prefix_len <= addr_len &&
+               CommonPrefixLength(node->key, key, checked_len,
+                                  node->prefix_len) == node->prefix_len) {
+            if (node->is_subnet && time < node->ban_until) {
+                return true;
+            }
+            if (node->prefix_len == addr_len) {
+                break;
+            }
+            checked_len = node->prefix_len;
+            node = node->children[GetBit(key, node->prefix_len)].get();
+        }
+    }
+
+    for (const auto &other : m_other) {
+        if (time < other.second && other.first.Match(addr)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUBNETTRIE_H
+#define BITCOIN_SUBNETTRIE_H
+
+#include <netaddress.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+/**
+ * A set of subnets, each with the time until which it is banned, indexed by
+ * a path-compressed binary trie of their prefixes per network. Finding
+ * whether an address is in a banned subnet walks down the bits of the
+ * address, so it takes O(prefix length) instead of matching every subnet.
+ *
+ * Subnets with a netmask which isn't a prefix can't be in the trie. They can
+ * only come from a hand-crafted banlist.dat, and are matched one by one.
+ */
+class SubNetTrie {
+public:
+    //! Add a subnet, or update the time until which it is banned.
+    void Insert(const CSubNet &subnet, int64_t ban_until);
+    //! Remove a subnet. Returns whether it was in the set.
+    bool Erase(const CSubNet &subnet);
+    void Clear();
+
+    //! Return whether addr is in a subnet banned after the given time.
+    bool Match(const CNetAddr &addr, int64_t time) const;
+
+    size_t Size() const { return m_size + m_other.size(); }
+
+private:
+    using Key = std::array<uint8_t, ADDR_IPV6_SIZE>;
+
+    struct Node {
+        //! The prefix of this node is the first prefix_len bits of key.
+        Key key;
+        size_t prefix_len;
+        //! Whether the prefix of this node is a subnet of the set, or only
+        //! separates two branches.
+        bool is_subnet{false};
+        int64_t ban_until{0};
+        std::unique_ptr<Node> children[2];
+    };
+
+    static Key GetKey(const CNetAddr &addr);
+    static bool EraseFrom(std::unique_ptr<Node> &slot, const Key &key,
+                          size_t prefix_len, size_t checked_len);
+
+    //! The root of the trie of each network.
+    std::map<Network, std::unique_ptr<Node>> m_roots;
+    //! Number of subnets in the tries.
+    size_t m_size{0};
+    //! Subnets which aren't prefixes.
+    std::map<CSubNet, int64_t> m_other;
+};
+
+#endif // BITCOIN_SUBNETTRIE_H
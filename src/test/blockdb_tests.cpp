@@ -0,0 +1,114 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdb.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/consensus.h>
+#include <streams.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(blockdb_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(disk_record_encoding) {
+    std::vector<uint8_t> raw(10000, 0x42);
+
+    // Without compression, the record is stored as is.
+    std::vector<uint8_t> data(raw);
+    uint32_t nSize = EncodeDiskRecord(data, false);
+    BOOST_CHECK_EQUAL(nSize, raw.size());
+    BOOST_CHECK(data == raw);
+
+    // With compression, the size is flagged and the data can be decoded.
+    nSize = EncodeDiskRecord(data, true);
+    BOOST_CHECK(nSize & DISK_RECORD_COMPRESSED_FLAG);
+    BOOST_CHECK_EQUAL(nSize & ~DISK_RECORD_COMPRESSED_FLAG, data.size());
+    BOOST_CHECK(data.size() < raw.size());
+
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(DecodeDiskRecord(data, stream));
+    BOOST_CHECK(std::vector<uint8_t>(stream.begin(), stream.end()) == raw);
+
+    // A corrupted uncompressed size is detected.
+    data[0]++;
+    BOOST_CHECK(!DecodeDiskRecord(data, stream));
+
+    // Data that doesn't compress is stored raw even if requested.
+    raw = g_insecure_rand_ctx.randbytes(10000);
+    data = raw;
+    nSize = EncodeDiskRecord(data, true);
+    BOOST_CHECK_EQUAL(nSize, raw.size());
+    BOOST_CHECK(data == raw);
+}
+
+static bool IsCompressedRecord(FlatFileSeq seq, const FlatFilePos &pos) {
+    uint32_t nSize;
+    CAutoFile file(OpenDiskRecord(seq, pos, nSize), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!file.IsNull());
+    return nSize & DISK_RECORD_COMPRESSED_FLAG;
+}
+
+BOOST_FIXTURE_TEST_CASE(compressed_block_files, TestChain100Setup) {
+    // Mine coinbases that can be spent without signatures.
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+    std::vector<CTransactionRef> coinbases;
+    for (int i = 0; i < COINBASE_MATURITY; i++) {
+        coinbases.push_back(CreateAndProcessBlock({}, scriptPubKey).vtx[0]);
+    }
+
+    // Split a coinbase, then spend each part to similar outputs, so both the
+    // block and its undo data compress well.
+    std::vector<CMutableTransaction> spends(11);
+    CMutableTransaction &split = spends[0];
+    split.nVersion = 1;
+    // vout 0 = OP_RETURN, vout 1 = miner reward
+    split.vin.emplace_back(COutPoint(coinbases[0]->GetId(), 1));
+    split.vout.resize(spends.size() - 1, CTxOut(10 * CENT, scriptPubKey));
+
+    for (size_t i = 1; i < spends.size(); i++) {
+        CMutableTransaction &tx = spends[i];
+        tx.nVersion = 1;
+        tx.vin.emplace_back(COutPoint(split.GetId(), i - 1));
+        tx.vout.resize(20, CTxOut(CENT / 4, scriptPubKey));
+    }
+
+    fBlockCompression = true;
+    const CBlock block = CreateAndProcessBlock(spends, scriptPubKey);
+    fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+
+    LOCK(cs_main);
+    const CBlockIndex *pindex = ::ChainActive().Tip();
+    BOOST_CHECK_EQUAL(pindex->GetBlockHash(), block.GetHash());
+    BOOST_CHECK(IsCompressedRecord(BlockFileSeq(), pindex->GetBlockPos()));
+    BOOST_CHECK(IsCompressedRecord(UndoFileSeq(), pindex->GetUndoPos()));
+
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pindex,
+                                  Params().GetConsensus()));
+    BOOST_CHECK_EQUAL(blockRead.GetHash(), block.GetHash());
+    BOOST_CHECK_EQUAL(blockRead.vtx.size(), block.vtx.size());
+
+    CBlockUndo blockUndo;
+    BOOST_CHECK(UndoReadFromDisk(blockUndo, pindex));
+    BOOST_CHECK_EQUAL(blockUndo.vtxundo.size(), spends.size());
+
+    // Blocks written before remain raw and readable from the same file.
+    const CBlockIndex *pprev = pindex->pprev;
+    BOOST_CHECK_EQUAL(pprev->GetBlockPos().nFile, pindex->GetBlockPos().nFile);
+    BOOST_CHECK(!IsCompressedRecord(BlockFileSeq(), pprev->GetBlockPos()));
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pprev, Params().GetConsensus()));
+    BOOST_CHECK_EQUAL(blockRead.GetHash(), pprev->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
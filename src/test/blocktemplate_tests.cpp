@@ -0,0 +1,122 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <miner.h>
+
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <policy/policy.h>
+#include <script/standard.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+BOOST_FIXTURE_TEST_SUITE(blocktemplate_tests, TestChain100Setup)
+
+static std::set<TxId> TemplateTxIds(const CBlockTemplate &blocktemplate) {
+    std::set<TxId> txids;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); i++) {
+        txids.insert(blocktemplate.block.vtx[i]->GetId());
+    }
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(incremental_selection) {
+    // Mine coinbases that can be spent without signatures.
+    const CScript redeemScript = CScript() << OP_TRUE;
+    const CScript scriptPubKey =
+        GetScriptForDestination(ScriptHash(redeemScript));
+    std::vector<CTransactionRef> coinbases;
+    for (int i = 0; i < COINBASE_MATURITY + 5; i++) {
+        coinbases.push_back(CreateAndProcessBlock({}, scriptPubKey).vtx[0]);
+    }
+
+    const CScript scriptSig = CScript() << ToByteVector(redeemScript);
+    // vout 0 = OP_RETURN, vout 1 = miner reward
+    auto spend = [&](const CTransactionRef &prevTx, uint32_t n,
+                     const Amount fee) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.emplace_back(COutPoint(prevTx->GetId(), n), scriptSig);
+        // Make the transactions large enough for the block to run out of
+        // space before it runs out of sigchecks.
+        const Amount value = prevTx->vout[n].nValue - fee;
+        tx.vout.resize(200, CTxOut(value / 200, scriptPubKey));
+        const CTransactionRef txRef = MakeTransactionRef(tx);
+
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK_MESSAGE(
+            AcceptToMemoryPool(GetConfig(), *m_node.mempool, state, txRef,
+                               false /* bypass_limits */,
+                               Amount::zero() /* nAbsurdFee */),
+            state.ToString());
+        return txRef;
+    };
+
+    // Only two of these transactions fit in the block.
+    const size_t txSize = GetSerializeSize(
+        *spend(coinbases[0], 1, 10000 * SATOSHI), PROTOCOL_VERSION);
+    BlockAssembler::Options options;
+    options.nMaxGeneratedBlockSize = 1000 + 2 * txSize + txSize / 2;
+    options.enableMinerFund = GetConfig().EnableMinerFund();
+
+    BlockTemplateSelection selection;
+    auto checkTemplate = [&]() {
+        const std::unique_ptr<CBlockTemplate> incremental =
+            BlockAssembler(Params(), *m_node.mempool, options)
+                .CreateNewBlock(scriptPubKey, &selection);
+        const std::unique_ptr<CBlockTemplate> fresh =
+            BlockAssembler(Params(), *m_node.mempool, options)
+                .CreateNewBlock(scriptPubKey);
+        BOOST_CHECK(TemplateTxIds(*incremental) == TemplateTxIds(*fresh));
+        BOOST_CHECK_EQUAL(incremental->entries[0].fees,
+                          fresh->entries[0].fees);
+        return TemplateTxIds(*incremental);
+    };
+
+    BOOST_CHECK_EQUAL(checkTemplate().size(), 1UL);
+
+    // A new transaction is appended.
+    const CTransactionRef low = spend(coinbases[1], 1, 10000 * SATOSHI);
+    BOOST_CHECK_EQUAL(checkTemplate().size(), 2UL);
+
+    // The block is full and this one pays less than the selected ones.
+    const CTransactionRef lower = spend(coinbases[2], 1, 8000 * SATOSHI);
+    BOOST_CHECK_EQUAL(checkTemplate().count(lower->GetId()), 0UL);
+
+    // This one pays more, so it displaces one of them.
+    const CTransactionRef high = spend(coinbases[3], 1, 50000 * SATOSHI);
+    std::set<TxId> txids = checkTemplate();
+    BOOST_CHECK_EQUAL(txids.size(), 2UL);
+    BOOST_CHECK_EQUAL(txids.count(high->GetId()), 1UL);
+
+    // Removing a selected transaction makes room for another one.
+    {
+        LOCK(m_node.mempool->cs);
+        m_node.mempool->removeRecursive(*high, MemPoolRemovalReason::CONFLICT);
+    }
+    txids = checkTemplate();
+    BOOST_CHECK_EQUAL(txids.size(), 2UL);
+    BOOST_CHECK_EQUAL(txids.count(high->GetId()), 0UL);
+
+    // Prioritising a transaction changes the selection.
+    m_node.mempool->PrioritiseTransaction(lower->GetId(), COIN);
+    BOOST_CHECK_EQUAL(checkTemplate().count(lower->GetId()), 1UL);
+
+    // A child paying for its parent, then a new tip.
+    spend(low, 0, COIN);
+    checkTemplate();
+    MineBlock(GetConfig(), m_node, scriptPubKey);
+    BOOST_CHECK_EQUAL(checkTemplate().size(), 0UL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
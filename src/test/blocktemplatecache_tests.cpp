@@ -0,0 +1,106 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/blocktemplatecache.h>
+
+#include <config.h>
+#include <consensus/validation.h>
+#include <script/standard.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktemplatecache_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(refresh) {
+    // Mine coinbases that can be spent without signatures.
+    const CScript redeemScript = CScript() << OP_TRUE;
+    const CScript scriptPubKey =
+        GetScriptForDestination(ScriptHash(redeemScript));
+    std::vector<CTransactionRef> coinbases;
+    for (int i = 0; i < COINBASE_MATURITY + 3; i++) {
+        coinbases.push_back(CreateAndProcessBlock({}, scriptPubKey).vtx[0]);
+    }
+
+    const CScript scriptSig = CScript() << ToByteVector(redeemScript);
+    // vout 0 = OP_RETURN, vout 1 = miner reward
+    auto spend = [&](const CTransactionRef &prevTx, const Amount fee) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.emplace_back(COutPoint(prevTx->GetId(), 1), scriptSig);
+        const Amount value = prevTx->vout[1].nValue - fee;
+        tx.vout.resize(2, CTxOut(value / 2, scriptPubKey));
+        const CTransactionRef txRef = MakeTransactionRef(tx);
+
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK_MESSAGE(
+            AcceptToMemoryPool(GetConfig(), *m_node.mempool, state, txRef,
+                               false /* bypass_limits */,
+                               Amount::zero() /* nAbsurdFee */),
+            state.ToString());
+    };
+
+    const int64_t now = GetTime();
+    SetMockTime(now);
+
+    BlockTemplateCache cache(10000 * SATOSHI);
+    auto get = [&]() {
+        LOCK(cs_main);
+        return cache.Get(GetConfig(), *m_node.mempool);
+    };
+
+    const auto empty = get();
+    BOOST_CHECK_EQUAL(empty->transactions.size(), 0UL);
+    BOOST_CHECK(get() == empty);
+
+    // Not enough fees to refresh the template.
+    spend(coinbases[0], 5000 * SATOSHI);
+    SetMockTime(now + BLOCK_TEMPLATE_MIN_AGE);
+    BOOST_CHECK(get() == empty);
+
+    // Now there are, but the template is too recent.
+    spend(coinbases[1], 5000 * SATOSHI);
+    SetMockTime(now + BLOCK_TEMPLATE_MIN_AGE - 1);
+    BOOST_CHECK(get() == empty);
+
+    SetMockTime(now + BLOCK_TEMPLATE_MIN_AGE);
+    const auto full = get();
+    BOOST_CHECK(full != empty);
+    BOOST_CHECK_EQUAL(full->transactions.size(), 2UL);
+    const UniValue &entry = full->transactions[0];
+    BOOST_CHECK_EQUAL(find_value(entry, "fee").get_int64(), 5000);
+    BOOST_CHECK(get() == full);
+
+    // Old templates are refreshed for any mempool change.
+    spend(coinbases[2], 1000 * SATOSHI);
+    SetMockTime(now + BLOCK_TEMPLATE_MIN_AGE + BLOCK_TEMPLATE_MAX_AGE - 1);
+    BOOST_CHECK(get() == full);
+    SetMockTime(now + BLOCK_TEMPLATE_MIN_AGE + BLOCK_TEMPLATE_MAX_AGE);
+    const auto old = get();
+    BOOST_CHECK(old != full);
+    BOOST_CHECK_EQUAL(old->transactions.size(), 3UL);
+
+    // A new tip always gets a new template.
+    MineBlock(GetConfig(), m_node, scriptPubKey);
+    const auto tip = get();
+    BOOST_CHECK(tip != old);
+    BOOST_CHECK_EQUAL(tip->transactions.size(), 0UL);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(tip->pindexPrev == ::ChainActive().Tip());
+    }
+
+    cache.Clear();
+    BOOST_CHECK(get() != tip);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -131,7 +131,7 @@ void test_one_input(const std::vector<uint8_t> &buffer) {
             }
             case 9: {
                 const TxId &txid = TxId(ConsumeUInt256(fuzzed_data_provider));
-                node.PushTxInventory(txid);
+                g_tx_announcements.Push(txid);
                 break;
             }
             case 10: {
@@ -0,0 +1,36 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <test/fuzz/FuzzedDataProvider.h>
+#include <test/fuzz/fuzz.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+void test_one_input(const std::vector<uint8_t> &buffer) {
+    FuzzedDataProvider fuzzed_data_provider(buffer.data(), buffer.size());
+
+    // Decode a sketch received from a peer, of at most the maximum capacity
+    // used for reconciliation.
+    const PinSketch sketch = PinSketch::Deserialize(
+        fuzzed_data_provider.ConsumeBytes<uint8_t>(4 * 128));
+    std::vector<uint32_t> elements;
+    if (!sketch.Decode(elements)) {
+        assert(elements.empty());
+        return;
+    }
+
+    // The elements found are distinct and non-zero, and sketch back into the
+    // same sketch.
+    assert(elements.size() < sketch.GetCapacity());
+    PinSketch check(sketch.GetCapacity());
+    for (const uint32_t element : elements) {
+        assert(element != 0);
+        check.Add(element);
+    }
+    assert(check.Serialize() == sketch.Serialize());
+}
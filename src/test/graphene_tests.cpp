@@ -0,0 +1,224 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <graphene.h>
+
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/merkle.h>
+#include <pow/pow.h>
+#include <streams.h>
+#include <txmempool.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+static std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
+
+BOOST_FIXTURE_TEST_SUITE(graphene_tests, RegTestingSetup)
+
+static CTransactionRef RandomTransaction() {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    return MakeTransactionRef(tx);
+}
+
+static CBlock BuildBlock(size_t nTxs) {
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42 * SATOSHI;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < nTxs; i++) {
+        block.vtx.push_back(RandomTransaction());
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    block.hashPrevBlock = BlockHash(InsecureRand256());
+    block.nBits = 0x207fffff;
+    block.nHeaderVersion = 1;
+    block.hashExtendedMetadata = SerializeHash(std::vector<uint8_t>());
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.SetSize(::GetSerializeSize(block));
+
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        ++block.nNonce;
+    }
+    return block;
+}
+
+static CGrapheneBlock RoundTrip(const CGrapheneBlock &grapheneblock) {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << grapheneblock;
+    CGrapheneBlock grapheneblock2;
+    stream >> grapheneblock2;
+    return grapheneblock2;
+}
+
+BOOST_AUTO_TEST_CASE(reconstruct) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CBlock block = BuildBlock(200);
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            pool.addUnchecked(entry.FromTx(block.vtx[i]));
+        }
+        for (size_t i = 0; i < 1000; i++) {
+            pool.addUnchecked(entry.FromTx(RandomTransaction()));
+        }
+    }
+
+    const CGrapheneBlock grapheneblock =
+        RoundTrip(CGrapheneBlock(block, pool.size()));
+    BOOST_CHECK_EQUAL(grapheneblock.BlockTxCount(), block.vtx.size());
+    // Smaller than the 6 bytes per transaction of a compact block.
+    BOOST_CHECK_LT(
+        GetSerializeSize(grapheneblock, PROTOCOL_VERSION),
+        GetSerializeSize(CBlockHeaderAndShortTxIDs(block), PROTOCOL_VERSION));
+
+    PartiallyDownloadedGrapheneBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK_EQUAL(partialBlock.InitData(grapheneblock, extra_txn),
+                      READ_STATUS_OK);
+    BOOST_CHECK(
+        partialBlock.GetMissingTransactionsRequest().shorttxids.empty());
+
+    CBlock block2;
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(block2, {}), READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(),
+                      block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(BlockMerkleRoot(block2).ToString(),
+                      block.hashMerkleRoot.ToString());
+}
+
+BOOST_AUTO_TEST_CASE(missing_transactions) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CBlock block = BuildBlock(100);
+    // We miss a few transactions of the block, one of them is in the extra
+    // transactions.
+    const std::vector<CTransactionRef> missing{block.vtx[10], block.vtx[20]};
+    std::vector<std::pair<TxHash, CTransactionRef>> extra{
+        {block.vtx[30]->GetHash(), block.vtx[30]}};
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            if (i % 10 != 0 || i > 30) {
+                pool.addUnchecked(entry.FromTx(block.vtx[i]));
+            }
+        }
+        for (size_t i = 0; i < 100; i++) {
+            pool.addUnchecked(entry.FromTx(RandomTransaction()));
+        }
+    }
+
+    const CGrapheneBlock grapheneblock =
+        RoundTrip(CGrapheneBlock(block, pool.size() + missing.size()));
+    PartiallyDownloadedGrapheneBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK_EQUAL(partialBlock.InitData(grapheneblock, extra),
+                      READ_STATUS_OK);
+    const GrapheneBlockTransactionsRequest req =
+        partialBlock.GetMissingTransactionsRequest();
+    BOOST_CHECK(req.blockhash == block.GetHash());
+    BOOST_CHECK_EQUAL(req.nonce, grapheneblock.GetNonce());
+    BOOST_CHECK_EQUAL(req.shorttxids.size(), missing.size());
+
+    // The sender finds the transactions from their short ids, and ignores
+    // unknown ones.
+    GrapheneBlockTransactionsRequest req2 = req;
+    req2.shorttxids.push_back(InsecureRandBits(64));
+    const BlockTransactions resp = GetGrapheneBlockTransactions(block, req2);
+    BOOST_CHECK(resp.blockhash == block.GetHash());
+    BOOST_CHECK_EQUAL(resp.txn.size(), missing.size());
+    for (const CTransactionRef &tx : resp.txn) {
+        BOOST_CHECK(std::find(missing.begin(), missing.end(), tx) !=
+                    missing.end());
+    }
+
+    CBlock block2;
+    {
+        // Missing or unexpected transactions.
+        PartiallyDownloadedGrapheneBlock tmp = partialBlock;
+        BOOST_CHECK_EQUAL(tmp.FillBlock(block2, {missing[0]}),
+                          READ_STATUS_INVALID);
+        tmp = partialBlock;
+        BOOST_CHECK_EQUAL(tmp.FillBlock(block2, {missing[0], block.vtx[1]}),
+                          READ_STATUS_INVALID);
+    }
+
+    // The transactions can come in any order.
+    BOOST_CHECK_EQUAL(partialBlock.FillBlock(block2, {missing[1], missing[0]}),
+                      READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(),
+                      block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(BlockMerkleRoot(block2).ToString(),
+                      block.hashMerkleRoot.ToString());
+}
+
+BOOST_AUTO_TEST_CASE(failure) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CBlock block = BuildBlock(100);
+
+    // The IBLT is too small to list the transactions of a block we don't
+    // have.
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < 200; i++) {
+            pool.addUnchecked(entry.FromTx(RandomTransaction()));
+        }
+    }
+    PartiallyDownloadedGrapheneBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK_EQUAL(
+        partialBlock.InitData(RoundTrip(CGrapheneBlock(block, pool.size())),
+                              extra_txn),
+        READ_STATUS_FAILED);
+
+    // Malformed graphene blocks.
+    PartiallyDownloadedGrapheneBlock partialBlock2(GetConfig(), &pool);
+    BOOST_CHECK_EQUAL(partialBlock2.InitData(CGrapheneBlock(), extra_txn),
+                      READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_CASE(filter) {
+    std::vector<uint64_t> elements;
+    for (size_t i = 0; i < 1000; i++) {
+        elements.push_back(InsecureRandBits(64));
+    }
+
+    // An empty filter matches everything.
+    ShortIdFilter all;
+    BOOST_CHECK(all.contains(InsecureRandBits(64)));
+    BOOST_CHECK_EQUAL(ShortIdFilter::GetSize(1000, 1), 0U);
+    BOOST_CHECK_EQUAL(ShortIdFilter::GetSize(0, 0.01), 0U);
+
+    ShortIdFilter filter(elements.size(), 0.01);
+    BOOST_CHECK(filter.IsWithinSizeConstraints());
+    for (const uint64_t element : elements) {
+        filter.insert(element);
+    }
+    for (const uint64_t element : elements) {
+        BOOST_CHECK(filter.contains(element));
+    }
+    size_t false_positives = 0;
+    for (size_t i = 0; i < 10000; i++) {
+        false_positives += filter.contains(InsecureRandBits(64));
+    }
+    BOOST_CHECK_LT(false_positives, 200U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -156,6 +156,24 @@ BOOST_AUTO_TEST_CASE(siphash) {
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and SipHashUint256Batch, for
+    // batches which are not a multiple of the 4 values hashed at once.
+    std::vector<uint256> vals(11);
+    std::vector<const uint256 *> val_ptrs;
+    for (uint256 &val : vals) {
+        val = InsecureRand256();
+        val_ptrs.push_back(&val);
+    }
+    for (size_t count = 0; count <= vals.size(); ++count) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        std::vector<uint64_t> hashes(count);
+        SipHashUint256Batch(k1, k2, val_ptrs.data(), hashes.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(hashes[i], SipHashUint256(k1, k2, vals[i]));
+        }
+    }
 }
 
 namespace {
@@ -0,0 +1,115 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(iblt_tests, BasicTestingSetup)
+
+static std::vector<uint64_t> RandomKeys(size_t count) {
+    std::set<uint64_t> keys;
+    while (keys.size() < count) {
+        keys.insert(InsecureRandBits(64));
+    }
+    return {keys.begin(), keys.end()};
+}
+
+static std::vector<uint64_t> Sorted(std::vector<uint64_t> keys) {
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+BOOST_AUTO_TEST_CASE(list_entries) {
+    std::vector<uint64_t> inserted, erased;
+    BOOST_CHECK(IBLT(10).ListEntries(inserted, erased));
+    BOOST_CHECK(inserted.empty() && erased.empty());
+
+    // The difference of two large sets is listed from a small table.
+    const std::vector<uint64_t> keys = RandomKeys(1030);
+    IBLT table(30);
+    for (size_t i = 0; i < 1000; i++) {
+        table.Insert(keys[i]);
+        table.Erase(keys[i]);
+    }
+    const std::vector<uint64_t> only_inserted(keys.begin() + 1000,
+                                              keys.begin() + 1010);
+    const std::vector<uint64_t> only_erased(keys.begin() + 1010, keys.end());
+    for (const uint64_t key : only_inserted) {
+        table.Insert(key);
+    }
+    for (const uint64_t key : only_erased) {
+        table.Erase(key);
+    }
+    BOOST_CHECK(table.ListEntries(inserted, erased));
+    BOOST_CHECK(Sorted(inserted) == only_inserted);
+    BOOST_CHECK(Sorted(erased) == only_erased);
+}
+
+BOOST_AUTO_TEST_CASE(capacity) {
+    // Tables filled up to their capacity are almost always listed.
+    size_t listed = 0;
+    for (size_t i = 0; i < 100; i++) {
+        const size_t entries = 1 + InsecureRandRange(200);
+        const std::vector<uint64_t> keys = RandomKeys(entries);
+        IBLT table(entries);
+        for (size_t j = 0; j < entries; j++) {
+            j % 2 ? table.Insert(keys[j]) : table.Erase(keys[j]);
+        }
+        std::vector<uint64_t> inserted, erased;
+        if (table.ListEntries(inserted, erased)) {
+            BOOST_CHECK_EQUAL(inserted.size() + erased.size(), entries);
+            listed++;
+        }
+    }
+    BOOST_CHECK_GE(listed, 95U);
+
+    // Overfull tables fail.
+    IBLT table(10);
+    for (const uint64_t key : RandomKeys(table.GetCells())) {
+        table.Insert(key);
+    }
+    std::vector<uint64_t> inserted, erased;
+    BOOST_CHECK(!table.ListEntries(inserted, erased));
+}
+
+BOOST_AUTO_TEST_CASE(serialization) {
+    IBLT table(5);
+    BOOST_CHECK(table.IsValid());
+    BOOST_CHECK_EQUAL(table.GetCells() % IBLT::NUM_HASHES, 0U);
+    const std::vector<uint64_t> keys = RandomKeys(5);
+    for (const uint64_t key : keys) {
+        table.Insert(key);
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << table;
+    BOOST_CHECK_EQUAL(stream.size(), 1 + 16 * table.GetCells());
+    IBLT table2;
+    stream >> table2;
+    std::vector<uint64_t> inserted, erased;
+    BOOST_CHECK(table2.ListEntries(inserted, erased));
+    BOOST_CHECK(Sorted(inserted) == keys);
+
+    // Tables without cells, or with a number of cells which can't be split
+    // into sub-tables, can't be used.
+    BOOST_CHECK(!IBLT().IsValid());
+    BOOST_CHECK(!IBLT().ListEntries(inserted, erased));
+    WriteCompactSize(stream, 1);
+    stream.write(std::vector<char>(16).data(), 16);
+    stream >> table2;
+    BOOST_CHECK_EQUAL(table2.GetCells(), 1U);
+    BOOST_CHECK(!table2.IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/lzcodec.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(lzcodec_tests, BasicTestingSetup)
+
+static void CheckRoundTrip(const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> compressed = LZCompress(data);
+    BOOST_CHECK(compressed.size() <= LZCompressBound(data.size()));
+
+    std::vector<uint8_t> decompressed;
+    BOOST_CHECK(LZDecompress(compressed, data.size(), decompressed));
+    BOOST_CHECK(decompressed == data);
+}
+
+BOOST_AUTO_TEST_CASE(lzcodec_roundtrip) {
+    // Edge cases around the minimum input size for a match.
+    for (size_t size = 0; size < 64; size++) {
+        CheckRoundTrip(std::vector<uint8_t>(size, 0x42));
+        CheckRoundTrip(g_insecure_rand_ctx.randbytes(size));
+    }
+
+    // Long runs, which use overlapping matches and extended lengths.
+    CheckRoundTrip(std::vector<uint8_t>(100000, 0));
+
+    // Incompressible data.
+    CheckRoundTrip(g_insecure_rand_ctx.randbytes(100000));
+
+    // Repeated chunks of random data, with matches at various distances.
+    for (size_t chunk : {3, 17, 255, 4096, 70000}) {
+        const std::vector<uint8_t> pattern =
+            g_insecure_rand_ctx.randbytes(chunk);
+        std::vector<uint8_t> data;
+        while (data.size() < 200000) {
+            data.insert(data.end(), pattern.begin(), pattern.end());
+            data.push_back(InsecureRand32());
+        }
+        CheckRoundTrip(data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lzcodec_compresses) {
+    const std::vector<uint8_t> data(100000, 0x42);
+    BOOST_CHECK(LZCompress(data).size() < 1000);
+}
+
+BOOST_AUTO_TEST_CASE(lzcodec_malformed) {
+    std::vector<uint8_t> data(1000, 0x42);
+    for (size_t i = 0; i < data.size(); i += 7) {
+        data[i] = i;
+    }
+    const std::vector<uint8_t> compressed = LZCompress(data);
+
+    std::vector<uint8_t> out;
+    // Wrong expected sizes.
+    BOOST_CHECK(!LZDecompress(compressed, data.size() - 1, out));
+    BOOST_CHECK(!LZDecompress(compressed, data.size() + 1, out));
+
+    // Empty and truncated inputs.
+    BOOST_CHECK(!LZDecompress({}, data.size(), out));
+    for (size_t i = 1; i < compressed.size(); i++) {
+        BOOST_CHECK(!LZDecompress(
+            Span<const uint8_t>(compressed.data(), compressed.size() - i),
+            data.size(), out));
+    }
+
+    // A match refering to data before the start of the output.
+    const std::vector<uint8_t> bad_offset{0x10, 0x00, 0x02, 0x00, 0x00};
+    BOOST_CHECK(!LZDecompress(bad_offset, 5, out));
+
+    // Random garbage must never be accepted for a larger size, nor crash.
+    for (int i = 0; i < 1000; i++) {
+        const std::vector<uint8_t> garbage =
+            g_insecure_rand_ctx.randbytes(1 + InsecureRandRange(64));
+        LZDecompress(garbage, InsecureRandRange(4096), out);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -305,6 +305,76 @@ BOOST_AUTO_TEST_CASE(MempoolClearTest) {
     BOOST_CHECK_EQUAL(testPool.vTxHashes.size(), 0UL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolJournalTest) {
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000 * SATOSHI;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetId(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000 * SATOSHI;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+
+    using Type = MempoolJournalEntry::Type;
+    auto checkChanges =
+        [&](uint64_t &sequence,
+            const std::vector<std::pair<TxId, Type>> &expected) {
+            std::vector<MempoolJournalEntry> changes;
+            BOOST_CHECK(testPool.GetJournalEntriesSince(sequence, changes));
+            BOOST_CHECK_EQUAL(sequence, testPool.GetJournalSequence());
+            BOOST_REQUIRE_EQUAL(changes.size(), expected.size());
+            for (size_t i = 0; i < changes.size(); i++) {
+                BOOST_CHECK(changes[i].txid == expected[i].first);
+                BOOST_CHECK(changes[i].type == expected[i].second);
+            }
+        };
+
+    uint64_t sequence = testPool.GetJournalSequence();
+    checkChanges(sequence, {});
+
+    testPool.addUnchecked(entry.FromTx(txParent));
+    testPool.addUnchecked(entry.FromTx(txChild));
+    testPool.PrioritiseTransaction(txChild.GetId(), 1000 * SATOSHI);
+    // Prioritising a transaction which is not in the mempool changes nothing.
+    testPool.PrioritiseTransaction(TxId(InsecureRand256()), 1000 * SATOSHI);
+
+    uint64_t cursor = sequence;
+    checkChanges(cursor, {{txParent.GetId(), Type::ADDED},
+                          {txChild.GetId(), Type::ADDED},
+                          {txChild.GetId(), Type::UPDATED}});
+    checkChanges(cursor, {});
+
+    testPool.removeRecursive(CTransaction(txParent),
+                             MemPoolRemovalReason::CONFLICT);
+    std::vector<MempoolJournalEntry> changes;
+    BOOST_CHECK(testPool.GetJournalEntriesSince(cursor, changes));
+    BOOST_CHECK_EQUAL(changes.size(), 2UL);
+    for (const MempoolJournalEntry &change : changes) {
+        BOOST_CHECK(change.type == Type::REMOVED);
+    }
+
+    // A cursor from the future is rejected.
+    uint64_t future = cursor + 1;
+    BOOST_CHECK(!testPool.GetJournalEntriesSince(future, changes));
+
+    // Clearing the mempool invalidates all the cursors.
+    testPool.clear();
+    BOOST_CHECK(!testPool.GetJournalEntriesSince(sequence, changes));
+    BOOST_CHECK(!testPool.GetJournalEntriesSince(cursor, changes));
+    sequence = testPool.GetJournalSequence();
+    checkChanges(sequence, {});
+}
+
 template <typename name>
 static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder,
                       const std::string &testcase)
@@ -0,0 +1,189 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempoolsnapshot.h>
+
+#include <txmempool.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(mempoolsnapshot_tests, TestingSetup)
+
+static CMutableTransaction MakeTx(const std::vector<COutPoint> &prevouts,
+                                  size_t nOutputs) {
+    CMutableTransaction tx;
+    for (const COutPoint &prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    for (size_t i = 0; i < nOutputs; i++) {
+        tx.vout.emplace_back(10 * COIN, CScript() << OP_TRUE);
+    }
+    return tx;
+}
+
+static void CheckSnapshot(const CTxMemPool &pool,
+                          const MempoolSnapshot &snapshot)
+    EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+    BOOST_CHECK_EQUAL(snapshot.size(), pool.mapTx.size());
+    BOOST_CHECK_EQUAL(snapshot.GetTotalTxSize(), pool.GetTotalTxSize());
+    BOOST_CHECK_EQUAL(snapshot.DynamicMemoryUsage(),
+                      pool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(snapshot.GetUnbroadcastCount(),
+                      pool.GetUnbroadcastTxs().size());
+
+    size_t count = 0;
+    snapshot.ForEachEntry([&](const MempoolSnapshotEntry &e) {
+        count++;
+        auto it = pool.mapTx.find(e.GetId());
+        BOOST_REQUIRE(it != pool.mapTx.end());
+        BOOST_CHECK_EQUAL(snapshot.find(e.GetId()), &e);
+        BOOST_CHECK(e.modifiedFee == it->GetModifiedFee());
+        BOOST_CHECK_EQUAL(e.countWithAncestors, it->GetCountWithAncestors());
+        BOOST_CHECK_EQUAL(e.sizeWithAncestors, it->GetSizeWithAncestors());
+        BOOST_CHECK(e.modFeesWithAncestors == it->GetModFeesWithAncestors());
+        BOOST_CHECK_EQUAL(e.countWithDescendants,
+                          it->GetCountWithDescendants());
+        BOOST_CHECK_EQUAL(e.sizeWithDescendants, it->GetSizeWithDescendants());
+        BOOST_CHECK(e.modFeesWithDescendants ==
+                    it->GetModFeesWithDescendants());
+        BOOST_CHECK_EQUAL(e.depends.size(),
+                          pool.GetMemPoolParents(it).size());
+        BOOST_CHECK_EQUAL(e.spentBy.size(),
+                          pool.GetMemPoolChildren(it).size());
+        BOOST_CHECK_EQUAL(e.unbroadcast, pool.IsUnbroadcastTx(e.GetId()));
+    });
+    BOOST_CHECK_EQUAL(count, pool.mapTx.size());
+
+    std::vector<uint256> hashes;
+    pool.queryHashes(hashes);
+    std::vector<const MempoolSnapshotEntry *> sorted =
+        snapshot.GetSortedDepthAndScore();
+    BOOST_REQUIRE_EQUAL(sorted.size(), hashes.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        BOOST_CHECK(sorted[i]->GetId() == hashes[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_follows_mempool) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK2(cs_main, pool.cs);
+
+    RCUPtr<const MempoolSnapshot> empty = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(empty->size(), 0);
+    BOOST_CHECK(empty->find(TxId(InsecureRand256())) == nullptr);
+
+    const CMutableTransaction parent =
+        MakeTx({COutPoint(TxId(InsecureRand256()), 0)}, 2);
+    pool.addUnchecked(entry.Fee(1000 * SATOSHI).FromTx(parent));
+    const CMutableTransaction child =
+        MakeTx({COutPoint(parent.GetId(), 0), COutPoint(parent.GetId(), 1)},
+               1);
+    pool.addUnchecked(entry.Fee(2000 * SATOSHI).FromTx(child));
+
+    RCUPtr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
+    CheckSnapshot(pool, *snapshot);
+
+    // Nothing changed, so the same snapshot is returned.
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+
+    const MempoolSnapshotEntry *parentEntry = snapshot->find(parent.GetId());
+    BOOST_REQUIRE(parentEntry);
+    BOOST_CHECK(parentEntry->depends.empty());
+    BOOST_REQUIRE_EQUAL(parentEntry->spentBy.size(), 1);
+    BOOST_CHECK(parentEntry->spentBy[0] == child.GetId());
+    BOOST_CHECK_EQUAL(parentEntry->countWithDescendants, 2);
+
+    const MempoolSnapshotEntry *childEntry = snapshot->find(child.GetId());
+    BOOST_REQUIRE(childEntry);
+    BOOST_REQUIRE_EQUAL(childEntry->depends.size(), 1);
+    BOOST_CHECK(childEntry->depends[0] == parent.GetId());
+    BOOST_CHECK(childEntry->modFeesWithAncestors == 3000 * SATOSHI);
+
+    // Changes are published in a new snapshot, older ones are left untouched.
+    const CMutableTransaction other =
+        MakeTx({COutPoint(TxId(InsecureRand256()), 0)}, 1);
+    pool.addUnchecked(entry.Fee(500 * SATOSHI).FromTx(other));
+    pool.PrioritiseTransaction(child.GetId(), 1000 * SATOSHI);
+    pool.AddUnbroadcastTx(other.GetId());
+
+    RCUPtr<const MempoolSnapshot> updated = pool.GetSnapshot();
+    BOOST_CHECK(updated != snapshot);
+    CheckSnapshot(pool, *updated);
+    BOOST_CHECK_EQUAL(snapshot->size(), 2);
+    BOOST_CHECK(snapshot->find(other.GetId()) == nullptr);
+    BOOST_CHECK(childEntry->modifiedFee == 2000 * SATOSHI);
+    BOOST_CHECK(updated->find(child.GetId())->modifiedFee == 3000 * SATOSHI);
+    BOOST_CHECK(updated->find(parent.GetId())->modFeesWithDescendants ==
+                4000 * SATOSHI);
+    BOOST_CHECK(updated->find(other.GetId())->unbroadcast);
+
+    // Buckets that weren't modified are shared between snapshots.
+    size_t shared = 0;
+    for (size_t i = 0; i < MempoolSnapshot::NUM_BUCKETS; i++) {
+        if (snapshot->GetBuckets()[i] == updated->GetBuckets()[i]) {
+            shared++;
+        }
+    }
+    BOOST_CHECK(shared >= MempoolSnapshot::NUM_BUCKETS - 3);
+
+    pool.removeRecursive(CTransaction(parent), MemPoolRemovalReason::CONFLICT);
+    RCUPtr<const MempoolSnapshot> removed = pool.GetSnapshot();
+    CheckSnapshot(pool, *removed);
+    BOOST_CHECK_EQUAL(removed->size(), 1);
+    BOOST_CHECK(removed->find(parent.GetId()) == nullptr);
+    BOOST_CHECK(removed->find(child.GetId()) == nullptr);
+    BOOST_CHECK(updated->find(child.GetId()) != nullptr);
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->size(), 0);
+    BOOST_CHECK_EQUAL(removed->size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_random_updates) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK2(cs_main, pool.cs);
+
+    std::vector<COutPoint> outpoints;
+    std::vector<CTransactionRef> txs;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 50; i++) {
+            std::vector<COutPoint> prevouts;
+            if (outpoints.empty() || InsecureRandBool()) {
+                prevouts.emplace_back(TxId(InsecureRand256()), 0);
+            } else {
+                size_t n = InsecureRandRange(outpoints.size());
+                prevouts.push_back(outpoints[n]);
+                outpoints.erase(outpoints.begin() + n);
+            }
+
+            const CTransactionRef tx =
+                MakeTransactionRef(MakeTx(prevouts, 1 + InsecureRandRange(3)));
+            const Amount fee = int64_t(InsecureRandRange(10000)) * SATOSHI;
+            pool.addUnchecked(entry.Fee(fee).FromTx(tx));
+            for (size_t n = 0; n < tx->vout.size(); n++) {
+                outpoints.emplace_back(tx->GetId(), n);
+            }
+            txs.push_back(tx);
+        }
+
+        for (int i = 0; i < 5; i++) {
+            const CTransactionRef &tx = txs[InsecureRandRange(txs.size())];
+            if (InsecureRandBool()) {
+                pool.PrioritiseTransaction(tx->GetId(), 100 * SATOSHI);
+            } else {
+                pool.removeRecursive(*tx, MemPoolRemovalReason::CONFLICT);
+            }
+        }
+
+        CheckSnapshot(pool, *pool.GetSnapshot());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
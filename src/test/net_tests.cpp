@@ -17,6 +17,7 @@
 #include <util/string.h>
 #include <version.h>
 
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
@@ -201,6 +202,227 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test) {
     BOOST_CHECK(pnode2->IsInboundConn() == true);
 }
 
+BOOST_AUTO_TEST_CASE(socket_events) {
+    ConnmanTestMsg connman(GetConfig(), 0x1337, 0x1337);
+    std::vector<std::pair<SOCKET, SOCKET>> sockets;
+    BOOST_REQUIRE(CreateLoopbackConnections(3, sockets));
+
+    NodeId id = 0;
+    std::vector<CNode *> nodes;
+    auto addNode = [&](SOCKET hSocket) {
+        nodes.push_back(new CNode(id++, NODE_NETWORK, 0, hSocket, CAddress(),
+                                  0, 0, 0, CAddress(), "",
+                                  ConnectionType::INBOUND));
+        connman.AddTestNode(*nodes.back());
+    };
+    for (const auto &pair : sockets) {
+        addNode(pair.second);
+    }
+
+    // Return the sockets which can be read from, waiting a bit for the
+    // expected ones to show up.
+    auto readable = [&](size_t expected) {
+        std::set<SOCKET> recv_set;
+        for (int i = 0; i < 20 && recv_set.size() < expected; i++) {
+            std::set<SOCKET> send_set, error_set;
+            recv_set.clear();
+            connman.SocketEventsOnce(recv_set, send_set, error_set);
+        }
+        return recv_set;
+    };
+
+    BOOST_CHECK(readable(0).empty());
+
+    const char byte = 0;
+    BOOST_CHECK_EQUAL(send(sockets[1].first, &byte, 1, 0), 1);
+    BOOST_CHECK(readable(1) == std::set<SOCKET>{sockets[1].second});
+    // Nothing was received, so the socket stays readable.
+    BOOST_CHECK(readable(1) == std::set<SOCKET>{sockets[1].second});
+
+    // Paused nodes are not read from.
+    nodes[1]->fPauseRecv = true;
+    BOOST_CHECK(readable(0).empty());
+    nodes[1]->fPauseRecv = false;
+    BOOST_CHECK(readable(1) == std::set<SOCKET>{sockets[1].second});
+
+    // The descriptor of a closed socket is likely to be reused by the next
+    // connection, which must be watched all the same.
+    nodes[2]->CloseSocketDisconnect();
+    CloseSocket(sockets[2].first);
+    BOOST_REQUIRE(CreateLoopbackConnections(1, sockets));
+    addNode(sockets[3].second);
+    BOOST_CHECK_EQUAL(send(sockets[3].first, &byte, 1, 0), 1);
+    BOOST_CHECK(readable(2) ==
+                (std::set<SOCKET>{sockets[1].second, sockets[3].second}));
+
+    connman.ClearTestNodes();
+    for (auto &pair : sockets) {
+        CloseSocket(pair.first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(send_buffers) {
+    ConnmanTestMsg connman(GetConfig(), 0x1337, 0x1337);
+    std::vector<std::pair<SOCKET, SOCKET>> sockets;
+    BOOST_REQUIRE(CreateLoopbackConnections(1, sockets));
+    CNode *node =
+        new CNode(0, NODE_NETWORK, 0, sockets[0].second, CAddress(), 0, 0, 0,
+                  CAddress(), "", ConnectionType::INBOUND);
+    connman.AddTestNode(*node);
+
+    auto makeMsg = [](const std::string &type, size_t size) {
+        CSerializedNetMsg msg;
+        msg.m_type = type;
+        msg.data = g_insecure_rand_ctx.randbytes(size);
+        return msg;
+    };
+    // What the peer is expected to receive
+    std::vector<uint8_t> expected;
+    auto expect = [&](CSerializedNetMsg &msg) {
+        std::vector<uint8_t> header;
+        V1TransportSerializer().prepareForTransport(GetConfig(), msg, header);
+        expected.insert(expected.end(), header.begin(), header.end());
+        expected.insert(expected.end(), msg.data.begin(), msg.data.end());
+    };
+
+    // Large enough not to fit in the socket buffers, so some of the messages
+    // are only partially sent at first.
+    CSerializedNetMsg block = makeMsg("block", 4000000);
+    expect(block);
+    const std::vector<uint8_t> blockBytes = expected;
+    expected.clear();
+    CSharedNetMsg shared = connman.MakeSharedMsg(std::move(block));
+    BOOST_CHECK(shared.data && shared.data->size() == 4000000);
+
+    CSerializedNetMsg ping = makeMsg("ping", 8);
+    expect(ping);
+    connman.PushMessage(node, std::move(ping));
+    expected.insert(expected.end(), blockBytes.begin(), blockBytes.end());
+    connman.PushMessage(node, shared);
+    CSerializedNetMsg verack = makeMsg("verack", 0);
+    expect(verack);
+    connman.PushMessage(node, std::move(verack));
+    expected.insert(expected.end(), blockBytes.begin(), blockBytes.end());
+    connman.PushMessage(node, shared);
+
+    // Both queued messages point to the same payload.
+    BOOST_CHECK_GT(shared.data.use_count(), 1);
+
+    std::vector<uint8_t> received;
+    std::vector<uint8_t> buffer(100000);
+    BOOST_REQUIRE(SetSocketNonBlocking(sockets[0].first, true));
+    for (int i = 0; i < 10000 && received.size() < expected.size(); i++) {
+        connman.SendQueuedData(*node);
+        int nBytes = recv(sockets[0].first, (char *)buffer.data(),
+                          buffer.size(), 0);
+        if (nBytes > 0) {
+            received.insert(received.end(), buffer.begin(),
+                            buffer.begin() + nBytes);
+        }
+    }
+    BOOST_CHECK(received == expected);
+    BOOST_CHECK_EQUAL(shared.data.use_count(), 1);
+    {
+        LOCK(node->cs_vSend);
+        BOOST_CHECK(node->vSendMsg.empty());
+        BOOST_CHECK_EQUAL(node->nSendSize, 0U);
+        BOOST_CHECK_EQUAL(node->nSendBytes, expected.size());
+    }
+
+    connman.ClearTestNodes();
+    CloseSocket(sockets[0].first);
+}
+
+BOOST_AUTO_TEST_CASE(recv_buffer_pool) {
+    RecvBufferPool pool;
+    BOOST_CHECK_EQUAL(pool.Get(0, SER_NETWORK, INIT_PROTO_VERSION).capacity(),
+                      0U);
+
+    // Buffers are rounded up to their size class.
+    CDataStream stream = pool.Get(300, SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(stream.capacity(), 512U);
+    stream << uint64_t(42);
+    pool.Put(std::move(stream));
+    BOOST_CHECK_EQUAL(pool.Count(), 1U);
+
+    // Same size class, the buffer is reused and comes back empty.
+    stream = pool.Get(257, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(pool.Count(), 0U);
+    BOOST_CHECK_EQUAL(stream.capacity(), 512U);
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK_EQUAL(stream.GetVersion(), PROTOCOL_VERSION);
+
+    // A buffer with a bigger capacity can serve the smaller class it fills.
+    stream.reserve(1000);
+    pool.Put(std::move(stream));
+    BOOST_CHECK(pool.Get(512, SER_NETWORK, PROTOCOL_VERSION).capacity() >=
+                1000);
+
+    // Large payloads get the largest size class, but their buffers are not
+    // kept once they grew past it.
+    stream = pool.Get(MAX_PROTOCOL_MESSAGE_LENGTH, SER_NETWORK,
+                      PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(stream.capacity(), 256U * 1024);
+    stream.reserve(1024 * 1024);
+    pool.Put(std::move(stream));
+    BOOST_CHECK_EQUAL(pool.Count(), 0U);
+
+    // Each size class only keeps so many buffers.
+    std::vector<CDataStream> streams;
+    for (int i = 0; i < 3; i++) {
+        streams.push_back(pool.Get(256 * 1024, SER_NETWORK, PROTOCOL_VERSION));
+    }
+    for (CDataStream &s : streams) {
+        pool.Put(std::move(s));
+    }
+    BOOST_CHECK_EQUAL(pool.Count(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(recv_buffer_reuse) {
+    V1TransportDeserializer deserializer(
+        GetConfig().GetChainParams().NetMagic(), SER_NETWORK,
+        INIT_PROTO_VERSION);
+    auto receive = [&](const std::string &type, size_t size) {
+        CSerializedNetMsg msg;
+        msg.m_type = type;
+        msg.data = g_insecure_rand_ctx.randbytes(size);
+        std::vector<uint8_t> bytes;
+        V1TransportSerializer().prepareForTransport(GetConfig(), msg, bytes);
+        bytes.insert(bytes.end(), msg.data.begin(), msg.data.end());
+
+        // Feed the message in small chunks, like a slow peer would.
+        for (size_t pos = 0; pos < bytes.size();) {
+            const uint32_t chunk =
+                std::min<size_t>(bytes.size() - pos, 1000 + size / 7);
+            const int ret = deserializer.Read(
+                GetConfig(), (const char *)bytes.data() + pos, chunk);
+            BOOST_REQUIRE(ret > 0);
+            pos += ret;
+        }
+        BOOST_REQUIRE(deserializer.Complete());
+        CNetMessage netmsg = deserializer.GetMessage(
+            GetConfig(), std::chrono::microseconds(GetTimeMicros()));
+        BOOST_CHECK(netmsg.m_valid_checksum);
+        BOOST_CHECK_EQUAL(netmsg.m_command, type);
+        BOOST_CHECK(std::vector<uint8_t>(netmsg.m_recv.begin(),
+                                         netmsg.m_recv.end()) == msg.data);
+        return netmsg;
+    };
+
+    CNetMessage tx = receive("tx", 400);
+    const size_t pooled = g_recv_buffer_pool.Count();
+    g_recv_buffer_pool.Put(std::move(tx.m_recv));
+    BOOST_CHECK_EQUAL(g_recv_buffer_pool.Count(), pooled + 1);
+    // The next message of the same size class takes the buffer back.
+    receive("tx", 300);
+    BOOST_CHECK_EQUAL(g_recv_buffer_pool.Count(), pooled);
+
+    // Messages spanning several size classes, and larger than the biggest one.
+    receive("verack", 0);
+    receive("headers", 162001);
+    receive("block", 3000000);
+}
+
 BOOST_AUTO_TEST_CASE(test_getSubVersionEB) {
     BOOST_CHECK_EQUAL(getSubVersionEB(13800000000), "13800.0");
     BOOST_CHECK_EQUAL(getSubVersionEB(3800000000), "3800.0");
@@ -0,0 +1,128 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(pinsketch_tests, BasicTestingSetup)
+
+static std::vector<uint32_t> RandomElements(size_t count) {
+    std::set<uint32_t> elements;
+    while (elements.size() < count) {
+        const uint32_t element = InsecureRand32();
+        if (element != 0) {
+            elements.insert(element);
+        }
+    }
+    return {elements.begin(), elements.end()};
+}
+
+static std::vector<uint32_t> Decode(const PinSketch &sketch) {
+    std::vector<uint32_t> elements;
+    BOOST_CHECK(sketch.Decode(elements));
+    std::sort(elements.begin(), elements.end());
+    return elements;
+}
+
+BOOST_AUTO_TEST_CASE(decode) {
+    BOOST_CHECK(Decode(PinSketch(5)).empty());
+
+    for (size_t capacity = 1; capacity <= 40; capacity++) {
+        for (size_t count = 0; count < capacity; count++) {
+            const std::vector<uint32_t> elements = RandomElements(count);
+            PinSketch sketch(capacity);
+            for (const uint32_t element : elements) {
+                sketch.Add(element);
+            }
+            BOOST_CHECK(Decode(sketch) == elements);
+        }
+    }
+
+    // Extremal elements.
+    PinSketch sketch(4);
+    sketch.Add(1);
+    sketch.Add(0xffffffff);
+    sketch.Add(0x80000000);
+    BOOST_CHECK(Decode(sketch) ==
+                std::vector<uint32_t>({1, 0x80000000, 0xffffffff}));
+}
+
+BOOST_AUTO_TEST_CASE(overfull) {
+    // Sketches holding as many elements as their capacity or more fail to
+    // decode, rather than returning wrong elements.
+    for (size_t capacity = 1; capacity <= 20; capacity++) {
+        for (size_t count = capacity; count < capacity + 10; count++) {
+            PinSketch sketch(capacity);
+            for (const uint32_t element : RandomElements(count)) {
+                sketch.Add(element);
+            }
+            std::vector<uint32_t> elements{1};
+            BOOST_CHECK(!sketch.Decode(elements));
+            BOOST_CHECK(elements.empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merge) {
+    // The sketches of two large sets merge into the sketch of their symmetric
+    // difference.
+    const std::vector<uint32_t> elements = RandomElements(1019);
+    PinSketch sketch1(20);
+    PinSketch sketch2(30);
+    for (size_t i = 0; i < 1000; i++) {
+        sketch1.Add(elements[i]);
+        sketch2.Add(elements[i]);
+    }
+    const std::vector<uint32_t> difference(elements.begin() + 1000,
+                                           elements.begin() + 1019);
+    for (size_t i = 0; i < difference.size(); i++) {
+        (i % 3 == 0 ? sketch1 : sketch2).Add(difference[i]);
+    }
+    sketch1.Merge(sketch2);
+    BOOST_CHECK_EQUAL(sketch1.GetCapacity(), 20U);
+    BOOST_CHECK(Decode(sketch1) == difference);
+
+    // Adding an element twice removes it.
+    PinSketch sketch(3);
+    sketch.Add(42);
+    sketch.Add(7);
+    sketch.Add(42);
+    BOOST_CHECK(Decode(sketch) == std::vector<uint32_t>{7});
+}
+
+BOOST_AUTO_TEST_CASE(serialization) {
+    PinSketch sketch(10);
+    const std::vector<uint32_t> elements = RandomElements(9);
+    for (const uint32_t element : elements) {
+        sketch.Add(element);
+    }
+    const std::vector<uint8_t> data = sketch.Serialize();
+    BOOST_CHECK_EQUAL(data.size(), 40U);
+
+    const PinSketch copy = PinSketch::Deserialize(data);
+    BOOST_CHECK_EQUAL(copy.GetCapacity(), 10U);
+    BOOST_CHECK(copy.Serialize() == data);
+    BOOST_CHECK(Decode(copy) == elements);
+
+    // The first power sum is the xor of the elements, little endian.
+    uint32_t sum = 0;
+    for (const uint32_t element : elements) {
+        sum ^= element;
+    }
+    BOOST_CHECK_EQUAL(data[0] | data[1] << 8 | data[2] << 16 |
+                          uint32_t(data[3]) << 24,
+                      sum);
+
+    BOOST_CHECK_EQUAL(
+        PinSketch::Deserialize(std::vector<uint8_t>(7)).GetCapacity(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,161 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <subnettrie.h>
+
+#include <netbase.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(subnettrie_tests, BasicTestingSetup)
+
+static CNetAddr ResolveIP(const std::string &ip) {
+    CNetAddr addr;
+    LookupHost(ip, addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const std::string &subnet) {
+    CSubNet ret;
+    LookupSubNet(subnet, ret);
+    return ret;
+}
+
+// A random address close to one of a few base addresses, so that the subnets
+// built from them share prefixes.
+static CNetAddr RandomAddr(bool ipv6) {
+    static const std::vector<std::vector<uint8_t>> bases{
+        ParseHex("2001db8000000000000000000000000a"),
+        ParseHex("2a0100ff00000000000000000000ff00"),
+        ParseHex("05060708090a0b0c0d0e0f1011121314"),
+    };
+    std::vector<uint8_t> bytes = bases[InsecureRandRange(bases.size())];
+    const size_t size = ipv6 ? ADDR_IPV6_SIZE : ADDR_IPV4_SIZE;
+    bytes.resize(size);
+    // Flip a few of the low bits.
+    for (int i = InsecureRandRange(4); i > 0; i--) {
+        const size_t bit = 8 * size - 1 - InsecureRandRange(8 * size / 2);
+        bytes[bit / 8] ^= 1 << (7 - bit % 8);
+    }
+
+    if (ipv6) {
+        in6_addr addr;
+        memcpy(addr.s6_addr, bytes.data(), size);
+        return CNetAddr(addr);
+    }
+    in_addr addr;
+    memcpy(&addr.s_addr, bytes.data(), size);
+    return CNetAddr(addr);
+}
+
+static CSubNet RandomSubNet() {
+    const bool ipv6 = InsecureRandBool();
+    const CNetAddr addr = RandomAddr(ipv6);
+    const uint8_t max_len = ipv6 ? 128 : 32;
+    return CSubNet(addr, max_len - InsecureRandRange(max_len / 2 + 1));
+}
+
+BOOST_AUTO_TEST_CASE(match) {
+    SubNetTrie trie;
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.4"), 0));
+
+    trie.Insert(ResolveSubNet("1.2.0.0/16"), 100);
+    trie.Insert(ResolveSubNet("1.2.3.0/24"), 200);
+    trie.Insert(ResolveSubNet("1.2.3.4/32"), 300);
+    trie.Insert(ResolveSubNet("::/0"), 100);
+    BOOST_CHECK_EQUAL(trie.Size(), 4U);
+
+    // The subnets an address is in are matched until the latest time any of
+    // them is banned until.
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.3.4"), 299));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.4"), 300));
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.3.5"), 199));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.5"), 200));
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.4.5"), 99));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.4.5"), 100));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.3.3.4"), 0));
+
+    // Networks are matched separately.
+    BOOST_CHECK(trie.Match(ResolveIP("2001::1"), 0));
+    BOOST_CHECK(!trie.Match(ResolveIP("2001::1"), 100));
+    BOOST_CHECK(!trie.Match(ResolveIP("5.6.7.8"), 0));
+    BOOST_CHECK(!trie.Match(CNetAddr(), 0));
+
+    // Updating and erasing subnets.
+    trie.Insert(ResolveSubNet("1.2.0.0/16"), 400);
+    BOOST_CHECK_EQUAL(trie.Size(), 4U);
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.3.5"), 399));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.0.0/15")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.3.0/25")));
+    BOOST_CHECK(trie.Erase(ResolveSubNet("1.2.0.0/16")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.0.0/16")));
+    BOOST_CHECK_EQUAL(trie.Size(), 3U);
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.5"), 200));
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.3.4"), 200));
+
+    // Invalid subnets don't match anything.
+    trie.Insert(CSubNet(), 1000);
+    BOOST_CHECK_EQUAL(trie.Size(), 3U);
+    BOOST_CHECK(!trie.Match(ResolveIP("::1"), 200));
+
+    trie.Clear();
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.4"), 0));
+}
+
+BOOST_AUTO_TEST_CASE(non_prefix_netmask) {
+    // A netmask which isn't a prefix can only be deserialized.
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << ResolveIP("1.0.3.0");
+    const std::vector<uint8_t> netmask =
+        ParseHex("000000000000000000000000ff00ff00");
+    stream.write((const char *)netmask.data(), netmask.size());
+    stream << true;
+    CSubNet subnet;
+    stream >> subnet;
+    BOOST_CHECK(subnet.IsValid());
+
+    SubNetTrie trie;
+    trie.Insert(subnet, 100);
+    BOOST_CHECK_EQUAL(trie.Size(), 1U);
+    BOOST_CHECK(trie.Match(ResolveIP("1.5.3.9"), 0));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.5.4.9"), 0));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.5.3.9"), 100));
+    BOOST_CHECK(trie.Erase(subnet));
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(random_subnets) {
+    // Compare with matching the subnets one by one.
+    SubNetTrie trie;
+    std::map<CSubNet, int64_t> subnets;
+    for (int i = 0; i < 2000; i++) {
+        const CSubNet subnet = RandomSubNet();
+        if (InsecureRandRange(3) == 0) {
+            BOOST_CHECK_EQUAL(trie.Erase(subnet), subnets.erase(subnet) > 0);
+        } else {
+            const int64_t ban_until = InsecureRandRange(100);
+            trie.Insert(subnet, ban_until);
+            subnets[subnet] = ban_until;
+        }
+        BOOST_CHECK_EQUAL(trie.Size(), subnets.size());
+
+        const CNetAddr addr = RandomAddr(InsecureRandBool());
+        const int64_t time = InsecureRandRange(100);
+        bool match = false;
+        for (const auto &it : subnets) {
+            match |= time < it.second && it.first.Match(addr);
+        }
+        BOOST_CHECK_EQUAL(trie.Match(addr, time), match);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
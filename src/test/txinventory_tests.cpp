@@ -0,0 +1,143 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txinventory.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txinventory_tests, BasicTestingSetup)
+
+static std::vector<TxId> RandomTxIds(size_t count) {
+    std::vector<TxId> txids;
+    for (size_t i = 0; i < count; i++) {
+        txids.emplace_back(InsecureRand256());
+    }
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(known_inventory) {
+    KnownTxInventory known;
+    BOOST_CHECK_EQUAL(known.DynamicMemoryUsage(), 0U);
+
+    const std::vector<TxId> txids =
+        RandomTxIds(KnownTxInventory::CAPACITY + 1000);
+    for (size_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(!known.contains(txids[i]));
+        known.insert(txids[i]);
+        BOOST_CHECK(known.contains(txids[i]));
+    }
+    // Inserting a known txid again doesn't change anything.
+    known.insert(txids[0]);
+    BOOST_CHECK_EQUAL(known.size(), 1000U);
+    const size_t usage = known.DynamicMemoryUsage();
+    BOOST_CHECK(usage > 0);
+
+    // Once full, the oldest txids are forgotten first.
+    for (size_t i = 1000; i < txids.size(); i++) {
+        known.insert(txids[i]);
+    }
+    BOOST_CHECK_EQUAL(known.size(), KnownTxInventory::CAPACITY);
+    size_t forgotten = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        forgotten += !known.contains(txids[i]);
+    }
+    // Allow for false positives.
+    BOOST_CHECK(forgotten >= 990);
+    for (size_t i = 1000; i < txids.size(); i++) {
+        BOOST_CHECK(known.contains(txids[i]));
+    }
+
+    // The memory used is bounded, and smaller than the rolling bloom filter
+    // used previously.
+    const size_t full_usage = known.DynamicMemoryUsage();
+    BOOST_CHECK(full_usage > usage);
+    BOOST_CHECK(full_usage <= 8 * KnownTxInventory::CAPACITY + 1024);
+    for (size_t i = 0; i < 10; i++) {
+        for (const TxId &txid : RandomTxIds(1000)) {
+            known.insert(txid);
+        }
+        BOOST_CHECK_EQUAL(known.DynamicMemoryUsage(), full_usage);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(known_inventory_eviction) {
+    // Replace the entries of a full ring many times over, with checks that
+    // the lookups still find everything it contains.
+    KnownTxInventory known;
+    const std::vector<TxId> txids =
+        RandomTxIds(3 * KnownTxInventory::CAPACITY);
+    // The txids whose short id was already known when inserted, and so
+    // weren't added.
+    std::vector<bool> collided(txids.size());
+    for (size_t i = 0; i < txids.size(); i++) {
+        collided[i] = known.contains(txids[i]);
+        known.insert(txids[i]);
+        if (i % 997 == 0) {
+            const size_t first = i + 1 > KnownTxInventory::CAPACITY
+                                     ? i + 1 - KnownTxInventory::CAPACITY
+                                     : 0;
+            size_t missing = 0;
+            for (size_t j = first; j <= i; j++) {
+                missing += !collided[j] && !known.contains(txids[j]);
+            }
+            BOOST_CHECK_EQUAL(missing, 0U);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(announcement_queue) {
+    TxAnnouncementQueue queue;
+    const std::vector<TxId> txids = RandomTxIds(10);
+
+    // Without readers, nothing is kept.
+    queue.Push(txids[0]);
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+    BOOST_CHECK_EQUAL(queue.End(), 1U);
+
+    uint64_t reader1 = queue.AddReader();
+    BOOST_CHECK_EQUAL(reader1, 1U);
+    for (size_t i = 1; i < 6; i++) {
+        queue.Push(txids[i]);
+    }
+    uint64_t reader2 = queue.AddReader();
+    BOOST_CHECK_EQUAL(reader2, 6U);
+    for (size_t i = 6; i < 10; i++) {
+        queue.Push(txids[i]);
+    }
+    BOOST_CHECK_EQUAL(queue.Size(), 9U);
+
+    // Reads come back in the order of the pushes.
+    std::vector<TxId> read;
+    queue.Read(reader1, 3, read);
+    BOOST_CHECK(read == std::vector<TxId>(txids.begin() + 1,
+                                          txids.begin() + 4));
+    read.clear();
+    queue.Read(reader2, 100, read);
+    BOOST_CHECK(read == std::vector<TxId>(txids.begin() + 6, txids.end()));
+
+    // The transactions are dropped once every reader is past them.
+    queue.Advance(reader1, 4);
+    reader1 = 4;
+    BOOST_CHECK_EQUAL(queue.Size(), 6U);
+    queue.Advance(reader2, 10);
+    reader2 = 10;
+    BOOST_CHECK_EQUAL(queue.Size(), 6U);
+    queue.Advance(reader1, 8);
+    reader1 = 8;
+    BOOST_CHECK_EQUAL(queue.Size(), 2U);
+    read.clear();
+    queue.Read(reader1, 100, read);
+    BOOST_CHECK(read == std::vector<TxId>(txids.begin() + 8, txids.end()));
+
+    queue.RemoveReader(reader1);
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+    queue.RemoveReader(reader2);
+    BOOST_CHECK_EQUAL(queue.End(), 10U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,206 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+namespace {
+
+std::vector<TxId> RandomTxIds(size_t count) {
+    std::vector<TxId> txids;
+    for (size_t i = 0; i < count; i++) {
+        txids.emplace_back(InsecureRand256());
+    }
+    return txids;
+}
+
+std::vector<TxId> Sorted(std::vector<TxId> txids) {
+    std::sort(txids.begin(), txids.end());
+    return txids;
+}
+
+/**
+ * Two nodes reconciling with each other: the initiator has peer id 0 for the
+ * responder, which has peer id 1 for the initiator.
+ */
+struct ReconcilingPair {
+    TxReconciliationTracker initiator;
+    TxReconciliationTracker responder;
+
+    ReconcilingPair() {
+        const uint64_t initiator_salt = initiator.PreRegisterPeer(0);
+        const uint64_t responder_salt = responder.PreRegisterPeer(1);
+        BOOST_CHECK(initiator.RegisterPeer(0, true, responder_salt));
+        BOOST_CHECK(responder.RegisterPeer(1, false, initiator_salt));
+    }
+
+    /**
+     * Run a reconciliation, and return whether it succeeded, with the
+     * transactions each side announces to the other.
+     */
+    bool Reconcile(std::vector<TxId> &from_initiator,
+                   std::vector<TxId> &from_responder) {
+        ++m_reconciliations;
+        const auto request = initiator.MaybeRequestReconciliation(
+            0, GetTime<std::chrono::microseconds>() +
+                   m_reconciliations * RECON_REQUEST_INTERVAL);
+        BOOST_REQUIRE(request);
+        const auto skdata = responder.HandleReconciliationRequest(
+            1, request->set_size, request->q);
+        BOOST_REQUIRE(skdata);
+        std::vector<uint32_t> ask_shortids;
+        const auto success =
+            initiator.HandleSketch(0, *skdata, ask_shortids, from_initiator);
+        BOOST_REQUIRE(success);
+        BOOST_CHECK(responder.HandleReconciliationDifference(
+            1, *success, ask_shortids, from_responder));
+        BOOST_CHECK_EQUAL(initiator.GetSetSize(0), 0U);
+        BOOST_CHECK_EQUAL(responder.GetSetSize(1), 0U);
+        return *success;
+    }
+
+private:
+    int m_reconciliations{0};
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(registration) {
+    TxReconciliationTracker tracker;
+    const TxId txid = RandomTxIds(1)[0];
+
+    // Peers must be pre-registered, and registered once.
+    BOOST_CHECK(!tracker.RegisterPeer(0, true, 1));
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(!tracker.AddToSet(0, txid));
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1));
+    BOOST_CHECK(tracker.IsPeerRegistered(0));
+    BOOST_CHECK(!tracker.RegisterPeer(0, true, 1));
+
+    BOOST_CHECK(tracker.AddToSet(0, txid));
+    BOOST_CHECK_EQUAL(tracker.GetSetSize(0), 1U);
+    tracker.ForgetPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK_EQUAL(tracker.GetSetSize(0), 0U);
+
+    // Transactions are flooded to the first outbound peers only.
+    for (NodeId peer = 1; peer <= NodeId(MAX_OUTBOUND_FLOOD_TO) + 1; peer++) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.RegisterPeer(peer, true, 1));
+        BOOST_CHECK_EQUAL(tracker.IsFloodPeer(peer),
+                          peer <= NodeId(MAX_OUTBOUND_FLOOD_TO));
+    }
+    tracker.PreRegisterPeer(100);
+    BOOST_CHECK(tracker.RegisterPeer(100, false, 1));
+    BOOST_CHECK(!tracker.IsFloodPeer(100));
+    // A flood peer going away lets another outbound peer take its place.
+    tracker.ForgetPeer(1);
+    tracker.PreRegisterPeer(101);
+    BOOST_CHECK(tracker.RegisterPeer(101, true, 1));
+    BOOST_CHECK(tracker.IsFloodPeer(101));
+}
+
+BOOST_AUTO_TEST_CASE(request_timer) {
+    TxReconciliationTracker tracker;
+    tracker.PreRegisterPeer(0);
+    tracker.PreRegisterPeer(1);
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1));
+    BOOST_CHECK(tracker.RegisterPeer(1, false, 1));
+
+    const auto now = GetTime<std::chrono::microseconds>();
+    BOOST_CHECK(!tracker.MaybeRequestReconciliation(0, now));
+    const auto request =
+        tracker.MaybeRequestReconciliation(0, now + RECON_REQUEST_INTERVAL);
+    BOOST_REQUIRE(request);
+    BOOST_CHECK_EQUAL(request->set_size, 0U);
+    BOOST_CHECK_EQUAL(request->q, RECON_Q);
+    // A single reconciliation is in progress at a time.
+    BOOST_CHECK(!tracker.MaybeRequestReconciliation(
+        0, now + 10 * RECON_REQUEST_INTERVAL));
+    // We only initiate reconciliations with outbound peers, and don't
+    // respond to them.
+    BOOST_CHECK(!tracker.MaybeRequestReconciliation(
+        1, now + RECON_REQUEST_INTERVAL));
+    BOOST_CHECK(!tracker.HandleReconciliationRequest(0, 0, 0));
+    std::vector<TxId> announce;
+    BOOST_CHECK(!tracker.HandleReconciliationDifference(1, true, {}, announce));
+}
+
+BOOST_AUTO_TEST_CASE(reconcile) {
+    ReconcilingPair pair;
+    const std::vector<TxId> txids = RandomTxIds(230);
+
+    // Identical sets.
+    std::vector<TxId> from_initiator;
+    std::vector<TxId> from_responder;
+    for (size_t i = 0; i < 100; i++) {
+        BOOST_CHECK(pair.initiator.AddToSet(0, txids[i]));
+        BOOST_CHECK(pair.responder.AddToSet(1, txids[i]));
+    }
+    BOOST_CHECK(pair.Reconcile(from_initiator, from_responder));
+    BOOST_CHECK(from_initiator.empty());
+    BOOST_CHECK(from_responder.empty());
+
+    // Each side has transactions the other misses.
+    for (size_t i = 100; i < 200; i++) {
+        BOOST_CHECK(pair.initiator.AddToSet(0, txids[i]));
+        BOOST_CHECK(pair.responder.AddToSet(1, txids[i]));
+    }
+    const std::vector<TxId> initiator_only(txids.begin() + 200,
+                                           txids.begin() + 203);
+    const std::vector<TxId> responder_only(txids.begin() + 203, txids.end());
+    for (const TxId &txid : initiator_only) {
+        BOOST_CHECK(pair.initiator.AddToSet(0, txid));
+    }
+    for (const TxId &txid : responder_only) {
+        BOOST_CHECK(pair.responder.AddToSet(1, txid));
+    }
+    BOOST_CHECK(pair.Reconcile(from_initiator, from_responder));
+    BOOST_CHECK(Sorted(from_initiator) == Sorted(initiator_only));
+    BOOST_CHECK(Sorted(from_responder) == Sorted(responder_only));
+}
+
+BOOST_AUTO_TEST_CASE(reconcile_failure) {
+    ReconcilingPair pair;
+    const std::vector<TxId> txids = RandomTxIds(2 * MAX_SKETCH_CAPACITY);
+
+    // A difference larger than the sketch can hold: both sides announce
+    // their whole set.
+    for (size_t i = 0; i < txids.size(); i++) {
+        BOOST_CHECK((i % 2 ? pair.initiator.AddToSet(0, txids[i])
+                           : pair.responder.AddToSet(1, txids[i])));
+    }
+    std::vector<TxId> from_initiator;
+    std::vector<TxId> from_responder;
+    BOOST_CHECK(!pair.Reconcile(from_initiator, from_responder));
+    BOOST_CHECK_EQUAL(from_initiator.size(), MAX_SKETCH_CAPACITY);
+    BOOST_CHECK_EQUAL(from_responder.size(), MAX_SKETCH_CAPACITY);
+
+    // Unexpected sketches are rejected.
+    std::vector<uint32_t> ask_shortids;
+    BOOST_CHECK(!pair.initiator.HandleSketch(0, std::vector<uint8_t>(4),
+                                             ask_shortids, from_initiator));
+}
+
+BOOST_AUTO_TEST_CASE(set_limit) {
+    TxReconciliationTracker tracker;
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(tracker.RegisterPeer(0, false, 1));
+    for (const TxId &txid : RandomTxIds(MAX_RECON_SET_SIZE)) {
+        BOOST_CHECK(tracker.AddToSet(0, txid));
+    }
+    BOOST_CHECK(!tracker.AddToSet(0, RandomTxIds(1)[0]));
+    BOOST_CHECK_EQUAL(tracker.GetSetSize(0), MAX_RECON_SET_SIZE);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txrequest.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+namespace {
+
+using namespace std::chrono_literals;
+
+TxId RandomTxId() {
+    return TxId(InsecureRand256());
+}
+
+void Check(const TxRequestTracker &tracker, std::chrono::microseconds now) {
+    tracker.SanityCheck();
+    tracker.PostGetRequestableSanityCheck(now);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(request_lifecycle) {
+    TxRequestTracker tracker(true);
+    const TxId txid = RandomTxId();
+    const std::chrono::microseconds start{1000000s};
+
+    tracker.ReceivedInv(0, txid, false, start + 2s);
+    // Duplicate announcements are ignored.
+    tracker.ReceivedInv(0, txid, true, start);
+    BOOST_CHECK_EQUAL(tracker.Size(), 1U);
+    BOOST_CHECK_EQUAL(tracker.CountCandidates(0), 1U);
+
+    // Not requestable before its reqtime.
+    BOOST_CHECK(tracker.GetRequestable(0, start + 1s).empty());
+    Check(tracker, start + 1s);
+
+    auto requestable = tracker.GetRequestable(0, start + 2s);
+    Check(tracker, start + 2s);
+    BOOST_CHECK(requestable == std::vector<TxId>{txid});
+
+    tracker.RequestedTx(0, txid, start + 62s);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 1U);
+    BOOST_CHECK_EQUAL(tracker.CountCandidates(0), 0U);
+    BOOST_CHECK(tracker.GetRequestable(0, start + 3s).empty());
+
+    // Once the only announcement is completed, the txid is forgotten.
+    tracker.ReceivedResponse(0, txid);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(request_fallback) {
+    TxRequestTracker tracker(true);
+    const TxId txid = RandomTxId();
+    const std::chrono::microseconds start{1000000s};
+
+    // Peer 2 is preferred, so it is picked first even if the others announced
+    // the transaction before it.
+    tracker.ReceivedInv(0, txid, false, start);
+    tracker.ReceivedInv(1, txid, false, start);
+    tracker.ReceivedInv(2, txid, true, start);
+    BOOST_CHECK(tracker.ComputePriority(txid, 2, true) >
+                tracker.ComputePriority(txid, 0, false));
+    BOOST_CHECK(tracker.GetRequestable(0, start).empty());
+    BOOST_CHECK(tracker.GetRequestable(1, start).empty());
+    BOOST_CHECK(tracker.GetRequestable(2, start) == std::vector<TxId>{txid});
+    Check(tracker, start);
+    tracker.RequestedTx(2, txid, start + 60s);
+
+    // The request expires, and the best non-preferred peer takes over.
+    std::vector<std::pair<NodeId, TxId>> expired;
+    const NodeId next =
+        tracker.ComputePriority(txid, 0, false) >
+                tracker.ComputePriority(txid, 1, false)
+            ? 0
+            : 1;
+    BOOST_CHECK(tracker.GetRequestable(next, start + 59s, &expired).empty());
+    BOOST_CHECK(expired.empty());
+    BOOST_CHECK(tracker.GetRequestable(next, start + 60s, &expired) ==
+                std::vector<TxId>{txid});
+    Check(tracker, start + 60s);
+    BOOST_CHECK_EQUAL(expired.size(), 1U);
+    BOOST_CHECK_EQUAL(expired[0].first, 2);
+    BOOST_CHECK(expired[0].second == txid);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(2), 0U);
+    // The expired announcement is kept so it isn't requested again.
+    BOOST_CHECK_EQUAL(tracker.Count(2), 1U);
+    tracker.RequestedTx(next, txid, start + 120s);
+
+    // The peer disconnects, and the last one takes over.
+    tracker.DisconnectedPeer(next);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Count(next), 0U);
+    BOOST_CHECK(tracker.GetRequestable(1 - next, start + 61s) ==
+                std::vector<TxId>{txid});
+
+    // Once it has been received, nobody is asked anymore.
+    tracker.ForgetTxId(txid);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(request_order) {
+    TxRequestTracker tracker;
+    const std::chrono::microseconds start{1000000s};
+
+    // Requestable transactions come back in the order they were announced.
+    std::vector<TxId> txids;
+    for (int i = 0; i < 100; i++) {
+        txids.push_back(RandomTxId());
+        tracker.ReceivedInv(0, txids.back(), i % 2, start + 1s * (i % 3));
+    }
+    BOOST_CHECK_EQUAL(tracker.CountCandidates(0), 100U);
+    BOOST_CHECK(tracker.GetRequestable(0, start + 2s) == txids);
+    Check(tracker, start + 2s);
+
+    // If the clock goes back, announcements are delayed again.
+    const auto requestable = tracker.GetRequestable(0, start);
+    Check(tracker, start);
+    BOOST_CHECK_EQUAL(requestable.size(), 34U);
+
+    for (const TxId &txid : txids) {
+        tracker.RequestedTx(0, txid, start + 60s);
+    }
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 100U);
+    tracker.DisconnectedPeer(0);
+    tracker.SanityCheck();
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,8 +4,11 @@
 
 #include <config.h>
 #include <consensus/validation.h>
+#include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
+#include <script/scriptcache.h>
+#include <script/standard.h>
 #include <txmempool.h>
 #include <validation.h>
 
@@ -53,4 +56,81 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup) {
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that the scripts verified ahead of mempool acceptance are cached, and
+ * that transactions which cannot be accepted are not.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_preverify_scripts, TestChain100Setup) {
+    // Mine coinbases that can be spent without signatures.
+    const CScript redeemScript = CScript() << OP_TRUE;
+    const CScript scriptPubKey =
+        GetScriptForDestination(ScriptHash(redeemScript));
+    std::vector<CTransactionRef> coinbases;
+    for (int i = 0; i < COINBASE_MATURITY; i++) {
+        coinbases.push_back(CreateAndProcessBlock({}, scriptPubKey).vtx[0]);
+    }
+
+    const CScript p2pkh =
+        GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    auto spend = [&](const COutPoint &prevout, const CScript &scriptSig,
+                     const Amount value) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.emplace_back(prevout, scriptSig);
+        tx.vout.resize(2, CTxOut(value, p2pkh));
+        return MakeTransactionRef(tx);
+    };
+
+    auto isCached = [](const CTransaction &tx) {
+        // Replay protection may or may not be enabled for the next block.
+        int nSigChecks;
+        LOCK(cs_main);
+        return IsKeyInScriptCache(
+                   ScriptCacheKey(tx, STANDARD_SCRIPT_VERIFY_FLAGS), false,
+                   nSigChecks) ||
+               IsKeyInScriptCache(
+                   ScriptCacheKey(tx, STANDARD_SCRIPT_VERIFY_FLAGS |
+                                          SCRIPT_ENABLE_REPLAY_PROTECTION),
+                   false, nSigChecks);
+    };
+
+    // vout 0 = OP_RETURN, vout 1 = miner reward
+    const CScript scriptSig = CScript() << ToByteVector(redeemScript);
+    const CTransactionRef tx =
+        spend(COutPoint(coinbases[0]->GetId(), 1), scriptSig, 10 * CENT);
+    BOOST_CHECK(!isCached(*tx));
+    BOOST_CHECK(PreVerifyTransactionScripts(GetConfig(), *m_node.mempool, *tx));
+    BOOST_CHECK(isCached(*tx));
+
+    {
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(GetConfig(), *m_node.mempool, state, tx,
+                                       false /* bypass_limits */,
+                                       Amount::zero() /* nAbsurdFee */));
+        BOOST_CHECK(m_node.mempool->exists(tx->GetId()));
+    }
+
+    // The input is already spent by a mempool transaction.
+    const CTransactionRef doubleSpend =
+        spend(COutPoint(coinbases[0]->GetId(), 1), scriptSig, 20 * CENT);
+    BOOST_CHECK(!PreVerifyTransactionScripts(GetConfig(), *m_node.mempool,
+                                             *doubleSpend));
+    BOOST_CHECK(!isCached(*doubleSpend));
+
+    // The input doesn't exist.
+    const CTransactionRef missing =
+        spend(COutPoint(TxId(InsecureRand256()), 0), scriptSig, 10 * CENT);
+    BOOST_CHECK(
+        !PreVerifyTransactionScripts(GetConfig(), *m_node.mempool, *missing));
+
+    // The scriptSig is not push only, which is not standard.
+    const CTransactionRef nonStandard =
+        spend(COutPoint(coinbases[1]->GetId(), 1),
+              CScript() << OP_NOP << ToByteVector(redeemScript), 10 * CENT);
+    BOOST_CHECK(!PreVerifyTransactionScripts(GetConfig(), *m_node.mempool,
+                                             *nonStandard));
+    BOOST_CHECK(!isCached(*nonStandard));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
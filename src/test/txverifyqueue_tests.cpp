@@ -0,0 +1,107 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txverifyqueue.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(txverifyqueue_tests, BasicTestingSetup)
+
+static void WaitFor(const std::atomic<int> &counter, int expected) {
+    for (int i = 0; i < 10000 && counter != expected; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    BOOST_CHECK_EQUAL(counter, expected);
+}
+
+BOOST_AUTO_TEST_CASE(run_jobs) {
+    TxVerifyQueue queue(1000);
+    std::atomic<int> counter{0};
+
+    // There is no worker to run the job.
+    BOOST_CHECK(!queue.IsRunning());
+    BOOST_CHECK(!queue.Enqueue([&]() { counter++; }));
+
+    queue.Start(4);
+    BOOST_CHECK(queue.IsRunning());
+    for (int i = 0; i < 500; i++) {
+        BOOST_CHECK(queue.Enqueue([&]() { counter++; }));
+    }
+    WaitFor(counter, 500);
+
+    queue.Stop();
+    BOOST_CHECK(!queue.IsRunning());
+    BOOST_CHECK(!queue.Enqueue([&]() { counter++; }));
+
+    // The queue can be restarted.
+    queue.Start(1);
+    BOOST_CHECK(queue.Enqueue([&]() { counter++; }));
+    WaitFor(counter, 501);
+}
+
+BOOST_AUTO_TEST_CASE(bounded_queue) {
+    TxVerifyQueue queue(10);
+    std::atomic<int> counter{0};
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    queue.Start(1);
+
+    // Keep the only worker busy, then fill the queue.
+    std::promise<void> started;
+    BOOST_CHECK(queue.Enqueue([&]() {
+        started.set_value();
+        released.wait();
+        counter++;
+    }));
+    started.get_future().wait();
+
+    for (int i = 0; i < 10; i++) {
+        BOOST_CHECK(queue.Enqueue([&]() { counter++; }));
+    }
+    BOOST_CHECK(!queue.Enqueue([&]() { counter++; }));
+
+    release.set_value();
+    WaitFor(counter, 11);
+    BOOST_CHECK(queue.Enqueue([&]() { counter++; }));
+    WaitFor(counter, 12);
+}
+
+BOOST_AUTO_TEST_CASE(stop_discards_jobs) {
+    TxVerifyQueue queue(10);
+    std::atomic<int> counter{0};
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    queue.Start(1);
+
+    std::promise<void> started;
+    BOOST_CHECK(queue.Enqueue([&]() {
+        started.set_value();
+        released.wait();
+        counter++;
+    }));
+    started.get_future().wait();
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK(queue.Enqueue([&]() { counter++; }));
+    }
+
+    // The running job completes, the ones waiting for a worker don't.
+    std::thread stopper([&]() { queue.Stop(); });
+    while (queue.IsRunning()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release.set_value();
+    stopper.join();
+    BOOST_CHECK_EQUAL(counter, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <config.h>
 #include <net.h>
+#include <netbase.h>
 
 void ConnmanTestMsg::NodeReceiveMsgBytes(CNode &node, const char *pch,
                                          unsigned int nBytes,
@@ -43,3 +44,48 @@ bool ConnmanTestMsg::ReceiveMsgFrom(CNode &node,
                         ser_msg.data.size(), complete);
     return complete;
 }
+
+bool CreateLoopbackConnections(size_t count,
+                               std::vector<std::pair<SOCKET, SOCKET>> &pairs) {
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listener, (struct sockaddr *)&addr, addr_len) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR ||
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) ==
+            SOCKET_ERROR) {
+        CloseSocket(listener);
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < count; i++) {
+        SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (client == INVALID_SOCKET) {
+            success = false;
+            break;
+        }
+        if (connect(client, (struct sockaddr *)&addr, addr_len) ==
+            SOCKET_ERROR) {
+            CloseSocket(client);
+            success = false;
+            break;
+        }
+        SOCKET server = accept(listener, nullptr, nullptr);
+        if (server == INVALID_SOCKET) {
+            CloseSocket(client);
+            success = false;
+            break;
+        }
+        pairs.emplace_back(client, server);
+    }
+
+    CloseSocket(listener);
+    return success;
+}
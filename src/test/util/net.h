@@ -7,6 +7,10 @@
 
 #include <net.h>
 
+#include <set>
+#include <utility>
+#include <vector>
+
 struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
     void AddTestNode(CNode &node) {
@@ -25,10 +29,35 @@ struct ConnmanTestMsg : public CConnman {
         m_msgproc->ProcessMessages(*config, &node, flagInterruptMsgProc);
     }
 
+    size_t SendQueuedData(CNode &node) const {
+        LOCK(node.cs_vSend);
+        return SocketSendData(&node);
+    }
+    void ClearSendQueue(CNode &node) const {
+        LOCK(node.cs_vSend);
+        node.vSendMsg.clear();
+        node.nSendSize = 0;
+        node.nSendOffset = 0;
+        node.fPauseSend = false;
+    }
+
+    void SocketEventsOnce(std::set<SOCKET> &recv_set,
+                          std::set<SOCKET> &send_set,
+                          std::set<SOCKET> &error_set) {
+        SocketEvents(recv_set, send_set, error_set);
+    }
+
     void NodeReceiveMsgBytes(CNode &node, const char *pch, unsigned int nBytes,
                              bool &complete) const;
 
     bool ReceiveMsgFrom(CNode &node, CSerializedNetMsg &ser_msg) const;
 };
 
+/**
+ * Open count TCP connections over the loopback interface. Each pair holds the
+ * connecting socket, then the accepted one.
+ */
+bool CreateLoopbackConnections(size_t count,
+                               std::vector<std::pair<SOCKET, SOCKET>> &pairs);
+
 #endif // BITCOIN_TEST_UTIL_NET_H
@@ -0,0 +1,167 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txinventory.h>
+
+#include <crypto/siphash.h>
+#include <memusage.h>
+#include <random.h>
+
+#include <cassert>
+
+KnownTxInventory::KnownTxInventory()
+    : m_k0(GetRand(std::numeric_limits<uint64_t>::max())),
+      m_k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+uint32_t KnownTxInventory::GetShortId(const TxId &txid) const {
+    return SipHashUint256(m_k0, m_k1, txid);
+}
+
+size_t KnownTxInventory::Find(uint32_t short_id) const {
+    const size_t mask = m_table.size() - 1;
+    size_t slot = GetSlot(short_id);
+    while (m_table[slot] != EMPTY && m_ring[m_table[slot]] != short_id) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void KnownTxInventory::Erase(size_t slot) {
+    // Shift the following entries back, so that no empty slot is left between
+    // an entry and its own slot.
+    const size_t mask = m_table.size() - 1;
+    size_t hole = slot;
+    for (size_t i = (slot + 1) & mask; m_table[i] != EMPTY;
+         i = (i + 1) & mask) {
+        const size_t home = GetSlot(m_ring[m_table[i]]);
+        // The entry can move to the hole if the hole is between its own slot
+        // and its current one.
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m_table[hole] = m_table[i];
+            hole = i;
+        }
+    }
+    m_table[hole] = EMPTY;
+}
+
+void KnownTxInventory::Rehash(size_t table_size) {
+    m_table.assign(table_size, EMPTY);
+    for (size_t pos = 0; pos < m_ring.size(); ++pos) {
+        m_table[Find(m_ring[pos])] = pos;
+    }
+}
+
+void KnownTxInventory::insert(const TxId &txid) {
+    if (m_table.empty()) {
+        m_table.assign(MIN_TABLE_SIZE, EMPTY);
+    }
+
+    const uint32_t short_id = GetShortId(txid);
+    size_t slot = Find(short_id);
+    if (m_table[slot] != EMPTY) {
+        // Already known.
+        return;
+    }
+
+    if (m_ring.size() < CAPACITY) {
+        m_table[slot] = m_ring.size();
+        m_ring.push_back(short_id);
+        if (2 * m_ring.size() > m_table.size()) {
+            Rehash(2 * m_table.size());
+        }
+        return;
+    }
+
+    // The ring is full, replace the oldest entry.
+    const size_t mask = m_table.size() - 1;
+    size_t oldest_slot = GetSlot(m_ring[m_oldest]);
+    while (m_table[oldest_slot] != m_oldest) {
+        oldest_slot = (oldest_slot + 1) & mask;
+    }
+    Erase(oldest_slot);
+    m_ring[m_oldest] = short_id;
+    // The slot found above may have moved with the erase.
+    m_table[Find(short_id)] = m_oldest;
+    m_oldest = (m_oldest + 1) % CAPACITY;
+}
+
+bool KnownTxInventory::contains(const TxId &txid) const {
+    if (m_table.empty()) {
+        return false;
+    }
+    return m_table[Find(GetShortId(txid))] != EMPTY;
+}
+
+size_t KnownTxInventory::DynamicMemoryUsage() const {
+    return memusage::DynamicUsage(m_ring) + memusage::DynamicUsage(m_table);
+}
+
+uint64_t TxAnnouncementQueue::AddReader() {
+    LOCK(cs);
+    const uint64_t end = m_begin + m_txids.size();
+    m_readers.insert(end);
+    return end;
+}
+
+void TxAnnouncementQueue::RemoveReader(uint64_t pos) {
+    LOCK(cs);
+    auto it = m_readers.find(pos);
+    assert(it != m_readers.end());
+    m_readers.erase(it);
+    Trim();
+}
+
+void TxAnnouncementQueue::Advance(uint64_t from, uint64_t to) {
+    if (from == to) {
+        return;
+    }
+    LOCK(cs);
+    assert(from < to && to <= m_begin + m_txids.size());
+    auto it = m_readers.find(from);
+    assert(it != m_readers.end());
+    m_readers.erase(it);
+    m_readers.insert(to);
+    Trim();
+}
+
+void TxAnnouncementQueue::Push(const TxId &txid) {
+    LOCK(cs);
+    if (m_readers.empty()) {
+        // Nobody would ever read it.
+        ++m_begin;
+        return;
+    }
+    m_txids.push_back(txid);
+}
+
+void TxAnnouncementQueue::Read(uint64_t pos, size_t max_count,
+                               std::vector<TxId> &txids) const {
+    LOCK(cs);
+    assert(pos >= m_begin);
+    const uint64_t end = m_begin + m_txids.size();
+    auto it = m_txids.begin() + (pos - m_begin);
+    for (; pos < end && max_count > 0; ++pos, --max_count) {
+        txids.push_back(*it++);
+    }
+}
+
+uint64_t TxAnnouncementQueue::End() const {
+    LOCK(cs);
+    return m_begin + m_txids.size();
+}
+
+size_t TxAnnouncementQueue::Size() const {
+    LOCK(cs);
+    return m_txids.size();
+}
+
+void TxAnnouncementQueue::Trim() {
+    const uint64_t end = m_begin + m_txids.size();
+    const uint64_t first_reader =
+        m_readers.empty() ? end : *m_readers.begin();
+    while (m_begin < first_reader) {
+        m_txids.pop_front();
+        ++m_begin;
+    }
+}
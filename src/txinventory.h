@@ -0,0 +1,125 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINVENTORY_H
+#define BITCOIN_TXINVENTORY_H
+
+#include <primitives/txid.h>
+#include <sync.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <set>
+#include <vector>
+
+/**
+ * The most recent transactions a peer is known to have, either because it
+ * announced them to us or because we announced them to it.
+ *
+ * The txids are stored as 32 bits short ids, salted per instance, in a ring of
+ * at most CAPACITY entries which evicts the oldest ones first. An open
+ * addressing hash table of positions in the ring is used for lookups. Both
+ * only grow as transactions are inserted, so the peers which don't see much
+ * transaction traffic only use a few bytes.
+ *
+ * When full, this uses 8 bytes per entry, against about 11 bytes per entry for
+ * a CRollingBloomFilter with a false positive rate of one in a million. The
+ * chance of a false positive is CAPACITY / 2^32 (less than 1 in 100000), and
+ * as the salt differs between peers, a transaction wrongly believed to be
+ * known by a peer is still announced to the others.
+ *
+ * This class is not thread-safe, the caller is responsible for locking.
+ */
+class KnownTxInventory {
+public:
+    //! The number of txids remembered.
+    static constexpr size_t CAPACITY = 1 << 15;
+
+    KnownTxInventory();
+
+    void insert(const TxId &txid);
+    bool contains(const TxId &txid) const;
+
+    size_t size() const { return m_ring.size(); }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    using Position = uint16_t;
+    static_assert(CAPACITY <= std::numeric_limits<Position>::max(),
+                  "Ring positions do not fit in a Position");
+    //! Marks an unused slot in m_table.
+    static constexpr Position EMPTY = std::numeric_limits<Position>::max();
+    //! The initial size of m_table.
+    static constexpr size_t MIN_TABLE_SIZE = 16;
+
+    const uint64_t m_k0;
+    const uint64_t m_k1;
+
+    //! The short ids, in the order they were inserted until the ring is full.
+    //! Then m_ring[m_oldest] is the next one to be replaced.
+    std::vector<uint32_t> m_ring;
+    size_t m_oldest{0};
+
+    //! Positions in m_ring, with linear probing from the slot of their short
+    //! id. Its size is a power of two, at least twice the size of m_ring.
+    std::vector<Position> m_table;
+
+    uint32_t GetShortId(const TxId &txid) const;
+    size_t GetSlot(uint32_t short_id) const {
+        return short_id & (m_table.size() - 1);
+    }
+    //! Find the slot of a short id in m_table, or the empty slot where it
+    //! would go.
+    size_t Find(uint32_t short_id) const;
+    void Erase(size_t slot);
+    void Rehash(size_t table_size);
+};
+
+/**
+ * Queue of the transactions to announce to peers, shared between them.
+ *
+ * Every relayed transaction is pushed once, and each peer keeps a reader
+ * position in the queue, which it advances as it announces the transactions.
+ * The transactions are kept in the order they were relayed, which announces
+ * the parents before their children without sorting. A transaction is dropped
+ * once all the readers are past it.
+ *
+ * Positions are counted from the first transaction ever pushed, so they stay
+ * valid as the front of the queue is dropped.
+ */
+class TxAnnouncementQueue {
+public:
+    //! Register a reader, positioned at the end of the queue: it will read the
+    //! transactions pushed from now on. Returns its position.
+    uint64_t AddReader();
+    //! Unregister the reader at position pos.
+    void RemoveReader(uint64_t pos);
+    //! Move the reader at position from to position to, which must be between
+    //! from and End().
+    void Advance(uint64_t from, uint64_t to);
+
+    void Push(const TxId &txid);
+    //! Append to txids at most max_count transactions from position pos, which
+    //! must not be before the position of a reader.
+    void Read(uint64_t pos, size_t max_count, std::vector<TxId> &txids) const;
+
+    //! The position after the last transaction pushed.
+    uint64_t End() const;
+    //! The number of transactions in the queue.
+    size_t Size() const;
+
+private:
+    mutable Mutex cs;
+    std::deque<TxId> m_txids GUARDED_BY(cs);
+    //! The position of m_txids.front().
+    uint64_t m_begin GUARDED_BY(cs){0};
+    std::multiset<uint64_t> m_readers GUARDED_BY(cs);
+
+    //! Drop the transactions all readers are past.
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(cs);
+};
+
+#endif // BITCOIN_TXINVENTORY_H
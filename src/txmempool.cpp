@@ -120,11 +120,15 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt,
                          update_ancestor_state(updateIt->GetTxSize(),
                                                updateIt->GetModifiedFee(), 1,
                                                updateIt->GetSigOpCount()));
+            MarkSnapshotDirty(cit);
+            RecordChange(cit->GetTx().GetId(),
+                         MempoolJournalEntry::Type::UPDATED);
         }
     }
     mapTx.modify(updateIt,
                  update_descendant_state(modifySize, modifyFee, modifyCount,
                                          modifySigOpCount));
+    MarkSnapshotDirty(updateIt);
 }
 
 // txidsToUpdate is the set of transaction hashes from a disconnected block
@@ -278,6 +282,7 @@ void CTxMemPool::UpdateAncestorsOf(bool add, txiter it,
         mapTx.modify(ancestorIt,
                      update_descendant_state(updateSize, updateFee, updateCount,
                                              updateSigOpCount));
+        MarkSnapshotDirty(ancestorIt);
     }
 }
 
@@ -295,6 +300,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it,
     }
     mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount,
                                            updateSigOpsCount));
+    MarkSnapshotDirty(it);
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it) {
@@ -325,6 +331,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove,
             for (txiter dit : setDescendants) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee,
                                                         -1, modifySigOps));
+                MarkSnapshotDirty(dit);
             }
         }
     }
@@ -400,7 +407,10 @@ CTxMemPool::CTxMemPool()
     nCheckFrequency = 0;
 }
 
-CTxMemPool::~CTxMemPool() {}
+CTxMemPool::~CTxMemPool() {
+    const MempoolSnapshot *snapshot = m_snapshot.exchange(nullptr);
+    RCUPtr<const MempoolSnapshot>::acquire(snapshot);
+}
 
 bool CTxMemPool::isSpent(const COutPoint &outpoint) const {
     LOCK(cs);
@@ -421,6 +431,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry,
     // Used by AcceptToMemoryPool(), which DOES do all the appropriate checks.
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
     mapLinks.insert(make_pair(newit, TxLinks()));
+    MarkSnapshotDirty(newit);
+    RecordChange(entry.GetTx().GetId(), MempoolJournalEntry::Type::ADDED);
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting into
@@ -458,6 +470,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry,
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    m_total_fee += entry.GetFee();
 
     vTxHashes.emplace_back(tx.GetHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
@@ -478,6 +491,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
 
     /* add logging because unchecked */
     RemoveUnbroadcastTx(it->GetTx().GetId(), true);
+    m_avalanche_finalized_txids.erase(it->GetTx().GetId());
 
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
@@ -491,9 +505,12 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
     }
 
     totalTxSize -= it->GetTxSize();
+    m_total_fee -= it->GetFee();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
                         memusage::DynamicUsage(mapLinks[it].children);
+    MarkSnapshotDirty(it);
+    RecordChange(it->GetTx().GetId(), MempoolJournalEntry::Type::REMOVED);
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
@@ -675,12 +692,20 @@ void CTxMemPool::_clear() {
     mapTx.clear();
     mapNextTx.clear();
     vTxHashes.clear();
+    m_avalanche_finalized_txids.clear();
     totalTxSize = 0;
+    m_total_fee = Amount::zero();
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    m_snapshot_dirty.clear();
+    m_snapshot_rebuild = true;
+    m_snapshot_stale = true;
+    // Everything is gone, readers of the journal have to start over.
+    m_journal.clear();
+    ++m_journal_sequence;
 }
 
 void CTxMemPool::clear() {
@@ -717,6 +742,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
              (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    Amount check_total_fee = Amount::zero();
     uint64_t innerUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache *>(pcoins));
@@ -727,6 +753,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
          it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
+        check_total_fee += it->GetFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction &tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
@@ -835,6 +862,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
     }
 
     assert(totalTxSize == checkTotal);
+    assert(m_total_fee == check_total_fee);
     assert(innerUsage == cachedInnerUsage);
 }
 
@@ -959,6 +987,8 @@ void CTxMemPool::PrioritiseTransaction(const TxId &txid,
         txiter it = mapTx.find(txid);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
+            MarkSnapshotDirty(it);
+            RecordChange(txid, MempoolJournalEntry::Type::UPDATED);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -968,6 +998,7 @@ void CTxMemPool::PrioritiseTransaction(const TxId &txid,
             for (txiter ancestorIt : setAncestors) {
                 mapTx.modify(ancestorIt,
                              update_descendant_state(0, nFeeDelta, 0, 0));
+                MarkSnapshotDirty(ancestorIt);
             }
 
             // Now update all descendants' modified fees with ancestors
@@ -977,6 +1008,7 @@ void CTxMemPool::PrioritiseTransaction(const TxId &txid,
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt,
                              update_ancestor_state(0, nFeeDelta, 0, 0));
+                MarkSnapshotDirty(descendantIt);
             }
             ++nTransactionsUpdated;
         }
@@ -1072,6 +1104,7 @@ void CTxMemPool::RemoveUnbroadcastTx(const TxId &txid, const bool unchecked) {
     LOCK(cs);
 
     if (m_unbroadcast_txids.erase(txid)) {
+        MarkSnapshotDirty(txid);
         LogPrint(
             BCLog::MEMPOOL, "Removed %i from set of unbroadcast txns%s\n",
             txid.GetHex(),
@@ -1134,8 +1167,10 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
     setEntries s;
     if (add && mapLinks[entry].children.insert(child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
+        MarkSnapshotDirty(entry);
     } else if (!add && mapLinks[entry].children.erase(child)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+        MarkSnapshotDirty(entry);
     }
 }
 
@@ -1143,8 +1178,10 @@ void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add) {
     setEntries s;
     if (add && mapLinks[entry].parents.insert(parent).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
+        MarkSnapshotDirty(entry);
     } else if (!add && mapLinks[entry].parents.erase(parent)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+        MarkSnapshotDirty(entry);
     }
 }
 
@@ -1291,6 +1328,169 @@ bool CTxMemPool::IsLoaded() const {
 void CTxMemPool::SetIsLoaded(bool loaded) {
     LOCK(cs);
     m_is_loaded = loaded;
+    m_snapshot_stale = true;
+}
+
+void CTxMemPool::MarkSnapshotDirty(const TxId &txid) {
+    AssertLockHeld(cs);
+    m_snapshot_stale = true;
+    if (m_snapshot_rebuild) {
+        return;
+    }
+
+    m_snapshot_dirty.insert(txid);
+
+    // Past this point, rebuilding the whole snapshot is cheaper. This also
+    // bounds memory usage when no snapshot is requested for a long time.
+    if (m_snapshot_dirty.size() > mapTx.size()) {
+        m_snapshot_dirty.clear();
+        m_snapshot_rebuild = true;
+    }
+}
+
+RCUPtr<const MempoolSnapshotEntry>
+CTxMemPool::MakeSnapshotEntry(txiter it) const {
+    AssertLockHeld(cs);
+    std::vector<TxId> depends;
+    for (txiter parent : GetMemPoolParents(it)) {
+        depends.push_back(parent->GetTx().GetId());
+    }
+
+    std::vector<TxId> spentBy;
+    for (txiter child : GetMemPoolChildren(it)) {
+        spentBy.push_back(child->GetTx().GetId());
+    }
+
+    const TxId &txid = it->GetTx().GetId();
+    return RCUPtr<const MempoolSnapshotEntry>::make(
+        *it, std::move(depends), std::move(spentBy),
+        m_unbroadcast_txids.count(txid) != 0);
+}
+
+void CTxMemPool::UpdateSnapshot() const {
+    AssertLockHeld(cs);
+
+    // The snapshot is only ever published with cs held, so there is no need
+    // to protect it from concurrent release here.
+    const MempoolSnapshot *previous = m_snapshot.load();
+
+    const bool rebuild = m_snapshot_rebuild || previous == nullptr;
+
+    std::map<size_t, std::vector<TxId>> changes;
+    if (rebuild) {
+        for (const CTxMemPoolEntry &entry : mapTx) {
+            const TxId &txid = entry.GetTx().GetId();
+            changes[MempoolSnapshot::GetBucketIndex(txid)].push_back(txid);
+        }
+    } else {
+        for (const TxId &txid : m_snapshot_dirty) {
+            changes[MempoolSnapshot::GetBucketIndex(txid)].push_back(txid);
+        }
+    }
+
+    MempoolSnapshot::BucketArray buckets;
+    if (!rebuild) {
+        buckets = previous->GetBuckets();
+    }
+
+    for (auto &change : changes) {
+        std::vector<TxId> &txids = change.second;
+        std::sort(txids.begin(), txids.end());
+
+        RCUPtr<const MempoolSnapshot::Bucket> &bucket = buckets[change.first];
+
+        // Keep the unmodified entries, and refresh the others.
+        std::vector<RCUPtr<const MempoolSnapshotEntry>> entries;
+        if (bucket) {
+            for (const auto &entry : bucket->entries) {
+                if (!std::binary_search(txids.begin(), txids.end(),
+                                        entry->GetId())) {
+                    entries.push_back(entry);
+                }
+            }
+        }
+
+        for (const TxId &txid : txids) {
+            txiter it = mapTx.find(txid);
+            if (it != mapTx.end()) {
+                entries.push_back(MakeSnapshotEntry(it));
+            }
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const RCUPtr<const MempoolSnapshotEntry> &a,
+                     const RCUPtr<const MempoolSnapshotEntry> &b) {
+                      return a->GetId() < b->GetId();
+                  });
+
+        bucket = entries.empty() ? RCUPtr<const MempoolSnapshot::Bucket>()
+                                 : RCUPtr<const MempoolSnapshot::Bucket>::make(
+                                       std::move(entries));
+    }
+
+    const MempoolSnapshot *snapshot =
+        RCUPtr<const MempoolSnapshot>::make(
+            std::move(buckets), mapTx.size(), totalTxSize,
+            DynamicMemoryUsage(), m_unbroadcast_txids.size(), m_is_loaded)
+            .release();
+
+    m_snapshot_dirty.clear();
+    m_snapshot_rebuild = false;
+    m_snapshot_stale = false;
+
+    // The previous snapshot is destroyed once its last reader is done with it.
+    previous = m_snapshot.exchange(snapshot);
+    RCUPtr<const MempoolSnapshot>::acquire(previous);
+}
+
+RCUPtr<const MempoolSnapshot> CTxMemPool::GetSnapshot() const {
+    // Reclaim the snapshots this thread stopped using since its last call.
+    RCULock::synchronize();
+
+    if (m_snapshot_stale) {
+        LOCK(cs);
+        if (m_snapshot_stale) {
+            UpdateSnapshot();
+        }
+    }
+
+    RCULock lock;
+    return RCUPtr<const MempoolSnapshot>::copy(m_snapshot.load());
+}
+
+void CTxMemPool::RecordChange(const TxId &txid,
+                              MempoolJournalEntry::Type type) {
+    AssertLockHeld(cs);
+    ++m_journal_sequence;
+    if (!m_journal_enabled) {
+        return;
+    }
+
+    m_journal.emplace_back(txid, type);
+    if (m_journal.size() > MAX_MEMPOOL_JOURNAL_SIZE) {
+        m_journal.pop_front();
+    }
+}
+
+uint64_t CTxMemPool::GetJournalSequence() const {
+    LOCK(cs);
+    m_journal_enabled = true;
+    return m_journal_sequence;
+}
+
+bool CTxMemPool::GetJournalEntriesSince(
+    uint64_t &sequence, std::vector<MempoolJournalEntry> &changes) const {
+    LOCK(cs);
+    if (sequence > m_journal_sequence ||
+        sequence < m_journal_sequence - m_journal.size()) {
+        return false;
+    }
+
+    changes.insert(changes.end(),
+                   m_journal.end() - (m_journal_sequence - sequence),
+                   m_journal.end());
+    sequence = m_journal_sequence;
+    return true;
 }
 
 /** Maximum bytes for transactions to store for processing during reorg */
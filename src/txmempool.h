@@ -10,6 +10,7 @@
 #include <coins.h>
 #include <core_memusage.h>
 #include <indirectmap.h>
+#include <mempoolsnapshot.h>
 #include <primitives/transaction.h>
 #include <salteduint256hasher.h>
 #include <sync.h>
@@ -20,6 +21,7 @@
 #include <boost/multi_index_container.hpp>
 
 #include <atomic>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
@@ -37,6 +39,9 @@ extern RecursiveMutex cs_main;
  */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Maximum number of changes kept in the mempool journal. */
+static const size_t MAX_MEMPOOL_JOURNAL_SIZE = 100000;
+
 struct LockPoints {
     // Will be set to the blockchain height and median time past values that
     // would be necessary to satisfy all relative locktime constraints (BIP68)
@@ -382,7 +387,30 @@ enum class MemPoolRemovalReason {
     //! Removed for conflict with in-block transaction
     CONFLICT,
     //! Removed for replacement
-    REPLACED
+    REPLACED,
+    //! Rejected by avalanche
+    AVALANCHE,
+};
+
+/**
+ * A change to the mempool, as recorded in its journal. This lets consumers
+ * such as the block assembler catch up with the mempool without walking it.
+ */
+struct MempoolJournalEntry {
+    enum class Type : uint8_t {
+        //! The transaction entered the mempool
+        ADDED,
+        //! The transaction left the mempool
+        REMOVED,
+        //! The transaction's fee or ancestor state changed
+        UPDATED,
+    };
+
+    TxId txid;
+    Type type;
+
+    MempoolJournalEntry(const TxId &txidIn, Type typeIn)
+        : txid(txidIn), type(typeIn) {}
 };
 
 class SaltedTxIdHasher : private SaltedUint256Hasher {
@@ -474,6 +502,8 @@ private:
 
     //! sum of all mempool tx's sizes.
     uint64_t totalTxSize;
+    //! sum of all mempool tx's fees (NOT modified fee)
+    Amount m_total_fee{Amount::zero()};
     //! sum of dynamic memory usage of all the map elements (NOT the maps
     //! themselves)
     uint64_t cachedInnerUsage;
@@ -574,8 +604,10 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorById> txlinksMap;
     txlinksMap mapLinks;
 
-    void UpdateParent(txiter entry, txiter parent, bool add);
-    void UpdateChild(txiter entry, txiter child, bool add);
+    void UpdateParent(txiter entry, txiter parent, bool add)
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void UpdateChild(txiter entry, txiter child, bool add)
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     std::vector<indexed_transaction_set::const_iterator>
     GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -586,6 +618,40 @@ private:
      */
     std::set<TxId> m_unbroadcast_txids GUARDED_BY(cs);
 
+    /** Transactions which avalanche finalized */
+    std::set<TxId> m_avalanche_finalized_txids GUARDED_BY(cs);
+
+    /**
+     * The last published snapshot. It is only replaced with cs held, but may
+     * be read by anyone under RCU.
+     */
+    mutable std::atomic<const MempoolSnapshot *> m_snapshot{nullptr};
+    //! Whether the mempool changed since m_snapshot was published.
+    mutable std::atomic<bool> m_snapshot_stale{true};
+    //! Transactions added, removed or modified since then.
+    mutable std::set<TxId> m_snapshot_dirty GUARDED_BY(cs);
+    //! Set when the next snapshot has to be built from scratch.
+    mutable bool m_snapshot_rebuild GUARDED_BY(cs){true};
+
+    void MarkSnapshotDirty(const TxId &txid) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void MarkSnapshotDirty(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        MarkSnapshotDirty(it->GetTx().GetId());
+    }
+    RCUPtr<const MempoolSnapshotEntry> MakeSnapshotEntry(txiter it) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Publish a new snapshot, reusing the unmodified parts of the last one */
+    void UpdateSnapshot() const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Sequence number of the last change to the mempool.
+    uint64_t m_journal_sequence GUARDED_BY(cs){0};
+    //! The most recent changes, the last one having m_journal_sequence.
+    std::deque<MempoolJournalEntry> m_journal GUARDED_BY(cs);
+    //! Changes are only kept once someone started reading the journal.
+    mutable bool m_journal_enabled GUARDED_BY(cs){false};
+
+    void RecordChange(const TxId &txid, MempoolJournalEntry::Type type)
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 public:
     indirectmap<COutPoint, const CTransaction *> mapNextTx GUARDED_BY(cs);
     std::map<TxId, Amount> mapDeltas;
@@ -770,6 +836,11 @@ public:
         return totalTxSize;
     }
 
+    Amount GetTotalFee() const {
+        LOCK(cs);
+        return m_total_fee;
+    }
+
     bool exists(const TxId &txid) const {
         LOCK(cs);
         return mapTx.count(txid) != 0;
@@ -787,8 +858,8 @@ public:
     void AddUnbroadcastTx(const TxId &txid) {
         LOCK(cs);
         // Sanity Check: the transaction should also be in the mempool
-        if (exists(txid)) {
-            m_unbroadcast_txids.insert(txid);
+        if (exists(txid) && m_unbroadcast_txids.insert(txid).second) {
+            MarkSnapshotDirty(txid);
         }
     }
 
@@ -801,12 +872,48 @@ public:
         return m_unbroadcast_txids;
     }
 
+    /**
+     * Returns an immutable snapshot of the mempool, which may be traversed
+     * without holding cs. If the mempool changed since the last snapshot was
+     * published, cs is held while the modified entries are refreshed.
+     */
+    RCUPtr<const MempoolSnapshot> GetSnapshot() const;
+
+    /**
+     * Returns the sequence number of the last change to the mempool, to be
+     * used as a cursor into the journal.
+     */
+    uint64_t GetJournalSequence() const;
+
+    /**
+     * Append the changes made after sequence to changes and advance sequence
+     * past them. Returns false if some of these changes are no longer in the
+     * journal, in which case the caller has to start from scratch.
+     */
+    bool
+    GetJournalEntriesSince(uint64_t &sequence,
+                           std::vector<MempoolJournalEntry> &changes) const;
+
     /** Returns whether a txid is in the unbroadcast set */
     bool IsUnbroadcastTx(const TxId &txid) const {
         LOCK(cs);
         return (m_unbroadcast_txids.count(txid) != 0);
     }
 
+    /** Records that avalanche finalized a transaction of the mempool */
+    void SetAvalancheFinalized(const TxId &txid) {
+        LOCK(cs);
+        if (exists(txid)) {
+            m_avalanche_finalized_txids.insert(txid);
+        }
+    }
+
+    /** Returns whether avalanche finalized a transaction of the mempool */
+    bool IsAvalancheFinalized(const TxId &txid) const {
+        LOCK(cs);
+        return m_avalanche_finalized_txids.count(txid) != 0;
+    }
+
 private:
     /**
      * UpdateForDescendants is used by UpdateTransactionsFromBlock to update the
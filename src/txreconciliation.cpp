@@ -0,0 +1,259 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <pinsketch.h>
+#include <random.h>
+#include <sync.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+struct ReconciliationState {
+    //! The SipHash key of the short ids.
+    const uint64_t m_k0;
+    const uint64_t m_k1;
+    //! Whether we initiate the reconciliations, or respond to them.
+    const bool m_we_initiate;
+    //! Whether transactions are flooded to the peer rather than reconciled.
+    const bool m_flood;
+
+    //! The transactions to reconcile, by short id.
+    std::unordered_map<uint32_t, TxId> m_set;
+
+    // Initiator state.
+    std::chrono::microseconds m_next_request;
+    bool m_request_pending{false};
+
+    // Responder state: the set as of the last request, kept until the
+    // reconcildiff message.
+    std::unordered_map<uint32_t, TxId> m_snapshot;
+    bool m_snapshot_pending{false};
+
+    ReconciliationState(uint64_t k0, uint64_t k1, bool we_initiate,
+                        bool flood, std::chrono::microseconds next_request)
+        : m_k0(k0), m_k1(k1), m_we_initiate(we_initiate), m_flood(flood),
+          m_next_request(next_request) {}
+
+    //! A short id in [1, 2^32 - 1], as zero cannot be added to a sketch.
+    uint32_t GetShortId(const TxId &txid) const {
+        return 1 + SipHashUint256(m_k0, m_k1, txid) % 0xffffffff;
+    }
+};
+
+std::vector<TxId> SetToVector(const std::unordered_map<uint32_t, TxId> &set) {
+    std::vector<TxId> txids;
+    txids.reserve(set.size());
+    for (const auto &entry : set) {
+        txids.push_back(entry.second);
+    }
+    return txids;
+}
+
+} // namespace
+
+class TxReconciliationTracker::Impl {
+public:
+    mutable Mutex m_mutex;
+    //! Our salts for the peers which haven't sent their sendrecon yet.
+    std::map<NodeId, uint64_t> m_pre_registered GUARDED_BY(m_mutex);
+    std::map<NodeId, ReconciliationState> m_states GUARDED_BY(m_mutex);
+    size_t m_outbound_flood_peers GUARDED_BY(m_mutex){0};
+
+    ReconciliationState *GetState(NodeId peer)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        auto it = m_states.find(peer);
+        return it != m_states.end() ? &it->second : nullptr;
+    }
+};
+
+TxReconciliationTracker::TxReconciliationTracker()
+    : m_impl{std::make_unique<Impl>()} {}
+
+TxReconciliationTracker::~TxReconciliationTracker() = default;
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer) {
+    const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(m_impl->m_mutex);
+    m_impl->m_pre_registered[peer] = salt;
+    return salt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool is_outbound,
+                                           uint64_t remote_salt) {
+    LOCK(m_impl->m_mutex);
+    auto it = m_impl->m_pre_registered.find(peer);
+    if (it == m_impl->m_pre_registered.end()) {
+        return false;
+    }
+    const uint64_t local_salt = it->second;
+    m_impl->m_pre_registered.erase(it);
+
+    // Both peers derive the same key, whichever salt is their own.
+    const uint256 key = (CHashWriter(SER_GETHASH, 0)
+                         << std::min(local_salt, remote_salt)
+                         << std::max(local_salt, remote_salt))
+                            .GetSHA256();
+    const bool flood =
+        is_outbound && m_impl->m_outbound_flood_peers < MAX_OUTBOUND_FLOOD_TO;
+    m_impl->m_outbound_flood_peers += flood;
+    m_impl->m_states.emplace(
+        std::piecewise_construct, std::forward_as_tuple(peer),
+        std::forward_as_tuple(
+            key.GetUint64(0), key.GetUint64(1), is_outbound, flood,
+            GetTime<std::chrono::microseconds>() + RECON_REQUEST_INTERVAL));
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer) {
+    LOCK(m_impl->m_mutex);
+    m_impl->m_pre_registered.erase(peer);
+    auto it = m_impl->m_states.find(peer);
+    if (it != m_impl->m_states.end()) {
+        m_impl->m_outbound_flood_peers -= it->second.m_flood;
+        m_impl->m_states.erase(it);
+    }
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const {
+    LOCK(m_impl->m_mutex);
+    return m_impl->m_states.count(peer);
+}
+
+bool TxReconciliationTracker::IsFloodPeer(NodeId peer) const {
+    LOCK(m_impl->m_mutex);
+    auto it = m_impl->m_states.find(peer);
+    return it != m_impl->m_states.end() && it->second.m_flood;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const TxId &txid) {
+    LOCK(m_impl->m_mutex);
+    ReconciliationState *state = m_impl->GetState(peer);
+    if (!state || state->m_set.size() >= MAX_RECON_SET_SIZE) {
+        return false;
+    }
+    state->m_set.emplace(state->GetShortId(txid), txid);
+    return true;
+}
+
+std::optional<TxReconciliationTracker::ReconciliationRequest>
+TxReconciliationTracker::MaybeRequestReconciliation(
+    NodeId peer, std::chrono::microseconds now) {
+    LOCK(m_impl->m_mutex);
+    ReconciliationState *state = m_impl->GetState(peer);
+    if (!state || !state->m_we_initiate || state->m_request_pending ||
+        now < state->m_next_request) {
+        return std::nullopt;
+    }
+    state->m_request_pending = true;
+    state->m_next_request = now + RECON_REQUEST_INTERVAL;
+    return ReconciliationRequest{uint32_t(state->m_set.size()), RECON_Q};
+}
+
+std::optional<std::vector<uint8_t>>
+TxReconciliationTracker::HandleReconciliationRequest(NodeId peer,
+                                                     uint32_t remote_set_size,
+                                                     uint16_t remote_q) {
+    LOCK(m_impl->m_mutex);
+    ReconciliationState *state = m_impl->GetState(peer);
+    if (!state || state->m_we_initiate || state->m_snapshot_pending) {
+        return std::nullopt;
+    }
+    state->m_snapshot.swap(state->m_set);
+    state->m_set.clear();
+    state->m_snapshot_pending = true;
+
+    // The difference is estimated as the difference of the sizes, plus a
+    // share q of the smaller set.
+    const uint64_t local_set_size = state->m_snapshot.size();
+    const uint64_t min_size = std::min<uint64_t>(local_set_size,
+                                                 remote_set_size);
+    const uint64_t estimate =
+        std::max<uint64_t>(local_set_size, remote_set_size) - min_size +
+        (min_size * remote_q + Q_PRECISION - 1) / Q_PRECISION;
+    // Decoding needs one more power sum than the number of elements.
+    PinSketch sketch(std::min<uint64_t>(estimate + 1, MAX_SKETCH_CAPACITY));
+    for (const auto &entry : state->m_snapshot) {
+        sketch.Add(entry.first);
+    }
+    return sketch.Serialize();
+}
+
+std::optional<bool> TxReconciliationTracker::HandleSketch(
+    NodeId peer, const std::vector<uint8_t> &skdata,
+    std::vector<uint32_t> &ask_shortids, std::vector<TxId> &announce) {
+    LOCK(m_impl->m_mutex);
+    ReconciliationState *state = m_impl->GetState(peer);
+    if (!state || !state->m_we_initiate || !state->m_request_pending) {
+        return std::nullopt;
+    }
+    PinSketch sketch = PinSketch::Deserialize(skdata);
+    if (sketch.GetCapacity() == 0 ||
+        sketch.GetCapacity() > MAX_SKETCH_CAPACITY) {
+        return std::nullopt;
+    }
+    state->m_request_pending = false;
+
+    PinSketch local_sketch(sketch.GetCapacity());
+    for (const auto &entry : state->m_set) {
+        local_sketch.Add(entry.first);
+    }
+    sketch.Merge(local_sketch);
+
+    std::vector<uint32_t> difference;
+    if (!sketch.Decode(difference)) {
+        announce = SetToVector(state->m_set);
+        state->m_set.clear();
+        return false;
+    }
+
+    for (const uint32_t short_id : difference) {
+        auto it = state->m_set.find(short_id);
+        if (it != state->m_set.end()) {
+            announce.push_back(it->second);
+        } else {
+            ask_shortids.push_back(short_id);
+        }
+    }
+    state->m_set.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(
+    NodeId peer, bool success, const std::vector<uint32_t> &ask,
+    std::vector<TxId> &announce) {
+    LOCK(m_impl->m_mutex);
+    ReconciliationState *state = m_impl->GetState(peer);
+    if (!state || state->m_we_initiate || !state->m_snapshot_pending) {
+        return false;
+    }
+    if (success) {
+        for (const uint32_t short_id : ask) {
+            auto it = state->m_snapshot.find(short_id);
+            if (it != state->m_snapshot.end()) {
+                announce.push_back(it->second);
+            }
+        }
+    } else {
+        announce = SetToVector(state->m_snapshot);
+    }
+    state->m_snapshot.clear();
+    state->m_snapshot_pending = false;
+    return true;
+}
+
+size_t TxReconciliationTracker::GetSetSize(NodeId peer) const {
+    LOCK(m_impl->m_mutex);
+    auto it = m_impl->m_states.find(peer);
+    return it != m_impl->m_states.end() ? it->second.m_set.size() : 0;
+}
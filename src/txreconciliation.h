@@ -0,0 +1,167 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <net.h> // For NodeId
+#include <primitives/txid.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/** Default for -txreconciliation. */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** The version of the reconciliation protocol, sent in sendrecon. */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Time between the reconciliations we initiate with a peer. */
+static constexpr std::chrono::microseconds RECON_REQUEST_INTERVAL{
+    std::chrono::seconds{8}};
+/** The number of outbound peers we keep flooding transactions to. */
+static const size_t MAX_OUTBOUND_FLOOD_TO = 8;
+/**
+ * Maximum number of transactions waiting to be reconciled with a peer. Once
+ * full, the transactions are announced to the peer with an inv instead.
+ */
+static const size_t MAX_RECON_SET_SIZE = 10000;
+/**
+ * Maximum capacity of a sketch. Larger differences fail to decode, and the
+ * sets are then announced in full.
+ */
+static const size_t MAX_SKETCH_CAPACITY = 128;
+/**
+ * The coefficient q estimates the difference between two sets as the
+ * difference of their sizes, plus q times the size of the smaller one. It is
+ * sent as a fixed point number with this precision.
+ */
+static const uint16_t Q_PRECISION = 1 << 14;
+/** The q we send, 0.25. */
+static const uint16_t RECON_Q = Q_PRECISION / 4;
+
+/**
+ * Track the state of the transaction reconciliations with peers, a way to
+ * relay transactions which uses less bandwidth than announcing every
+ * transaction to every peer.
+ *
+ * Instead of sending an inv to a peer, the transactions are added to a set of
+ * transactions to reconcile with it. Periodically, the peer which made the
+ * outbound connection (the initiator) sends a reqrecon message with the size
+ * of its own set. The other peer (the responder) replies with a sketch of its
+ * set (see PinSketch), with enough capacity for the expected difference. The
+ * initiator computes the difference between the two sets from the sketches,
+ * announces the transactions only it has, and asks the responder for the ones
+ * it misses with a reconcildiff message. If the sketch cannot be decoded,
+ * both peers announce their whole set instead.
+ *
+ * Sketches hold 32 bits short ids, computed with a SipHash keyed by the salts
+ * both peers exchanged in their sendrecon message.
+ *
+ * Transactions are still flooded to the first MAX_OUTBOUND_FLOOD_TO outbound
+ * peers supporting reconciliation, which keeps them propagating fast across
+ * the network, and to the peers which don't support it.
+ *
+ * This class is thread-safe.
+ */
+class TxReconciliationTracker {
+    // Avoid littering this header file with implementation details.
+    class Impl;
+    const std::unique_ptr<Impl> m_impl;
+
+public:
+    TxReconciliationTracker();
+    ~TxReconciliationTracker();
+
+    TxReconciliationTracker(const TxReconciliationTracker &) = delete;
+    TxReconciliationTracker &
+    operator=(const TxReconciliationTracker &) = delete;
+
+    /**
+     * Start the registration of a peer, before sending it a sendrecon
+     * message. Returns the salt to send.
+     */
+    uint64_t PreRegisterPeer(NodeId peer);
+    /**
+     * Complete the registration of a peer once its sendrecon message is
+     * received. We initiate the reconciliations with outbound peers.
+     *
+     * @return False if the peer wasn't pre-registered, or was already
+     *         registered.
+     */
+    bool RegisterPeer(NodeId peer, bool is_outbound, uint64_t remote_salt);
+    //! Forget everything about a peer.
+    void ForgetPeer(NodeId peer);
+
+    bool IsPeerRegistered(NodeId peer) const;
+    //! Whether transactions are flooded to a registered peer, rather than
+    //! reconciled.
+    bool IsFloodPeer(NodeId peer) const;
+
+    /**
+     * Add a transaction to the set to reconcile with a registered peer.
+     *
+     * @return False if the set is full, in which case the transaction should
+     *         be announced with an inv.
+     */
+    bool AddToSet(NodeId peer, const TxId &txid);
+
+    struct ReconciliationRequest {
+        uint32_t set_size;
+        uint16_t q;
+    };
+    /**
+     * Return the reqrecon message to send to a peer if it is time to
+     * reconcile with it: we are the initiator, no reconciliation is in
+     * progress, and RECON_REQUEST_INTERVAL passed since the previous one.
+     */
+    std::optional<ReconciliationRequest>
+    MaybeRequestReconciliation(NodeId peer, std::chrono::microseconds now);
+
+    /**
+     * Handle a reqrecon message, as the responder. The current set is kept
+     * aside until the reconcildiff message.
+     *
+     * @return The serialized sketch to send back, or nothing if the peer
+     *         shouldn't have sent the request.
+     */
+    std::optional<std::vector<uint8_t>>
+    HandleReconciliationRequest(NodeId peer, uint32_t remote_set_size,
+                                uint16_t remote_q);
+
+    /**
+     * Handle a sketch message, as the initiator. The set is emptied in any
+     * case.
+     *
+     * @param[out] ask_shortids The short ids of the transactions we miss, to
+     *             send in reconcildiff.
+     * @param[out] announce The transactions the peer misses, or the whole set
+     *             if the decoding failed.
+     * @return Whether the difference was decoded, or nothing if the peer
+     *         shouldn't have sent the sketch.
+     */
+    std::optional<bool> HandleSketch(NodeId peer,
+                                     const std::vector<uint8_t> &skdata,
+                                     std::vector<uint32_t> &ask_shortids,
+                                     std::vector<TxId> &announce);
+
+    /**
+     * Handle a reconcildiff message, as the responder, which ends the
+     * reconciliation.
+     *
+     * @param[out] announce The transactions the peer asked for, or the whole
+     *             set kept aside if the decoding failed.
+     * @return False if the peer shouldn't have sent the message.
+     */
+    bool HandleReconciliationDifference(NodeId peer, bool success,
+                                        const std::vector<uint32_t> &ask,
+                                        std::vector<TxId> &announce);
+
+    //! The number of transactions waiting to be reconciled with a peer.
+    size_t GetSetSize(NodeId peer) const;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -0,0 +1,127 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXREQUEST_H
+#define BITCOIN_TXREQUEST_H
+
+#include <net.h> // For NodeId
+#include <primitives/txid.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Data structure to keep track of, and schedule, transaction downloads from
+ * peers.
+ *
+ * Every (peer, txid) pair announced through an inv is tracked as an
+ * announcement, which goes through these states:
+ *  - CANDIDATE_DELAYED: announced, but its request time is in the future.
+ *  - CANDIDATE_READY: can be requested, but another announcement for the same
+ *    txid is preferred.
+ *  - CANDIDATE_BEST: the announcement the txid will be requested from next.
+ *  - REQUESTED: requested, waiting for a response until its expiry time.
+ *  - COMPLETED: the peer responded, its request expired, or it is otherwise
+ *    no longer a candidate. Kept so the txid isn't requested from it again.
+ *
+ * For each txid, at most one announcement is CANDIDATE_BEST or REQUESTED.
+ * Among the ready candidates, the best one is picked by a priority which
+ * prefers outbound peers, and otherwise is a salted hash of the (txid, peer)
+ * pair, so that attackers cannot predict which peer is picked. Once no
+ * announcement for a txid is left other than COMPLETED ones, the txid is
+ * forgotten entirely.
+ *
+ * All the announcements are kept in a single multi-index container, indexed
+ * by peer, by txid and by the time of their next event. Every operation is
+ * O(log n) in the number of announcements, plus the size of its result, so
+ * floods of announcements from many peers are cheap to handle.
+ *
+ * This class is not thread-safe, the caller is responsible for locking.
+ */
+class TxRequestTracker {
+    // Avoid littering this header file with implementation details.
+    class Impl;
+    const std::unique_ptr<Impl> m_impl;
+
+public:
+    //! Construct a TxRequestTracker. The deterministic flag is only used in
+    //! tests, to make the priorities predictable.
+    explicit TxRequestTracker(bool deterministic = false);
+    ~TxRequestTracker();
+
+    TxRequestTracker(const TxRequestTracker &) = delete;
+    TxRequestTracker &operator=(const TxRequestTracker &) = delete;
+
+    /**
+     * Add a new CANDIDATE_DELAYED announcement, which becomes requestable at
+     * reqtime. Does nothing if this peer already announced this txid.
+     */
+    void ReceivedInv(NodeId peer, const TxId &txid, bool preferred,
+                     std::chrono::microseconds reqtime);
+
+    /**
+     * Delete all the announcements of a peer. The txids it was the best
+     * candidate for, or was requested from, move on to other peers.
+     */
+    void DisconnectedPeer(NodeId peer);
+
+    /**
+     * Delete all the announcements of a txid, once it is no longer needed
+     * (it was accepted or rejected, or is included in a block).
+     */
+    void ForgetTxId(const TxId &txid);
+
+    /**
+     * Find the txids to request now from a peer.
+     *
+     * This first updates the states for the time passed: the CANDIDATE_DELAYED
+     * announcements whose request time has come are now candidates, and the
+     * REQUESTED ones whose expiry time has come are COMPLETED. These expired
+     * requests are returned in expired if it is not nullptr.
+     *
+     * The returned txids are the CANDIDATE_BEST announcements of that peer,
+     * in the order they were announced. The caller is expected to call
+     * RequestedTx for the ones it actually requests.
+     */
+    std::vector<TxId>
+    GetRequestable(NodeId peer, std::chrono::microseconds now,
+                   std::vector<std::pair<NodeId, TxId>> *expired = nullptr);
+
+    /**
+     * Mark a transaction as requested from a peer, with a deadline for the
+     * response. Does nothing if the peer is not a candidate for it.
+     */
+    void RequestedTx(NodeId peer, const TxId &txid,
+                     std::chrono::microseconds expiry);
+
+    /**
+     * Mark the announcement of a txid by a peer as COMPLETED, because the
+     * peer responded with the transaction or a notfound.
+     */
+    void ReceivedResponse(NodeId peer, const TxId &txid);
+
+    //! Number of REQUESTED announcements of a peer.
+    size_t CountInFlight(NodeId peer) const;
+    //! Number of CANDIDATE announcements of a peer.
+    size_t CountCandidates(NodeId peer) const;
+    //! Number of announcements of a peer, in any state.
+    size_t Count(NodeId peer) const;
+    //! Number of announcements in total.
+    size_t Size() const;
+
+    //! Priority of an announcement, only exposed for testing.
+    uint64_t ComputePriority(const TxId &txid, NodeId peer,
+                             bool preferred) const;
+
+    //! Check the internal consistency of the data structure, for testing.
+    void SanityCheck() const;
+    //! Check that no announcement is left in a state which GetRequestable
+    //! should have updated for the time now, for testing.
+    void PostGetRequestableSanityCheck(std::chrono::microseconds now) const;
+};
+
+#endif // BITCOIN_TXREQUEST_H
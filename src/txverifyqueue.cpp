@@ -0,0 +1,83 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txverifyqueue.h>
+
+#include <util/system.h>
+#include <util/threadnames.h>
+
+#include <tinyformat.h>
+
+TxVerifyQueue::~TxVerifyQueue() {
+    Stop();
+}
+
+void TxVerifyQueue::Start(int numThreads) {
+    LOCK(cs_jobs);
+    if (!workers.empty()) {
+        return;
+    }
+
+    stopRequest = false;
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back([this, i]() {
+            util::ThreadRename(strprintf("txverify.%i", i));
+            ThreadWorker();
+        });
+    }
+}
+
+void TxVerifyQueue::Stop() {
+    std::vector<std::thread> stopping;
+    {
+        LOCK(cs_jobs);
+        stopRequest = true;
+        jobs.clear();
+        stopping.swap(workers);
+    }
+
+    cond_jobs.notify_all();
+    for (std::thread &worker : stopping) {
+        worker.join();
+    }
+}
+
+bool TxVerifyQueue::Enqueue(Job job) {
+    {
+        LOCK(cs_jobs);
+        if (workers.empty() || stopRequest || jobs.size() >= maxQueued) {
+            return false;
+        }
+
+        jobs.push_back(std::move(job));
+    }
+
+    cond_jobs.notify_one();
+    return true;
+}
+
+bool TxVerifyQueue::IsRunning() const {
+    LOCK(cs_jobs);
+    return !workers.empty() && !stopRequest;
+}
+
+void TxVerifyQueue::ThreadWorker() {
+    while (true) {
+        Job job;
+        {
+            WAIT_LOCK(cs_jobs, lock);
+            cond_jobs.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(cs_jobs) {
+                return stopRequest || !jobs.empty();
+            });
+            if (stopRequest) {
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
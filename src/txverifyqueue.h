@@ -0,0 +1,60 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXVERIFYQUEUE_H
+#define BITCOIN_TXVERIFYQUEUE_H
+
+#include <sync.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * A bounded queue of jobs run by a pool of worker threads.
+ *
+ * This is used to verify the scripts of relayed transactions in parallel,
+ * ahead of their acceptance to the mempool which remains serialized. Jobs are
+ * started in the order they are queued, but may complete in any order.
+ */
+class TxVerifyQueue {
+public:
+    using Job = std::function<void()>;
+
+    explicit TxVerifyQueue(size_t maxQueuedIn) : maxQueued(maxQueuedIn) {}
+    ~TxVerifyQueue();
+
+    /** Start the worker threads. Does nothing if already started. */
+    void Start(int numThreads);
+
+    /**
+     * Stop the worker threads and wait for them to exit. Jobs which were not
+     * started yet are discarded.
+     */
+    void Stop();
+
+    /**
+     * Queue a job. Returns false if there is no worker running or the queue is
+     * full, in which case the caller is expected to do the work itself.
+     */
+    bool Enqueue(Job job);
+
+    bool IsRunning() const;
+
+private:
+    void ThreadWorker();
+
+    const size_t maxQueued;
+
+    mutable Mutex cs_jobs;
+    std::condition_variable cond_jobs;
+    std::deque<Job> jobs GUARDED_BY(cs_jobs);
+    bool stopRequest GUARDED_BY(cs_jobs) = false;
+    std::vector<std::thread> workers GUARDED_BY(cs_jobs);
+};
+
+#endif // BITCOIN_TXVERIFYQUEUE_H
@@ -0,0 +1,201 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/lzcodec.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/** Shortest match that can be encoded. */
+constexpr size_t MIN_MATCH = 4;
+/** The last bytes of the input are always encoded as literals. */
+constexpr size_t LAST_LITERALS = 5;
+/** No match may start within this many bytes of the end of the input. */
+constexpr size_t MF_LIMIT = 12;
+/** Matches are encoded with a 16 bits offset. */
+constexpr size_t MAX_DISTANCE = 0xffff;
+/** Lengths that don't fit in a token nibble are extended. */
+constexpr size_t RUN_MASK = 0x0f;
+
+constexpr int HASH_LOG = 16;
+
+uint32_t HashSequence(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+void WriteExtendedLength(std::vector<uint8_t> &out, size_t length) {
+    while (length >= 0xff) {
+        out.push_back(0xff);
+        length -= 0xff;
+    }
+    out.push_back(length);
+}
+
+/**
+ * Emit one sequence: the literals followed by a match. A match_length of zero
+ * denotes the last sequence of the block, which only has literals.
+ */
+void WriteSequence(std::vector<uint8_t> &out, const uint8_t *literals,
+                   size_t literal_length, size_t offset, size_t match_length) {
+    const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    const uint8_t token =
+        (std::min(literal_length, RUN_MASK) << 4) |
+        std::min(match_code, RUN_MASK);
+    out.push_back(token);
+    if (literal_length >= RUN_MASK) {
+        WriteExtendedLength(out, literal_length - RUN_MASK);
+    }
+    out.insert(out.end(), literals, literals + literal_length);
+
+    if (match_length == 0) {
+        return;
+    }
+
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if (match_code >= RUN_MASK) {
+        WriteExtendedLength(out, match_code - RUN_MASK);
+    }
+}
+
+bool ReadExtendedLength(Span<const uint8_t> data, size_t &pos, size_t limit,
+                        size_t &length) {
+    uint8_t b;
+    do {
+        if (pos >= data.size()) {
+            return false;
+        }
+        b = data[pos++];
+        length += b;
+        // No valid length can exceed the size of the output.
+        if (length > limit) {
+            return false;
+        }
+    } while (b == 0xff);
+    return true;
+}
+
+} // namespace
+
+std::vector<uint8_t> LZCompress(Span<const uint8_t> data) {
+    std::vector<uint8_t> out;
+    out.reserve(LZCompressBound(data.size()));
+
+    const uint8_t *const base = data.data();
+    const size_t size = data.size();
+    size_t anchor = 0;
+
+    if (size > MF_LIMIT) {
+        std::vector<uint32_t> table(1 << HASH_LOG, 0);
+        const size_t match_limit = size - LAST_LITERALS;
+        const size_t input_limit = size - MF_LIMIT;
+
+        size_t pos = 0;
+        while (pos < input_limit) {
+            const uint32_t sequence = ReadLE32(base + pos);
+            uint32_t &slot = table[HashSequence(sequence)];
+            size_t ref = slot;
+            slot = pos;
+
+            if (ref >= pos || pos - ref > MAX_DISTANCE ||
+                ReadLE32(base + ref) != sequence) {
+                // Skip faster over data that doesn't compress.
+                pos += 1 + ((pos - anchor) >> 6);
+                continue;
+            }
+
+            // Extend the match backward, then forward.
+            while (pos > anchor && ref > 0 && base[pos - 1] == base[ref - 1]) {
+                pos--;
+                ref--;
+            }
+            size_t match_length = MIN_MATCH;
+            while (pos + match_length < match_limit &&
+                   base[pos + match_length] == base[ref + match_length]) {
+                match_length++;
+            }
+
+            WriteSequence(out, base + anchor, pos - anchor, pos - ref,
+                          match_length);
+            pos += match_length;
+            anchor = pos;
+
+            if (pos < input_limit) {
+                table[HashSequence(ReadLE32(base + pos - 2))] = pos - 2;
+            }
+        }
+    }
+
+    WriteSequence(out, base + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool LZDecompress(Span<const uint8_t> data, size_t raw_size,
+                  std::vector<uint8_t> &out) {
+    out.resize(raw_size);
+    uint8_t *const dst = out.data();
+
+    size_t pos = 0;
+    size_t written = 0;
+    while (true) {
+        if (pos >= data.size()) {
+            return false;
+        }
+        const uint8_t token = data[pos++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == RUN_MASK &&
+            !ReadExtendedLength(data, pos, raw_size, literal_length)) {
+            return false;
+        }
+        if (literal_length > data.size() - pos ||
+            literal_length > raw_size - written) {
+            return false;
+        }
+        std::memcpy(dst + written, data.data() + pos, literal_length);
+        pos += literal_length;
+        written += literal_length;
+
+        // The last sequence has no match.
+        if (pos == data.size()) {
+            break;
+        }
+
+        if (data.size() - pos < 2) {
+            return false;
+        }
+        const size_t offset = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        if (offset == 0 || offset > written) {
+            return false;
+        }
+
+        size_t match_length = token & RUN_MASK;
+        if (match_length == RUN_MASK &&
+            !ReadExtendedLength(data, pos, raw_size, match_length)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (match_length > raw_size - written) {
+            return false;
+        }
+
+        const uint8_t *src = dst + written - offset;
+        if (offset >= match_length) {
+            std::memcpy(dst + written, src, match_length);
+        } else {
+            // Overlapping copy, which repeats the last offset bytes.
+            for (size_t i = 0; i < match_length; i++) {
+                dst[written + i] = src[i];
+            }
+        }
+        written += match_length;
+    }
+
+    return written == raw_size;
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2021 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_LZCODEC_H
+#define BITCOIN_UTIL_LZCODEC_H
+
+#include <span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A small, dependency free LZ77 codec producing the LZ4 block format. It
+ * favors speed over compression ratio and is meant for bulk data such as block
+ * and undo records, where decompression throughput matters most.
+ */
+
+/** Upper bound of the compressed size for an input of the given size. */
+constexpr size_t LZCompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+/** Compress data and return the compressed bytes. */
+std::vector<uint8_t> LZCompress(Span<const uint8_t> data);
+
+/**
+ * Decompress data which is expected to expand to exactly raw_size bytes.
+ * Returns false if the input is malformed, in which case the content of out is
+ * unspecified.
+ */
+bool LZDecompress(Span<const uint8_t> data, size_t raw_size,
+                  std::vector<uint8_t> &out);
+
+#endif // BITCOIN_UTIL_LZCODEC_H
@@ -747,6 +747,11 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef &ptx,
         return false;
     }
 
+    if (g_avalanche &&
+        gArgs.GetBoolArg("-enableavalanche", AVALANCHE_DEFAULT_ENABLED)) {
+        g_avalanche->addTxToReconcile(*m_pool.mapTx.find(ptx->GetId()));
+    }
+
     GetMainSignals().TransactionAddedToMempool(ptx);
     return true;
 }
@@ -796,6 +801,80 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                                       bypass_limits, nAbsurdFee, test_accept);
 }
 
+bool PreVerifyTransactionScripts(const Config &config, const CTxMemPool &pool,
+                                 const CTransaction &tx) {
+    TxValidationState state;
+    if (!CheckRegularTransaction(tx, state)) {
+        return false;
+    }
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    uint32_t flags;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewCache &coins_tip = ::ChainstateActive().CoinsTip();
+        for (const CTxIn &txin : tx.vin) {
+            const COutPoint &prevout = txin.prevout;
+            if (pool.isSpent(prevout)) {
+                return false;
+            }
+
+            Coin coin;
+            const CTransactionRef txFrom = pool.get(prevout.GetTxId());
+            if (txFrom) {
+                if (prevout.GetN() >= txFrom->vout.size()) {
+                    return false;
+                }
+                coin = Coin(txFrom->vout[prevout.GetN()], MEMPOOL_HEIGHT,
+                            false);
+            } else if (coins_tip.HaveCoinInCache(prevout)) {
+                coin = coins_tip.AccessCoin(prevout);
+            } else if (!::ChainstateActive().CoinsDB().GetCoin(prevout,
+                                                               coin)) {
+                // Don't pull the coin into the tip cache, as
+                // AcceptToMemoryPool would not know to uncache it.
+                return false;
+            }
+
+            if (coin.IsSpent()) {
+                return false;
+            }
+            view.AddCoin(prevout, std::move(coin), false);
+        }
+
+        flags = GetNextBlockScriptFlags(
+            config.GetChainParams().GetConsensus(), ::ChainActive().Tip());
+    }
+
+    // Run the scripts with the flags used by both PreChecks and
+    // ConsensusScriptChecks. The second run mostly hits the signature cache.
+    const PrecomputedTransactionData txdata =
+        PrecomputedTransactionData::FromCoinsView(tx, view);
+    std::vector<std::pair<ScriptCacheKey, int>> results;
+    for (const uint32_t scriptFlags :
+         {flags | STANDARD_SCRIPT_VERIFY_FLAGS, flags}) {
+        TxSigCheckLimiter txLimitSigChecks;
+        int nSigChecks = 0;
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            CScriptCheck check(view.AccessCoin(tx.vin[i].prevout).GetTxOut(),
+                               tx, i, scriptFlags, true, txdata,
+                               &txLimitSigChecks, nullptr);
+            if (!check()) {
+                return false;
+            }
+            nSigChecks += check.GetScriptExecutionMetrics().nSigChecks;
+        }
+        results.emplace_back(ScriptCacheKey(tx, scriptFlags), nSigChecks);
+    }
+
+    LOCK(cs_main);
+    for (const auto &result : results) {
+        AddKeyInScriptCache(result.first, result.second);
+    }
+    return true;
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is
  * placed in hashBlock. If blockIndex is provided, the transaction is fetched
@@ -837,7 +916,8 @@ bool GetTransaction(const TxId &txid, CTransactionRef &txOut,
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
+static bool WriteBlockToDisk(const std::vector<uint8_t> &data, uint32_t nSize,
+                             FlatFilePos &pos,
                              const CMessageHeader::MessageMagic &messageStart) {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -846,7 +926,6 @@ static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
     fileout << messageStart << nSize;
 
     // Write block
@@ -856,7 +935,7 @@ static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
     }
 
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write(reinterpret_cast<const char *>(data.data()), data.size());
 
     return true;
 }
@@ -1311,8 +1390,8 @@ bool CheckInputScripts(const CTransaction &tx, TxValidationState &state,
     return true;
 }
 
-static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
-                            const BlockHash &hashBlock,
+static bool UndoWriteToDisk(const std::vector<uint8_t> &data, uint32_t nSize,
+                            const uint256 &hashChecksum, FlatFilePos &pos,
                             const CMessageHeader::MessageMagic &messageStart) {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1321,7 +1400,6 @@ static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
     fileout << messageStart << nSize;
 
     // Write undo data
@@ -1330,13 +1408,10 @@ static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
         return error("%s: ftell failed", __func__);
     }
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout.write(reinterpret_cast<const char *>(data.data()), data.size());
 
-    // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
-    hasher << hashBlock;
-    hasher << blockundo;
-    fileout << hasher.GetHash();
+    // write checksum
+    fileout << hashChecksum;
 
     return true;
 }
@@ -1348,25 +1423,40 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     }
 
     // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    uint32_t nSize;
+    CAutoFile filein(OpenDiskRecord(UndoFileSeq(), pos, nSize), SER_DISK,
+                     CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("%s: OpenUndoFile failed", __func__);
     }
 
     // Read block
     uint256 hashChecksum;
-    // We need a CHashVerifier as reserializing may lose data
-    CHashVerifier<CAutoFile> verifier(&filein);
+    uint256 hashData;
     try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
+        // We need a CHashVerifier as reserializing may lose data
+        if (nSize & DISK_RECORD_COMPRESSED_FLAG) {
+            CDataStream stream(SER_DISK, CLIENT_VERSION);
+            if (!ReadCompressedDiskRecord(filein, nSize, stream)) {
+                return error("%s: Corrupted compressed undo data", __func__);
+            }
+            CHashVerifier<CDataStream> verifier(&stream);
+            verifier << pindex->pprev->GetBlockHash();
+            verifier >> blockundo;
+            hashData = verifier.GetHash();
+        } else {
+            CHashVerifier<CAutoFile> verifier(&filein);
+            verifier << pindex->pprev->GetBlockHash();
+            verifier >> blockundo;
+            hashData = verifier.GetHash();
+        }
         filein >> hashChecksum;
     } catch (const std::exception &e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash()) {
+    if (hashChecksum != hashData) {
         return error("%s: Checksum mismatch", __func__);
     }
 
@@ -1542,12 +1632,21 @@ static bool WriteUndoDataForBlock(const CBlockUndo &blockundo,
                                   const CChainParams &chainparams) {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        std::vector<uint8_t> data;
+        CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << blockundo;
+
+        // calculate checksum
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << pindex->pprev->GetBlockHash();
+        hasher.write(reinterpret_cast<const char *>(data.data()), data.size());
+        const uint256 hashChecksum = hasher.GetHash();
+
+        const uint32_t nSize = EncodeDiskRecord(data, fBlockCompression);
         FlatFilePos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos,
-                         ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40)) {
+        if (!FindUndoPos(state, pindex->nFile, _pos, data.size() + 40)) {
             return error("ConnectBlock(): FindUndoPos failed");
         }
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(),
+        if (!UndoWriteToDisk(data, nSize, hashChecksum, _pos,
                              chainparams.DiskMagic())) {
             return AbortNode(state, "Failed to write undo data");
         }
@@ -4149,18 +4248,29 @@ bool ChainstateManager::ProcessNewBlockHeaders(
 static FlatFilePos SaveBlockToDisk(const CBlock &block, int nHeight,
                                    const CChainParams &chainparams,
                                    const FlatFilePos *dbp) {
-    unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    std::vector<uint8_t> data;
+    uint32_t nSize;
     FlatFilePos blockPos;
     if (dbp != nullptr) {
         blockPos = *dbp;
+        // The block may have been stored compressed, use its size on disk.
+        CAutoFile file(OpenDiskRecord(BlockFileSeq(), blockPos, nSize),
+                       SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            nSize = ::GetSerializeSize(block, CLIENT_VERSION);
+        }
+    } else {
+        CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << block;
+        nSize = EncodeDiskRecord(data, fBlockCompression);
     }
-    if (!FindBlockPos(blockPos, nBlockSize + 8, nHeight, block.GetBlockTime(),
+    const unsigned int nDiskSize = nSize & ~DISK_RECORD_COMPRESSED_FLAG;
+    if (!FindBlockPos(blockPos, nDiskSize + 8, nHeight, block.GetBlockTime(),
                       dbp != nullptr)) {
         error("%s: FindBlockPos failed", __func__);
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.DiskMagic())) {
+        if (!WriteBlockToDisk(data, nSize, blockPos, chainparams.DiskMagic())) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -5243,7 +5353,7 @@ void LoadExternalBlockFile(const Config &config, FILE *fileIn,
 
                 // Read size.
                 blkdat >> nSize;
-                if (nSize < 160) {
+                if (!(nSize & DISK_RECORD_COMPRESSED_FLAG) && nSize < 160) {
                     continue;
                 }
             } catch (const std::exception &) {
@@ -5257,11 +5367,24 @@ void LoadExternalBlockFile(const Config &config, FILE *fileIn,
                 if (dbp) {
                     dbp->nPos = nBlockPos;
                 }
-                blkdat.SetLimit(nBlockPos + nSize);
+                const unsigned int nDiskSize =
+                    nSize & ~DISK_RECORD_COMPRESSED_FLAG;
+                blkdat.SetLimit(nBlockPos + nDiskSize);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock &block = *pblock;
-                blkdat >> block;
+                if (nSize & DISK_RECORD_COMPRESSED_FLAG) {
+                    std::vector<uint8_t> frame(nDiskSize);
+                    blkdat.read(reinterpret_cast<char *>(frame.data()),
+                                frame.size());
+                    CDataStream stream(SER_DISK, CLIENT_VERSION);
+                    if (!DecodeDiskRecord(frame, stream)) {
+                        continue;
+                    }
+                    stream >> block;
+                } else {
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 const BlockHash hash = block.GetHash();
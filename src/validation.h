@@ -291,6 +291,19 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                         bool test_accept = false)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Verify the input scripts of a transaction ahead of AcceptToMemoryPool,
+ * against a copy of the coins it spends, so that the scripts run without
+ * holding cs_main. On success, the results are stored in the script cache and
+ * AcceptToMemoryPool doesn't need to run the scripts again. Failures are left
+ * for AcceptToMemoryPool to report.
+ *
+ * @return Whether the script results were cached
+ */
+bool PreVerifyTransactionScripts(const Config &config, const CTxMemPool &pool,
+                                 const CTransaction &tx)
+    LOCKS_EXCLUDED(cs_main);
+
 /**
  * Simple class for regulating resource usage during CheckInputScripts (and
  * CScriptCheck), atomic so as to be compatible with parallel validation.
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""
+Test graphene block relay (-graphene).
+"""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCHREG_UNSPENDABLE
+from test_framework.blocktools import SUBSIDY
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+    wait_until,
+)
+
+
+class GrapheneTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-graphene"], ["-graphene"]]
+
+    def send_tx(self, node, block_height):
+        """Spend the coinbase of a block to the node, return the txid."""
+        # The blocks of the cached chain are mined by each node in turn, 25
+        # at a time.
+        miner = self.nodes[(block_height - 1) // 25]
+        coinbase = node.getblock(node.getblockhash(block_height))['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{"txid": coinbase, "vout": 1}],
+            outputs={ADDRESS_BCHREG_UNSPENDABLE: SUBSIDY - Decimal('0.025')},
+        )
+        rawtx = node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[miner.get_deterministic_priv_key().key],
+        )['hex']
+        return node.sendrawtransaction(rawtx)
+
+    def msg_bytes(self, direction):
+        """The bytes per message type node 1 exchanged with node 0."""
+        return self.nodes[1].getpeerinfo()[0]["bytes{}_per_msg".format(
+            direction)]
+
+    def reconnect(self):
+        connect_nodes(self.nodes[1], self.nodes[0])
+        wait_until(lambda: all(len(node.getpeerinfo()) == 1
+                               for node in self.nodes))
+
+    def run_test(self):
+        for node in self.nodes:
+            info = node.getpeerinfo()[0]
+            assert "GRAPHENE" in info["servicesnames"]
+
+        self.log.info(
+            "A block with transactions the peer has is relayed as a graphene "
+            "block")
+        for height in range(1, 11):
+            self.send_tx(self.nodes[0], height)
+        self.sync_mempools()
+        blockhash = self.nodes[0].generate(1)[0]
+        self.sync_blocks()
+        assert_equal(len(self.nodes[1].getblock(blockhash)["tx"]), 11)
+        assert "grblk" in self.msg_bytes("recv")
+        assert "getgrblktx" not in self.msg_bytes("sent")
+        assert "getblocktxn" not in self.msg_bytes("sent")
+
+        self.log.info(
+            "Transactions the peer misses are requested with getgrblktx")
+        disconnect_nodes(self.nodes[1], self.nodes[0])
+        txids = [self.send_tx(self.nodes[0], 11)]
+        blockhash = self.nodes[0].generate(1)[0]
+        assert_equal(self.nodes[0].getblock(blockhash)["tx"][1:], txids)
+        self.reconnect()
+        self.sync_blocks()
+        assert "grblk" in self.msg_bytes("recv")
+        assert "getgrblktx" in self.msg_bytes("sent")
+        assert "blocktxn" in self.msg_bytes("recv")
+        assert "getblocktxn" not in self.msg_bytes("sent")
+
+        self.log.info(
+            "If too many transactions are missing, the peer falls back to "
+            "compact blocks")
+        disconnect_nodes(self.nodes[1], self.nodes[0])
+        for height in range(12, 51):
+            self.send_tx(self.nodes[0], height)
+        blockhash = self.nodes[0].generate(1)[0]
+        assert_equal(len(self.nodes[0].getblock(blockhash)["tx"]), 40)
+        self.reconnect()
+        self.sync_blocks()
+        assert "cmpctblock" in self.msg_bytes("recv")
+        assert "getblocktxn" in self.msg_bytes("sent")
+
+
+if __name__ == '__main__':
+    GrapheneTest().main()
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""
+Test transaction relay by set reconciliation (-txreconciliation).
+"""
+
+from decimal import Decimal
+import hashlib
+import random
+import struct
+
+from test_framework.address import ADDRESS_BCHREG_UNSPENDABLE
+from test_framework.blocktools import SUBSIDY
+from test_framework.messages import (
+    CInv,
+    CTransaction,
+    FromHex,
+    MSG_TX,
+    NODE_NETWORK,
+    NODE_TXRECON,
+    msg_inv,
+    msg_reconcildiff,
+    msg_reqrecon,
+    msg_sendrecon,
+)
+from test_framework.mininode import P2PInterface, mininode_lock
+from test_framework.siphash import siphash256
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+# Constants from txreconciliation.h
+TXRECONCILIATION_VERSION = 1
+RECON_Q = (1 << 14) // 4
+INV_ENTRY_SIZE = 36
+MESSAGE_HEADER_SIZE = 24
+
+
+def gf_mul(a, b):
+    """Multiply in GF(2^32), modulo x^32 + x^7 + x^3 + x^2 + 1."""
+    r = 0
+    while b:
+        if b & 1:
+            r ^= a
+        b >>= 1
+        a <<= 1
+        if a >> 32:
+            a ^= 0x10000008d
+    return r
+
+
+def sketch_data(elements, capacity):
+    """The serialized sketch of a set of short ids."""
+    sums = [0] * capacity
+    for x in elements:
+        square = gf_mul(x, x)
+        power = x
+        for i in range(capacity):
+            sums[i] ^= power
+            power = gf_mul(power, square)
+    return b"".join(struct.pack("<I", s) for s in sums)
+
+
+class ReconcilingPeer(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.salt = random.getrandbits(64)
+        self.node_salt = None
+
+    def on_sendrecon(self, message):
+        self.node_salt = message.salt
+        self.send_message(msg_sendrecon(TXRECONCILIATION_VERSION, self.salt))
+
+    def short_id(self, txid):
+        salts = sorted([self.salt, self.node_salt])
+        key = hashlib.sha256(struct.pack("<QQ", *salts)).digest()
+        k0 = struct.unpack("<Q", key[0:8])[0]
+        k1 = struct.unpack("<Q", key[8:16])[0]
+        return 1 + siphash256(k0, k1, txid) % 0xffffffff
+
+    def reconcile(self, set_size, success, ask_txids):
+        """Request a sketch, then answer it. Return the sketch data."""
+        with mininode_lock:
+            self.last_message.pop("sketch", None)
+        self.send_message(msg_reqrecon(set_size, RECON_Q))
+        self.wait_until(lambda: "sketch" in self.last_message)
+        with mininode_lock:
+            skdata = self.last_message["sketch"].skdata
+        self.send_message(msg_reconcildiff(
+            success, [self.short_id(txid) for txid in ask_txids]))
+        return skdata
+
+
+class TxReconciliationTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-txreconciliation"], ["-txreconciliation"]]
+
+    def create_tx(self, block_height):
+        node = self.nodes[0]
+        coinbase = node.getblock(node.getblockhash(block_height))['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{"txid": coinbase, "vout": 1}],
+            outputs={ADDRESS_BCHREG_UNSPENDABLE: SUBSIDY - Decimal('0.025')},
+        )
+        rawtx = node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[node.get_deterministic_priv_key().key],
+        )['hex']
+        tx = FromHex(CTransaction(), rawtx)
+        tx.rehash()
+        return tx
+
+    def peer_info(self, node, peer):
+        return next(p for p in node.getpeerinfo() if p["id"] == peer)
+
+    def run_test(self):
+        self.test_between_nodes()
+        self.test_responder()
+
+    def test_between_nodes(self):
+        self.log.info("Check the nodes reconcile with each other")
+        # Node 1 made the outbound connection to node 0.
+        for node in self.nodes:
+            wait_until(lambda: node.getpeerinfo()[0]["txreconciliation"])
+            info = node.getpeerinfo()[0]
+            assert "TXRECON" in info["servicesnames"]
+
+        self.log.info(
+            "Transactions are flooded to node 0, an outbound peer of node 1")
+        tx = self.create_tx(1)
+        self.nodes[1].sendrawtransaction(tx.serialize().hex())
+        wait_until(lambda: tx.txid_hex in self.nodes[0].getrawmempool())
+
+        self.log.info(
+            "Transactions are reconciled with node 1, an inbound peer of "
+            "node 0")
+        tx = self.create_tx(2)
+        self.nodes[0].sendrawtransaction(tx.serialize().hex())
+        wait_until(lambda: tx.txid_hex in self.nodes[1].getrawmempool(),
+                   timeout=60)
+        info = self.nodes[0].getpeerinfo()[0]
+        assert "sketch" in info["bytessent_per_msg"]
+        info = self.nodes[1].getpeerinfo()[0]
+        assert "reqrecon" in info["bytessent_per_msg"]
+        assert "reconcildiff" in info["bytessent_per_msg"]
+
+    def test_responder(self):
+        node = self.nodes[0]
+        self.log.info("Check a reconciling peer is registered")
+        peer = node.add_p2p_connection(
+            ReconcilingPeer(), services=NODE_NETWORK | NODE_TXRECON)
+        peer.wait_until(lambda: peer.node_salt is not None)
+        peer.sync_with_ping()
+        peer_id = node.getpeerinfo()[-1]["id"]
+        info = self.peer_info(node, peer_id)
+        assert info["txreconciliation"]
+        saved = info["txrecon_bytes_saved"]
+
+        def add_to_set(tx):
+            """Submit a transaction and wait until it is in the set."""
+            node.sendrawtransaction(tx.serialize().hex())
+            wait_until(lambda: self.peer_info(node, peer_id)[
+                "txrecon_bytes_saved"] == saved + INV_ENTRY_SIZE)
+            return saved + INV_ENTRY_SIZE
+
+        def sketch_size(capacity):
+            return MESSAGE_HEADER_SIZE + 1 + 4 * capacity
+
+        inv_size = MESSAGE_HEADER_SIZE + 1 + INV_ENTRY_SIZE
+
+        self.log.info(
+            "A transaction the peer misses is announced when it asks for it")
+        tx = self.create_tx(3)
+        saved = add_to_set(tx)
+        with mininode_lock:
+            peer.last_message.pop("inv", None)
+        skdata = peer.reconcile(0, True, [tx.txid])
+        # The set sizes differ by 1, so the sketch has a capacity of 2.
+        assert_equal(skdata, sketch_data([peer.short_id(tx.txid)], 2))
+        peer.wait_until(lambda: "inv" in peer.last_message)
+        with mininode_lock:
+            assert_equal(peer.last_message["inv"].inv,
+                         [CInv(MSG_TX, tx.txid)])
+        peer.sync_with_ping()
+        saved -= sketch_size(2) + inv_size
+        assert_equal(self.peer_info(node, peer_id)["txrecon_bytes_saved"],
+                     saved)
+
+        self.log.info("A transaction the peer has is not announced")
+        tx = self.create_tx(4)
+        saved = add_to_set(tx)
+        with mininode_lock:
+            peer.last_message.pop("inv", None)
+        skdata = peer.reconcile(1, True, [])
+        assert_equal(skdata, sketch_data([peer.short_id(tx.txid)], 2))
+        peer.sync_with_ping()
+        with mininode_lock:
+            assert "inv" not in peer.last_message
+        saved -= sketch_size(2)
+        assert_equal(self.peer_info(node, peer_id)["txrecon_bytes_saved"],
+                     saved)
+
+        self.log.info("The whole set is announced if the decoding failed")
+        tx = self.create_tx(5)
+        saved = add_to_set(tx)
+        peer.send_message(msg_inv([CInv(MSG_TX, tx.txid)]))
+        tx2 = self.create_tx(6)
+        node.sendrawtransaction(tx2.serialize().hex())
+        wait_until(lambda: self.peer_info(node, peer_id)[
+            "txrecon_bytes_saved"] == saved + INV_ENTRY_SIZE)
+        saved += INV_ENTRY_SIZE
+        with mininode_lock:
+            peer.last_message.pop("inv", None)
+        peer.reconcile(0, False, [])
+        peer.wait_until(lambda: "inv" in peer.last_message)
+        # The transaction the peer announced is left out.
+        with mininode_lock:
+            assert_equal(peer.last_message["inv"].inv,
+                         [CInv(MSG_TX, tx2.txid)])
+
+        self.log.info("Peers without the service bit are not registered")
+        peer = node.add_p2p_connection(P2PInterface())
+        peer.sync_with_ping()
+        assert not node.getpeerinfo()[-1]["txreconciliation"]
+
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
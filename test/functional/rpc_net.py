@@ -177,6 +177,10 @@ class NetTest(BitcoinTestFramework):
         assert_equal(peer_info[1][0]['addrbind'], peer_info[0][0]['addr'])
         assert_equal(peer_info[0][0]['minfeefilter'], Decimal('0.000500'))
         assert_equal(peer_info[1][0]['minfeefilter'], Decimal('0.001000'))
+        # both peers relay transactions, and have seen at most a few of them
+        for info in peer_info:
+            assert_greater_than(info[0]['txrelayusage'], 0)
+            assert_greater_than(10000, info[0]['txrelayusage'])
         # check the `servicesnames` field
         for info in peer_info:
             assert_net_servicesnames(int(info[0]["services"], 0x10),
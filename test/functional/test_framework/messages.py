@@ -60,6 +60,8 @@ NODE_BLOOM = (1 << 2)
 NODE_COMPACT_FILTERS = (1 << 6)
 NODE_NETWORK_LIMITED = (1 << 10)
 NODE_AVALANCHE = (1 << 24)
+NODE_TXRECON = (1 << 25)
+NODE_GRAPHENE = (1 << 26)
 
 MSG_TX = 1
 MSG_BLOCK = 2
@@ -1800,6 +1802,95 @@ class msg_feefilter:
         return "msg_feefilter(feerate={:08x})".format(self.feerate)
 
 
+class msg_sendrecon:
+    __slots__ = ("version", "salt")
+    msgtype = b"sendrecon"
+
+    def __init__(self, version=1, salt=0):
+        self.version = version
+        self.salt = salt
+
+    def deserialize(self, f):
+        self.version = struct.unpack("<I", f.read(4))[0]
+        self.salt = struct.unpack("<Q", f.read(8))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<I", self.version)
+        r += struct.pack("<Q", self.salt)
+        return r
+
+    def __repr__(self):
+        return "msg_sendrecon(version={}, salt={:016x})".format(
+            self.version, self.salt)
+
+
+class msg_reqrecon:
+    __slots__ = ("set_size", "q")
+    msgtype = b"reqrecon"
+
+    def __init__(self, set_size=0, q=0):
+        self.set_size = set_size
+        self.q = q
+
+    def deserialize(self, f):
+        self.set_size = struct.unpack("<I", f.read(4))[0]
+        self.q = struct.unpack("<H", f.read(2))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<I", self.set_size)
+        r += struct.pack("<H", self.q)
+        return r
+
+    def __repr__(self):
+        return "msg_reqrecon(set_size={}, q={})".format(
+            self.set_size, self.q)
+
+
+class msg_sketch:
+    __slots__ = ("skdata",)
+    msgtype = b"sketch"
+
+    def __init__(self, skdata=b""):
+        self.skdata = skdata
+
+    def deserialize(self, f):
+        self.skdata = deser_string(f)
+
+    def serialize(self):
+        return ser_string(self.skdata)
+
+    def __repr__(self):
+        return "msg_sketch(skdata={})".format(self.skdata.hex())
+
+
+class msg_reconcildiff:
+    __slots__ = ("success", "ask_shortids")
+    msgtype = b"reconcildiff"
+
+    def __init__(self, success=True, ask_shortids=None):
+        self.success = success
+        self.ask_shortids = ask_shortids if ask_shortids is not None else []
+
+    def deserialize(self, f):
+        self.success = struct.unpack("<?", f.read(1))[0]
+        self.ask_shortids = [struct.unpack("<I", f.read(4))[0]
+                             for _ in range(deser_compact_size(f))]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<?", self.success)
+        r += ser_compact_size(len(self.ask_shortids))
+        for short_id in self.ask_shortids:
+            r += struct.pack("<I", short_id)
+        return r
+
+    def __repr__(self):
+        return "msg_reconcildiff(success={}, ask_shortids={})".format(
+            self.success, self.ask_shortids)
+
+
 class msg_sendcmpct:
     __slots__ = ("announce", "version")
     msgtype = b"sendcmpct"